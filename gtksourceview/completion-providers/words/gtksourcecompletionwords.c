@@ -27,6 +27,10 @@
  * The #GtkSourceCompletionWords is an example of an implementation of
  * the #GtkSourceCompletionProvider interface. The proposals are words
  * appearing in the registered #GtkTextBuffer<!-- -->s.
+ *
+ * The proposals can also come from a words index file, for example with the
+ * words of all the files of a project, see
+ * gtk_source_completion_words_set_index_file().
  */
 
 #ifdef HAVE_CONFIG_H
@@ -44,6 +48,9 @@
 
 #define BUFFER_KEY "GtkSourceCompletionWordsBufferKey"
 
+/* The maximum time spent to find the fuzzy matches, in microseconds. */
+#define FUZZY_MATCHING_TIME_BUDGET 3000
+
 enum
 {
 	PROP_0,
@@ -55,6 +62,7 @@ enum
 	PROP_INTERACTIVE_DELAY,
 	PROP_PRIORITY,
 	PROP_ACTIVATION,
+	PROP_FUZZY_MATCHING,
 	N_PROPERTIES
 };
 
@@ -68,7 +76,9 @@ struct _GtkSourceCompletionWordsPrivate
 	guint idle_id;
 
 	GtkSourceCompletionContext *context;
-	GSequenceIter *populate_iter;
+
+	/* The last word added to the context, to continue the population. */
+	gchar *populate_last_word;
 
 	guint cancel_id;
 
@@ -82,6 +92,8 @@ struct _GtkSourceCompletionWordsPrivate
 	gint interactive_delay;
 	gint priority;
 	GtkSourceCompletionActivation activation;
+
+	guint fuzzy_matching : 1;
 };
 
 typedef struct
@@ -125,6 +137,9 @@ population_finished (GtkSourceCompletionWords *words)
 	g_free (words->priv->word);
 	words->priv->word = NULL;
 
+	g_free (words->priv->populate_last_word);
+	words->priv->populate_last_word = NULL;
+
 	if (words->priv->context != NULL)
 	{
 		if (words->priv->cancel_id)
@@ -142,39 +157,52 @@ static gboolean
 add_in_idle (GtkSourceCompletionWords *words)
 {
 	guint idx = 0;
+	GList *proposals;
+	GList *item;
 	GList *ret = NULL;
 	gboolean finished;
 
-	if (words->priv->populate_iter == NULL)
+	if (words->priv->fuzzy_matching)
 	{
-		words->priv->populate_iter =
-			gtk_source_completion_words_library_find_first (words->priv->library,
-			                                                words->priv->word,
-			                                                words->priv->word_len);
+		/* The best matches, in one batch. */
+		proposals = gtk_source_completion_words_library_get_fuzzy_proposals (words->priv->library,
+		                                                                    words->priv->word,
+		                                                                    words->priv->proposals_batch_size,
+		                                                                    FUZZY_MATCHING_TIME_BUDGET);
+	}
+	else
+	{
+		proposals = gtk_source_completion_words_library_get_proposals (words->priv->library,
+		                                                              words->priv->word,
+		                                                              words->priv->word_len,
+		                                                              words->priv->populate_last_word,
+		                                                              words->priv->proposals_batch_size);
 	}
 
-	while (idx < words->priv->proposals_batch_size &&
-	       words->priv->populate_iter)
+	for (item = proposals; item != NULL; item = g_list_next (item))
 	{
-		GtkSourceCompletionWordsProposal *proposal =
-				gtk_source_completion_words_library_get_proposal (words->priv->populate_iter);
+		GtkSourceCompletionWordsProposal *proposal = item->data;
+		const gchar *proposal_word = gtk_source_completion_words_proposal_get_word (proposal);
 
 		/* Only add non-exact matches */
-		if (strcmp (gtk_source_completion_words_proposal_get_word (proposal),
-		            words->priv->word) != 0)
+		if (strcmp (proposal_word, words->priv->word) != 0)
 		{
 			ret = g_list_prepend (ret, proposal);
 		}
 
-		words->priv->populate_iter =
-				gtk_source_completion_words_library_find_next (words->priv->populate_iter,
-		                                                               words->priv->word,
-		                                                               words->priv->word_len);
+		if (item->next == NULL)
+		{
+			g_free (words->priv->populate_last_word);
+			words->priv->populate_last_word = g_strdup (proposal_word);
+		}
+
 		++idx;
 	}
 
+	g_list_free (proposals);
+
 	ret = g_list_reverse (ret);
-	finished = words->priv->populate_iter == NULL;
+	finished = words->priv->fuzzy_matching || idx < words->priv->proposals_batch_size;
 
 	gtk_source_completion_context_add_proposals (words->priv->context,
 	                                             GTK_SOURCE_COMPLETION_PROVIDER (words),
@@ -230,6 +258,9 @@ gtk_source_completion_words_populate (GtkSourceCompletionProvider *provider,
 	g_free (words->priv->word);
 	words->priv->word = NULL;
 
+	g_free (words->priv->populate_last_word);
+	words->priv->populate_last_word = NULL;
+
 	word = get_word_at_iter (&iter);
 
 	activation = gtk_source_completion_context_get_activation (context);
@@ -364,6 +395,10 @@ gtk_source_completion_words_set_property (GObject      *object,
 			self->priv->activation = g_value_get_flags (value);
 			break;
 
+		case PROP_FUZZY_MATCHING:
+			self->priv->fuzzy_matching = g_value_get_boolean (value);
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -412,6 +447,10 @@ gtk_source_completion_words_get_property (GObject    *object,
 			g_value_set_flags (value, self->priv->activation);
 			break;
 
+		case PROP_FUZZY_MATCHING:
+			g_value_set_boolean (value, self->priv->fuzzy_matching);
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -502,6 +541,26 @@ gtk_source_completion_words_class_init (GtkSourceCompletionWordsClass *klass)
 				    GTK_SOURCE_COMPLETION_ACTIVATION_USER_REQUESTED,
 				    G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * GtkSourceCompletionWords:fuzzy-matching:
+	 *
+	 * Whether the proposals are the words containing the characters of the
+	 * current word in the same order, e.g. "gbuf" for "get_buffer" or
+	 * "getBuffer", instead of the words beginning with the current word.
+	 * The best matches come first, especially the matches at the start of
+	 * the words and after "_" or a lowercase letter. Only the
+	 * #GtkSourceCompletionWords:proposals-batch-size best proposals are
+	 * shown.
+	 *
+	 * Since: 4.2
+	 */
+	properties[PROP_FUZZY_MATCHING] =
+		g_param_spec_boolean ("fuzzy-matching",
+				      "Fuzzy Matching",
+				      "Whether to match the words by subsequence",
+				      FALSE,
+				      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -655,3 +714,49 @@ gtk_source_completion_words_unregister (GtkSourceCompletionWords *words,
 
 	g_object_set_data (G_OBJECT (buffer), BUFFER_KEY, NULL);
 }
+
+/**
+ * gtk_source_completion_words_set_index_file:
+ * @words: a #GtkSourceCompletionWords
+ * @filename: (type filename) (nullable): the words index file, or %NULL.
+ * @error: location to a #GError, or %NULL.
+ *
+ * Attaches a words index file to the @words provider. Its words are proposed
+ * along with the words of the registered buffers, without the need to load the
+ * files in buffers. The file is mapped in memory, read-only, so it is shared by
+ * all the processes using it.
+ *
+ * A words index file is created with the gtksourceview-words-index tool. The
+ * file must be replaced atomically to be updated, for example by writing a
+ * temporary file and renaming it; the index of @words is updated when this
+ * function is called again.
+ *
+ * If @filename is %NULL, the current index is detached. On error, the current
+ * index is kept.
+ *
+ * Returns: whether the index file has been attached successfully.
+ * Since: 4.2
+ */
+gboolean
+gtk_source_completion_words_set_index_file (GtkSourceCompletionWords  *words,
+					    const gchar               *filename,
+					    GError                   **error)
+{
+	GtkSourceCompletionWordsIndex *index = NULL;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS (words), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (filename != NULL)
+	{
+		index = gtk_source_completion_words_index_new (filename, error);
+
+		if (index == NULL)
+		{
+			return FALSE;
+		}
+	}
+
+	gtk_source_completion_words_library_set_index (words->priv->library, index);
+	return TRUE;
+}
@@ -67,6 +67,11 @@ GTK_SOURCE_AVAILABLE_IN_ALL
 void 		gtk_source_completion_words_unregister 	(GtkSourceCompletionWords *words,
                                                          GtkTextBuffer            *buffer);
 
+GTK_SOURCE_AVAILABLE_IN_4_2
+gboolean	gtk_source_completion_words_set_index_file (GtkSourceCompletionWords  *words,
+							 const gchar               *filename,
+							 GError                   **error);
+
 G_END_DECLS
 
 #endif /* GTK_SOURCE_COMPLETION_WORDS_H */
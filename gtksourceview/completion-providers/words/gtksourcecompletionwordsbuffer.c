@@ -30,14 +30,30 @@
 /* Timeout in seconds */
 #define INITIATE_SCAN_TIMEOUT 5
 
-/* Timeout in milliseconds */
-#define BATCH_SCAN_TIMEOUT 10
+/* The maximum size in bytes of a chunk of text scanned in a worker thread. */
+#define SCAN_CHUNK_SIZE (256 * 1024)
 
+/* A chunk contains at most this number of batches of
+ * GtkSourceCompletionWords:scan-batch-size lines.
+ */
+#define SCAN_CHUNK_NB_BATCHES 100
+
+/* The maximum size in bytes of an insertion for which the words are updated
+ * directly, instead of adding the text to the scan region.
+ */
+#define EDIT_MAX_SIZE 1024
+
+/* A chunk of text scanned in a worker thread. */
 typedef struct
 {
-	GtkSourceCompletionWordsProposal *proposal;
-	guint use_count;
-} ProposalCache;
+	gchar *text;
+	guint minimum_word_size;
+
+	/* The words of @text, with their number of occurrences stored with
+	 * GUINT_TO_POINTER(). Filled in the worker thread.
+	 */
+	GHashTable *words;
+} ScanChunk;
 
 struct _GtkSourceCompletionWordsBufferPrivate
 {
@@ -48,42 +64,67 @@ struct _GtkSourceCompletionWordsBufferPrivate
 	gulong batch_scan_id;
 	gulong initiate_scan_id;
 
+	/* The location of the ScanChunk being scanned or pending. The marks
+	 * follow the edits done elsewhere in the buffer, so only an edit
+	 * touching the chunk makes it out-of-date.
+	 */
+	GtkTextMark *chunk_start;
+	GtkTextMark *chunk_end;
+	guint chunk_up_to_date : 1;
+
+	/* A ScanChunk is being scanned in a worker thread. */
+	guint scan_in_progress : 1;
+
+	/* A scanned ScanChunk, applied when the library is unlocked. */
+	ScanChunk *pending_chunk;
+
+	/* The changes of the number of occurrences of the words touched by the
+	 * text insertion or deletion being done, stored with GINT_TO_POINTER().
+	 * The words are removed in the "before" signal handler, and added back
+	 * in the "after" one, so only the differences are applied.
+	 */
+	GHashTable *edit_words;
+
+	/* The text insertion or deletion being done is added to the scan
+	 * region, instead of updating the words directly.
+	 */
+	guint edit_in_scan_region : 1;
+
 	guint scan_batch_size;
 	guint minimum_word_size;
 
+	/* The words added to the library, with their number of occurrences in
+	 * the buffer, stored in the values with GUINT_TO_POINTER().
+	 */
 	GHashTable *words;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtkSourceCompletionWordsBuffer, gtk_source_completion_words_buffer, G_TYPE_OBJECT)
 
-static ProposalCache *
-proposal_cache_new (GtkSourceCompletionWordsProposal *proposal)
-{
-	ProposalCache *cache = g_slice_new (ProposalCache);
-	cache->proposal = g_object_ref (proposal);
-	cache->use_count = 1;
-
-	return cache;
-}
+static void install_scan_chunk (GtkSourceCompletionWordsBuffer *buffer);
 
 static void
-proposal_cache_free (ProposalCache *cache)
+scan_chunk_free (ScanChunk *chunk)
 {
-	g_object_unref (cache->proposal);
-	g_slice_free (ProposalCache, cache);
+	if (chunk != NULL)
+	{
+		g_free (chunk->text);
+		g_clear_pointer (&chunk->words, g_hash_table_unref);
+		g_slice_free (ScanChunk, chunk);
+	}
 }
 
 static void
-remove_proposal_cache (const gchar                    *key,
-		       ProposalCache                  *cache,
-		       GtkSourceCompletionWordsBuffer *buffer)
+remove_word_occurrences (const gchar                    *word,
+			 gpointer                        use_count,
+			 GtkSourceCompletionWordsBuffer *buffer)
 {
 	guint i;
 
-	for (i = 0; i < cache->use_count; ++i)
+	for (i = 0; i < GPOINTER_TO_UINT (use_count); ++i)
 	{
 		gtk_source_completion_words_library_remove_word (buffer->priv->library,
-		                                                 cache->proposal);
+		                                                 word);
 	}
 }
 
@@ -91,7 +132,7 @@ static void
 remove_all_words (GtkSourceCompletionWordsBuffer *buffer)
 {
 	g_hash_table_foreach (buffer->priv->words,
-	                      (GHFunc)remove_proposal_cache,
+	                      (GHFunc)remove_word_occurrences,
 	                      buffer);
 
 	g_hash_table_remove_all (buffer->priv->words);
@@ -123,7 +164,18 @@ gtk_source_completion_words_buffer_dispose (GObject *object)
 		buffer->priv->initiate_scan_id = 0;
 	}
 
+	g_clear_pointer (&buffer->priv->pending_chunk, scan_chunk_free);
+	g_clear_pointer (&buffer->priv->edit_words, g_hash_table_unref);
 	g_clear_object (&buffer->priv->scan_region);
+
+	if (buffer->priv->buffer != NULL)
+	{
+		gtk_text_buffer_delete_mark (buffer->priv->buffer, buffer->priv->chunk_start);
+		gtk_text_buffer_delete_mark (buffer->priv->buffer, buffer->priv->chunk_end);
+		buffer->priv->chunk_start = NULL;
+		buffer->priv->chunk_end = NULL;
+	}
+
 	g_clear_object (&buffer->priv->buffer);
 	g_clear_object (&buffer->priv->library);
 
@@ -149,45 +201,37 @@ gtk_source_completion_words_buffer_init (GtkSourceCompletionWordsBuffer *self)
 	self->priv->words = g_hash_table_new_full (g_str_hash,
 	                                           g_str_equal,
 	                                           (GDestroyNotify)g_free,
-	                                           (GDestroyNotify)proposal_cache_free);
+	                                           NULL);
+
+	self->priv->edit_words = g_hash_table_new_full (g_str_hash,
+							g_str_equal,
+							(GDestroyNotify)g_free,
+							NULL);
 }
 
-/* Starts the scanning at @start, and ends at the line end or @end. So at most
- * one line is scanned, and the text after @end will never be scanned.
+/* Returns the words between @start and @end, which must be at word
+ * boundaries. The text is not split by lines: the line terminators are not
+ * word characters, and this way only the text between the two iters is
+ * traversed, even for very long lines.
  */
 static GSList *
-scan_line (GtkSourceCompletionWordsBuffer *buffer,
-	   const GtkTextIter              *start,
-	   const GtkTextIter              *end)
+scan_subregion (GtkSourceCompletionWordsBuffer *buffer,
+		const GtkTextIter              *start,
+		const GtkTextIter              *end)
 {
-	GtkTextIter line_end;
-	GtkTextIter text_end;
 	gchar *text;
 	GSList *words;
 
-	if (gtk_text_iter_compare (end, start) <= 0 ||
-	    gtk_text_iter_ends_line (start))
+	if (gtk_text_iter_compare (end, start) <= 0)
 	{
 		return NULL;
 	}
 
-	line_end = *start;
-	gtk_text_iter_forward_to_line_end (&line_end);
-
-	if (gtk_text_iter_compare (end, &line_end) < 0)
-	{
-		text_end = *end;
-	}
-	else
-	{
-		text_end = line_end;
-	}
-
-	_gtk_source_completion_words_utils_check_scan_region (start, &text_end);
+	_gtk_source_completion_words_utils_check_scan_region (start, end);
 
 	text = gtk_text_buffer_get_text (buffer->priv->buffer,
 					 start,
-					 &text_end,
+					 end,
 					 FALSE);
 
 	words = _gtk_source_completion_words_utils_scan_words (text, buffer->priv->minimum_word_size);
@@ -196,13 +240,44 @@ scan_line (GtkSourceCompletionWordsBuffer *buffer,
 	return words;
 }
 
+static void
+add_word (GtkSourceCompletionWordsBuffer *buffer,
+	  const gchar                    *word)
+{
+	gpointer key;
+	gpointer value;
+
+	if (!gtk_source_completion_words_library_add_word (buffer->priv->library,
+							   word))
+	{
+		return;
+	}
+
+	if (g_hash_table_lookup_extended (buffer->priv->words, word, &key, &value))
+	{
+		/* Keep the same key, without copying it. */
+		g_hash_table_steal (buffer->priv->words, key);
+		g_hash_table_insert (buffer->priv->words,
+				     key,
+				     GUINT_TO_POINTER (GPOINTER_TO_UINT (value) + 1));
+	}
+	else
+	{
+		g_hash_table_insert (buffer->priv->words,
+				     g_strdup (word),
+				     GUINT_TO_POINTER (1));
+	}
+}
+
 static void
 remove_word (GtkSourceCompletionWordsBuffer *buffer,
 	     const gchar                    *word)
 {
-	ProposalCache *cache = g_hash_table_lookup (buffer->priv->words, word);
+	gpointer key;
+	gpointer value;
+	guint use_count;
 
-	if (cache == NULL)
+	if (!g_hash_table_lookup_extended (buffer->priv->words, word, &key, &value))
 	{
 		g_warning ("Could not find word to remove in buffer (%s), this should not happen!",
 		           word);
@@ -210,139 +285,274 @@ remove_word (GtkSourceCompletionWordsBuffer *buffer,
 	}
 
 	gtk_source_completion_words_library_remove_word (buffer->priv->library,
-	                                                 cache->proposal);
+	                                                 word);
 
-	--cache->use_count;
+	use_count = GPOINTER_TO_UINT (value) - 1;
 
-	if (cache->use_count == 0)
+	if (use_count == 0)
 	{
 		g_hash_table_remove (buffer->priv->words, word);
 	}
+	else
+	{
+		/* Keep the same key, without copying it. */
+		g_hash_table_steal (buffer->priv->words, key);
+		g_hash_table_insert (buffer->priv->words, key, GUINT_TO_POINTER (use_count));
+	}
 }
 
+/* Adds @delta to the number of occurrences in edit_words of each word between
+ * @start and @end.
+ */
 static void
-add_words (GtkSourceCompletionWordsBuffer *buffer,
-	   GSList                         *words)
+add_edit_words (GtkSourceCompletionWordsBuffer *buffer,
+		const GtkTextIter              *start,
+		const GtkTextIter              *end,
+		gint                            delta)
 {
+	GSList *words = scan_subregion (buffer, start, end);
 	GSList *item;
 
 	for (item = words; item != NULL; item = g_slist_next (item))
 	{
-		GtkSourceCompletionWordsProposal *proposal;
-		ProposalCache *cache;
+		gint count = GPOINTER_TO_INT (g_hash_table_lookup (buffer->priv->edit_words, item->data));
+
+		/* Frees the word if it is already in the hash table. */
+		g_hash_table_insert (buffer->priv->edit_words,
+				     item->data,
+				     GINT_TO_POINTER (count + delta));
+	}
+
+	g_slist_free (words);
+}
 
-		proposal = gtk_source_completion_words_library_add_word (buffer->priv->library,
-		                                                         item->data);
+/* Applies the differences stored in edit_words. A word removed and added back
+ * by the edit is left untouched in the library.
+ */
+static void
+apply_edit_words (GtkSourceCompletionWordsBuffer *buffer)
+{
+	GHashTableIter iter;
+	gpointer word;
+	gpointer value;
 
-		cache = g_hash_table_lookup (buffer->priv->words,
-		                             item->data);
+	g_hash_table_iter_init (&iter, buffer->priv->edit_words);
 
-		if (cache != NULL)
+	while (g_hash_table_iter_next (&iter, &word, &value))
+	{
+		gint delta;
+
+		for (delta = GPOINTER_TO_INT (value); delta < 0; delta++)
 		{
-			++cache->use_count;
-			g_free (item->data);
+			remove_word (buffer, word);
 		}
-		else
+
+		for (; delta > 0; delta--)
 		{
-			/* Hash table takes over ownership of the word string */
-			cache = proposal_cache_new (proposal);
-			g_hash_table_insert (buffer->priv->words,
-			                     item->data,
-			                     cache);
+			add_word (buffer, word);
 		}
 	}
 
+	g_hash_table_remove_all (buffer->priv->edit_words);
+}
+
+/* Runs in a worker thread. */
+static void
+scan_chunk_thread (GTask        *task,
+		   gpointer      source_object,
+		   gpointer      task_data,
+		   GCancellable *cancellable)
+{
+	ScanChunk *chunk = task_data;
+	GSList *words;
+	GSList *item;
+
+	words = _gtk_source_completion_words_utils_scan_words (chunk->text, chunk->minimum_word_size);
+
+	chunk->words = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (item = words; item != NULL; item = g_slist_next (item))
+	{
+		guint use_count = GPOINTER_TO_UINT (g_hash_table_lookup (chunk->words, item->data));
+
+		/* Frees the word if it is already in the hash table. */
+		g_hash_table_insert (chunk->words, item->data, GUINT_TO_POINTER (use_count + 1));
+	}
+
 	g_slist_free (words);
+	g_task_return_boolean (task, TRUE);
 }
 
-/* Scan words in the region delimited by @start and @end.
- * Maximum @max_lines are scanned.
- * Returns the number of lines scanned.
- * @stop is set to the iter where the scanning has stopped.
+/* Adds the words of @chunk to the library, in one batch, and removes the chunk
+ * from the scan region.
  */
-static guint
-scan_region (GtkSourceCompletionWordsBuffer *buffer,
-	     const GtkTextIter              *start,
-	     const GtkTextIter              *end,
-	     guint                           max_lines,
-	     GtkTextIter                    *stop)
+static void
+apply_scan_chunk (GtkSourceCompletionWordsBuffer *buffer,
+		  ScanChunk                      *chunk)
 {
-	GtkTextIter iter = *start;
-	guint nb_lines_scanned = 0;
+	GHashTableIter iter;
+	gpointer word;
+	gpointer count;
+	GtkTextIter start;
+	GtkTextIter end;
 
-	g_assert (max_lines != 0);
+	gtk_source_completion_words_library_add_words (buffer->priv->library, chunk->words);
 
-	while (TRUE)
+	g_hash_table_iter_init (&iter, chunk->words);
+
+	while (g_hash_table_iter_next (&iter, &word, &count))
 	{
-		GSList *words;
+		guint use_count = GPOINTER_TO_UINT (g_hash_table_lookup (buffer->priv->words, word));
 
-		if (gtk_text_iter_compare (end, &iter) < 0)
-		{
-			*stop = *end;
-			break;
-		}
+		/* The hash table takes the ownership of the word, or frees it. */
+		g_hash_table_iter_steal (&iter);
+		g_hash_table_insert (buffer->priv->words,
+				     word,
+				     GUINT_TO_POINTER (use_count + GPOINTER_TO_UINT (count)));
+	}
 
-		if (nb_lines_scanned >= max_lines)
-		{
-			*stop = iter;
-			break;
-		}
+	gtk_text_buffer_get_iter_at_mark (buffer->priv->buffer, &start, buffer->priv->chunk_start);
+	gtk_text_buffer_get_iter_at_mark (buffer->priv->buffer, &end, buffer->priv->chunk_end);
+
+	gtk_source_region_subtract_subregion (buffer->priv->scan_region, &start, &end);
+}
+
+static void
+scan_chunk_finished_cb (GtkSourceCompletionWordsBuffer *buffer,
+			GAsyncResult                   *result,
+			gpointer                        user_data)
+{
+	ScanChunk *chunk = g_task_get_task_data (G_TASK (result));
 
-		words = scan_line (buffer, &iter, end);
+	buffer->priv->scan_in_progress = FALSE;
 
-		/* add_words also frees the list */
-		add_words (buffer, words);
+	if (buffer->priv->buffer == NULL ||
+	    !g_task_propagate_boolean (G_TASK (result), NULL))
+	{
+		return;
+	}
 
-		nb_lines_scanned++;
-		gtk_text_iter_forward_line (&iter);
+	/* The chunk has been edited in the meantime, it is scanned again. */
+	if (!buffer->priv->chunk_up_to_date)
+	{
+		install_scan_chunk (buffer);
+		return;
+	}
+
+	if (gtk_source_completion_words_library_is_locked (buffer->priv->library))
+	{
+		/* Take the contents of the chunk, the task data is freed with
+		 * the task.
+		 */
+		g_clear_pointer (&buffer->priv->pending_chunk, scan_chunk_free);
+		buffer->priv->pending_chunk = g_slice_dup (ScanChunk, chunk);
+		chunk->text = NULL;
+		chunk->words = NULL;
+		return;
 	}
 
-	return nb_lines_scanned;
+	apply_scan_chunk (buffer, chunk);
+	install_scan_chunk (buffer);
 }
 
+/* Takes a copy of the next chunk of the scan region, and scans it in a worker
+ * thread. The chunk begins at the start of the scan region, and ends at a line
+ * start or at the end of the first subregion, so it doesn't split a word. The
+ * line terminators are replaced by '\n', which is not a word character either,
+ * so the words found are the same when they are removed.
+ */
 static gboolean
-idle_scan_regions (GtkSourceCompletionWordsBuffer *buffer)
+idle_scan_chunk (GtkSourceCompletionWordsBuffer *buffer)
 {
-	guint nb_remaining_lines = buffer->priv->scan_batch_size;
 	GtkSourceRegionIter region_iter;
-	GtkTextIter start;
-	GtkTextIter stop;
-
-	gtk_text_buffer_get_start_iter (buffer->priv->buffer, &start);
-	stop = start;
+	GtkTextIter region_start;
+	GtkTextIter region_end;
+	GtkTextIter iter;
+	guint max_nb_lines = buffer->priv->scan_batch_size * SCAN_CHUNK_NB_BATCHES;
+	guint nb_lines = 0;
+	GString *text;
+	ScanChunk *chunk;
+	GTask *task;
+
+	buffer->priv->batch_scan_id = 0;
+
+	if (buffer->priv->scan_in_progress ||
+	    buffer->priv->pending_chunk != NULL ||
+	    gtk_source_region_is_empty (buffer->priv->scan_region))
+	{
+		return G_SOURCE_REMOVE;
+	}
 
 	gtk_source_region_get_start_region_iter (buffer->priv->scan_region, &region_iter);
+	gtk_source_region_iter_get_subregion (&region_iter, &region_start, &region_end);
+
+	text = g_string_new (NULL);
+	iter = region_start;
 
-	while (nb_remaining_lines > 0 &&
-	       !gtk_source_region_iter_is_end (&region_iter))
+	while (gtk_text_iter_compare (&iter, &region_end) < 0 &&
+	       nb_lines < max_nb_lines &&
+	       text->len < SCAN_CHUNK_SIZE)
 	{
-		GtkTextIter region_start;
-		GtkTextIter region_end;
+		GtkTextIter line_end = iter;
+		gchar *line;
 
-		gtk_source_region_iter_get_subregion (&region_iter,
-						      &region_start,
-						      &region_end);
+		if (!gtk_text_iter_ends_line (&line_end))
+		{
+			gtk_text_iter_forward_to_line_end (&line_end);
+		}
 
-		nb_remaining_lines -= scan_region (buffer,
-						   &region_start,
-						   &region_end,
-						   nb_remaining_lines,
-						   &stop);
+		if (gtk_text_iter_compare (&region_end, &line_end) < 0)
+		{
+			line_end = region_end;
+		}
 
-		gtk_source_region_iter_next (&region_iter);
-	}
+		line = gtk_text_buffer_get_text (buffer->priv->buffer, &iter, &line_end, FALSE);
+		g_string_append (text, line);
+		g_string_append_c (text, '\n');
+		g_free (line);
 
-	gtk_source_region_subtract_subregion (buffer->priv->scan_region,
-					      &start,
-					      &stop);
+		nb_lines++;
+		gtk_text_iter_forward_line (&iter);
+	}
 
-	if (gtk_source_region_is_empty (buffer->priv->scan_region))
+	if (gtk_text_iter_compare (&region_end, &iter) < 0)
 	{
-		buffer->priv->batch_scan_id = 0;
-		return G_SOURCE_REMOVE;
+		iter = region_end;
 	}
 
-	return G_SOURCE_CONTINUE;
+	chunk = g_slice_new0 (ScanChunk);
+	chunk->text = g_string_free (text, FALSE);
+	chunk->minimum_word_size = buffer->priv->minimum_word_size;
+
+	gtk_text_buffer_move_mark (buffer->priv->buffer, buffer->priv->chunk_start, &region_start);
+	gtk_text_buffer_move_mark (buffer->priv->buffer, buffer->priv->chunk_end, &iter);
+	buffer->priv->chunk_up_to_date = TRUE;
+
+	buffer->priv->scan_in_progress = TRUE;
+
+	task = g_task_new (buffer, NULL, (GAsyncReadyCallback) scan_chunk_finished_cb, NULL);
+	g_task_set_task_data (task, chunk, (GDestroyNotify) scan_chunk_free);
+	g_task_run_in_thread (task, scan_chunk_thread);
+	g_object_unref (task);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+install_scan_chunk (GtkSourceCompletionWordsBuffer *buffer)
+{
+	if (buffer->priv->batch_scan_id == 0 &&
+	    buffer->priv->initiate_scan_id == 0 &&
+	    !buffer->priv->scan_in_progress &&
+	    !gtk_source_completion_words_library_is_locked (buffer->priv->library) &&
+	    !gtk_source_region_is_empty (buffer->priv->scan_region))
+	{
+		buffer->priv->batch_scan_id =
+			g_idle_add_full (G_PRIORITY_LOW,
+					 (GSourceFunc)idle_scan_chunk,
+					 buffer,
+					 NULL);
+	}
 }
 
 static gboolean
@@ -350,13 +560,7 @@ initiate_scan (GtkSourceCompletionWordsBuffer *buffer)
 {
 	buffer->priv->initiate_scan_id = 0;
 
-	/* Add the batch scanner */
-	buffer->priv->batch_scan_id =
-		g_timeout_add_full (G_PRIORITY_LOW,
-		                    BATCH_SCAN_TIMEOUT,
-		                    (GSourceFunc)idle_scan_regions,
-		                    buffer,
-		                    NULL);
+	install_scan_chunk (buffer);
 
 	return G_SOURCE_REMOVE;
 }
@@ -381,22 +585,16 @@ remove_words_in_subregion (GtkSourceCompletionWordsBuffer *buffer,
 			   const GtkTextIter              *start,
 			   const GtkTextIter              *end)
 {
-	GtkTextIter iter = *start;
+	GSList *words = scan_subregion (buffer, start, end);
+	GSList *item;
 
-	while (gtk_text_iter_compare (&iter, end) < 0)
+	for (item = words; item != NULL; item = g_slist_next (item))
 	{
-		GSList *words = scan_line (buffer, &iter, end);
-		GSList *item;
-
-		for (item = words; item != NULL; item = g_slist_next (item))
-		{
-			remove_word (buffer, item->data);
-			g_free (item->data);
-		}
-
-		g_slist_free (words);
-		gtk_text_iter_forward_line (&iter);
+		remove_word (buffer, item->data);
+		g_free (item->data);
 	}
+
+	g_slist_free (words);
 }
 
 static void
@@ -493,6 +691,117 @@ add_to_scan_region (GtkSourceCompletionWordsBuffer *buffer,
 	install_initiate_scan (buffer);
 }
 
+/* Returns whether the words between @start and @end can be updated directly.
+ * Otherwise the text is added to the scan region, if it touches the scan
+ * region (the words would be counted twice), or if the library is locked (new
+ * words can not be added).
+ */
+static gboolean
+can_edit_words (GtkSourceCompletionWordsBuffer *buffer,
+		const GtkTextIter              *start,
+		const GtkTextIter              *end)
+{
+	GtkSourceRegion *intersection;
+	gboolean ret;
+
+	if (gtk_source_completion_words_library_is_locked (buffer->priv->library))
+	{
+		return FALSE;
+	}
+
+	intersection = gtk_source_region_intersect_subregion (buffer->priv->scan_region,
+							      start,
+							      end);
+
+	ret = gtk_source_region_is_empty (intersection);
+
+	g_clear_object (&intersection);
+	return ret;
+}
+
+/* Marks the ScanChunk being scanned or pending as out-of-date if the text
+ * between @start and @end touches it. The edits elsewhere don't affect the
+ * words of the chunk, so it can still be applied.
+ */
+static void
+check_scan_chunk (GtkSourceCompletionWordsBuffer *buffer,
+		  const GtkTextIter              *start,
+		  const GtkTextIter              *end)
+{
+	GtkTextIter chunk_start;
+	GtkTextIter chunk_end;
+
+	if (!buffer->priv->chunk_up_to_date)
+	{
+		return;
+	}
+
+	gtk_text_buffer_get_iter_at_mark (buffer->priv->buffer, &chunk_start, buffer->priv->chunk_start);
+	gtk_text_buffer_get_iter_at_mark (buffer->priv->buffer, &chunk_end, buffer->priv->chunk_end);
+
+	if (gtk_text_iter_compare (start, &chunk_end) <= 0 &&
+	    gtk_text_iter_compare (&chunk_start, end) <= 0)
+	{
+		buffer->priv->chunk_up_to_date = FALSE;
+	}
+}
+
+/* Removes the words between @start and @end, adjusted to word boundaries,
+ * before a text insertion or deletion. If @direct is %FALSE, or if the words
+ * can not be updated directly, the text is added to the scan region by
+ * end_edit().
+ */
+static void
+begin_edit (GtkSourceCompletionWordsBuffer *buffer,
+	    const GtkTextIter              *start,
+	    const GtkTextIter              *end,
+	    gboolean                        direct)
+{
+	GtkTextIter start_iter = *start;
+	GtkTextIter end_iter = *end;
+
+	_gtk_source_completion_words_utils_adjust_region (&start_iter, &end_iter);
+
+	check_scan_chunk (buffer, &start_iter, &end_iter);
+
+	/* A previous edit has not been ended. */
+	apply_edit_words (buffer);
+
+	if (direct && can_edit_words (buffer, &start_iter, &end_iter))
+	{
+		add_edit_words (buffer, &start_iter, &end_iter, -1);
+		buffer->priv->edit_in_scan_region = FALSE;
+	}
+	else
+	{
+		invalidate_region (buffer, start, end);
+		buffer->priv->edit_in_scan_region = TRUE;
+	}
+}
+
+/* Adds the words between @start and @end, adjusted to word boundaries, after a
+ * text insertion or deletion.
+ */
+static void
+end_edit (GtkSourceCompletionWordsBuffer *buffer,
+	  const GtkTextIter              *start,
+	  const GtkTextIter              *end)
+{
+	GtkTextIter start_iter = *start;
+	GtkTextIter end_iter = *end;
+
+	if (buffer->priv->edit_in_scan_region)
+	{
+		add_to_scan_region (buffer, start, end);
+		return;
+	}
+
+	_gtk_source_completion_words_utils_adjust_region (&start_iter, &end_iter);
+
+	add_edit_words (buffer, &start_iter, &end_iter, 1);
+	apply_edit_words (buffer);
+}
+
 static void
 on_insert_text_before_cb (GtkTextBuffer                  *textbuffer,
 			  GtkTextIter                    *location,
@@ -500,7 +809,7 @@ on_insert_text_before_cb (GtkTextBuffer                  *textbuffer,
 			  gint                            len,
 			  GtkSourceCompletionWordsBuffer *buffer)
 {
-	invalidate_region (buffer, location, location);
+	begin_edit (buffer, location, location, len <= EDIT_MAX_SIZE);
 }
 
 static void
@@ -519,8 +828,9 @@ on_insert_text_after_cb (GtkTextBuffer                  *textbuffer,
 	 * created GtkSourceRegion can be empty and is thus not added to the
 	 * scan region. After the text insertion, we are sure that the
 	 * GtkSourceRegion is not empty and that the words will be scanned.
+	 * The same applies to the words added directly.
 	 */
-	add_to_scan_region (buffer, &start_iter, location);
+	end_edit (buffer, &start_iter, location);
 }
 
 static void
@@ -538,14 +848,17 @@ on_delete_range_before_cb (GtkTextBuffer                  *text_buffer,
 	if (gtk_text_iter_equal (start, &start_buf) &&
 	    gtk_text_iter_equal (end, &end_buf))
 	{
+		buffer->priv->chunk_up_to_date = FALSE;
+		apply_edit_words (buffer);
 		remove_all_words (buffer);
 
 		g_clear_object (&buffer->priv->scan_region);
 		buffer->priv->scan_region = gtk_source_region_new (text_buffer);
+		buffer->priv->edit_in_scan_region = TRUE;
 	}
 	else
 	{
-		invalidate_region (buffer, start, end);
+		begin_edit (buffer, start, end, TRUE);
 	}
 }
 
@@ -564,7 +877,7 @@ on_delete_range_after_cb (GtkTextBuffer                  *text_buffer,
 	 * removed from the scan region. Hence two callbacks: before and after
 	 * the text deletion.
 	 */
-	add_to_scan_region (buffer, start, end);
+	end_edit (buffer, start, end);
 }
 
 static void
@@ -633,6 +946,20 @@ on_library_lock (GtkSourceCompletionWordsBuffer *buffer)
 static void
 on_library_unlock (GtkSourceCompletionWordsBuffer *buffer)
 {
+	ScanChunk *chunk = buffer->priv->pending_chunk;
+
+	if (chunk != NULL)
+	{
+		buffer->priv->pending_chunk = NULL;
+
+		if (buffer->priv->chunk_up_to_date)
+		{
+			apply_scan_chunk (buffer, chunk);
+		}
+
+		scan_chunk_free (chunk);
+	}
+
 	if (!gtk_source_region_is_empty (buffer->priv->scan_region))
 	{
 		install_initiate_scan (buffer);
@@ -644,6 +971,7 @@ gtk_source_completion_words_buffer_new (GtkSourceCompletionWordsLibrary *library
 					GtkTextBuffer                   *buffer)
 {
 	GtkSourceCompletionWordsBuffer *ret;
+	GtkTextIter start;
 
 	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library), NULL);
 	g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
@@ -655,6 +983,10 @@ gtk_source_completion_words_buffer_new (GtkSourceCompletionWordsLibrary *library
 
 	ret->priv->scan_region = gtk_source_region_new (buffer);
 
+	gtk_text_buffer_get_start_iter (buffer, &start);
+	ret->priv->chunk_start = gtk_text_buffer_create_mark (buffer, NULL, &start, TRUE);
+	ret->priv->chunk_end = gtk_text_buffer_create_mark (buffer, NULL, &start, TRUE);
+
 	g_signal_connect_object (ret->priv->library,
 				 "lock",
 				 G_CALLBACK (on_library_lock),
@@ -700,6 +1032,7 @@ gtk_source_completion_words_buffer_set_minimum_word_size (GtkSourceCompletionWor
 	if (buffer->priv->minimum_word_size != size)
 	{
 		buffer->priv->minimum_word_size = size;
+		buffer->priv->chunk_up_to_date = FALSE;
 		remove_all_words (buffer);
 		scan_all_buffer (buffer);
 	}
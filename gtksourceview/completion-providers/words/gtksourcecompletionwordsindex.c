@@ -0,0 +1,342 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gtksourcecompletionwordsindex.h"
+
+#include <string.h>
+#include <gio/gio.h>
+
+/* A words index is a read-only file containing words with their frequencies,
+ * typically the words of all the files of a project. It is mapped in memory,
+ * so it is shared by all the processes using it, and it can be used without
+ * being parsed.
+ *
+ * The file format, with the integers in little endian:
+ * - the header: INDEX_MAGIC, the version (guint32) and the number of words
+ *   (guint32);
+ * - for each word, sorted in the strcmp() order: the offset of the word in the
+ *   file (guint32) and its frequency (guint32);
+ * - the words, nul-terminated.
+ *
+ * Loading an index only checks its header and its last byte, so it takes the
+ * same time for any index size. A word is checked when it is read: an offset out of the words
+ * or a word that is not valid UTF-8 gives NULL. The order is checked only
+ * around the result of a binary search, a wrong order gives missing words.
+ */
+
+#define INDEX_MAGIC "GSVWORDS"
+#define INDEX_MAGIC_LENGTH 8
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE (INDEX_MAGIC_LENGTH + 2 * sizeof (guint32))
+#define INDEX_ENTRY_SIZE (2 * sizeof (guint32))
+
+struct _GtkSourceCompletionWordsIndex
+{
+	GMappedFile *file;
+	const gchar *contents;
+	gsize length;
+	gsize words_start;
+	guint n_words;
+};
+
+static inline guint32
+read_uint32 (const gchar *data)
+{
+	guint32 value;
+
+	memcpy (&value, data, sizeof (value));
+	return GUINT32_FROM_LE (value);
+}
+
+static inline void
+write_uint32 (GByteArray *data,
+	      guint32     value)
+{
+	value = GUINT32_TO_LE (value);
+	g_byte_array_append (data, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+set_invalid_data_error (GError      **error,
+			const gchar  *filename)
+{
+	gchar *display_name = g_filename_display_name (filename);
+
+	g_set_error (error,
+		     G_IO_ERROR,
+		     G_IO_ERROR_INVALID_DATA,
+		     "Invalid words index file: %s",
+		     display_name);
+
+	g_free (display_name);
+}
+
+/* Maps @filename in memory and checks its header. The words are checked by
+ * gtk_source_completion_words_index_get_word().
+ */
+GtkSourceCompletionWordsIndex *
+gtk_source_completion_words_index_new (const gchar  *filename,
+				       GError      **error)
+{
+	GtkSourceCompletionWordsIndex *index;
+	GMappedFile *file;
+	const gchar *contents;
+	gsize length;
+	guint n_words;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	file = g_mapped_file_new (filename, FALSE, error);
+
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	contents = g_mapped_file_get_contents (file);
+	length = g_mapped_file_get_length (file);
+
+	if (length < INDEX_HEADER_SIZE ||
+	    memcmp (contents, INDEX_MAGIC, INDEX_MAGIC_LENGTH) != 0 ||
+	    read_uint32 (contents + INDEX_MAGIC_LENGTH) != INDEX_VERSION)
+	{
+		goto invalid;
+	}
+
+	n_words = read_uint32 (contents + INDEX_MAGIC_LENGTH + sizeof (guint32));
+
+	if (n_words > (length - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE)
+	{
+		goto invalid;
+	}
+
+	/* The last word is nul-terminated, so all the words are. */
+	if (n_words > 0 && contents[length - 1] != '\0')
+	{
+		goto invalid;
+	}
+
+	index = g_slice_new (GtkSourceCompletionWordsIndex);
+	index->file = file;
+	index->contents = contents;
+	index->length = length;
+	index->words_start = INDEX_HEADER_SIZE + (gsize) n_words * INDEX_ENTRY_SIZE;
+	index->n_words = n_words;
+
+	return index;
+
+invalid:
+	set_invalid_data_error (error, filename);
+	g_mapped_file_unref (file);
+	return NULL;
+}
+
+void
+gtk_source_completion_words_index_free (GtkSourceCompletionWordsIndex *index)
+{
+	if (index != NULL)
+	{
+		g_mapped_file_unref (index->file);
+		g_slice_free (GtkSourceCompletionWordsIndex, index);
+	}
+}
+
+guint
+gtk_source_completion_words_index_get_n_words (GtkSourceCompletionWordsIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return index->n_words;
+}
+
+/* Returns the word at @pos, or NULL if the index file is corrupted there. */
+const gchar *
+gtk_source_completion_words_index_get_word (GtkSourceCompletionWordsIndex *index,
+					    guint                          pos)
+{
+	guint32 offset;
+	const gchar *word;
+
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (pos < index->n_words, NULL);
+
+	offset = read_uint32 (index->contents + INDEX_HEADER_SIZE + (gsize) pos * INDEX_ENTRY_SIZE);
+
+	if (offset < index->words_start || offset >= index->length)
+	{
+		return NULL;
+	}
+
+	word = index->contents + offset;
+
+	if (!g_utf8_validate (word, -1, NULL))
+	{
+		return NULL;
+	}
+
+	return word;
+}
+
+guint
+gtk_source_completion_words_index_get_frequency (GtkSourceCompletionWordsIndex *index,
+						 guint                          pos)
+{
+	g_return_val_if_fail (index != NULL, 0);
+	g_return_val_if_fail (pos < index->n_words, 0);
+
+	return read_uint32 (index->contents + INDEX_HEADER_SIZE + (gsize) pos * INDEX_ENTRY_SIZE + sizeof (guint32));
+}
+
+/* Returns the position of the first word not lower than the first
+ * @prefix_length bytes of @prefix, and greater than @after if @after is not
+ * %NULL. The words having @prefix as prefix follow, in the sorted order.
+ *
+ * The order of the words is not checked when the index is loaded, only here
+ * around the result: if the word before it is not lower, the number of words
+ * is returned, i.e. nothing is found.
+ */
+guint
+gtk_source_completion_words_index_find (GtkSourceCompletionWordsIndex *index,
+					const gchar                   *prefix,
+					gsize                          prefix_length,
+					const gchar                   *after)
+{
+	guint min = 0;
+	guint max;
+
+	g_return_val_if_fail (index != NULL, 0);
+	g_return_val_if_fail (prefix != NULL, 0);
+
+	max = index->n_words;
+
+	while (min < max)
+	{
+		guint middle = min + (max - min) / 2;
+		const gchar *word = gtk_source_completion_words_index_get_word (index, middle);
+
+		if (word != NULL &&
+		    (strncmp (word, prefix, prefix_length) < 0 ||
+		     (after != NULL && strcmp (word, after) <= 0)))
+		{
+			min = middle + 1;
+		}
+		else
+		{
+			max = middle;
+		}
+	}
+
+	if (min > 0 && min < index->n_words)
+	{
+		const gchar *prev_word = gtk_source_completion_words_index_get_word (index, min - 1);
+		const gchar *word = gtk_source_completion_words_index_get_word (index, min);
+
+		if (prev_word == NULL ||
+		    word == NULL ||
+		    strcmp (prev_word, word) >= 0)
+		{
+			return index->n_words;
+		}
+	}
+
+	return min;
+}
+
+static gint
+compare_words (gconstpointer a,
+	       gconstpointer b)
+{
+	return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Writes the words index @filename. @words contains the words with their
+ * frequencies stored with GUINT_TO_POINTER().
+ */
+gboolean
+gtk_source_completion_words_index_write (GHashTable   *words,
+					 const gchar  *filename,
+					 GError      **error)
+{
+	GPtrArray *sorted_words;
+	GByteArray *data;
+	GHashTableIter iter;
+	gpointer word;
+	gsize offset;
+	gboolean ret;
+	guint i;
+
+	g_return_val_if_fail (words != NULL, FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	sorted_words = g_ptr_array_sized_new (g_hash_table_size (words));
+
+	g_hash_table_iter_init (&iter, words);
+
+	while (g_hash_table_iter_next (&iter, &word, NULL))
+	{
+		g_ptr_array_add (sorted_words, word);
+	}
+
+	g_ptr_array_sort (sorted_words, compare_words);
+
+	data = g_byte_array_new ();
+	g_byte_array_append (data, (const guint8 *) INDEX_MAGIC, INDEX_MAGIC_LENGTH);
+	write_uint32 (data, INDEX_VERSION);
+	write_uint32 (data, sorted_words->len);
+
+	offset = INDEX_HEADER_SIZE + (gsize) sorted_words->len * INDEX_ENTRY_SIZE;
+
+	for (i = 0; i < sorted_words->len; i++)
+	{
+		word = g_ptr_array_index (sorted_words, i);
+
+		write_uint32 (data, offset);
+		write_uint32 (data, GPOINTER_TO_UINT (g_hash_table_lookup (words, word)));
+
+		offset += strlen (word) + 1;
+	}
+
+	if (offset > G_MAXUINT32)
+	{
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_FAILED,
+				     "Too many words for a words index file");
+		ret = FALSE;
+		goto out;
+	}
+
+	for (i = 0; i < sorted_words->len; i++)
+	{
+		word = g_ptr_array_index (sorted_words, i);
+		g_byte_array_append (data, word, strlen (word) + 1);
+	}
+
+	ret = g_file_set_contents (filename, (const gchar *) data->data, data->len, error);
+
+out:
+	g_byte_array_unref (data);
+	g_ptr_array_unref (sorted_words);
+	return ret;
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTK_SOURCE_COMPLETION_WORDS_INDEX_H
+#define GTK_SOURCE_COMPLETION_WORDS_INDEX_H
+
+#include <glib.h>
+#include "gtksourceview/gtksourcetypes-private.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GtkSourceCompletionWordsIndex GtkSourceCompletionWordsIndex;
+
+GTK_SOURCE_INTERNAL
+GtkSourceCompletionWordsIndex *
+		 gtk_source_completion_words_index_new			(const gchar                    *filename,
+									 GError                        **error);
+
+GTK_SOURCE_INTERNAL
+void		 gtk_source_completion_words_index_free			(GtkSourceCompletionWordsIndex  *index);
+
+GTK_SOURCE_INTERNAL
+guint		 gtk_source_completion_words_index_get_n_words		(GtkSourceCompletionWordsIndex  *index);
+
+GTK_SOURCE_INTERNAL
+const gchar	*gtk_source_completion_words_index_get_word		(GtkSourceCompletionWordsIndex  *index,
+									 guint                           pos);
+
+GTK_SOURCE_INTERNAL
+guint		 gtk_source_completion_words_index_get_frequency	(GtkSourceCompletionWordsIndex  *index,
+									 guint                           pos);
+
+GTK_SOURCE_INTERNAL
+guint		 gtk_source_completion_words_index_find			(GtkSourceCompletionWordsIndex  *index,
+									 const gchar                    *prefix,
+									 gsize                           prefix_length,
+									 const gchar                    *after);
+
+GTK_SOURCE_INTERNAL
+gboolean	 gtk_source_completion_words_index_write		(GHashTable                     *words,
+									 const gchar                    *filename,
+									 GError                        **error);
+
+G_END_DECLS
+
+#endif /* GTK_SOURCE_COMPLETION_WORDS_INDEX_H */
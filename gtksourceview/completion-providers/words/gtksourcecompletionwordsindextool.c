@@ -0,0 +1,197 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* gtksourceview-words-index: creates a words index file for
+ * gtk_source_completion_words_set_index_file(), with the words of the files
+ * given on the command line. The directories are scanned recursively, except
+ * the hidden ones. The files that are not valid UTF-8, e.g. binary files, are
+ * skipped.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "gtksourcecompletionwordsindex.h"
+#include "gtksourcecompletionwordsutils.h"
+
+static gint minimum_word_size = 3;
+static gboolean verbose = FALSE;
+
+static GOptionEntry entries[] =
+{
+	{ "minimum-word-size", 'm', 0, G_OPTION_ARG_INT, &minimum_word_size,
+	  "The minimum size of the words (default: 3)", "SIZE" },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+	  "Print the files scanned", NULL },
+	{ NULL }
+};
+
+static void
+scan_file (const gchar *filename,
+	   GHashTable  *words)
+{
+	gchar *contents;
+	gsize length;
+	GSList *file_words;
+	GSList *item;
+	GError *error = NULL;
+
+	if (!g_file_get_contents (filename, &contents, &length, &error))
+	{
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	if (!g_utf8_validate (contents, length, NULL))
+	{
+		if (verbose)
+		{
+			g_print ("Skipped: %s\n", filename);
+		}
+
+		g_free (contents);
+		return;
+	}
+
+	if (verbose)
+	{
+		g_print ("Scanned: %s\n", filename);
+	}
+
+	file_words = _gtk_source_completion_words_utils_scan_words (contents, minimum_word_size);
+
+	for (item = file_words; item != NULL; item = g_slist_next (item))
+	{
+		guint frequency = GPOINTER_TO_UINT (g_hash_table_lookup (words, item->data));
+
+		/* Frees the word if it is already in the hash table. */
+		g_hash_table_insert (words, item->data, GUINT_TO_POINTER (frequency + 1));
+	}
+
+	g_slist_free (file_words);
+	g_free (contents);
+}
+
+static void
+scan_path (const gchar *path,
+	   GHashTable  *words)
+{
+	GDir *dir;
+	const gchar *name;
+	GError *error = NULL;
+
+	if (!g_file_test (path, G_FILE_TEST_IS_DIR))
+	{
+		scan_file (path, words);
+		return;
+	}
+
+	dir = g_dir_open (path, 0, &error);
+
+	if (dir == NULL)
+	{
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL)
+	{
+		gchar *child_path;
+
+		if (name[0] == '.')
+		{
+			continue;
+		}
+
+		child_path = g_build_filename (path, name, NULL);
+
+		/* Don't follow the links to directories, to avoid cycles. */
+		if (!g_file_test (child_path, G_FILE_TEST_IS_SYMLINK) ||
+		    !g_file_test (child_path, G_FILE_TEST_IS_DIR))
+		{
+			scan_path (child_path, words);
+		}
+
+		g_free (child_path);
+	}
+
+	g_dir_close (dir);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	GHashTable *words;
+	GError *error = NULL;
+	gint i;
+
+	context = g_option_context_new ("OUTPUT FILE…");
+	g_option_context_set_summary (context,
+				      "Creates a words index file, for the words completion provider of GtkSourceView,\n"
+				      "with the words of the FILEs. The directories are scanned recursively.");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+	{
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	if (argc < 3 || minimum_word_size < 1)
+	{
+		gchar *help = g_option_context_get_help (context, TRUE, NULL);
+
+		g_printerr ("%s", help);
+		g_free (help);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	words = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (i = 2; i < argc; i++)
+	{
+		scan_path (argv[i], words);
+	}
+
+	if (!gtk_source_completion_words_index_write (words, argv[1], &error))
+	{
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_hash_table_destroy (words);
+		return EXIT_FAILURE;
+	}
+
+	if (verbose)
+	{
+		g_print ("%u words written to %s\n", g_hash_table_size (words), argv[1]);
+	}
+
+	g_hash_table_destroy (words);
+	return EXIT_SUCCESS;
+}
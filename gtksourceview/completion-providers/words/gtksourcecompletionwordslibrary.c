@@ -27,6 +27,98 @@
 
 #include <string.h>
 
+/* The words are stored in a radix trie. The nodes are packed in an array, and
+ * refer to each other by their index in the array. The label of a node, i.e.
+ * the text on the edge from its parent, is a range in a pool of bytes shared by
+ * all the nodes, so a node doesn't need its own allocation.
+ *
+ * A word ends at a node whose use_count is not 0. The children of a node are
+ * in a linked list sorted by the first byte of their label, so a depth-first
+ * traversal visits the words in the strcmp() order.
+ *
+ * The GtkSourceCompletionWordsProposal's are created lazily, only for the
+ * words returned by gtk_source_completion_words_library_get_proposals() and
+ * gtk_source_completion_words_library_get_fuzzy_proposals().
+ *
+ * For the fuzzy matching, each node has a bitmask of the characters of the
+ * words of its subtree (see get_char_mask()). A subtree is skipped when it
+ * lacks a character of the query. The mask is not updated when a word is
+ * removed, so it can contain more characters than the words of the subtree.
+ *
+ * A GtkSourceCompletionWordsIndex can be attached to the library. Its words are
+ * merged with the words of the trie in the proposals, without being copied.
+ */
+
+/* The root has an empty label, and is never the child of another node, so its
+ * index also means "no node".
+ */
+#define ROOT_NODE 0
+#define NO_NODE 0
+
+/* The label_start of a node in the free list. */
+#define FREE_NODE_LABEL G_MAXUINT32
+
+/* The labels pool is compacted when it contains more unused bytes than used
+ * bytes, and at least this number of unused bytes.
+ */
+#define MIN_LABELS_GARBAGE (64 * 1024)
+
+/* The fuzzy matching scores, for each matched character of the query. The
+ * unmatched characters of the word are subtracted from the score, so the
+ * shorter words come first.
+ */
+#define FUZZY_SCORE_MATCH 16
+#define FUZZY_BONUS_START 8
+#define FUZZY_BONUS_BOUNDARY 6
+#define FUZZY_BONUS_CONSECUTIVE 4
+#define FUZZY_BONUS_CASE 1
+
+/* The number of nodes visited between two checks of the time budget. */
+#define FUZZY_TIME_CHECK_INTERVAL 1024
+
+typedef struct
+{
+	guint32 label_start;
+	guint32 label_length;
+
+	guint32 first_child;
+	guint32 next_sibling;
+
+	/* The number of times the word ending at this node has been added. */
+	guint32 use_count;
+
+	/* The characters of the words of the subtree. */
+	guint32 mask;
+
+	GtkSourceCompletionWordsProposal *proposal;
+} TrieNode;
+
+typedef struct
+{
+	/* NO_NODE for a word of the index, at @index_pos. */
+	guint32 node;
+	guint32 index_pos;
+	gint score;
+	guint32 use_count;
+	gchar *word;
+} FuzzyCandidate;
+
+typedef struct
+{
+	const gchar *query;
+	gsize query_length;
+	guint32 query_mask;
+
+	/* The best FuzzyCandidate's, sorted from the best. */
+	GArray *candidates;
+	guint max_candidates;
+
+	/* In monotonic time, or 0 for no limit. */
+	gint64 deadline;
+	guint nb_visited_nodes;
+	guint timed_out : 1;
+} FuzzySearch;
+
 enum
 {
 	LOCK,
@@ -36,7 +128,25 @@ enum
 
 struct _GtkSourceCompletionWordsLibraryPrivate
 {
-	GSequence *store;
+	/* Array of TrieNode's. */
+	GArray *nodes;
+
+	/* The labels of the nodes. */
+	GByteArray *labels;
+
+	/* The number of bytes in @labels not used by any node. */
+	guint32 labels_garbage;
+
+	/* The first node of the free list, linked with next_sibling. */
+	guint32 free_nodes;
+
+	GtkSourceCompletionWordsIndex *index;
+
+	/* The proposals of the words of @index, created lazily. The keys are
+	 * owned by @index.
+	 */
+	GHashTable *index_proposals;
+
 	gboolean locked;
 };
 
@@ -44,12 +154,41 @@ static guint signals[N_SIGNALS];
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtkSourceCompletionWordsLibrary, gtk_source_completion_words_library, G_TYPE_OBJECT)
 
+static inline TrieNode *
+get_node (GtkSourceCompletionWordsLibrary *library,
+	  guint32                          index)
+{
+	return &g_array_index (library->priv->nodes, TrieNode, index);
+}
+
+static inline const gchar *
+get_label (GtkSourceCompletionWordsLibrary *library,
+	   const TrieNode                  *node)
+{
+	return (const gchar *) library->priv->labels->data + node->label_start;
+}
+
 static void
 gtk_source_completion_words_library_finalize (GObject *object)
 {
 	GtkSourceCompletionWordsLibrary *library = GTK_SOURCE_COMPLETION_WORDS_LIBRARY (object);
+	guint i;
+
+	for (i = 0; i < library->priv->nodes->len; i++)
+	{
+		TrieNode *node = get_node (library, i);
+
+		if (node->label_start != FREE_NODE_LABEL)
+		{
+			g_clear_object (&node->proposal);
+		}
+	}
+
+	g_array_free (library->priv->nodes, TRUE);
+	g_byte_array_free (library->priv->labels, TRUE);
 
-	g_sequence_free (library->priv->store);
+	g_hash_table_destroy (library->priv->index_proposals);
+	gtk_source_completion_words_index_free (library->priv->index);
 
 	G_OBJECT_CLASS (gtk_source_completion_words_library_parent_class)->finalize (object);
 }
@@ -83,7 +222,17 @@ gtk_source_completion_words_library_init (GtkSourceCompletionWordsLibrary *self)
 {
 	self->priv = gtk_source_completion_words_library_get_instance_private (self);
 
-	self->priv->store = g_sequence_new ((GDestroyNotify)g_object_unref);
+	self->priv->nodes = g_array_new (FALSE, TRUE, sizeof (TrieNode));
+	self->priv->labels = g_byte_array_new ();
+	self->priv->free_nodes = NO_NODE;
+
+	self->priv->index_proposals = g_hash_table_new_full (g_str_hash,
+							     g_str_equal,
+							     NULL,
+							     g_object_unref);
+
+	/* The root. */
+	g_array_set_size (self->priv->nodes, 1);
 }
 
 GtkSourceCompletionWordsLibrary *
@@ -92,210 +241,1209 @@ gtk_source_completion_words_library_new (void)
 	return g_object_new (GTK_SOURCE_TYPE_COMPLETION_WORDS_LIBRARY, NULL);
 }
 
-static gint
-compare_full (GtkSourceCompletionWordsProposal *a,
-	      GtkSourceCompletionWordsProposal *b,
-	      gpointer                          user_data)
+/* The lowercase ASCII letters have one bit each. The other characters share
+ * a few bits.
+ */
+static inline guint32
+get_char_mask (guchar c)
 {
-	if (a == b)
+	if (g_ascii_isalpha (c))
+	{
+		return 1u << (g_ascii_tolower (c) - 'a');
+	}
+	else if (g_ascii_isdigit (c))
+	{
+		return 1u << 26;
+	}
+	else if (c == '_')
 	{
-		return 0;
+		return 1u << 27;
+	}
+	else if (c < 0x80)
+	{
+		return 1u << 28;
 	}
 
-	return strcmp (gtk_source_completion_words_proposal_get_word (a),
-	               gtk_source_completion_words_proposal_get_word (b));
+	return 1u << 29;
 }
 
-static gint
-compare_prefix (GtkSourceCompletionWordsProposal *a,
-		GtkSourceCompletionWordsProposal *b,
-		gpointer                          len)
+static guint32
+get_text_mask (const gchar *text,
+	       gsize        length)
 {
-	gint prefix_length = GPOINTER_TO_INT (len);
+	guint32 mask = 0;
+	gsize i;
 
-	return strncmp (gtk_source_completion_words_proposal_get_word (a),
-			gtk_source_completion_words_proposal_get_word (b),
-			prefix_length);
+	for (i = 0; i < length; i++)
+	{
+		mask |= get_char_mask (text[i]);
+	}
+
+	return mask;
 }
 
-static gboolean
-iter_match_prefix (GSequenceIter *iter,
-                   const gchar   *word,
-                   gint           len)
+static guint32
+add_label (GtkSourceCompletionWordsLibrary *library,
+	   const gchar                     *text,
+	   guint32                          length)
 {
-	GtkSourceCompletionWordsProposal *item;
-	const gchar *proposal_word;
+	guint32 start = library->priv->labels->len;
+
+	g_byte_array_append (library->priv->labels, (const guint8 *) text, length);
 
-	item = gtk_source_completion_words_library_get_proposal (iter);
-	proposal_word = gtk_source_completion_words_proposal_get_word (item);
+	return start;
+}
+
+static guint32
+new_node (GtkSourceCompletionWordsLibrary *library,
+	  guint32                          label_start,
+	  guint32                          label_length)
+{
+	TrieNode *node;
+	guint32 index;
 
-	if (len == -1)
+	if (library->priv->free_nodes != NO_NODE)
 	{
-		len = strlen (word);
+		index = library->priv->free_nodes;
+		library->priv->free_nodes = get_node (library, index)->next_sibling;
 	}
+	else
+	{
+		index = library->priv->nodes->len;
+		g_array_set_size (library->priv->nodes, index + 1);
+	}
+
+	node = get_node (library, index);
+	node->label_start = label_start;
+	node->label_length = label_length;
+	node->first_child = NO_NODE;
+	node->next_sibling = NO_NODE;
+	node->use_count = 0;
+	node->mask = 0;
+	node->proposal = NULL;
+
+	return index;
+}
+
+static void
+free_node (GtkSourceCompletionWordsLibrary *library,
+	   guint32                          index)
+{
+	TrieNode *node = get_node (library, index);
+
+	g_clear_object (&node->proposal);
 
-	return strncmp (proposal_word, word, len) == 0;
+	library->priv->labels_garbage += node->label_length;
+
+	node->label_start = FREE_NODE_LABEL;
+	node->label_length = 0;
+	node->first_child = NO_NODE;
+	node->next_sibling = library->priv->free_nodes;
+	library->priv->free_nodes = index;
 }
 
-GtkSourceCompletionWordsProposal *
-gtk_source_completion_words_library_get_proposal (GSequenceIter *iter)
+/* Returns the child of @parent whose label starts with @c, or NO_NODE. @prev is
+ * set to the previous sibling, i.e. the last child whose label starts with a
+ * byte lower than @c, or NO_NODE. It is where a new child starting with @c
+ * must be inserted.
+ */
+static guint32
+find_child (GtkSourceCompletionWordsLibrary *library,
+	    guint32                          parent,
+	    guchar                           c,
+	    guint32                         *prev)
 {
-	if (iter == NULL)
+	guint32 child = get_node (library, parent)->first_child;
+	guint32 prev_child = NO_NODE;
+
+	while (child != NO_NODE)
 	{
-		return NULL;
+		guchar first = (guchar) get_label (library, get_node (library, child))[0];
+
+		if (first >= c)
+		{
+			if (prev != NULL)
+			{
+				*prev = prev_child;
+			}
+
+			return first == c ? child : NO_NODE;
+		}
+
+		prev_child = child;
+		child = get_node (library, child)->next_sibling;
+	}
+
+	if (prev != NULL)
+	{
+		*prev = prev_child;
 	}
 
-	return GTK_SOURCE_COMPLETION_WORDS_PROPOSAL (g_sequence_get (iter));
+	return NO_NODE;
 }
 
-/* Find the first item in the library with the prefix equal to @word.
- * If no such items exist, returns %NULL.
+/* Replaces @child, whose previous sibling is @prev, by @new_child in the list
+ * of the children of @parent. If @child is NO_NODE, @new_child is inserted
+ * after @prev.
  */
-GSequenceIter *
-gtk_source_completion_words_library_find_first (GtkSourceCompletionWordsLibrary *library,
-                                                const gchar                     *word,
-                                                gint                             len)
+static void
+replace_child (GtkSourceCompletionWordsLibrary *library,
+	       guint32                          parent,
+	       guint32                          prev,
+	       guint32                          child,
+	       guint32                          new_child)
+{
+	guint32 next;
+
+	if (prev == NO_NODE)
+	{
+		next = get_node (library, parent)->first_child;
+	}
+	else
+	{
+		next = get_node (library, prev)->next_sibling;
+	}
+
+	if (child != NO_NODE)
+	{
+		g_assert_cmpuint (next, ==, child);
+		next = get_node (library, child)->next_sibling;
+	}
+
+	if (new_child != NO_NODE)
+	{
+		get_node (library, new_child)->next_sibling = next;
+		next = new_child;
+	}
+
+	if (prev == NO_NODE)
+	{
+		get_node (library, parent)->first_child = next;
+	}
+	else
+	{
+		get_node (library, prev)->next_sibling = next;
+	}
+}
+
+/* Splits the label of @child after @length bytes. Returns the new node, which
+ * has the first part of the label and @child as its only child.
+ */
+static guint32
+split_node (GtkSourceCompletionWordsLibrary *library,
+	    guint32                          parent,
+	    guint32                          prev,
+	    guint32                          child,
+	    guint32                          length)
 {
+	guint32 middle;
+	TrieNode *child_node;
+
+	middle = new_node (library, get_node (library, child)->label_start, length);
+	replace_child (library, parent, prev, child, middle);
+
+	child_node = get_node (library, child);
+	child_node->label_start += length;
+	child_node->label_length -= length;
+	child_node->next_sibling = NO_NODE;
+
+	get_node (library, middle)->first_child = child;
+	get_node (library, middle)->mask = get_node (library, child)->mask;
+
+	return middle;
+}
+
+/* Merges @index, which has no word and only one child, with its child. */
+static void
+merge_node (GtkSourceCompletionWordsLibrary *library,
+	    guint32                          index)
+{
+	guint32 child = get_node (library, index)->first_child;
+	TrieNode *node = get_node (library, index);
+	TrieNode *child_node = get_node (library, child);
+
+	g_assert (child != NO_NODE);
+	g_assert_cmpuint (child_node->next_sibling, ==, NO_NODE);
+
+	/* After a split_node(), the two labels are often still contiguous. */
+	if (node->label_start + node->label_length != child_node->label_start)
+	{
+		guint32 start = library->priv->labels->len;
+		guint8 *data;
+
+		g_byte_array_set_size (library->priv->labels,
+				       start + node->label_length + child_node->label_length);
+
+		data = library->priv->labels->data;
+		memcpy (data + start, data + node->label_start, node->label_length);
+		memcpy (data + start + node->label_length,
+			data + child_node->label_start,
+			child_node->label_length);
+
+		library->priv->labels_garbage += node->label_length + child_node->label_length;
+
+		node->label_start = start;
+	}
+
+	node->label_length += child_node->label_length;
+	node->first_child = child_node->first_child;
+	node->use_count = child_node->use_count;
+	node->mask = child_node->mask;
+	node->proposal = child_node->proposal;
+
+	child_node->proposal = NULL;
+	child_node->label_length = 0;
+	free_node (library, child);
+}
+
+static void
+compact_labels (GtkSourceCompletionWordsLibrary *library)
+{
+	GByteArray *labels;
+	guint i;
+
+	labels = g_byte_array_sized_new (library->priv->labels->len - library->priv->labels_garbage);
+
+	for (i = 0; i < library->priv->nodes->len; i++)
+	{
+		TrieNode *node = get_node (library, i);
+		guint32 start = labels->len;
+
+		if (node->label_start == FREE_NODE_LABEL)
+		{
+			continue;
+		}
+
+		g_byte_array_append (labels,
+				     library->priv->labels->data + node->label_start,
+				     node->label_length);
+
+		node->label_start = start;
+	}
+
+	g_byte_array_free (library->priv->labels, TRUE);
+	library->priv->labels = labels;
+	library->priv->labels_garbage = 0;
+}
+
+/* Adds the proposals of the subtree of @index, in the sorted order. @word is
+ * the text from the root to @index included. Only the words greater than
+ * @after are added, if @after is not %NULL.
+ */
+static void
+collect_proposals (GtkSourceCompletionWordsLibrary  *library,
+		   guint32                           index,
+		   GString                          *word,
+		   const gchar                      *after,
+		   guint                            *max_proposals,
+		   GList                           **proposals)
+{
+	TrieNode *node = get_node (library, index);
+	guint32 child;
+
+	if (after != NULL)
+	{
+		gint cmp = strncmp (word->str, after, word->len);
+
+		/* All the words of the subtree are lower than @after. */
+		if (cmp < 0)
+		{
+			return;
+		}
+
+		/* All the words of the subtree are greater than @after. */
+		if (cmp > 0)
+		{
+			after = NULL;
+		}
+	}
+
+	/* If @after is not NULL, @word is a prefix of @after, so it is not
+	 * greater than @after.
+	 */
+	if (node->use_count > 0 && after == NULL)
+	{
+		if (node->proposal == NULL)
+		{
+			node->proposal = gtk_source_completion_words_proposal_new (word->str);
+		}
+
+		*proposals = g_list_prepend (*proposals, node->proposal);
+		--*max_proposals;
+	}
+
+	for (child = node->first_child;
+	     child != NO_NODE && *max_proposals > 0;
+	     child = get_node (library, child)->next_sibling)
+	{
+		TrieNode *child_node = get_node (library, child);
+		gsize length = word->len;
+
+		g_string_append_len (word, get_label (library, child_node), child_node->label_length);
+		collect_proposals (library, child, word, after, max_proposals, proposals);
+		g_string_truncate (word, length);
+	}
+}
+
+/* The proposals of the trie, in the sorted order. */
+static GList *
+get_trie_proposals (GtkSourceCompletionWordsLibrary *library,
+		    const gchar                     *prefix,
+		    gsize                            prefix_length,
+		    const gchar                     *after,
+		    guint                            max_proposals)
+{
+	GList *proposals = NULL;
+	GString *word;
+	guint32 index = ROOT_NODE;
+	gsize pos = 0;
+
+	word = g_string_new (NULL);
+
+	/* The prefix can end in the middle of a label. */
+	while (pos < prefix_length)
+	{
+		TrieNode *node;
+		gsize length;
+
+		index = find_child (library, index, prefix[pos], NULL);
+
+		if (index == NO_NODE)
+		{
+			g_string_free (word, TRUE);
+			return NULL;
+		}
+
+		node = get_node (library, index);
+		length = MIN (node->label_length, prefix_length - pos);
+
+		if (memcmp (get_label (library, node), prefix + pos, length) != 0)
+		{
+			g_string_free (word, TRUE);
+			return NULL;
+		}
+
+		g_string_append_len (word, get_label (library, node), node->label_length);
+		pos += node->label_length;
+	}
+
+	collect_proposals (library, index, word, after, &max_proposals, &proposals);
+
+	g_string_free (word, TRUE);
+	return g_list_reverse (proposals);
+}
+
+static GtkSourceCompletionWordsProposal *
+get_index_proposal (GtkSourceCompletionWordsLibrary *library,
+		    guint                            pos)
+{
+	const gchar *word = gtk_source_completion_words_index_get_word (library->priv->index, pos);
 	GtkSourceCompletionWordsProposal *proposal;
-	GSequenceIter *iter;
 
-	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library), NULL);
-	g_return_val_if_fail (word != NULL, NULL);
+	proposal = g_hash_table_lookup (library->priv->index_proposals, word);
+
+	if (proposal == NULL)
+	{
+		proposal = gtk_source_completion_words_proposal_new (word);
+		g_hash_table_insert (library->priv->index_proposals, (gpointer) word, proposal);
+	}
+
+	return proposal;
+}
 
-	if (len == -1)
+/* Merges the sorted @proposals of the trie with the words of the index, and
+ * returns the first @max_proposals. A word present in both is returned once.
+ */
+static GList *
+merge_index_proposals (GtkSourceCompletionWordsLibrary *library,
+		       GList                           *proposals,
+		       const gchar                     *prefix,
+		       gsize                            prefix_length,
+		       const gchar                     *after,
+		       guint                            max_proposals)
+{
+	GtkSourceCompletionWordsIndex *index = library->priv->index;
+	guint n_words = gtk_source_completion_words_index_get_n_words (index);
+	guint pos = gtk_source_completion_words_index_find (index, prefix, prefix_length, after);
+	const gchar *prev_index_word = NULL;
+	GList *merged = NULL;
+	GList *l = proposals;
+
+	while (max_proposals > 0)
 	{
-		len = strlen (word);
+		const gchar *index_word = NULL;
+		gint cmp;
+
+		if (pos < n_words)
+		{
+			index_word = gtk_source_completion_words_index_get_word (index, pos);
+
+			/* A corrupted word or a word out of order ends the
+			 * words of the index.
+			 */
+			if (index_word == NULL ||
+			    strncmp (index_word, prefix, prefix_length) != 0 ||
+			    (prev_index_word != NULL && strcmp (prev_index_word, index_word) >= 0))
+			{
+				index_word = NULL;
+			}
+		}
+
+		if (l == NULL && index_word == NULL)
+		{
+			break;
+		}
+
+		if (l == NULL)
+		{
+			cmp = 1;
+		}
+		else if (index_word == NULL)
+		{
+			cmp = -1;
+		}
+		else
+		{
+			cmp = strcmp (gtk_source_completion_words_proposal_get_word (l->data), index_word);
+		}
+
+		if (cmp <= 0)
+		{
+			merged = g_list_prepend (merged, l->data);
+			l = l->next;
+		}
+		else
+		{
+			merged = g_list_prepend (merged, get_index_proposal (library, pos));
+		}
+
+		if (cmp >= 0)
+		{
+			prev_index_word = index_word;
+			pos++;
+		}
+
+		max_proposals--;
 	}
 
-	proposal = gtk_source_completion_words_proposal_new (word);
+	g_list_free (proposals);
+	return g_list_reverse (merged);
+}
+
+/* Returns the proposals for the words having @prefix as prefix, in the sorted
+ * order. At most @max_proposals are returned. If @after is not %NULL, only the
+ * words greater than @after are returned, to continue a previous call, even if
+ * the library has been modified in the meantime.
+ *
+ * Returns: (transfer container): the proposals, owned by @library.
+ */
+GList *
+gtk_source_completion_words_library_get_proposals (GtkSourceCompletionWordsLibrary *library,
+						   const gchar                     *prefix,
+						   gint                             prefix_length,
+						   const gchar                     *after,
+						   guint                            max_proposals)
+{
+	GList *proposals;
 
-	iter = g_sequence_lookup (library->priv->store,
-				  proposal,
-				  (GCompareDataFunc)compare_prefix,
-				  GINT_TO_POINTER (len));
+	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library), NULL);
+	g_return_val_if_fail (prefix != NULL, NULL);
 
-	g_clear_object (&proposal);
+	if (prefix_length == -1)
+	{
+		prefix_length = strlen (prefix);
+	}
 
-	if (iter == NULL)
+	if (max_proposals == 0)
 	{
 		return NULL;
 	}
 
-	while (!g_sequence_iter_is_begin (iter))
+	proposals = get_trie_proposals (library, prefix, prefix_length, after, max_proposals);
+
+	if (library->priv->index != NULL)
+	{
+		proposals = merge_index_proposals (library,
+						   proposals,
+						   prefix,
+						   prefix_length,
+						   after,
+						   max_proposals);
+	}
+
+	return proposals;
+}
+
+static inline gboolean
+is_word_char (guchar c)
+{
+	return g_ascii_isalnum (c) || c >= 0x80;
+}
+
+/* Returns the score of @word for @query, or G_MININT if the characters of
+ * @query don't appear in the same order in @word. The ASCII letters are
+ * compared case insensitively. The characters are matched greedily, with
+ * bonuses for the start of the word, the word boundaries ("_", camelCase,
+ * digits) and the consecutive characters.
+ */
+static gint
+fuzzy_score (const gchar *query,
+	     gsize        query_length,
+	     const gchar *word,
+	     gsize        word_length)
+{
+	const gchar *q = query;
+	const gchar *query_end = query + query_length;
+	gsize nb_word_chars = 0;
+	gsize nb_matched_chars = 0;
+	gsize prev_match = G_MAXSIZE;
+	gint score = 0;
+	gsize i;
+
+	for (i = 0; i < word_length; i++)
 	{
-		GSequenceIter *prev = g_sequence_iter_prev (iter);
+		guchar c = word[i];
+		gsize char_length;
 
-		if (!iter_match_prefix (prev, word, len))
+		/* Continuation byte of a multi-byte character. */
+		if ((c & 0xc0) == 0x80)
 		{
-			break;
+			continue;
+		}
+
+		nb_word_chars++;
+
+		if (q == query_end)
+		{
+			continue;
 		}
 
-		iter = prev;
+		if (c < 0x80)
+		{
+			if (g_ascii_tolower (c) != g_ascii_tolower (*q))
+			{
+				continue;
+			}
+
+			char_length = 1;
+		}
+		else
+		{
+			char_length = g_utf8_skip[(guchar) *q];
+
+			if (i + char_length > word_length ||
+			    memcmp (word + i, q, char_length) != 0)
+			{
+				continue;
+			}
+		}
+
+		score += FUZZY_SCORE_MATCH;
+
+		if (c == (guchar) *q)
+		{
+			score += FUZZY_BONUS_CASE;
+		}
+
+		if (i == 0)
+		{
+			score += FUZZY_BONUS_START;
+		}
+		else
+		{
+			guchar prev_c = word[i - 1];
+
+			if (!is_word_char (prev_c) ||
+			    (g_ascii_isupper (c) && g_ascii_islower (prev_c)) ||
+			    (g_ascii_isdigit (c) && !g_ascii_isdigit (prev_c)))
+			{
+				score += FUZZY_BONUS_BOUNDARY;
+			}
+		}
+
+		if (prev_match != G_MAXSIZE && prev_match == i - 1)
+		{
+			score += FUZZY_BONUS_CONSECUTIVE;
+		}
+
+		prev_match = i + char_length - 1;
+		nb_matched_chars++;
+		q += char_length;
+	}
+
+	if (q != query_end)
+	{
+		return G_MININT;
 	}
 
-	return iter;
+	return score - (gint) MIN (nb_word_chars - nb_matched_chars, G_MAXINT / 2);
 }
 
-GSequenceIter *
-gtk_source_completion_words_library_find_next (GSequenceIter *iter,
-                                               const gchar   *word,
-                                               gint           len)
+/* Returns a positive value if @a is better than @b. */
+static gint
+compare_candidates (const FuzzyCandidate *a,
+		    const FuzzyCandidate *b)
 {
-	g_return_val_if_fail (iter != NULL, NULL);
-	g_return_val_if_fail (word != NULL, NULL);
+	if (a->score != b->score)
+	{
+		return a->score > b->score ? 1 : -1;
+	}
+
+	if (a->use_count != b->use_count)
+	{
+		return a->use_count > b->use_count ? 1 : -1;
+	}
 
-	iter = g_sequence_iter_next (iter);
+	return strcmp (b->word, a->word);
+}
 
-	if (!g_sequence_iter_is_end (iter) &&
-	    iter_match_prefix (iter, word, len))
+static void
+fuzzy_candidate_clear (FuzzyCandidate *candidate)
+{
+	g_free (candidate->word);
+}
+
+static void
+add_fuzzy_candidate (FuzzySearch *search,
+		     guint32      node,
+		     guint32      index_pos,
+		     gint         score,
+		     guint32      use_count,
+		     const gchar *word,
+		     gsize        word_length)
+{
+	FuzzyCandidate candidate;
+	guint min = 0;
+	guint max;
+
+	candidate.node = node;
+	candidate.index_pos = index_pos;
+	candidate.score = score;
+	candidate.use_count = use_count;
+	candidate.word = (gchar *) word;
+
+	max = search->candidates->len;
+
+	/* Not better than the last one. */
+	if (max == search->max_candidates &&
+	    compare_candidates (&candidate,
+				&g_array_index (search->candidates, FuzzyCandidate, max - 1)) <= 0)
 	{
-		return iter;
+		return;
 	}
 
-	return NULL;
+	while (min < max)
+	{
+		guint middle = (min + max) / 2;
+
+		if (compare_candidates (&candidate,
+					&g_array_index (search->candidates, FuzzyCandidate, middle)) > 0)
+		{
+			max = middle;
+		}
+		else
+		{
+			min = middle + 1;
+		}
+	}
+
+	candidate.word = g_strndup (word, word_length);
+	g_array_insert_val (search->candidates, min, candidate);
+
+	if (search->candidates->len > search->max_candidates)
+	{
+		g_array_remove_index (search->candidates, search->candidates->len - 1);
+	}
 }
 
-GSequenceIter *
-gtk_source_completion_words_library_find (GtkSourceCompletionWordsLibrary  *library,
-					  GtkSourceCompletionWordsProposal *proposal)
+/* @word is the text from the root to @index included. */
+static void
+collect_fuzzy_candidates (GtkSourceCompletionWordsLibrary *library,
+			  guint32                          index,
+			  GString                         *word,
+			  FuzzySearch                     *search)
 {
-	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library), NULL);
-	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_PROPOSAL (proposal), NULL);
+	TrieNode *node = get_node (library, index);
+	guint32 child;
+
+	if ((search->query_mask & ~node->mask) != 0 ||
+	    search->timed_out)
+	{
+		return;
+	}
+
+	if (search->deadline != 0 &&
+	    ++search->nb_visited_nodes % FUZZY_TIME_CHECK_INTERVAL == 0 &&
+	    g_get_monotonic_time () > search->deadline)
+	{
+		search->timed_out = TRUE;
+		return;
+	}
+
+	if (node->use_count > 0 && word->len >= search->query_length)
+	{
+		gint score = fuzzy_score (search->query, search->query_length, word->str, word->len);
+
+		if (score != G_MININT)
+		{
+			add_fuzzy_candidate (search, index, 0, score, node->use_count, word->str, word->len);
+		}
+	}
+
+	for (child = node->first_child;
+	     child != NO_NODE;
+	     child = get_node (library, child)->next_sibling)
+	{
+		TrieNode *child_node = get_node (library, child);
+		gsize length = word->len;
+
+		g_string_append_len (word, get_label (library, child_node), child_node->label_length);
+		collect_fuzzy_candidates (library, child, word, search);
+		g_string_truncate (word, length);
+	}
+}
+
+/* Returns the node of @word, or NO_NODE if @word is not in the trie. */
+static guint32
+lookup_word (GtkSourceCompletionWordsLibrary *library,
+	     const gchar                     *word,
+	     gsize                            length)
+{
+	guint32 index = ROOT_NODE;
+	gsize pos = 0;
+
+	while (pos < length)
+	{
+		TrieNode *node;
+
+		index = find_child (library, index, word[pos], NULL);
 
-	return g_sequence_lookup (library->priv->store,
-				  proposal,
-				  (GCompareDataFunc)compare_full,
-				  NULL);
+		if (index == NO_NODE)
+		{
+			return NO_NODE;
+		}
+
+		node = get_node (library, index);
+
+		if (node->label_length > length - pos ||
+		    memcmp (get_label (library, node), word + pos, node->label_length) != 0)
+		{
+			return NO_NODE;
+		}
+
+		pos += node->label_length;
+	}
+
+	return get_node (library, index)->use_count > 0 ? index : NO_NODE;
 }
 
+/* Scans the words of the index from @start to @end excluded. The words starting
+ * with @skip_char, case insensitively, are skipped if @skip_char is not '\0'.
+ * The words also in the trie are skipped, they have been scanned with the trie.
+ */
 static void
-on_proposal_unused (GtkSourceCompletionWordsProposal *proposal,
-                    GtkSourceCompletionWordsLibrary  *library)
+collect_fuzzy_index_candidates (GtkSourceCompletionWordsLibrary *library,
+				FuzzySearch                     *search,
+				guint                            start,
+				guint                            end,
+				gchar                            skip_char)
 {
-	GSequenceIter *iter = gtk_source_completion_words_library_find (library,
-	                                                                proposal);
+	GtkSourceCompletionWordsIndex *index = library->priv->index;
+	guint pos;
 
-	if (iter != NULL)
+	for (pos = start; pos < end && !search->timed_out; pos++)
 	{
-		g_sequence_remove (iter);
+		const gchar *word = gtk_source_completion_words_index_get_word (index, pos);
+		gsize length;
+		gint score;
+
+		if (word == NULL)
+		{
+			continue;
+		}
+
+		if (skip_char != '\0' &&
+		    g_ascii_tolower (word[0]) == g_ascii_tolower (skip_char))
+		{
+			continue;
+		}
+
+		if (search->deadline != 0 &&
+		    ++search->nb_visited_nodes % FUZZY_TIME_CHECK_INTERVAL == 0 &&
+		    g_get_monotonic_time () > search->deadline)
+		{
+			search->timed_out = TRUE;
+			return;
+		}
+
+		length = strlen (word);
+
+		if (length < search->query_length ||
+		    (search->query_mask & ~get_text_mask (word, length)) != 0)
+		{
+			continue;
+		}
+
+		score = fuzzy_score (search->query, search->query_length, word, length);
+
+		if (score != G_MININT &&
+		    lookup_word (library, word, length) == NO_NODE)
+		{
+			add_fuzzy_candidate (search,
+					     NO_NODE,
+					     pos,
+					     score,
+					     gtk_source_completion_words_index_get_frequency (index, pos),
+					     word,
+					     length);
+		}
 	}
 }
 
-GtkSourceCompletionWordsProposal *
+/* Returns the proposals for the words containing the characters of @query in
+ * the same order, e.g. "gbuf" matches "get_buffer" and "getBuffer". At most
+ * @max_proposals are returned, the best first: by score, then by number of
+ * occurrences, or by frequency for the words of the index. The words are all
+ * scanned, except the subtrees of the trie that don't contain all the
+ * characters of @query. If @time_budget is positive, the
+ * scan stops after @time_budget microseconds, and the best proposals found so
+ * far are returned.
+ *
+ * Returns: (transfer container): the proposals, owned by @library.
+ */
+GList *
+gtk_source_completion_words_library_get_fuzzy_proposals (GtkSourceCompletionWordsLibrary *library,
+							 const gchar                     *query,
+							 guint                            max_proposals,
+							 gint64                           time_budget)
+{
+	FuzzySearch search;
+	GString *word;
+	GList *proposals = NULL;
+	guint pass;
+	guint i;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library), NULL);
+	g_return_val_if_fail (query != NULL, NULL);
+
+	if (max_proposals == 0)
+	{
+		return NULL;
+	}
+
+	search.query = query;
+	search.query_length = strlen (query);
+	search.query_mask = get_text_mask (query, search.query_length);
+	search.candidates = g_array_new (FALSE, FALSE, sizeof (FuzzyCandidate));
+	g_array_set_clear_func (search.candidates, (GDestroyNotify) fuzzy_candidate_clear);
+	search.max_candidates = max_proposals;
+	search.deadline = time_budget > 0 ? g_get_monotonic_time () + time_budget : 0;
+	search.nb_visited_nodes = 0;
+	search.timed_out = FALSE;
+
+	word = g_string_new (NULL);
+
+	/* The words starting with the first character of @query have the best
+	 * scores, so they are scanned first in case the time budget is
+	 * exceeded.
+	 */
+	for (pass = 0; pass < 2; pass++)
+	{
+		guint32 child;
+
+		for (child = get_node (library, ROOT_NODE)->first_child;
+		     child != NO_NODE;
+		     child = get_node (library, child)->next_sibling)
+		{
+			TrieNode *child_node = get_node (library, child);
+			const gchar *label = get_label (library, child_node);
+			gboolean starts_query;
+
+			starts_query = (search.query_length > 0 &&
+					g_ascii_tolower (label[0]) == g_ascii_tolower (query[0]));
+
+			if (starts_query != (pass == 0))
+			{
+				continue;
+			}
+
+			g_string_append_len (word, label, child_node->label_length);
+			collect_fuzzy_candidates (library, child, word, &search);
+			g_string_truncate (word, 0);
+		}
+	}
+
+	g_string_free (word, TRUE);
+
+	/* The words of the index, with the same order of the passes. */
+	if (library->priv->index != NULL)
+	{
+		GtkSourceCompletionWordsIndex *index = library->priv->index;
+		gchar skip_char = '\0';
+
+		if (search.query_length > 0)
+		{
+			gchar first_chars[2];
+			guint n_first_chars = 1;
+
+			skip_char = query[0];
+			first_chars[0] = g_ascii_tolower (query[0]);
+			first_chars[1] = g_ascii_toupper (query[0]);
+
+			if (first_chars[1] != first_chars[0])
+			{
+				n_first_chars = 2;
+			}
+
+			for (i = 0; i < n_first_chars; i++)
+			{
+				gchar next_char = first_chars[i] + 1;
+
+				collect_fuzzy_index_candidates (library,
+								&search,
+								gtk_source_completion_words_index_find (index, &first_chars[i], 1, NULL),
+								gtk_source_completion_words_index_find (index, &next_char, 1, NULL),
+								'\0');
+			}
+		}
+
+		collect_fuzzy_index_candidates (library,
+						&search,
+						0,
+						gtk_source_completion_words_index_get_n_words (index),
+						skip_char);
+	}
+
+	for (i = search.candidates->len; i > 0; i--)
+	{
+		FuzzyCandidate *candidate = &g_array_index (search.candidates, FuzzyCandidate, i - 1);
+		GtkSourceCompletionWordsProposal *proposal;
+
+		if (candidate->node == NO_NODE)
+		{
+			proposal = get_index_proposal (library, candidate->index_pos);
+		}
+		else
+		{
+			TrieNode *node = get_node (library, candidate->node);
+
+			if (node->proposal == NULL)
+			{
+				node->proposal = gtk_source_completion_words_proposal_new (candidate->word);
+			}
+
+			proposal = node->proposal;
+		}
+
+		proposals = g_list_prepend (proposals, proposal);
+	}
+
+	g_array_free (search.candidates, TRUE);
+	return proposals;
+}
+
+static gboolean
+add_word_count (GtkSourceCompletionWordsLibrary *library,
+		const gchar                     *word,
+		guint32                          count)
+{
+	guint32 index = ROOT_NODE;
+	const gchar *p = word;
+	TrieNode *node;
+	guint32 mask;
+
+	mask = get_text_mask (word, strlen (word));
+
+	while (*p != '\0')
+	{
+		guint32 prev;
+		guint32 child;
+		const gchar *label;
+		guint32 label_length;
+		guint32 common;
+
+		get_node (library, index)->mask |= mask;
+
+		child = find_child (library, index, *p, &prev);
+
+		if (child == NO_NODE)
+		{
+			guint32 length = strlen (p);
+
+			if (library->priv->locked)
+			{
+				return FALSE;
+			}
+
+			child = new_node (library, add_label (library, p, length), length);
+			replace_child (library, index, prev, NO_NODE, child);
+
+			index = child;
+			break;
+		}
+
+		node = get_node (library, child);
+		label = get_label (library, node);
+		label_length = node->label_length;
+
+		/* The labels don't contain nul bytes, so it stops at the end of
+		 * @word.
+		 */
+		for (common = 1; common < label_length && label[common] == p[common]; common++)
+		{
+		}
+
+		if (common < label_length)
+		{
+			if (library->priv->locked)
+			{
+				return FALSE;
+			}
+
+			child = split_node (library, index, prev, child, common);
+		}
+
+		index = child;
+		p += common;
+	}
+
+	node = get_node (library, index);
+	node->mask |= mask;
+
+	if (node->use_count == 0 && library->priv->locked)
+	{
+		return FALSE;
+	}
+
+	node->use_count += count;
+	return TRUE;
+}
+
+/* Returns %FALSE if @word is not in the library and the library is locked. */
+gboolean
 gtk_source_completion_words_library_add_word (GtkSourceCompletionWordsLibrary *library,
                                               const gchar                     *word)
 {
-	GtkSourceCompletionWordsProposal *proposal;
-	GSequenceIter *iter;
+	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library), FALSE);
+	g_return_val_if_fail (word != NULL && word[0] != '\0', FALSE);
 
-	g_return_val_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library), NULL);
-	g_return_val_if_fail (word != NULL, NULL);
+	return add_word_count (library, word, 1);
+}
+
+/* Adds the words of @words, a hash table of words with their number of
+ * occurrences stored with GUINT_TO_POINTER(). The library must not be
+ * locked, so all the words are added.
+ */
+void
+gtk_source_completion_words_library_add_words (GtkSourceCompletionWordsLibrary *library,
+					       GHashTable                      *words)
+{
+	GHashTableIter iter;
+	gpointer word;
+	gpointer count;
+
+	g_return_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library));
+	g_return_if_fail (!library->priv->locked);
+
+	g_hash_table_iter_init (&iter, words);
+
+	while (g_hash_table_iter_next (&iter, &word, &count))
+	{
+		add_word_count (library, word, GPOINTER_TO_UINT (count));
+	}
+}
 
-	/* Check if word already exists */
-	proposal = gtk_source_completion_words_proposal_new (word);
+void
+gtk_source_completion_words_library_remove_word (GtkSourceCompletionWordsLibrary *library,
+                                                 const gchar                     *word)
+{
+	guint32 parent = NO_NODE;
+	guint32 prev = NO_NODE;
+	guint32 index = ROOT_NODE;
+	const gchar *p = word;
+	TrieNode *node;
 
-	iter = gtk_source_completion_words_library_find (library, proposal);
+	g_return_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library));
+	g_return_if_fail (word != NULL);
 
-	if (iter != NULL)
+	while (*p != '\0')
 	{
-		GtkSourceCompletionWordsProposal *iter_proposal;
+		guint32 child = find_child (library, index, *p, &prev);
+
+		if (child == NO_NODE)
+		{
+			return;
+		}
 
-		iter_proposal = gtk_source_completion_words_library_get_proposal (iter);
+		node = get_node (library, child);
 
-		/* Already exists, increase the use count */
-		gtk_source_completion_words_proposal_use (iter_proposal);
+		if (strncmp (get_label (library, node), p, node->label_length) != 0)
+		{
+			return;
+		}
 
-		g_object_unref (proposal);
-		return iter_proposal;
+		parent = index;
+		index = child;
+		p += node->label_length;
 	}
 
-	if (library->priv->locked)
+	node = get_node (library, index);
+
+	if (index == ROOT_NODE || node->use_count == 0)
 	{
-		g_object_unref (proposal);
-		return NULL;
+		return;
 	}
 
-	g_signal_connect (proposal,
-	                  "unused",
-	                  G_CALLBACK (on_proposal_unused),
-	                  library);
+	node->use_count--;
 
-	g_sequence_insert_sorted (library->priv->store,
-	                          proposal,
-	                          (GCompareDataFunc)compare_full,
-	                          NULL);
+	if (node->use_count > 0)
+	{
+		return;
+	}
 
-	return proposal;
+	g_clear_object (&node->proposal);
+
+	if (node->first_child == NO_NODE)
+	{
+		replace_child (library, parent, prev, index, NO_NODE);
+		free_node (library, index);
+
+		index = parent;
+		node = get_node (library, index);
+	}
+
+	if (index != ROOT_NODE &&
+	    node->use_count == 0 &&
+	    node->first_child != NO_NODE &&
+	    get_node (library, node->first_child)->next_sibling == NO_NODE)
+	{
+		merge_node (library, index);
+	}
+
+	if (library->priv->labels_garbage >= MIN_LABELS_GARBAGE &&
+	    library->priv->labels_garbage > library->priv->labels->len / 2)
+	{
+		compact_labels (library);
+	}
 }
 
+/* Attaches @index to @library, replacing the previous one, or detaches it if
+ * @index is %NULL. @library takes the ownership of @index.
+ */
 void
-gtk_source_completion_words_library_remove_word (GtkSourceCompletionWordsLibrary  *library,
-                                                 GtkSourceCompletionWordsProposal *proposal)
+gtk_source_completion_words_library_set_index (GtkSourceCompletionWordsLibrary *library,
+					       GtkSourceCompletionWordsIndex   *index)
 {
 	g_return_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_LIBRARY (library));
-	g_return_if_fail (GTK_SOURCE_IS_COMPLETION_WORDS_PROPOSAL (proposal));
 
-	gtk_source_completion_words_proposal_unuse (proposal);
+	if (library->priv->index == index)
+	{
+		return;
+	}
+
+	g_hash_table_remove_all (library->priv->index_proposals);
+	gtk_source_completion_words_index_free (library->priv->index);
+	library->priv->index = index;
 }
 
 void
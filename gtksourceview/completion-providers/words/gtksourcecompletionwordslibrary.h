@@ -23,6 +23,7 @@
 
 #include <glib-object.h>
 #include "gtksourcecompletionwordsproposal.h"
+#include "gtksourcecompletionwordsindex.h"
 
 G_BEGIN_DECLS
 
@@ -57,33 +58,35 @@ GtkSourceCompletionWordsLibrary *
 
 /* Finding */
 GTK_SOURCE_INTERNAL
-GSequenceIter	*gtk_source_completion_words_library_find 		(GtkSourceCompletionWordsLibrary  *library,
-									 GtkSourceCompletionWordsProposal *proposal);
+GList		*gtk_source_completion_words_library_get_proposals	(GtkSourceCompletionWordsLibrary  *library,
+									 const gchar                      *prefix,
+									 gint                              prefix_length,
+									 const gchar                      *after,
+									 guint                             max_proposals);
 
 GTK_SOURCE_INTERNAL
-GSequenceIter	*gtk_source_completion_words_library_find_first		(GtkSourceCompletionWordsLibrary  *library,
-									 const gchar                      *word,
-									 gint                              len);
+GList		*gtk_source_completion_words_library_get_fuzzy_proposals	(GtkSourceCompletionWordsLibrary  *library,
+									 const gchar                      *query,
+									 guint                             max_proposals,
+									 gint64                            time_budget);
 
+/* Adding/removing */
 GTK_SOURCE_INTERNAL
-GSequenceIter	*gtk_source_completion_words_library_find_next		(GSequenceIter                    *iter,
-									 const gchar                      *word,
-									 gint                              len);
+gboolean	 gtk_source_completion_words_library_add_word 		(GtkSourceCompletionWordsLibrary  *library,
+                                              				 const gchar                      *word);
 
-/* Getting */
 GTK_SOURCE_INTERNAL
-GtkSourceCompletionWordsProposal *
-		 gtk_source_completion_words_library_get_proposal 	(GSequenceIter                    *iter);
+void		 gtk_source_completion_words_library_add_words		(GtkSourceCompletionWordsLibrary  *library,
+									 GHashTable                       *words);
 
-/* Adding/removing */
 GTK_SOURCE_INTERNAL
-GtkSourceCompletionWordsProposal *
-		 gtk_source_completion_words_library_add_word 		(GtkSourceCompletionWordsLibrary  *library,
-                                              				 const gchar                      *word);
+void		 gtk_source_completion_words_library_remove_word 	(GtkSourceCompletionWordsLibrary  *library,
+                                                 			 const gchar                      *word);
 
+/* Index */
 GTK_SOURCE_INTERNAL
-void		 gtk_source_completion_words_library_remove_word 	(GtkSourceCompletionWordsLibrary  *library,
-                                                 			 GtkSourceCompletionWordsProposal *proposal);
+void		 gtk_source_completion_words_library_set_index		(GtkSourceCompletionWordsLibrary  *library,
+									 GtkSourceCompletionWordsIndex    *index);
 
 GTK_SOURCE_INTERNAL
 gboolean	 gtk_source_completion_words_library_is_locked 		(GtkSourceCompletionWordsLibrary  *library);
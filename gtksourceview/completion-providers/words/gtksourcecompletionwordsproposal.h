@@ -60,12 +60,6 @@ GtkSourceCompletionWordsProposal *
 GTK_SOURCE_INTERNAL
 const gchar 	*gtk_source_completion_words_proposal_get_word 	(GtkSourceCompletionWordsProposal *proposal);
 
-GTK_SOURCE_INTERNAL
-void		 gtk_source_completion_words_proposal_use 	(GtkSourceCompletionWordsProposal *proposal);
-
-GTK_SOURCE_INTERNAL
-void		 gtk_source_completion_words_proposal_unuse 	(GtkSourceCompletionWordsProposal *proposal);
-
 G_END_DECLS
 
 #endif /* GTK_SOURCE_COMPLETION_WORDS_PROPOSAL_H */
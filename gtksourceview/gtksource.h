@@ -33,6 +33,7 @@
 #include <gtksourceview/gtksourcefile.h>
 #include <gtksourceview/gtksourcefileloader.h>
 #include <gtksourceview/gtksourcefilesaver.h>
+#include <gtksourceview/gtksourcefilesearch.h>
 #include <gtksourceview/gtksourcegutter.h>
 #include <gtksourceview/gtksourcegutterrenderer.h>
 #include <gtksourceview/gtksourcegutterrenderertext.h>
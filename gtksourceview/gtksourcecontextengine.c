@@ -69,10 +69,10 @@
 /* Priority of long running idle which is used to analyze whole buffer, if
  * the engine wasn't quick enough to analyze it in one shot.
  */
-/* FIXME this priority is low, since we don't want to block other gui stuff.
- * But, e.g. if we have a big file, and scroll down, we do want the engine
- * to analyze quickly. Perhaps we want to reinstall first_update in case
- * of expose events or something.
+/* This priority is low, since we don't want to block other gui stuff.
+ * If we have a big file and scroll down, the visible area is analyzed
+ * by the first update instead, see analyze_viewport(), and the text
+ * around it goes first in the long running idle, see fill_around_viewport().
  */
 #define INCREMENTAL_UPDATE_PRIORITY	G_PRIORITY_LOW
 
@@ -86,6 +86,46 @@
  */
 #define MAX_TIME_FOR_ONE_LINE		2000
 
+/* If the visible area starts more than this many lines after the first
+ * invalid line, it's analyzed on its own, before the text above it,
+ * see analyze_viewport().
+ */
+#define VIEWPORT_ANALYSIS_MIN_DISTANCE	1000
+
+/* Once the visible area is analyzed, the idle worker analyzes this many
+ * lines above and below it, by batches, before going on with the text
+ * above it, see fill_around_viewport().
+ */
+#define VIEWPORT_FILL_MAX_LINES		10000
+#define VIEWPORT_FILL_BATCH_LINES	200
+
+/* Buffers with at least this many characters are analyzed by the long running
+ * idle in a worker thread, see start_background_analysis(). The first update
+ * after a change is still done in the main loop, since it must be quick.
+ * Set it to G_MAXINT to analyze everything in the main loop.
+ */
+#define BACKGROUND_ANALYSIS_MIN_CHARS	(1 << 20)
+
+/* Approximate amount of characters copied from the buffer and analyzed by
+ * one worker thread run. The worker can be interrupted at each line.
+ */
+#define BACKGROUND_ANALYSIS_BATCH_CHARS	(1 << 18)
+
+/* Segments and subpatterns are allocated this many at a time, see
+ * node_allocator_alloc().
+ */
+#define NODES_PER_SLAB			512
+
+/* Maximum approximate amount of characters copied from the buffer at once
+ * when analyzing lines in the main thread, see get_line_info().
+ */
+#define LINE_READER_CHUNK_CHARS		16384
+
+/* Character offsets in non-ASCII lines are remembered every this many
+ * bytes, see line_pos_to_offset(). Must be a power of two.
+ */
+#define CHAR_OFFSETS_STEP		64
+
 #define GTK_SOURCE_CONTEXT_ENGINE_ERROR (gtk_source_context_engine_error_quark ())
 
 #define HAS_OPTION(def,opt) (((def)->flags & GTK_SOURCE_CONTEXT_##opt) != 0)
@@ -130,8 +170,12 @@ typedef struct _ContextDefinition ContextDefinition;
 typedef struct _DefinitionChild DefinitionChild;
 typedef struct _DefinitionsIter DefinitionsIter;
 typedef struct _LineInfo LineInfo;
+typedef struct _LineReader LineReader;
 typedef struct _InvalidRegion InvalidRegion;
 typedef struct _ContextClassTag ContextClassTag;
+typedef struct _AnalysisJob AnalysisJob;
+typedef struct _NodeAllocator NodeAllocator;
+typedef struct _OffsetFixup OffsetFixup;
 
 typedef enum _GtkSourceContextEngineError {
 	GTK_SOURCE_CONTEXT_ENGINE_ERROR_DUPLICATED_ID = 0,
@@ -321,9 +365,12 @@ struct _Segment
 	/* Subpatterns found in this segment. */
 	SubPattern *sub_patterns;
 
-	/* The context is used in the interval [start_at; end_at). */
-	gint start_at;
-	gint end_at;
+	/* The context is used in the interval [start_at; end_at), these
+	 * are stored as described at offset_get(), use START_OF() and
+	 * END_OF() to read them.
+	 */
+	gint stored_start;
+	gint stored_end;
 
 	/* In case of container contexts, start_len/end_len is length in chars
 	 * of start/end match.
@@ -340,8 +387,9 @@ struct _Segment
 struct _SubPattern
 {
 	SubPatternDefinition *definition;
-	gint start_at;
-	gint end_at;
+	/* Same as in Segment. */
+	gint stored_start;
+	gint stored_end;
 	SubPattern *next;
 };
 
@@ -379,6 +427,32 @@ struct _LineInfo
 	/* Length of the line text not including line terminator. */
 	gint char_length;
 	gint byte_length;
+
+	/* Character offsets at every CHAR_OFFSETS_STEP'th byte, or NULL if
+	 * all characters are ASCII. */
+	const gint *char_offsets;
+};
+
+struct _LineReader
+{
+	GtkTextBuffer *buffer;
+
+	/* Text of whole lines in [start_at; end_at) copied from the buffer. */
+	gchar *text;
+	gint byte_length;
+	gint start_at;
+	gint end_at;
+
+	/* Byte index and character offset of the line after the last
+	 * one returned. */
+	gint pos;
+	gint pos_offset;
+
+	/* Approximate amount of characters of the next chunk. */
+	gint chunk_chars;
+
+	/* Memory for LineInfo.char_offsets, reused for every line. */
+	GArray *char_offsets;
 };
 
 struct _InvalidRegion
@@ -403,6 +477,70 @@ struct _ContextClassTag
 	gboolean enabled;
 };
 
+/* Free-list allocator of segments or subpatterns, in slabs. */
+struct _NodeAllocator
+{
+	gsize node_size;
+
+	/* Memory blocks of NODES_PER_SLAB nodes each. */
+	GSList *slabs;
+
+	/* Freed nodes, linked through their first pointer. */
+	gpointer free_nodes;
+
+	/* Number of nodes in use. */
+	guint n_nodes;
+};
+
+/* Text inserted or deleted, see fix_offsets_(). */
+struct _OffsetFixup
+{
+	/* Start of the change, and length of inserted text, or minus
+	 * length of deleted text.
+	 */
+	gint offset;
+	gint length;
+
+	/* Stored offsets which may need updating are in [lo; hi]. */
+	gint lo;
+	gint hi;
+
+	/* priv->tail_base before the change. */
+	gint old_tail_base;
+};
+
+/* A batch of lines analyzed in a worker thread. The worker only touches the
+ * syntax tree, the main loop doesn't touch the tree until the thread is
+ * joined in stop_background_analysis().
+ */
+struct _AnalysisJob
+{
+	/* NULL once the engine doesn't wait for the job anymore. */
+	GtkSourceContextEngine *ce;
+	GThread *thread;
+
+	/* Copy of the lines [start_at; end_at) taken when the job started,
+	 * tree offsets match buffer offsets at that moment.
+	 */
+	gchar *text;
+	gint byte_length;
+	gint start_at;
+	gint end_at;
+
+	/* End of the last analyzed line, set by the worker. */
+	gint analyzed_end;
+
+	/* Memory for LineInfo.char_offsets, used by the worker. */
+	GArray *char_offsets;
+
+	gint cancelled;
+
+	guint at_buffer_end : 1;
+
+	/* Whether highlighting a line took too much time. */
+	guint disabled : 1;
+};
+
 struct _GtkSourceContextData
 {
 	guint ref_count;
@@ -411,6 +549,14 @@ struct _GtkSourceContextData
 
 	/* Contains every ContextDefinition indexed by its id. */
 	GHashTable *definitions;
+
+	/* Definitions, their regexes and contexts are shared by all the
+	 * engines using this language, and GtkSourceRegex keeps the last
+	 * match. Analysis of a line and any change to contexts must happen
+	 * with this lock held, since a worker thread may be analyzing
+	 * another buffer.
+	 */
+	GRecMutex lock;
 };
 
 struct _GtkSourceContextEnginePrivate
@@ -450,21 +596,72 @@ struct _GtkSourceContextEnginePrivate
 	GSList *invalid;
 	InvalidRegion invalid_region;
 
+	/* Memory for segments (except the root one) and subpatterns. */
+	NodeAllocator segments;
+	NodeAllocator sub_patterns;
+
 	guint first_update;
 	guint incremental_update;
+
+	/* Batch analyzed in a worker thread, or NULL. */
+	AnalysisJob *job;
+
+	/* Visible area to be analyzed by the first update, if
+	 * viewport_pending is set. Once it's analyzed, the marks delimit
+	 * the text analyzed around it, which the idle worker extends while
+	 * viewport_fill_above or viewport_fill_below lines remain. */
+	GtkTextMark *viewport_start;
+	GtkTextMark *viewport_end;
+	gboolean viewport_pending;
+	gint viewport_fill_above;
+	gint viewport_fill_below;
+
+	/* Offset of the last change applied to the tree, and the tree
+	 * length plus one. See offset_get().
+	 */
+	gint gap;
+	gint tail_base;
 };
 
+/* Segments and subpatterns don't store offsets after priv->gap as they
+ * are: they store their distance from the end of the tree instead, as
+ * a negative number (priv->tail_base is one more than the tree length,
+ * so 0 is an absolute offset). Offsets not after the gap are stored as
+ * is. Inserting or deleting text at the gap then moves all the offsets
+ * after it at once by changing priv->tail_base, instead of walking the
+ * rest of the tree; only the offsets between the gap and a change
+ * elsewhere have to be converted, see fix_offsets_().
+ */
+static inline gint
+offset_get (GtkSourceContextEngine *ce,
+	    gint                    stored)
+{
+	return stored >= 0 ? stored : stored + ce->priv->tail_base;
+}
+
+static inline gint
+offset_store (GtkSourceContextEngine *ce,
+	      gint                    offset)
+{
+	return offset <= ce->priv->gap ? offset : offset - ce->priv->tail_base;
+}
+
+#define START_OF(ce,s) (offset_get ((ce), (s)->stored_start))
+#define END_OF(ce,s) (offset_get ((ce), (s)->stored_end))
+#define SET_START_OF(ce,s,offset) ((s)->stored_start = offset_store ((ce), (offset)))
+#define SET_END_OF(ce,s,offset) ((s)->stored_end = offset_store ((ce), (offset)))
+
 #ifdef ENABLE_CHECK_TREE
 static void check_tree (GtkSourceContextEngine *ce);
-static void check_segment_list (Segment *segment);
-static void check_segment_children (Segment *segment);
+static void check_segment_list (GtkSourceContextEngine *ce, Segment *segment);
+static void check_segment_children (GtkSourceContextEngine *ce, Segment *segment);
 #define CHECK_TREE check_tree
 #define CHECK_SEGMENT_LIST check_segment_list
 #define CHECK_SEGMENT_CHILDREN check_segment_children
 #else
 #define CHECK_TREE(ce)
-#define CHECK_SEGMENT_LIST(s)
-#define CHECK_SEGMENT_CHILDREN(s)
+#define CHECK_SEGMENT_LIST(ce,s)
+#define CHECK_SEGMENT_CHILDREN(ce,s)
 #endif
 
 static GQuark		gtk_source_context_engine_error_quark (void) G_GNUC_CONST;
@@ -497,7 +694,8 @@ static void		erase_segments		(GtkSourceContextEngine *ce,
 static void		segment_remove		(GtkSourceContextEngine *ce,
 						 Segment                *segment);
 
-static void		find_insertion_place	(Segment		*segment,
+static void		find_insertion_place	(GtkSourceContextEngine	*ce,
+						 Segment		*segment,
 						 gint			 offset,
 						 Segment	       **parent,
 						 Segment	       **prev,
@@ -508,7 +706,8 @@ static void		segment_destroy		(GtkSourceContextEngine	*ce,
 static ContextDefinition *context_definition_ref(ContextDefinition	*definition);
 static void		context_definition_unref(ContextDefinition	*definition);
 
-static void		segment_extend		(Segment		*state,
+static void		segment_extend		(GtkSourceContextEngine	*ce,
+						 Segment		*state,
 						 gint			 end_at);
 static Context	       *ancestor_context_ends_here (Context		*state,
 						 LineInfo		*line,
@@ -523,6 +722,13 @@ static void		update_syntax		(GtkSourceContextEngine	*ce,
 						 gint			 time);
 static void		install_idle_worker	(GtkSourceContextEngine	*ce);
 static void		install_first_update	(GtkSourceContextEngine	*ce);
+static gboolean		start_background_analysis (GtkSourceContextEngine *ce);
+static void		stop_background_analysis (GtkSourceContextEngine *ce,
+						 gboolean		 apply_results);
+static void		disable_syntax_analysis	(GtkSourceContextEngine	*ce);
+static void		analyze_viewport	(GtkSourceContextEngine	*ce);
+static void		fill_around_viewport	(GtkSourceContextEngine	*ce,
+						 gint			 time);
 
 static ContextDefinition *
 gtk_source_context_data_lookup (GtkSourceContextData *ctx_data,
@@ -831,11 +1037,11 @@ apply_tags (GtkSourceContextEngine *ce,
 	if (SEGMENT_IS_INVALID (segment))
 		return;
 
-	if (segment->start_at >= end_offset || segment->end_at <= start_offset)
+	if (START_OF (ce, segment) >= end_offset || END_OF (ce, segment) <= start_offset)
 		return;
 
-	start_offset = MAX (start_offset, segment->start_at);
-	end_offset = MIN (end_offset, segment->end_at);
+	start_offset = MAX (start_offset, START_OF (ce, segment));
+	end_offset = MIN (end_offset, END_OF (ce, segment));
 
 	tag = get_context_tag (ce, segment->context);
 
@@ -848,8 +1054,8 @@ apply_tags (GtkSourceContextEngine *ce,
 
 		if (HAS_OPTION (segment->context->definition, STYLE_INSIDE))
 		{
-			style_start_at = MAX (segment->start_at + segment->start_len, start_offset);
-			style_end_at = MIN (segment->end_at - segment->end_len, end_offset);
+			style_start_at = MAX (START_OF (ce, segment) + segment->start_len, start_offset);
+			style_end_at = MIN (END_OF (ce, segment) - segment->end_len, end_offset);
 		}
 
 		if (style_start_at > style_end_at)
@@ -867,10 +1073,10 @@ apply_tags (GtkSourceContextEngine *ce,
 
 	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
 	{
-		if (sp->start_at >= start_offset && sp->end_at <= end_offset)
+		if (START_OF (ce, sp) >= start_offset && END_OF (ce, sp) <= end_offset)
 		{
-			gint start = MAX (start_offset, sp->start_at);
-			gint end = MIN (end_offset, sp->end_at);
+			gint start = MAX (start_offset, START_OF (ce, sp));
+			gint end = MIN (end_offset, END_OF (ce, sp));
 
 			tag = get_subpattern_tag (ce, segment->context, sp->definition);
 
@@ -885,10 +1091,10 @@ apply_tags (GtkSourceContextEngine *ce,
 	}
 
 	for (child = segment->children;
-	     child != NULL && child->start_at < end_offset;
+	     child != NULL && START_OF (ce, child) < end_offset;
 	     child = child->next)
 	{
-		if (child->end_at > start_offset)
+		if (END_OF (ce, child) > start_offset)
 			apply_tags (ce, child, start_offset, end_offset);
 	}
 }
@@ -1102,13 +1308,13 @@ add_region_context_classes (GtkSourceContextEngine *ce,
 		return;
 	}
 
-	if (segment->start_at >= end_offset || segment->end_at <= start_offset)
+	if (START_OF (ce, segment) >= end_offset || END_OF (ce, segment) <= start_offset)
 	{
 		return;
 	}
 
-	start_offset = MAX (start_offset, segment->start_at);
-	end_offset = MIN (end_offset, segment->end_at);
+	start_offset = MAX (start_offset, START_OF (ce, segment));
+	end_offset = MIN (end_offset, END_OF (ce, segment));
 
 	context_classes = get_context_classes (ce, segment->context);
 
@@ -1122,10 +1328,10 @@ add_region_context_classes (GtkSourceContextEngine *ce,
 
 	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
 	{
-		if (sp->start_at >= start_offset && sp->end_at <= end_offset)
+		if (START_OF (ce, sp) >= start_offset && END_OF (ce, sp) <= end_offset)
 		{
-			gint start = MAX (start_offset, sp->start_at);
-			gint end = MIN (end_offset, sp->end_at);
+			gint start = MAX (start_offset, START_OF (ce, sp));
+			gint end = MIN (end_offset, END_OF (ce, sp));
 
 			context_classes = get_subpattern_context_classes (ce,
 			                                                  segment->context,
@@ -1142,10 +1348,10 @@ add_region_context_classes (GtkSourceContextEngine *ce,
 	}
 
 	for (child = segment->children;
-	     child != NULL && child->start_at < end_offset;
+	     child != NULL && START_OF (ce, child) < end_offset;
 	     child = child->next)
 	{
-		if (child->end_at > start_offset)
+		if (END_OF (ce, child) > start_offset)
 		{
 			add_region_context_classes (ce, child, start_offset, end_offset);
 		}
@@ -1258,28 +1464,30 @@ refresh_range (GtkSourceContextEngine *ce,
  * segment_cmp:
  * @s1: first segment.
  * @s2: second segment.
+ * @ce: the engine.
  *
  * Compares segments by their offset, used to sort list of invalid segments.
  *
  * Returns: an integer like strcmp() does.
  */
 static gint
-segment_cmp (Segment *s1,
-	     Segment *s2)
+segment_cmp (Segment                *s1,
+	     Segment                *s2,
+	     GtkSourceContextEngine *ce)
 {
-	if (s1->start_at < s2->start_at)
+	if (START_OF (ce, s1) < START_OF (ce, s2))
 		return -1;
-	else if (s1->start_at > s2->start_at)
+	else if (START_OF (ce, s1) > START_OF (ce, s2))
 		return 1;
 	/* one of them must be zero-length */
-	g_assert (s1->start_at == s1->end_at || s2->start_at == s2->end_at);
+	g_assert (START_OF (ce, s1) == END_OF (ce, s1) || START_OF (ce, s2) == END_OF (ce, s2));
 #ifdef ENABLE_DEBUG
 	/* A new zero-length segment should never be created if there is
 	 * already an invalid segment. */
 	g_assert_not_reached ();
 #endif
-	g_return_val_if_reached (s1->end_at < s2->end_at ? -1 :
-                                 (s1->end_at > s2->end_at ? 1 : 0));
+	g_return_val_if_reached (END_OF (ce, s1) < END_OF (ce, s2) ? -1 :
+                                 (END_OF (ce, s1) > END_OF (ce, s2) ? 1 : 0));
 }
 
 /**
@@ -1300,9 +1508,10 @@ add_invalid (GtkSourceContextEngine *ce,
 #endif
 	g_return_if_fail (SEGMENT_IS_INVALID (segment));
 
-	ce->priv->invalid = g_slist_insert_sorted (ce->priv->invalid,
-						   segment,
-						   (GCompareFunc) segment_cmp);
+	ce->priv->invalid = g_slist_insert_sorted_with_data (ce->priv->invalid,
+							     segment,
+							     (GCompareDataFunc) segment_cmp,
+							     ce);
 
 	DEBUG (g_print ("%d invalid\n", g_slist_length (ce->priv->invalid)));
 }
@@ -1327,37 +1536,154 @@ remove_invalid (GtkSourceContextEngine *ce,
 }
 
 /**
- * fix_offsets_insert_:
+ * fix_offset_delete_one_:
+ * @offset: segment.
+ * @start: start of deleted text.
+ * @length: length of deleted text.
+ *
+ * Returns: new offset depending on location of @offset
+ * relative to deleted text.
+ * Called only from offset_fixup_one_().
+ */
+static inline gint
+fix_offset_delete_one_ (gint offset,
+			gint start,
+			gint length)
+{
+	if (offset > start)
+	{
+		if (offset >= start + length)
+			offset -= length;
+		else
+			offset = start;
+	}
+
+	return offset;
+}
+
+static inline gint
+offset_fixup_get_ (const OffsetFixup *fixup,
+		   gint               stored)
+{
+	return stored >= 0 ? stored : stored + fixup->old_tail_base;
+}
+
+/**
+ * offset_fixup_one_:
+ * @ce: a #GtkSourceContextEngine.
+ * @fixup: the change.
+ * @stored: stored offset.
+ * @moves: whether the offset moves if it's at the insertion point.
+ *
+ * Returns: @stored updated for the change and the new gap.
+ * Called only from fix_offsets_().
+ */
+static inline gint
+offset_fixup_one_ (GtkSourceContextEngine *ce,
+		   const OffsetFixup      *fixup,
+		   gint                    stored,
+		   gboolean                moves)
+{
+	gint offset = offset_fixup_get_ (fixup, stored);
+
+	/* Offsets before the range are stored as is and stay the same,
+	 * offsets after it are relative to the end and move with it. */
+	if (offset < fixup->lo || offset > fixup->hi)
+		return stored;
+
+	if (fixup->length < 0)
+		offset = fix_offset_delete_one_ (offset, fixup->offset, -fixup->length);
+	else if (offset > fixup->offset || (offset == fixup->offset && moves))
+		offset += fixup->length;
+
+	return offset_store (ce, offset);
+}
+
+/**
+ * fix_offsets_:
+ * @ce: a #GtkSourceContextEngine.
  * @segment: segment.
- * @start: start offset.
- * @delta: length of inserted text.
+ * @hint: segment near the change, or %NULL.
+ * @side: for inserted text, whether @segment is before it (negative),
+ * contains it (zero) or is after it (positive).
+ * @fixup: the change.
  *
- * Recursively updates offsets after inserting text. To be called
- * only from insert_range().
+ * Recursively updates offsets in [@fixup->lo; @fixup->hi] after
+ * inserting or deleting text, and skips segments outside that range.
+ * @hint must be the segment which text is inserted into, or some
+ * segment near deleted text.
+ * To be called only from insert_range() and delete_range_().
  */
 static void
-fix_offsets_insert_ (Segment *segment,
-		     gint     start,
-		     gint     delta)
+fix_offsets_ (GtkSourceContextEngine *ce,
+	      Segment                *segment,
+	      Segment                *hint,
+	      gint                    side,
+	      const OffsetFixup      *fixup)
 {
 	Segment *child;
 	SubPattern *sp;
+	gint start = offset_fixup_get_ (fixup, segment->stored_start);
+	gint end = offset_fixup_get_ (fixup, segment->stored_end);
 
-	g_assert (segment->start_at >= start);
+	/* Segments containing inserted text grow, segments after
+	 * it move, subpatterns move only if they start after it. */
+	segment->stored_start = offset_fixup_one_ (ce, fixup, segment->stored_start, side > 0);
+	segment->stored_end = offset_fixup_one_ (ce, fixup, segment->stored_end, side >= 0);
 
-	if (delta == 0)
-		return;
+	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
+	{
+		sp->stored_start = offset_fixup_one_ (ce, fixup, sp->stored_start, side > 0);
+		sp->stored_end = offset_fixup_one_ (ce, fixup, sp->stored_end, side > 0);
+	}
 
-	segment->start_at += delta;
-	segment->end_at += delta;
+	child = hint;
+	while (child != NULL && child->parent != segment)
+		child = child->parent;
 
-	for (child = segment->children; child != NULL; child = child->next)
-		fix_offsets_insert_ (child, start, delta);
+	if (child != NULL)
+	{
+		Segment *tmp;
 
-	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
+		for (tmp = child->next; tmp != NULL; tmp = tmp->next)
+		{
+			if (offset_fixup_get_ (fixup, tmp->stored_start) > fixup->hi)
+				break;
+			if (offset_fixup_get_ (fixup, tmp->stored_end) >= fixup->lo)
+				fix_offsets_ (ce, tmp, NULL, side == 0 ? 1 : side, fixup);
+		}
+
+		for (tmp = child->prev; tmp != NULL; tmp = tmp->prev)
+		{
+			if (offset_fixup_get_ (fixup, tmp->stored_end) < fixup->lo)
+				break;
+			if (offset_fixup_get_ (fixup, tmp->stored_start) <= fixup->hi)
+				fix_offsets_ (ce, tmp, NULL, side == 0 ? -1 : side, fixup);
+		}
+
+		if (offset_fixup_get_ (fixup, child->stored_start) <= fixup->hi &&
+		    offset_fixup_get_ (fixup, child->stored_end) >= fixup->lo)
+			fix_offsets_ (ce, child, hint, side, fixup);
+	}
+	else if (start < fixup->lo && end <= fixup->hi)
+	{
+		for (child = segment->last_child; child != NULL; child = child->prev)
+		{
+			if (offset_fixup_get_ (fixup, child->stored_end) < fixup->lo)
+				break;
+			if (offset_fixup_get_ (fixup, child->stored_start) <= fixup->hi)
+				fix_offsets_ (ce, child, NULL, side, fixup);
+		}
+	}
+	else
 	{
-		sp->start_at += delta;
-		sp->end_at += delta;
+		for (child = segment->children; child != NULL; child = child->next)
+		{
+			if (offset_fixup_get_ (fixup, child->stored_start) > fixup->hi)
+				break;
+			if (offset_fixup_get_ (fixup, child->stored_end) >= fixup->lo)
+				fix_offsets_ (ce, child, NULL, side, fixup);
+		}
 	}
 }
 
@@ -1374,26 +1700,27 @@ fix_offsets_insert_ (Segment *segment,
  * Auxiliary function used in find_insertion_place().
  */
 static void
-find_insertion_place_forward_ (Segment  *segment,
-			       gint      offset,
-			       Segment  *start,
-			       Segment **parent,
-			       Segment **prev,
-			       Segment **next)
+find_insertion_place_forward_ (GtkSourceContextEngine  *ce,
+			       Segment                 *segment,
+			       gint                     offset,
+			       Segment                 *start,
+			       Segment                **parent,
+			       Segment                **prev,
+			       Segment                **next)
 {
 	Segment *child;
 
-	g_assert (start->end_at < offset);
+	g_assert (END_OF (ce, start) < offset);
 
 	for (child = start; child != NULL; child = child->next)
 	{
-		if (child->start_at <= offset && child->end_at >= offset)
+		if (START_OF (ce, child) <= offset && END_OF (ce, child) >= offset)
 		{
-			find_insertion_place (child, offset, parent, prev, next, NULL);
+			find_insertion_place (ce, child, offset, parent, prev, next, NULL);
 			return;
 		}
 
-		if (child->end_at == offset)
+		if (END_OF (ce, child) == offset)
 		{
 			if (SEGMENT_IS_INVALID (child))
 			{
@@ -1411,13 +1738,13 @@ find_insertion_place_forward_ (Segment  *segment,
 			return;
 		}
 
-		if (child->end_at < offset)
+		if (END_OF (ce, child) < offset)
 		{
 			*prev = child;
 			continue;
 		}
 
-		if (child->start_at > offset)
+		if (START_OF (ce, child) > offset)
 		{
 			*next = child;
 			break;
@@ -1442,26 +1769,27 @@ find_insertion_place_forward_ (Segment  *segment,
  * Auxiliary function used in find_insertion_place().
  */
 static void
-find_insertion_place_backward_ (Segment  *segment,
-				gint      offset,
-				Segment  *start,
-				Segment **parent,
-				Segment **prev,
-				Segment **next)
+find_insertion_place_backward_ (GtkSourceContextEngine  *ce,
+				Segment                 *segment,
+				gint                     offset,
+				Segment                 *start,
+				Segment                **parent,
+				Segment                **prev,
+				Segment                **next)
 {
 	Segment *child;
 
-	g_assert (start->end_at >= offset);
+	g_assert (END_OF (ce, start) >= offset);
 
 	for (child = start; child != NULL; child = child->prev)
 	{
-		if (child->start_at <= offset && child->end_at >= offset)
+		if (START_OF (ce, child) <= offset && END_OF (ce, child) >= offset)
 		{
-			find_insertion_place (child, offset, parent, prev, next, NULL);
+			find_insertion_place (ce, child, offset, parent, prev, next, NULL);
 			return;
 		}
 
-		if (child->end_at == offset)
+		if (END_OF (ce, child) == offset)
 		{
 			if (SEGMENT_IS_INVALID (child))
 			{
@@ -1479,14 +1807,14 @@ find_insertion_place_backward_ (Segment  *segment,
 			return;
 		}
 
-		if (child->end_at < offset)
+		if (END_OF (ce, child) < offset)
 		{
 			*prev = child;
 			*next = child->next;
 			break;
 		}
 
-		if (child->start_at > offset)
+		if (START_OF (ce, child) > offset)
 		{
 			*next = child;
 			continue;
@@ -1516,14 +1844,15 @@ find_insertion_place_backward_ (Segment  *segment,
  * There is no return value, it always succeeds (or crashes).
  */
 static void
-find_insertion_place (Segment  *segment,
-		      gint      offset,
-		      Segment **parent,
-		      Segment **prev,
-		      Segment **next,
-		      Segment  *hint)
+find_insertion_place (GtkSourceContextEngine  *ce,
+		      Segment                 *segment,
+		      gint                     offset,
+		      Segment                **parent,
+		      Segment                **prev,
+		      Segment                **next,
+		      Segment                 *hint)
 {
-	g_assert (segment->start_at <= offset && segment->end_at >= offset);
+	g_assert (START_OF (ce, segment) <= offset && END_OF (ce, segment) >= offset);
 
 	*prev = NULL;
 	*next = NULL;
@@ -1534,12 +1863,12 @@ find_insertion_place (Segment  *segment,
 		return;
 	}
 
-	if (segment->start_at == offset)
+	if (START_OF (ce, segment) == offset)
 	{
 #ifdef ENABLE_CHECK_TREE
 		g_assert (!segment->children ||
 			  !SEGMENT_IS_INVALID (segment->children) ||
-			  segment->children->start_at > offset);
+			  START_OF (ce, segment->children) > offset);
 #endif
 
 		*parent = segment;
@@ -1555,10 +1884,10 @@ find_insertion_place (Segment  *segment,
 	if (hint == NULL)
 		hint = segment->children;
 
-	if (hint->end_at < offset)
-		find_insertion_place_forward_ (segment, offset, hint, parent, prev, next);
+	if (END_OF (ce, hint) < offset)
+		find_insertion_place_forward_ (ce, segment, offset, hint, parent, prev, next);
 	else
-		find_insertion_place_backward_ (segment, offset, hint, parent, prev, next);
+		find_insertion_place_backward_ (ce, segment, offset, hint, parent, prev, next);
 }
 
 /**
@@ -1583,10 +1912,10 @@ get_invalid_at (GtkSourceContextEngine *ce,
 
 		link = link->next;
 
-		if (segment->start_at > offset)
+		if (START_OF (ce, segment) > offset)
 			break;
 
-		if (segment->end_at < offset)
+		if (END_OF (ce, segment) < offset)
 			continue;
 
 		return segment;
@@ -1595,6 +1924,158 @@ get_invalid_at (GtkSourceContextEngine *ce,
 	return NULL;
 }
 
+/**
+ * node_allocator_init:
+ * @allocator: #NodeAllocator.
+ * @node_size: size of the nodes, at least size of a pointer.
+ *
+ * Initializes an empty allocator.
+ */
+static void
+node_allocator_init (NodeAllocator *allocator,
+		     gsize          node_size)
+{
+	g_assert (node_size >= sizeof (gpointer));
+
+	allocator->node_size = node_size;
+	allocator->slabs = NULL;
+	allocator->free_nodes = NULL;
+	allocator->n_nodes = 0;
+}
+
+/**
+ * node_allocator_alloc:
+ * @allocator: #NodeAllocator.
+ *
+ * Segment trees of big buffers consist of millions of small nodes,
+ * allocating them in slabs makes them take less memory and keeps them
+ * closer to each other.
+ *
+ * Returns: new zero-filled node.
+ */
+static gpointer
+node_allocator_alloc (NodeAllocator *allocator)
+{
+	gpointer node;
+
+	if (allocator->free_nodes == NULL)
+	{
+		gchar *slab;
+		gint i;
+
+		slab = g_malloc (allocator->node_size * NODES_PER_SLAB);
+		allocator->slabs = g_slist_prepend (allocator->slabs, slab);
+
+		for (i = NODES_PER_SLAB - 1; i >= 0; i--)
+		{
+			node = slab + i * allocator->node_size;
+			*(gpointer *) node = allocator->free_nodes;
+			allocator->free_nodes = node;
+		}
+	}
+
+	node = allocator->free_nodes;
+	allocator->free_nodes = *(gpointer *) node;
+	allocator->n_nodes++;
+
+	memset (node, 0, allocator->node_size);
+	return node;
+}
+
+/**
+ * node_allocator_free:
+ * @allocator: #NodeAllocator.
+ * @node: a node allocated by node_allocator_alloc().
+ *
+ * Puts the node back into @allocator. The memory is not returned
+ * to the system until node_allocator_release() is called.
+ */
+static void
+node_allocator_free (NodeAllocator *allocator,
+		     gpointer       node)
+{
+	g_assert (allocator->n_nodes > 0);
+
+	*(gpointer *) node = allocator->free_nodes;
+	allocator->free_nodes = node;
+	allocator->n_nodes--;
+}
+
+/**
+ * node_allocator_release:
+ * @allocator: #NodeAllocator.
+ *
+ * Frees all memory at once, when all nodes have been freed, i.e. when
+ * the tree is destroyed or emptied.
+ */
+static void
+node_allocator_release (NodeAllocator *allocator)
+{
+	/* With ENABLE_DEBUG freed nodes are not reused, see segment_destroy(). */
+#ifndef ENABLE_DEBUG
+	g_return_if_fail (allocator->n_nodes == 0);
+#endif
+
+	g_slist_free_full (allocator->slabs, g_free);
+	allocator->slabs = NULL;
+	allocator->free_nodes = NULL;
+}
+
+#ifdef ENABLE_PROFILE
+/**
+ * print_memory_usage:
+ * @ce: the engine.
+ *
+ * Prints how much memory the syntax tree takes, to be called when
+ * the whole buffer is analyzed. Also prints how often the end regexes
+ * were found in the cache of _gtk_source_regex_resolve().
+ */
+static void
+print_memory_usage (GtkSourceContextEngine *ce)
+{
+	NodeAllocator *segments = &ce->priv->segments;
+	NodeAllocator *sub_patterns = &ce->priv->sub_patterns;
+	GHashTableIter iter;
+	ContextDefinition *definition;
+	guint hits = 0;
+	guint misses = 0;
+	gsize size;
+
+	size = (g_slist_length (segments->slabs) * segments->node_size +
+		g_slist_length (sub_patterns->slabs) * sub_patterns->node_size) *
+	       NODES_PER_SLAB;
+
+	g_print ("syntax tree: %u segments, %u subpatterns, %" G_GSIZE_FORMAT
+		 " bytes, %.1f bytes per line\n",
+		 segments->n_nodes,
+		 sub_patterns->n_nodes,
+		 size,
+		 (gdouble) size / gtk_text_buffer_get_line_count (ce->priv->buffer));
+
+	g_hash_table_iter_init (&iter, ce->priv->ctx_data->definitions);
+
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &definition))
+	{
+		guint def_hits;
+		guint def_misses;
+
+		if (definition->type != CONTEXT_TYPE_CONTAINER ||
+		    definition->u.start_end.end == NULL)
+		{
+			continue;
+		}
+
+		_gtk_source_regex_get_resolve_stats (definition->u.start_end.end,
+						     &def_hits,
+						     &def_misses);
+		hits += def_hits;
+		misses += def_misses;
+	}
+
+	g_print ("resolved end regexes: %u cache hits, %u compiled\n", hits, misses);
+}
+#endif
+
 /**
  * segment_add_subpattern:
  * @state: the segment.
@@ -1612,6 +2093,7 @@ segment_add_subpattern (Segment    *state,
 
 /**
  * sub_pattern_new:
+ * @ce: the engine.
  * @segment: the segment.
  * @start_at: start offset of the subpattern.
  * @end_at: end offset of the subpattern.
@@ -1623,16 +2105,17 @@ segment_add_subpattern (Segment    *state,
  * Returns: new subpattern.
  */
 static SubPattern *
-sub_pattern_new (Segment              *segment,
-		 gint                  start_at,
-		 gint                  end_at,
-		 SubPatternDefinition *sp_def)
+sub_pattern_new (GtkSourceContextEngine *ce,
+		 Segment                *segment,
+		 gint                    start_at,
+		 gint                    end_at,
+		 SubPatternDefinition   *sp_def)
 {
 	SubPattern *sp;
 
-	sp = g_slice_new (SubPattern);
-	sp->start_at = start_at;
-	sp->end_at = end_at;
+	sp = node_allocator_alloc (&ce->priv->sub_patterns);
+	SET_START_OF (ce, sp, start_at);
+	SET_END_OF (ce, sp, end_at);
 	sp->definition = sp_def;
 
 	segment_add_subpattern (segment, sp);
@@ -1642,17 +2125,19 @@ sub_pattern_new (Segment              *segment,
 
 /**
  * sub_pattern_free:
+ * @ce: the engine.
  * @sp: subppatern.
  *
- * Calls g_free on subpattern, was useful for debugging.
+ * Frees subpattern, was useful for debugging.
  */
 static inline void
-sub_pattern_free (SubPattern *sp)
+sub_pattern_free (GtkSourceContextEngine *ce,
+		  SubPattern             *sp)
 {
 #ifdef ENABLE_DEBUG
 	memset (sp, 1, sizeof (SubPattern));
 #else
-	g_slice_free (SubPattern, sp);
+	node_allocator_free (&ce->priv->sub_patterns, sp);
 #endif
 }
 
@@ -1678,7 +2163,7 @@ segment_make_invalid_ (GtkSourceContextEngine *ce,
 	while (sp != NULL)
 	{
 		SubPattern *next = sp->next;
-		sub_pattern_free (sp);
+		sub_pattern_free (ce, sp);
 		sp = next;
 	}
 
@@ -1710,14 +2195,14 @@ simple_segment_split_ (GtkSourceContextEngine *ce,
 {
 	SubPattern *sp;
 	Segment *new_segment, *invalid;
-	gint end_at = segment->end_at;
+	gint end_at = END_OF (ce, segment);
 
 	g_assert (SEGMENT_IS_SIMPLE (segment));
-	g_assert (segment->start_at < offset && offset < segment->end_at);
+	g_assert (START_OF (ce, segment) < offset && offset < END_OF (ce, segment));
 
 	sp = segment->sub_patterns;
 	segment->sub_patterns = NULL;
-	segment->end_at = offset;
+	SET_END_OF (ce, segment, offset);
 
 	invalid = create_segment (ce, segment->parent, NULL, offset, offset, FALSE, segment);
 	new_segment = create_segment (ce, segment->parent, segment->context, offset, end_at, FALSE, invalid);
@@ -1727,21 +2212,22 @@ simple_segment_split_ (GtkSourceContextEngine *ce,
 		Segment *append_to = NULL;
 		SubPattern *next = sp->next;
 
-		if (sp->end_at <= offset)
+		if (END_OF (ce, sp) <= offset)
 		{
 			append_to = segment;
 		}
-		else if (sp->start_at >= offset)
+		else if (START_OF (ce, sp) >= offset)
 		{
 			append_to = new_segment;
 		}
 		else
 		{
-			sub_pattern_new (new_segment,
+			sub_pattern_new (ce,
+					 new_segment,
 					 offset,
-					 sp->end_at,
+					 END_OF (ce, sp),
 					 sp->definition);
-			sp->end_at = offset;
+			SET_END_OF (ce, sp, offset);
 			append_to = segment;
 		}
 
@@ -1851,12 +2337,12 @@ insert_range (GtkSourceContextEngine *ce,
 	parent = get_invalid_at (ce, offset);
 
 	if (parent == NULL)
-		find_insertion_place (ce->priv->root_segment, offset,
+		find_insertion_place (ce, ce->priv->root_segment, offset,
 				      &parent, &prev, &next,
 				      ce->priv->hint);
 
-	g_assert (parent->start_at <= offset);
-	g_assert (parent->end_at >= offset);
+	g_assert (START_OF (ce, parent) <= offset);
+	g_assert (END_OF (ce, parent) >= offset);
 	g_assert (!prev || prev->parent == parent);
 	g_assert (!next || next->parent == parent);
 	g_assert (!prev || prev->next == next);
@@ -1877,7 +2363,7 @@ insert_range (GtkSourceContextEngine *ce,
 		 * if one of its ends is offset, then we just invalidate it;
 		 * otherwise, we split it into two, and insert zero-lentgh
 		 * invalid segment in the middle. */
-		if (parent->start_at < offset && parent->end_at > offset)
+		if (START_OF (ce, parent) < offset && END_OF (ce, parent) > offset)
 		{
 			segment = simple_segment_split_ (ce, parent, offset);
 		}
@@ -1913,28 +2399,21 @@ insert_range (GtkSourceContextEngine *ce,
 
 	if (length != 0)
 	{
-		/* now fix offsets in all the segments "to the right"
-		 * of segment. */
-		while (segment != NULL)
-		{
-			Segment *tmp;
-			SubPattern *sp;
-
-			for (tmp = segment->next; tmp != NULL; tmp = tmp->next)
-				fix_offsets_insert_ (tmp, offset, length);
+		OffsetFixup fixup;
 
-			segment->end_at += length;
+		/* Moving the gap to the end of inserted text moves everything
+		 * after it; only offsets between the old gap and @offset need
+		 * to be looked at. */
+		fixup.offset = offset;
+		fixup.length = length;
+		fixup.lo = MIN (offset, ce->priv->gap);
+		fixup.hi = MAX (offset, ce->priv->gap);
+		fixup.old_tail_base = ce->priv->tail_base;
 
-			for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
-			{
-				if (sp->start_at > offset)
-					sp->start_at += length;
-				if (sp->end_at > offset)
-					sp->end_at += length;
-			}
+		ce->priv->gap = offset + length;
+		ce->priv->tail_base += length;
 
-			segment = segment->parent;
-		}
+		fix_offsets_ (ce, ce->priv->root_segment, segment, 0, &fixup);
 	}
 
 	CHECK_TREE (ce);
@@ -1977,103 +2456,37 @@ gtk_source_context_engine_text_inserted (GtkSourceEngine *engine,
 }
 
 /**
- * fix_offset_delete_one_:
- * @offset: segment.
- * @start: start of deleted text.
- * @length: length of deleted text.
+ * delete_range_:
+ * @ce: a #GtkSourceContextEngine.
+ * @start: the start of deleted area.
+ * @end: the end of deleted area.
  *
- * Returns: new offset depending on location of @offset
- * relative to deleted text.
- * Called only from fix_offsets_delete_().
+ * Updates segment tree after deletion: removes segments at deleted
+ * interval, updates tree offsets, etc.
+ * It's called only from update_tree().
  */
-static inline gint
-fix_offset_delete_one_ (gint offset,
-			gint start,
-			gint length)
+static void
+delete_range_ (GtkSourceContextEngine *ce,
+	       gint                    start,
+	       gint                    end)
 {
-	if (offset > start)
-	{
-		if (offset >= start + length)
-			offset -= length;
-		else
-			offset = start;
-	}
+	OffsetFixup fixup;
 
-	return offset;
-}
+	g_return_if_fail (start < end);
 
-/**
- * fix_offsets_delete_:
- * @segment: segment.
- * @start: start offset.
- * @length: length of deleted text.
- * @hint: some segment somewhere near deleted text to optimize search.
- *
- * Recursively updates offsets after deleting text. To be called
- * only from delete_range_().
- */
-static void
-fix_offsets_delete_ (Segment *segment,
-		     gint     offset,
-		     gint     length,
-		     Segment *hint)
-{
-	Segment *child;
-	SubPattern *sp;
-
-	g_return_if_fail (segment->end_at > offset);
-
-	if (hint != NULL)
-		while (hint != NULL && hint->parent != segment)
-			hint = hint->parent;
-
-	if (hint == NULL)
-		hint = segment->children;
-
-	for (child = hint; child != NULL; child = child->next)
-	{
-		if (child->end_at <= offset)
-			continue;
-		fix_offsets_delete_ (child, offset, length, NULL);
-	}
-
-	for (child = hint ? hint->prev : NULL; child != NULL; child = child->prev)
-	{
-		if (child->end_at <= offset)
-			break;
-		fix_offsets_delete_ (child, offset, length, NULL);
-	}
-
-	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
-	{
-		sp->start_at = fix_offset_delete_one_ (sp->start_at, offset, length);
-		sp->end_at = fix_offset_delete_one_ (sp->end_at, offset, length);
-	}
+	/* FIXME adjacent invalid segments? */
+	erase_segments (ce, start, end, NULL);
 
-	segment->start_at = fix_offset_delete_one_ (segment->start_at, offset, length);
-	segment->end_at = fix_offset_delete_one_ (segment->end_at, offset, length);
-}
+	fixup.offset = start;
+	fixup.length = start - end;
+	fixup.lo = MIN (start, ce->priv->gap);
+	fixup.hi = MAX (end, ce->priv->gap);
+	fixup.old_tail_base = ce->priv->tail_base;
 
-/**
- * delete_range_:
- * @ce: a #GtkSourceContextEngine.
- * @start: the start of deleted area.
- * @end: the end of deleted area.
- *
- * Updates segment tree after deletion: removes segments at deleted
- * interval, updates tree offsets, etc.
- * It's called only from update_tree().
- */
-static void
-delete_range_ (GtkSourceContextEngine *ce,
-	       gint                    start,
-	       gint                    end)
-{
-	g_return_if_fail (start < end);
+	ce->priv->gap = start;
+	ce->priv->tail_base -= end - start;
 
-	/* FIXME adjacent invalid segments? */
-	erase_segments (ce, start, end, NULL);
-	fix_offsets_delete_ (ce->priv->root_segment, start, end - start, ce->priv->hint);
+	fix_offsets_ (ce, ce->priv->root_segment, ce->priv->hint, 0, &fixup);
 
 	/* no need to invalidate at start, update_tree will do it */
 
@@ -2141,7 +2554,7 @@ get_invalid_line (GtkSourceContextEngine *ce)
 	if (ce->priv->invalid)
 	{
 		Segment *segment = ce->priv->invalid->data;
-		offset = MIN (offset, segment->start_at);
+		offset = MIN (offset, START_OF (ce, segment));
 	}
 
 	if (offset == G_MAXINT)
@@ -2217,6 +2630,39 @@ update_tree (GtkSourceContextEngine *ce)
 #endif
 }
 
+/**
+ * range_is_analyzed:
+ * @ce: a #GtkSourceContextEngine.
+ * @start: start offset.
+ * @end: end offset.
+ *
+ * Returns: whether there are no invalid segments and no pending
+ * changes in the area.
+ */
+static gboolean
+range_is_analyzed (GtkSourceContextEngine *ce,
+		   gint                    start,
+		   gint                    end)
+{
+	GSList *l;
+
+	if (!ce->priv->invalid_region.empty)
+		return FALSE;
+
+	for (l = ce->priv->invalid; l != NULL; l = l->next)
+	{
+		Segment *segment = l->data;
+
+		if (START_OF (ce, segment) > end)
+			break;
+
+		if (END_OF (ce, segment) >= start)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 /**
  * gtk_source_context_engine_update_highlight:
  * @ce: a #GtkSourceContextEngine.
@@ -2243,6 +2689,12 @@ gtk_source_context_engine_update_highlight (GtkSourceEngine   *engine,
 	if (!ce->priv->highlight || ce->priv->disabled)
 		return;
 
+	/* The tree can't be looked at while a worker thread modifies it. */
+	stop_background_analysis (ce, TRUE);
+
+	if (ce->priv->disabled)
+		return;
+
 	invalid_line = get_invalid_line (ce);
 	end_line = gtk_text_iter_get_line (end);
 
@@ -2261,13 +2713,36 @@ gtk_source_context_engine_update_highlight (GtkSourceEngine   *engine,
 	}
 	else
 	{
-		if (gtk_text_iter_get_line (start) < invalid_line)
+		gint start_line = gtk_text_iter_get_line (start);
+
+		if (start_line < invalid_line)
 		{
 			GtkTextIter valid_end = *start;
 
 			gtk_text_iter_set_line (&valid_end, invalid_line);
 			ensure_highlighted (ce, start, &valid_end);
 		}
+		else if (start_line - invalid_line > VIEWPORT_ANALYSIS_MIN_DISTANCE)
+		{
+			/* Don't make the user wait until everything above
+			 * the visible area is analyzed. */
+			if (range_is_analyzed (ce,
+					       gtk_text_iter_get_offset (start),
+					       gtk_text_iter_get_offset (end)))
+			{
+				ensure_highlighted (ce, start, end);
+			}
+			else
+			{
+				gtk_text_buffer_move_mark (ce->priv->buffer,
+							   ce->priv->viewport_start,
+							   start);
+				gtk_text_buffer_move_mark (ce->priv->buffer,
+							   ce->priv->viewport_end,
+							   end);
+				ce->priv->viewport_pending = TRUE;
+			}
+		}
 
 		install_first_update (ce);
 	}
@@ -2291,6 +2766,11 @@ enable_highlight (GtkSourceContextEngine *ce,
 	if (!enable == !ce->priv->highlight)
 		return;
 
+	stop_background_analysis (ce, TRUE);
+
+	if (ce->priv->disabled)
+		return;
+
 	ce->priv->highlight = enable != 0;
 	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (ce->priv->buffer),
 				    &start, &end);
@@ -2345,12 +2825,27 @@ idle_worker (GtkSourceContextEngine *ce)
 
 	g_return_val_if_fail (ce->priv->buffer != NULL, G_SOURCE_REMOVE);
 
+	/* The text around the visible area goes first. */
+	if (ce->priv->viewport_fill_above > 0 || ce->priv->viewport_fill_below > 0)
+	{
+		fill_around_viewport (ce, INCREMENTAL_UPDATE_TIME_SLICE);
+		return G_SOURCE_CONTINUE;
+	}
+
+	/* The job reinstalls the idle when it's done. */
+	if (ce->priv->job != NULL || start_background_analysis (ce))
+	{
+		ce->priv->incremental_update = 0;
+		return G_SOURCE_REMOVE;
+	}
+
 	/* analyze batch of text */
 	update_syntax (ce, NULL, INCREMENTAL_UPDATE_TIME_SLICE);
 	CHECK_TREE (ce);
 
 	if (all_analyzed (ce))
 	{
+		PROFILE (print_memory_usage (ce));
 		ce->priv->incremental_update = 0;
 		retval = G_SOURCE_REMOVE;
 	}
@@ -2363,13 +2858,20 @@ idle_worker (GtkSourceContextEngine *ce)
  * @ce: a #GtkSourceContextEngine.
  *
  * Same as idle_worker, except: it runs once, and install idle_worker
- * if not everything was analyzed at once.
+ * if not everything was analyzed at once. It also analyzes the visible
+ * area first if update_highlight asked for it.
  */
 static gboolean
 first_update_callback (GtkSourceContextEngine *ce)
 {
 	g_return_val_if_fail (ce->priv->buffer != NULL, G_SOURCE_REMOVE);
 
+	/* visible area goes first */
+	analyze_viewport (ce);
+
+	if (ce->priv->disabled)
+		return G_SOURCE_REMOVE;
+
 	/* analyze batch of text */
 	update_syntax (ce, NULL, FIRST_UPDATE_TIME_SLICE);
 	CHECK_TREE (ce);
@@ -2514,6 +3016,8 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 	if (ce->priv->buffer == buffer)
 		return;
 
+	stop_background_analysis (ce, FALSE);
+
 	/* Detach previous buffer if there is one. */
 	if (ce->priv->buffer != NULL)
 	{
@@ -2528,10 +3032,14 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 		ce->priv->first_update = 0;
 		ce->priv->incremental_update = 0;
 
+		g_rec_mutex_lock (&ce->priv->ctx_data->lock);
 		if (ce->priv->root_segment != NULL)
 			segment_destroy (ce, ce->priv->root_segment);
 		if (ce->priv->root_context != NULL)
 			context_unref (ce->priv->root_context);
+		g_rec_mutex_unlock (&ce->priv->ctx_data->lock);
+		node_allocator_release (&ce->priv->segments);
+		node_allocator_release (&ce->priv->sub_patterns);
 		g_assert (!ce->priv->invalid);
 		g_slist_free (ce->priv->invalid);
 		ce->priv->root_segment = NULL;
@@ -2547,6 +3055,14 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 		ce->priv->invalid_region.start = NULL;
 		ce->priv->invalid_region.end = NULL;
 
+		gtk_text_buffer_delete_mark (ce->priv->buffer, ce->priv->viewport_start);
+		gtk_text_buffer_delete_mark (ce->priv->buffer, ce->priv->viewport_end);
+		ce->priv->viewport_start = NULL;
+		ce->priv->viewport_end = NULL;
+		ce->priv->viewport_pending = FALSE;
+		ce->priv->viewport_fill_above = 0;
+		ce->priv->viewport_fill_below = 0;
+
 		/* this deletes tags from the tag table, therefore there is no need
 		 * in removing tags from the text (it may be very slow).
 		 * FIXME: don't we want to just destroy and forget everything when
@@ -2574,8 +3090,12 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 		 * never happen, _gtk_source_context_data_finish_parse checks main context. */
 		g_assert (main_definition != NULL);
 
+		g_rec_mutex_lock (&ce->priv->ctx_data->lock);
 		ce->priv->root_context = context_new (NULL, main_definition, NULL, NULL, FALSE);
+		ce->priv->gap = 0;
+		ce->priv->tail_base = 1;
 		ce->priv->root_segment = create_segment (ce, NULL, ce->priv->root_context, 0, 0, TRUE, NULL);
+		g_rec_mutex_unlock (&ce->priv->ctx_data->lock);
 
 		ce->priv->tags = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 		ce->priv->context_classes = NULL;
@@ -2585,6 +3105,10 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 									      &start, TRUE);
 		ce->priv->invalid_region.end = gtk_text_buffer_create_mark (buffer, NULL,
 									    &end, FALSE);
+		ce->priv->viewport_start = gtk_text_buffer_create_mark (buffer, NULL,
+									&start, TRUE);
+		ce->priv->viewport_end = gtk_text_buffer_create_mark (buffer, NULL,
+								      &end, FALSE);
 
 		if (gtk_text_buffer_get_char_count (buffer) != 0)
 		{
@@ -2724,6 +3248,9 @@ static void
 _gtk_source_context_engine_init (GtkSourceContextEngine *ce)
 {
 	ce->priv = _gtk_source_context_engine_get_instance_private (ce);
+
+	node_allocator_init (&ce->priv->segments, sizeof (Segment));
+	node_allocator_init (&ce->priv->sub_patterns, sizeof (SubPattern));
 }
 
 GtkSourceContextEngine *
@@ -2759,6 +3286,7 @@ _gtk_source_context_data_new (GtkSourceLanguage *lang)
 	ctx_data->lang = lang;
 	ctx_data->definitions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
 						       (GDestroyNotify) context_definition_unref);
+	g_rec_mutex_init (&ctx_data->lock);
 
 	return ctx_data;
 }
@@ -2790,12 +3318,51 @@ _gtk_source_context_data_unref (GtkSourceContextData *ctx_data)
 		    ctx_data->lang->priv->ctx_data == ctx_data)
 			ctx_data->lang->priv->ctx_data = NULL;
 		g_hash_table_destroy (ctx_data->definitions);
+		g_rec_mutex_clear (&ctx_data->lock);
 		g_slice_free (GtkSourceContextData, ctx_data);
 	}
 }
 
 /* SYNTAX TREE ------------------------------------------------------------ */
 
+/**
+ * line_pos_to_offset:
+ * @line: the line.
+ * @pos: byte index of a character in @line.
+ *
+ * Converts a position in the line to character offset in the buffer.
+ * It's called for every match, so for non-ASCII lines it counts
+ * characters from the nearest remembered offset instead of from the
+ * beginning of the line.
+ *
+ * Returns: the offset of @pos in the buffer.
+ */
+static gint
+line_pos_to_offset (LineInfo *line,
+		    gint      pos)
+{
+	if (line->char_offsets != NULL)
+	{
+		gint offset;
+		gint i;
+
+		if (pos >= line->byte_length)
+			return line->start_at + line->char_length;
+
+		offset = line->char_offsets[pos / CHAR_OFFSETS_STEP];
+
+		for (i = pos & ~(CHAR_OFFSETS_STEP - 1); i < pos; i++)
+		{
+			if (((guchar) line->text[i] & 0xC0) != 0x80)
+				offset++;
+		}
+
+		pos = offset;
+	}
+
+	return line->start_at + pos;
+}
+
 /**
  * apply_sub_patterns:
  * @contextstate: a #Context.
@@ -2809,37 +3376,40 @@ _gtk_source_context_data_unref (GtkSourceContextData *ctx_data)
  * Applies sub patterns of kind @where to the matched text.
  */
 static void
-apply_sub_patterns (Segment         *state,
-		    LineInfo        *line,
-		    GtkSourceRegex  *regex,
-		    SubPatternWhere  where)
+apply_sub_patterns (GtkSourceContextEngine *ce,
+		    Segment                *state,
+		    LineInfo               *line,
+		    GtkSourceRegex         *regex,
+		    SubPatternWhere         where)
 {
 	GSList *sub_pattern_list = state->context->definition->sub_patterns;
 
 	if (SEGMENT_IS_CONTAINER (state))
 	{
-		gint start_pos;
-		gint end_pos;
+		gint start_at;
+		gint end_at;
 
-		_gtk_source_regex_fetch_pos (regex, line->text, 0, &start_pos, &end_pos);
+		_gtk_source_regex_fetch_pos_bytes (regex, 0, &start_at, &end_at);
+		start_at = line_pos_to_offset (line, start_at);
+		end_at = line_pos_to_offset (line, end_at);
 
 		if (where == SUB_PATTERN_WHERE_START)
 		{
-			if (line->start_at + start_pos != state->start_at)
+			if (start_at != START_OF (ce, state))
 				g_critical ("%s: oops", G_STRLOC);
-			else if (line->start_at + end_pos > state->end_at)
+			else if (end_at > END_OF (ce, state))
 				g_critical ("%s: oops", G_STRLOC);
 			else
-				state->start_len = line->start_at + end_pos - state->start_at;
+				state->start_len = end_at - START_OF (ce, state);
 		}
 		else
 		{
-			if (line->start_at + start_pos < state->start_at)
+			if (start_at < START_OF (ce, state))
 				g_critical ("%s: oops", G_STRLOC);
-			else if (line->start_at + end_pos != state->end_at)
+			else if (end_at != END_OF (ce, state))
 				g_critical ("%s: oops", G_STRLOC);
 			else
-				state->end_len = state->end_at - line->start_at - start_pos;
+				state->end_len = END_OF (ce, state) - start_at;
 		}
 	}
 
@@ -2854,26 +3424,25 @@ apply_sub_patterns (Segment         *state,
 
 			if (sp_def->is_named)
 			{
-				_gtk_source_regex_fetch_named_pos (regex,
-								   line->text,
-								   sp_def->u.name,
-								   &start_pos,
-								   &end_pos);
+				_gtk_source_regex_fetch_named_pos_bytes (regex,
+									 sp_def->u.name,
+									 &start_pos,
+									 &end_pos);
 			}
 			else
 			{
-				_gtk_source_regex_fetch_pos (regex,
-							     line->text,
-							     sp_def->u.num,
-							     &start_pos,
-							     &end_pos);
+				_gtk_source_regex_fetch_pos_bytes (regex,
+								   sp_def->u.num,
+								   &start_pos,
+								   &end_pos);
 			}
 
 			if (start_pos >= 0 && start_pos != end_pos)
 			{
-				sub_pattern_new (state,
-						 line->start_at + start_pos,
-						 line->start_at + end_pos,
+				sub_pattern_new (ce,
+						 state,
+						 line_pos_to_offset (line, start_pos),
+						 line_pos_to_offset (line, end_pos),
 						 sp_def);
 			}
 		}
@@ -2956,15 +3525,6 @@ can_apply_match (Context        *state,
 	return TRUE;
 }
 
-static gint
-line_pos_to_offset (LineInfo *line,
-		    gint      pos)
-{
-	if (line->char_length != line->byte_length)
-		pos = g_utf8_pointer_to_offset (line->text, line->text + pos);
-	return line->start_at + pos;
-}
-
 /**
  * apply_match:
  * @state: the current state of the parser.
@@ -2984,19 +3544,20 @@ line_pos_to_offset (LineInfo *line,
  * Returns: %TRUE if the match can be applied.
  */
 static gboolean
-apply_match (Segment         *state,
-	     LineInfo        *line,
-	     gint            *line_pos,
-	     GtkSourceRegex  *regex,
-	     SubPatternWhere  where)
+apply_match (GtkSourceContextEngine *ce,
+	     Segment                *state,
+	     LineInfo               *line,
+	     gint                   *line_pos,
+	     GtkSourceRegex         *regex,
+	     SubPatternWhere         where)
 {
 	gint match_end;
 
 	if (!can_apply_match (state->context, line, *line_pos, &match_end, regex))
 		return FALSE;
 
-	segment_extend (state, line_pos_to_offset (line, match_end));
-	apply_sub_patterns (state, line, regex, where);
+	segment_extend (ce, state, line_pos_to_offset (line, match_end));
+	apply_sub_patterns (ce, state, line, regex, where);
 	*line_pos = match_end;
 
 	return TRUE;
@@ -3563,11 +4124,18 @@ segment_new (GtkSourceContextEngine *ce,
 	g_assert (!is_start || context != NULL);
 #endif
 
-	segment = g_slice_new0 (Segment);
+	/* The root segment lives as long as the buffer is attached,
+	 * and it's not counted so that the slabs can be released
+	 * together with the rest of the tree. */
+	if (parent != NULL)
+		segment = node_allocator_alloc (&ce->priv->segments);
+	else
+		segment = g_slice_new0 (Segment);
+
 	segment->parent = parent;
 	segment->context = context_ref (context);
-	segment->start_at = start_at;
-	segment->end_at = end_at;
+	SET_START_OF (ce, segment, start_at);
+	SET_END_OF (ce, segment, end_at);
 	segment->is_start = is_start;
 
 	if (context == NULL)
@@ -3577,19 +4145,20 @@ segment_new (GtkSourceContextEngine *ce,
 }
 
 static void
-find_segment_position_forward_ (Segment  *segment,
-				gint      start_at,
-				gint      end_at,
-				Segment **prev,
-				Segment **next)
+find_segment_position_forward_ (GtkSourceContextEngine  *ce,
+				Segment                 *segment,
+				gint                     start_at,
+				gint                     end_at,
+				Segment                **prev,
+				Segment                **next)
 {
-	g_assert (segment->start_at <= start_at);
+	g_assert (START_OF (ce, segment) <= start_at);
 
 	while (segment != NULL)
 	{
-		if (segment->end_at == start_at)
+		if (END_OF (ce, segment) == start_at)
 		{
-			while (segment->next != NULL && segment->next->start_at == start_at)
+			while (segment->next != NULL && START_OF (ce, segment->next) == start_at)
 				segment = segment->next;
 
 			*prev = segment;
@@ -3598,20 +4167,20 @@ find_segment_position_forward_ (Segment  *segment,
 			break;
 		}
 
-		if (segment->start_at == end_at)
+		if (START_OF (ce, segment) == end_at)
 		{
 			*next = segment;
 			*prev = segment->prev;
 			break;
 		}
 
-		if (segment->start_at > end_at)
+		if (START_OF (ce, segment) > end_at)
 		{
 			*next = segment;
 			break;
 		}
 
-		if (segment->end_at < start_at)
+		if (END_OF (ce, segment) < start_at)
 			*prev = segment;
 
 		segment = segment->next;
@@ -3619,23 +4188,24 @@ find_segment_position_forward_ (Segment  *segment,
 }
 
 static void
-find_segment_position_backward_ (Segment  *segment,
-				 gint      start_at,
-				 gint      end_at,
-				 Segment **prev,
-				 Segment **next)
+find_segment_position_backward_ (GtkSourceContextEngine  *ce,
+				 Segment                 *segment,
+				 gint                     start_at,
+				 gint                     end_at,
+				 Segment                **prev,
+				 Segment                **next)
 {
-	g_assert (start_at < segment->end_at);
+	g_assert (start_at < END_OF (ce, segment));
 
 	while (segment != NULL)
 	{
-		if (segment->end_at <= start_at)
+		if (END_OF (ce, segment) <= start_at)
 		{
 			*prev = segment;
 			break;
 		}
 
-		g_assert (segment->start_at >= end_at);
+		g_assert (START_OF (ce, segment) >= end_at);
 
 		*next = segment;
 		segment = segment->prev;
@@ -3656,16 +4226,17 @@ find_segment_position_backward_ (Segment  *segment,
  * parent->children list.
  */
 static void
-find_segment_position (Segment  *parent,
-		       Segment  *hint,
-		       gint      start_at,
-		       gint      end_at,
-		       Segment **prev,
-		       Segment **next)
+find_segment_position (GtkSourceContextEngine  *ce,
+		       Segment                 *parent,
+		       Segment                 *hint,
+		       gint                     start_at,
+		       gint                     end_at,
+		       Segment                **prev,
+		       Segment                **next)
 {
 	Segment *tmp;
 
-	g_assert (parent->start_at <= start_at && end_at <= parent->end_at);
+	g_assert (START_OF (ce, parent) <= start_at && end_at <= END_OF (ce, parent));
 	g_assert (!hint || hint->parent == parent);
 
 	*prev = *next = NULL;
@@ -3677,7 +4248,7 @@ find_segment_position (Segment  *parent,
 	{
 		tmp = parent->children;
 
-		if (start_at >= tmp->end_at)
+		if (start_at >= END_OF (ce, tmp))
 			*prev = tmp;
 		else
 			*next = tmp;
@@ -3688,10 +4259,10 @@ find_segment_position (Segment  *parent,
 	if (hint == NULL)
 		hint = parent->children;
 
-	if (hint->end_at <= start_at)
-		find_segment_position_forward_ (hint, start_at, end_at, prev, next);
+	if (END_OF (ce, hint) <= start_at)
+		find_segment_position_forward_ (ce, hint, start_at, end_at, prev, next);
 	else
-		find_segment_position_backward_ (hint, start_at, end_at, prev, next);
+		find_segment_position_backward_ (ce, hint, start_at, end_at, prev, next);
 }
 
 /**
@@ -3719,7 +4290,7 @@ create_segment (GtkSourceContextEngine *ce,
 {
 	Segment *segment;
 
-	g_assert (!parent || (parent->start_at <= start_at && end_at <= parent->end_at));
+	g_assert (!parent || (START_OF (ce, parent) <= start_at && end_at <= END_OF (ce, parent)));
 
 	segment = segment_new (ce, parent, context, start_at, end_at, is_start);
 
@@ -3734,7 +4305,7 @@ create_segment (GtkSourceContextEngine *ce,
 				hint = hint->parent;
 		}
 
-		find_segment_position (parent, hint,
+		find_segment_position (ce, parent, hint,
 				       start_at, end_at,
 				       &prev, &next);
 
@@ -3756,7 +4327,7 @@ create_segment (GtkSourceContextEngine *ce,
 		else
 			parent->children = segment;
 
-		CHECK_SEGMENT_LIST (parent);
+		CHECK_SEGMENT_LIST (ce, parent);
 		CHECK_TREE (ce);
 	}
 
@@ -3771,15 +4342,16 @@ create_segment (GtkSourceContextEngine *ce,
  * Updates end offset in the segment and its ancestors.
  */
 static void
-segment_extend (Segment *state,
-		gint     end_at)
+segment_extend (GtkSourceContextEngine *ce,
+		Segment                *state,
+		gint                    end_at)
 {
-	while (state != NULL && state->end_at < end_at)
+	while (state != NULL && END_OF (ce, state) < end_at)
 	{
-		state->end_at = end_at;
+		SET_END_OF (ce, state, end_at);
 		state = state->parent;
 	}
-	CHECK_SEGMENT_LIST (state->parent);
+	CHECK_SEGMENT_LIST (ce, state->parent);
 }
 
 static void
@@ -3808,7 +4380,7 @@ segment_destroy_children (GtkSourceContextEngine *ce,
 	while (sp != NULL)
 	{
 		SubPattern *next = sp->next;
-		sub_pattern_free (sp);
+		sub_pattern_free (ce, sp);
 		sp = next;
 	}
 }
@@ -3847,7 +4419,10 @@ segment_destroy (GtkSourceContextEngine *ce,
 	g_assert (!g_slist_find (ce->priv->invalid, segment));
 	memset (segment, 1, sizeof (Segment));
 #else
-	g_slice_free (Segment, segment);
+	if (segment->parent != NULL)
+		node_allocator_free (&ce->priv->segments, segment);
+	else
+		g_slice_free (Segment, segment);
 #endif
 }
 
@@ -3894,7 +4469,7 @@ container_context_starts_here (GtkSourceContextEngine  *ce,
 
 	g_assert (match_end <= line->byte_length);
 
-        segment_extend (state, line_pos_to_offset (line, match_end));
+        segment_extend (ce, state, line_pos_to_offset (line, match_end));
         new_segment = create_segment (ce, state, new_context,
 				      line_pos_to_offset (line, *line_pos),
 				      line_pos_to_offset (line, match_end),
@@ -3910,14 +4485,14 @@ container_context_starts_here (GtkSourceContextEngine  *ce,
 	if (*line_pos == match_end &&
 	    new_segment->prev != NULL &&
 	    new_segment->prev->context == new_segment->context &&
-	    new_segment->prev->start_at == new_segment->prev->end_at &&
-	    new_segment->prev->start_at == line_pos_to_offset (line, *line_pos))
+	    START_OF (ce, new_segment->prev) == END_OF (ce, new_segment->prev) &&
+	    START_OF (ce, new_segment->prev) == line_pos_to_offset (line, *line_pos))
 	{
 		segment_remove (ce, new_segment);
 		return FALSE;
 	}
 
-	apply_sub_patterns (new_segment, line,
+	apply_sub_patterns (ce, new_segment, line,
 			    definition->u.start_end.start,
 			    SUB_PATTERN_WHERE_START);
 	*line_pos = match_end;
@@ -3973,14 +4548,14 @@ simple_context_starts_here (GtkSourceContextEngine *ce,
 	 * so on). */
 	if (*line_pos == match_end &&
 	    (!CONTEXT_ENDS_PARENT (new_context) ||
-		line_pos_to_offset (line, *line_pos) == state->start_at))
+		line_pos_to_offset (line, *line_pos) == START_OF (ce, state)))
 	{
 		context_unref (new_context);
 		return FALSE;
 	}
 
 	g_assert (match_end <= line->byte_length);
-	segment_extend (state, line_pos_to_offset (line, match_end));
+	segment_extend (ce, state, line_pos_to_offset (line, match_end));
 
 	if (*line_pos != match_end)
 	{
@@ -3991,7 +4566,7 @@ simple_context_starts_here (GtkSourceContextEngine *ce,
 					      line_pos_to_offset (line, match_end),
 					      TRUE,
 					      ce->priv->hint2);
-		apply_sub_patterns (new_segment, line, definition->u.match, SUB_PATTERN_WHERE_DEFAULT);
+		apply_sub_patterns (ce, new_segment, line, definition->u.match, SUB_PATTERN_WHERE_DEFAULT);
 		ce->priv->hint2 = new_segment;
 	}
 
@@ -4235,7 +4810,7 @@ next_segment (GtkSourceContextEngine  *ce,
 		    ancestor_ends_here (state, line, pos, new_state))
 		{
 			g_assert (pos <= line->byte_length);
-			segment_extend (state, line_pos_to_offset (line, pos));
+			segment_extend (ce, state, line_pos_to_offset (line, pos));
 			*line_pos = pos;
 			return TRUE;
 		}
@@ -4302,7 +4877,7 @@ next_segment (GtkSourceContextEngine  *ce,
 			 * Still, it may happen that parent context ends in
 			 * the middle of the end regex match, apply_match()
 			 * checks this. */
-			if (apply_match (state, line, &pos, state->context->end, SUB_PATTERN_WHERE_END))
+			if (apply_match (ce, state, line, &pos, state->context->end, SUB_PATTERN_WHERE_END))
 			{
 				g_assert (pos <= line->byte_length);
 
@@ -4376,7 +4951,7 @@ delete_zero_length_segments (GtkSourceContextEngine *ce,
 	{
 		Segment *s = list->data;
 
-		if (s->start_at == s->end_at)
+		if (START_OF (ce, s) == END_OF (ce, s))
 		{
 			GList *l;
 
@@ -4439,7 +5014,8 @@ delete_zero_length_segments (GtkSourceContextEngine *ce,
  *
  * Finds contexts at the line and updates the syntax tree on it.
  *
- * Returns: starting state at the next line.
+ * Returns: starting state at the next line, or %NULL if it took too
+ * much time, in which case the syntax analysis must be disabled.
  */
 static Segment *
 analyze_line (GtkSourceContextEngine *ce,
@@ -4449,6 +5025,7 @@ analyze_line (GtkSourceContextEngine *ce,
 	gint line_pos = 0;
 	GList *end_segments = NULL;
 	GTimer *timer;
+	gboolean timed_out = FALSE;
 
 	g_assert (SEGMENT_IS_CONTAINER (state));
 
@@ -4471,7 +5048,7 @@ analyze_line (GtkSourceContextEngine *ce,
 			g_critical ("%s",
 			            _("Highlighting a single line took too much time, "
 				      "syntax highlighting will be disabled"));
-			disable_syntax_analysis (ce);
+			timed_out = TRUE;
 			break;
 		}
 
@@ -4489,16 +5066,19 @@ analyze_line (GtkSourceContextEngine *ce,
 		 * into infinite loop in that case. */
 		/* state may be extended later, so not all elements of new_segments
 		 * really have zero length */
-		if (state->start_at == line->char_length)
+		if (START_OF (ce, state) == line->char_length)
 			end_segments = g_list_prepend (end_segments, state);
 	}
 
 	g_timer_destroy (timer);
-	if (ce->priv->disabled)
+	if (timed_out)
+	{
+		g_list_free (end_segments);
 		return NULL;
+	}
 
 	/* Extend current state to the end of line. */
-	segment_extend (state, line->start_at + line->char_length);
+	segment_extend (ce, state, line->start_at + line->char_length);
 	g_assert (line_pos <= line->byte_length);
 
 	/* Verify if we need to close the context because we are at
@@ -4511,7 +5091,7 @@ analyze_line (GtkSourceContextEngine *ce,
 
 	/* Extend the segment to the beginning of next line. */
 	g_assert (SEGMENT_IS_CONTAINER (state));
-	segment_extend (state, NEXT_LINE_OFFSET (line));
+	segment_extend (ce, state, NEXT_LINE_OFFSET (line));
 
 	/* if it's the last line, don't bother with zero length segments */
 	if (!line->eol_length)
@@ -4525,62 +5105,193 @@ analyze_line (GtkSourceContextEngine *ce,
 }
 
 /**
- * get_line_info:
+ * line_info_from_text:
+ * @line: #LineInfo structure to be filled.
+ * @text: text starting at the beginning of a line.
+ * @length: length of @text in bytes.
+ * @start_at: character offset of the line in text buffer.
+ * @char_offsets: array of #gint to store @line char_offsets.
+ *
+ * Finds line terminator and fills @line structure, in one pass over the
+ * text. Line terminators are the same as in #GtkTextBuffer: \n, \r,
+ * \r\n and U+2029 PARAGRAPH SEPARATOR. @line does not own the text,
+ * and its char_offsets are only valid until @char_offsets is used for
+ * another line.
+ *
+ * Returns: the length of the line in bytes, including line terminator.
+ */
+static gint
+line_info_from_text (LineInfo    *line,
+		     const gchar *text,
+		     gint         length,
+		     gint         start_at,
+		     GArray      *char_offsets)
+{
+	gint n_chars = 0;
+	gint i;
+
+	g_array_set_size (char_offsets, 0);
+
+	for (i = 0; i < length; i++)
+	{
+		guchar c = text[i];
+
+		if ((i & (CHAR_OFFSETS_STEP - 1)) == 0)
+			g_array_append_val (char_offsets, n_chars);
+
+		if (c == '\n' || c == '\r')
+			break;
+
+		if (c == 0xE2 && i + 2 < length &&
+		    (guchar) text[i + 1] == 0x80 &&
+		    (guchar) text[i + 2] == 0xA9)
+			break;
+
+		if ((c & 0xC0) != 0x80)
+			n_chars++;
+	}
+
+	line->text = (gchar *) text;
+	line->start_at = start_at;
+	line->byte_length = i;
+	line->char_length = n_chars;
+	line->char_offsets = n_chars != i ? (const gint *) char_offsets->data : NULL;
+
+	if (i == length)
+	{
+		line->eol_length = 0;
+		return i;
+	}
+
+	line->eol_length = 1;
+
+	if (text[i] == '\r' && i + 1 < length && text[i + 1] == '\n')
+	{
+		line->eol_length = 2;
+		return i + 2;
+	}
+	else if (text[i] == '\n' || text[i] == '\r')
+	{
+		return i + 1;
+	}
+	else
+	{
+		return i + 3;
+	}
+}
+
+/**
+ * line_reader_init:
+ * @reader: #LineReader.
  * @buffer: #GtkTextBuffer.
+ * @expected_chars: amount of characters expected to be analyzed.
+ *
+ * Initializes @reader. The buffer must not be modified while
+ * it's used. The first chunk copied from the buffer is limited to
+ * @expected_chars, so that after a keystroke only the changed line
+ * is copied, and the next chunks double in size up to
+ * LINE_READER_CHUNK_CHARS.
+ */
+static void
+line_reader_init (LineReader    *reader,
+		  GtkTextBuffer *buffer,
+		  gint           expected_chars)
+{
+	reader->buffer = buffer;
+	reader->text = NULL;
+	reader->byte_length = 0;
+	reader->start_at = 0;
+	reader->end_at = 0;
+	reader->pos = 0;
+	reader->pos_offset = 0;
+	reader->chunk_chars = CLAMP (expected_chars, 1, LINE_READER_CHUNK_CHARS);
+	reader->char_offsets = g_array_new (FALSE, FALSE, sizeof (gint));
+}
+
+/**
+ * line_reader_destroy:
+ * @reader: #LineReader.
+ *
+ * Frees memory allocated by @reader.
+ */
+static void
+line_reader_destroy (LineReader *reader)
+{
+	g_free (reader->text);
+	g_array_free (reader->char_offsets, TRUE);
+}
+
+/**
+ * get_line_info:
+ * @reader: #LineReader.
  * @line_start: iterator pointing to the beginning of line.
  * @line_end: iterator pointing to the beginning of next line or to the end
- * of this line if it's the last line in @buffer.
+ * of this line if it's the last line in the buffer.
  * @line: #LineInfo structure to be filled.
  *
  * Retrieves line text from the buffer, finds line terminator and fills
- * @line structure.
+ * @line structure. Text is copied from the buffer in chunks of many lines,
+ * so consecutive lines don't need to be copied one by one. @line is valid
+ * until the next call.
  */
 static void
-get_line_info (GtkTextBuffer     *buffer,
+get_line_info (LineReader        *reader,
 	       const GtkTextIter *line_start,
 	       const GtkTextIter *line_end,
 	       LineInfo          *line)
 {
+	gint offset;
+
 	g_assert (!gtk_text_iter_equal (line_start, line_end));
 
-	line->text = gtk_text_buffer_get_slice (buffer, line_start, line_end, TRUE);
-	line->start_at = gtk_text_iter_get_offset (line_start);
+	offset = gtk_text_iter_get_offset (line_start);
 
-	if (!gtk_text_iter_starts_line (line_end))
-	{
-		line->eol_length = 0;
-		line->char_length = g_utf8_strlen (line->text, -1);
-		line->byte_length = strlen (line->text);
-	}
-	else
+	if (offset < reader->start_at || offset >= reader->end_at)
 	{
-		gint eol_index, next_line_index;
+		GtkTextIter chunk_end = *line_start;
 
-		pango_find_paragraph_boundary (line->text, -1,
-					       &eol_index,
-					       &next_line_index);
+		/* Whole lines, and at least this one. */
+		gtk_text_iter_forward_chars (&chunk_end, reader->chunk_chars);
+		if (gtk_text_iter_compare (&chunk_end, line_end) < 0)
+			chunk_end = *line_end;
+		else if (!gtk_text_iter_starts_line (&chunk_end))
+			gtk_text_iter_forward_line (&chunk_end);
 
-		g_assert (eol_index < next_line_index);
+		reader->chunk_chars = MIN (reader->chunk_chars * 2, LINE_READER_CHUNK_CHARS);
 
-		line->char_length = g_utf8_strlen (line->text, eol_index);
-		line->eol_length = g_utf8_strlen (line->text + eol_index, -1);
-		line->byte_length = eol_index;
+		g_free (reader->text);
+		reader->text = gtk_text_buffer_get_slice (reader->buffer,
+							  line_start,
+							  &chunk_end,
+							  TRUE);
+		reader->byte_length = strlen (reader->text);
+		reader->start_at = offset;
+		reader->end_at = gtk_text_iter_get_offset (&chunk_end);
+		reader->pos = 0;
+		reader->pos_offset = offset;
 	}
+	else if (offset > reader->pos_offset)
+	{
+		const gchar *p = reader->text + reader->pos;
 
-	g_assert (gtk_text_iter_get_offset (line_end) ==
-			line->start_at + line->char_length + line->eol_length);
-}
+		reader->pos += g_utf8_offset_to_pointer (p, offset - reader->pos_offset) - p;
+		reader->pos_offset = offset;
+	}
+	else if (offset < reader->pos_offset)
+	{
+		reader->pos = g_utf8_offset_to_pointer (reader->text,
+							offset - reader->start_at) - reader->text;
+		reader->pos_offset = offset;
+	}
 
-/**
- * line_info_destroy:
- * @line: #LineInfo.
- *
- * Destroys data allocated by get_line_info().
- */
-static void
-line_info_destroy (LineInfo *line)
-{
-	g_free (line->text);
+	reader->pos += line_info_from_text (line,
+					    reader->text + reader->pos,
+					    reader->byte_length - reader->pos,
+					    offset,
+					    reader->char_offsets);
+	reader->pos_offset = NEXT_LINE_OFFSET (line);
+
+	g_assert (gtk_text_iter_get_offset (line_end) == reader->pos_offset);
 }
 
 /**
@@ -4596,31 +5307,36 @@ segment_tree_zero_len (GtkSourceContextEngine *ce)
 {
 	Segment *root = ce->priv->root_segment;
 	segment_destroy_children (ce, root);
-	root->start_at = root->end_at = 0;
+	node_allocator_release (&ce->priv->segments);
+	node_allocator_release (&ce->priv->sub_patterns);
+	ce->priv->gap = 0;
+	ce->priv->tail_base = 1;
+	root->stored_start = root->stored_end = 0;
 	CHECK_TREE (ce);
 }
 
 #ifdef ENABLE_CHECK_TREE
 static Segment *
-get_segment_at_offset_slow_ (Segment *segment,
-			     gint     offset)
+get_segment_at_offset_slow_ (GtkSourceContextEngine *ce,
+			     Segment                *segment,
+			     gint                    offset)
 {
 	Segment *child;
 
 start:
-	if (segment->parent == NULL && offset == segment->end_at)
+	if (segment->parent == NULL && offset == END_OF (ce, segment))
 		return segment;
 
-	if (segment->start_at > offset)
+	if (START_OF (ce, segment) > offset)
 	{
 		g_assert (segment->parent != NULL);
 		segment = segment->parent;
 		goto start;
 	}
 
-	if (segment->start_at == offset)
+	if (START_OF (ce, segment) == offset)
 	{
-		if (segment->children != NULL && segment->children->start_at == offset)
+		if (segment->children != NULL && START_OF (ce, segment->children) == offset)
 		{
 			segment = segment->children;
 			goto start;
@@ -4629,11 +5345,11 @@ start:
 		return segment;
 	}
 
-        if (segment->end_at <= offset && segment->parent != NULL)
+        if (END_OF (ce, segment) <= offset && segment->parent != NULL)
 	{
 		if (segment->next != NULL)
 		{
-			if (segment->next->start_at > offset)
+			if (START_OF (ce, segment->next) > offset)
 				return segment->parent;
 
 			segment = segment->next;
@@ -4648,16 +5364,16 @@ start:
 
 	for (child = segment->children; child != NULL; child = child->next)
 	{
-		if (child->start_at == offset)
+		if (START_OF (ce, child) == offset)
 		{
 			segment = child;
 			goto start;
 		}
 
-		if (child->end_at <= offset)
+		if (END_OF (ce, child) <= offset)
 			continue;
 
-		if (child->start_at > offset)
+		if (START_OF (ce, child) > offset)
 			break;
 
 		segment = child;
@@ -4668,16 +5384,17 @@ start:
 }
 #endif /* ENABLE_CHECK_TREE */
 
-#define SEGMENT_IS_ZERO_LEN_AT(s,o) ((s)->start_at == (o) && (s)->end_at == (o))
-#define SEGMENT_CONTAINS(s,o) ((s)->start_at <= (o) && (s)->end_at > (o))
-#define SEGMENT_DISTANCE(s,o) (MIN (ABS ((s)->start_at - (o)), ABS ((s)->end_at - (o))))
+#define SEGMENT_IS_ZERO_LEN_AT(s,o) (START_OF (ce, (s)) == (o) && END_OF (ce, (s)) == (o))
+#define SEGMENT_CONTAINS(s,o) (START_OF (ce, (s)) <= (o) && END_OF (ce, (s)) > (o))
+#define SEGMENT_DISTANCE(s,o) (MIN (ABS (START_OF (ce, (s)) - (o)), ABS (END_OF (ce, (s)) - (o))))
 static Segment *
-get_segment_in_ (Segment *segment,
-		 gint     offset)
+get_segment_in_ (GtkSourceContextEngine *ce,
+		 Segment                *segment,
+		 gint                    offset)
 {
 	Segment *child;
 
-	g_assert (segment->start_at <= offset && segment->end_at > offset);
+	g_assert (START_OF (ce, segment) <= offset && END_OF (ce, segment) > offset);
 
 	if (segment->children == NULL)
 		return segment;
@@ -4688,26 +5405,26 @@ get_segment_in_ (Segment *segment,
 			return segment->children;
 
 		if (SEGMENT_CONTAINS (segment->children, offset))
-			return get_segment_in_ (segment->children, offset);
+			return get_segment_in_ (ce, segment->children, offset);
 
 		return segment;
 	}
 
-	if (segment->children->start_at > offset || segment->last_child->end_at < offset)
+	if (START_OF (ce, segment->children) > offset || END_OF (ce, segment->last_child) < offset)
 		return segment;
 
 	if (SEGMENT_DISTANCE (segment->children, offset) >= SEGMENT_DISTANCE (segment->last_child, offset))
 	{
 		for (child = segment->children; child; child = child->next)
 		{
-			if (child->start_at > offset)
+			if (START_OF (ce, child) > offset)
 				return segment;
 
 			if (SEGMENT_IS_ZERO_LEN_AT (child, offset))
 				return child;
 
 			if (SEGMENT_CONTAINS (child, offset))
-				return get_segment_in_ (child, offset);
+				return get_segment_in_ (ce, child, offset);
 		}
 	}
 	else
@@ -4721,11 +5438,11 @@ get_segment_in_ (Segment *segment,
 				return child;
 			}
 
-			if (child->end_at <= offset)
+			if (END_OF (ce, child) <= offset)
 				return segment;
 
 			if (SEGMENT_CONTAINS (child, offset))
-				return get_segment_in_ (child, offset);
+				return get_segment_in_ (ce, child, offset);
 		}
 	}
 
@@ -4734,22 +5451,23 @@ get_segment_in_ (Segment *segment,
 
 /* assumes zero-length segments can't have children */
 static Segment *
-get_segment_ (Segment *segment,
-	      gint     offset)
+get_segment_ (GtkSourceContextEngine *ce,
+	      Segment                *segment,
+	      gint                    offset)
 {
 	if (segment->parent != NULL)
 	{
 		if (!SEGMENT_CONTAINS (segment->parent, offset))
-			return get_segment_ (segment->parent, offset);
+			return get_segment_ (ce, segment->parent, offset);
 	}
 	else
 	{
-		g_assert (offset >= segment->start_at);
-		g_assert (offset <= segment->end_at);
+		g_assert (offset >= START_OF (ce, segment));
+		g_assert (offset <= END_OF (ce, segment));
 	}
 
 	if (SEGMENT_CONTAINS (segment, offset))
-		return get_segment_in_ (segment, offset);
+		return get_segment_in_ (ce, segment, offset);
 
 	if (SEGMENT_IS_ZERO_LEN_AT (segment, offset))
 	{
@@ -4758,20 +5476,20 @@ get_segment_ (Segment *segment,
 		return segment;
 	}
 
-	if (offset < segment->start_at)
+	if (offset < START_OF (ce, segment))
 	{
-		while (segment->prev != NULL && segment->prev->start_at > offset)
+		while (segment->prev != NULL && START_OF (ce, segment->prev) > offset)
 			segment = segment->prev;
 
-		g_assert (!segment->prev || segment->prev->start_at <= offset);
+		g_assert (!segment->prev || START_OF (ce, segment->prev) <= offset);
 
 		if (segment->prev == NULL)
 			return segment->parent;
 
-		if (segment->prev->end_at > offset)
-			return get_segment_in_ (segment->prev, offset);
+		if (END_OF (ce, segment->prev) > offset)
+			return get_segment_in_ (ce, segment->prev, offset);
 
-		if (segment->prev->end_at == offset)
+		if (END_OF (ce, segment->prev) == offset)
 		{
 			if (SEGMENT_IS_ZERO_LEN_AT (segment->prev, offset))
 			{
@@ -4784,21 +5502,21 @@ get_segment_ (Segment *segment,
 			return segment->parent;
 		}
 
-		/* segment->prev->end_at < offset */
+		/* segment->prev ends before offset */
 		return segment->parent;
 	}
 
-	/* offset >= segment->end_at, not zero-length */
+	/* offset is at or after the segment end, not zero-length */
 
 	while (segment->next != NULL)
 	{
 		if (SEGMENT_IS_ZERO_LEN_AT (segment->next, offset))
 			return segment->next;
 
-		if (segment->next->end_at > offset)
+		if (END_OF (ce, segment->next) > offset)
 		{
-			if (segment->next->start_at <= offset)
-				return get_segment_in_ (segment->next, offset);
+			if (START_OF (ce, segment->next) <= offset)
+				return get_segment_in_ (ce, segment->next, offset);
 			else
 				return segment->parent;
 		}
@@ -4832,7 +5550,7 @@ get_segment_at_offset (GtkSourceContextEngine *ce,
 {
 	Segment *result;
 
-	if (offset == ce->priv->root_segment->end_at)
+	if (offset == END_OF (ce, ce->priv->root_segment))
 		return ce->priv->root_segment;
 
 #ifdef ENABLE_DEBUG
@@ -4846,10 +5564,10 @@ get_segment_at_offset (GtkSourceContextEngine *ce,
 	}
 #endif
 
-	result = get_segment_ (hint ? hint : ce->priv->root_segment, offset);
+	result = get_segment_ (ce, hint ? hint : ce->priv->root_segment, offset);
 
 #ifdef ENABLE_CHECK_TREE
-	g_assert (result == get_segment_at_offset_slow_ (hint, offset));
+	g_assert (result == get_segment_at_offset_slow_ (ce, hint, offset));
 #endif
 
 	return result;
@@ -4919,9 +5637,9 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 				   segment->parent,
 				   segment->context,
 				   end,
-				   segment->end_at,
+				   END_OF (ce, segment),
 				   FALSE);
-	segment->end_at = start;
+	SET_END_OF (ce, segment, start);
 
 	new_segment->next = segment->next;
 	segment->next = new_segment;
@@ -4941,14 +5659,14 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 		Segment *append_to;
 		Segment *next = child->next;
 
-		if (child->start_at < start)
+		if (START_OF (ce, child) < start)
 		{
-			g_assert (child->end_at <= start);
+			g_assert (END_OF (ce, child) <= start);
 			append_to = segment;
 		}
 		else
 		{
-			g_assert (child->start_at >= end);
+			g_assert (START_OF (ce, child) >= end);
 			append_to = new_segment;
 		}
 
@@ -4979,15 +5697,15 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 		SubPattern *next = sp->next;
 		Segment *append_to;
 
-		if (sp->start_at < start)
+		if (START_OF (ce, sp) < start)
 		{
-			sp->end_at = MIN (sp->end_at, start);
+			SET_END_OF (ce, sp, MIN (END_OF (ce, sp), start));
 			append_to = segment;
 		}
 		else
 		{
-			g_assert (sp->end_at > end);
-			sp->start_at = MAX (sp->start_at, end);
+			g_assert (END_OF (ce, sp) > end);
+			SET_START_OF (ce, sp, MAX (START_OF (ce, sp), end));
 			append_to = new_segment;
 		}
 
@@ -4997,8 +5715,8 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 		sp = next;
 	}
 
-	CHECK_SEGMENT_CHILDREN (segment);
-	CHECK_SEGMENT_CHILDREN (new_segment);
+	CHECK_SEGMENT_CHILDREN (ce, segment);
+	CHECK_SEGMENT_CHILDREN (ce, new_segment);
 }
 
 /**
@@ -5024,38 +5742,38 @@ segment_erase_range_ (GtkSourceContextEngine *ce,
 {
 	g_assert (start < end);
 
-	if (segment->start_at == segment->end_at)
+	if (START_OF (ce, segment) == END_OF (ce, segment))
 	{
-		if (segment->start_at >= start && segment->start_at <= end)
+		if (START_OF (ce, segment) >= start && START_OF (ce, segment) <= end)
 			segment_remove (ce, segment);
 		return;
 	}
 
-	if (segment->start_at > end || segment->end_at < start)
+	if (START_OF (ce, segment) > end || END_OF (ce, segment) < start)
 		return;
 
-	if (segment->start_at >= start && segment->end_at <= end && segment->parent)
+	if (START_OF (ce, segment) >= start && END_OF (ce, segment) <= end && segment->parent)
 	{
 		segment_remove (ce, segment);
 		return;
 	}
 
-	if (segment->start_at == end)
+	if (START_OF (ce, segment) == end)
 	{
 		Segment *child = segment->children;
 
-		while (child != NULL && child->start_at == end)
+		while (child != NULL && START_OF (ce, child) == end)
 		{
 			Segment *next = child->next;
 			segment_erase_range_ (ce, child, start, end);
 			child = next;
 		}
 	}
-	else if (segment->end_at == start)
+	else if (END_OF (ce, segment) == start)
 	{
 		Segment *child = segment->last_child;
 
-		while (child != NULL && child->end_at == start)
+		while (child != NULL && END_OF (ce, child) == start)
 		{
 			Segment *prev = child->prev;
 			segment_erase_range_ (ce, child, start, end);
@@ -5085,8 +5803,8 @@ segment_erase_range_ (GtkSourceContextEngine *ce,
 		{
 			SubPattern *next = sp->next;
 
-			if (sp->start_at >= start && sp->end_at <= end)
-				sub_pattern_free (sp);
+			if (START_OF (ce, sp) >= start && END_OF (ce, sp) <= end)
+				sub_pattern_free (ce, sp);
 			else
 				segment_add_subpattern (segment, sp);
 
@@ -5099,25 +5817,25 @@ segment_erase_range_ (GtkSourceContextEngine *ce,
 		/* Now all children and subpatterns are cleaned up,
 		 * so we only need to split segment properly if its middle
 		 * was erased. Otherwise, only ends need to be adjusted. */
-		if (segment->start_at < start && segment->end_at > end)
+		if (START_OF (ce, segment) < start && END_OF (ce, segment) > end)
 		{
 			segment_erase_middle_ (ce, segment, start, end);
 		}
 		else
 		{
-			g_assert ((segment->start_at >= start && segment->end_at > end) ||
-				  (segment->start_at < start && segment->end_at <= end));
+			g_assert ((START_OF (ce, segment) >= start && END_OF (ce, segment) > end) ||
+				  (START_OF (ce, segment) < start && END_OF (ce, segment) <= end));
 
-			if (segment->end_at > end)
+			if (END_OF (ce, segment) > end)
 			{
 				/* If we erase the beginning, we need to clear
 				 * is_start flag. */
-				segment->start_at = end;
+				SET_START_OF (ce, segment, end);
 				segment->is_start = FALSE;
 			}
 			else
 			{
-				segment->end_at = start;
+				SET_END_OF (ce, segment, start);
 			}
 		}
 	}
@@ -5144,7 +5862,7 @@ segment_merge (GtkSourceContextEngine *ce,
 
 	g_assert (!SEGMENT_IS_INVALID (first));
 	g_assert (first->context == second->context);
-	g_assert (first->end_at == second->start_at);
+	g_assert (END_OF (ce, first) == START_OF (ce, second));
 
 	if (first->parent != second->parent)
 		segment_merge (ce, first->parent, second->parent);
@@ -5161,7 +5879,7 @@ segment_merge (GtkSourceContextEngine *ce,
 	if (second->next != NULL)
 		second->next->prev = first;
 
-	first->end_at = second->end_at;
+	SET_END_OF (ce, first, END_OF (ce, second));
 
 	if (second->children != NULL)
 	{
@@ -5250,7 +5968,7 @@ erase_segments (GtkSourceContextEngine *ce,
 	{
 		Segment *next = child->next;
 
-		if (child->end_at < start)
+		if (END_OF (ce, child) < start)
 		{
 			child = next;
 
@@ -5260,7 +5978,7 @@ erase_segments (GtkSourceContextEngine *ce,
 			continue;
 		}
 
-		if (child->start_at > end)
+		if (START_OF (ce, child) > end)
 		{
 			ce->priv->hint = child;
 			break;
@@ -5278,13 +5996,13 @@ erase_segments (GtkSourceContextEngine *ce,
 		if (ce->priv->hint == NULL)
 			ce->priv->hint = child;
 
-		if (child->start_at > end)
+		if (START_OF (ce, child) > end)
 		{
 			child = prev;
 			continue;
 		}
 
-		if (child->end_at < start)
+		if (END_OF (ce, child) < start)
 		{
 			break;
 		}
@@ -5298,6 +6016,107 @@ erase_segments (GtkSourceContextEngine *ce,
 
 #define IS_BOM(c) (c == 0xFEFF)
 
+/**
+ * reanalyze_line:
+ * @ce: #GtkSourceContextEngine.
+ * @line: the line to analyze.
+ * @first_line: whether to start in the root context instead of the
+ * state at the end of previous line, e.g. for the first line in the buffer.
+ * @state: the state at the end of previous line, or some segment
+ * near it; it's set to the state at the end of @line.
+ *
+ * Erases old segments on @line and analyzes it again.
+ *
+ * Returns: %FALSE if analyzing the line took too much time, in which
+ * case the syntax analysis must be disabled.
+ */
+static gboolean
+reanalyze_line (GtkSourceContextEngine  *ce,
+		LineInfo                *line,
+		gboolean                 first_line,
+		Segment                **state)
+{
+	erase_segments (ce, line->start_at, NEXT_LINE_OFFSET (line), ce->priv->hint);
+
+	if (first_line)
+	{
+		*state = ce->priv->root_segment;
+	}
+	else
+	{
+		*state = get_segment_at_offset (ce,
+						ce->priv->hint ? ce->priv->hint : *state,
+						line->start_at - 1);
+	}
+
+	g_assert ((*state)->context != NULL);
+
+	ce->priv->hint2 = ce->priv->hint;
+
+	if (ce->priv->hint2 != NULL && ce->priv->hint2->parent != *state)
+		ce->priv->hint2 = NULL;
+
+	*state = analyze_line (ce, *state, line);
+
+	if (*state == NULL)
+		return FALSE;
+
+	/* XXX this is wrong */
+	/* I don't know anymore why it's wrong, I guess it means
+	 * "may be inefficient" */
+	if (ce->priv->hint2 != NULL)
+		ce->priv->hint = ce->priv->hint2;
+	else
+		ce->priv->hint = *state;
+
+	return TRUE;
+}
+
+/**
+ * merge_next_line_state:
+ * @ce: #GtkSourceContextEngine.
+ * @state: the state at the end of just analyzed line.
+ * @line_end_offset: the beginning of the next line.
+ *
+ * Merges @state with the old state at the beginning of the next
+ * line, if the old one is continuation of @state.
+ *
+ * The old tree serves as per-line checkpoint of the analysis state:
+ * contexts are shared (see create_child_context()), so comparing the
+ * innermost contexts compares the whole stack of open contexts. This is
+ * what makes reanalysis after an edit stop at the first line whose new
+ * end state matches the old one, instead of going on to the end of the
+ * buffer. Keeping a separate array of states indexed by line would need
+ * to be updated on every change, which the tree already does.
+ *
+ * Returns: %FALSE if the states differ, i.e. the next line must be
+ * analyzed again.
+ */
+static gboolean
+merge_next_line_state (GtkSourceContextEngine *ce,
+		       Segment                *state,
+		       gint                    line_end_offset)
+{
+	Segment *old_state, *hint;
+
+	hint = ce->priv->hint ? ce->priv->hint : state;
+	old_state = get_segment_at_offset (ce, hint, line_end_offset);
+
+	/* We can merge old and new stuff if: contexts are the same,
+	 * and the segment on the next line is continuation of the
+	 * segment from previous line. */
+	if (old_state != state &&
+	    (old_state->context != state->context || state->is_start))
+	{
+		return FALSE;
+	}
+
+	segment_merge (ce, state, old_state);
+	CHECK_TREE (ce);
+
+	return TRUE;
+}
+
 /**
  * update_syntax:
  * @ce: #GtkSourceContextEngine.
@@ -5319,6 +6138,7 @@ update_syntax (GtkSourceContextEngine *ce,
 	       const GtkTextIter      *end,
 	       gint                    time)
 {
+	GtkSourceContextData *ctx_data;
 	GtkTextBuffer *buffer;
 	GtkTextIter start_iter, end_iter;
 	GtkTextIter line_start, line_end;
@@ -5328,11 +6148,21 @@ update_syntax (GtkSourceContextEngine *ce,
 	gint line_start_offset, line_end_offset;
 	gint analyzed_end;
 	gboolean first_line = FALSE;
+	LineReader reader;
 	GTimer *timer;
 
+	/* The worker thread stops after the line it is analyzing, and
+	 * changes made meanwhile are applied by update_tree() below. */
+	stop_background_analysis (ce, TRUE);
+
+	if (ce->priv->disabled)
+		return;
+
+	ctx_data = ce->priv->ctx_data;
 	buffer = ce->priv->buffer;
 	state = ce->priv->root_segment;
 
+	g_rec_mutex_lock (&ctx_data->lock);
 	context_freeze (ce->priv->root_context);
 	update_tree (ce);
 
@@ -5347,17 +6177,17 @@ update_syntax (GtkSourceContextEngine *ce,
 	if (invalid == NULL)
 		goto out;
 
-	if (end != NULL && invalid->start_at >= gtk_text_iter_get_offset (end))
+	if (end != NULL && START_OF (ce, invalid) >= gtk_text_iter_get_offset (end))
 		goto out;
 
 	if (end != NULL)
 	{
 		end_offset = gtk_text_iter_get_offset (end);
-		start_offset = MIN (end_offset, invalid->start_at);
+		start_offset = MIN (end_offset, START_OF (ce, invalid));
 	}
 	else
 	{
-		start_offset = invalid->start_at;
+		start_offset = START_OF (ce, invalid);
 		end_offset = gtk_text_buffer_get_char_count (buffer);
 	}
 
@@ -5412,6 +6242,8 @@ update_syntax (GtkSourceContextEngine *ce,
 	line_end_offset = gtk_text_iter_get_offset (&line_end);
 	analyzed_end = line_end_offset;
 
+	line_reader_init (&reader, buffer,
+			  MIN (end_offset, END_OF (ce, invalid)) - start_offset);
 	timer = g_timer_new ();
 
 	while (TRUE)
@@ -5428,57 +6260,24 @@ update_syntax (GtkSourceContextEngine *ce,
 		}
 
 		/* Analyze the line */
-		erase_segments (ce, line_start_offset, line_end_offset, ce->priv->hint);
-		get_line_info (buffer, &line_start, &line_end, &line);
+		get_line_info (&reader, &line_start, &line_end, &line);
 
-#ifdef ENABLE_CHECK_TREE
+		if (!reanalyze_line (ce, &line, first_line, &state))
 		{
-			Segment *inv = get_invalid_segment (ce);
-			g_assert (inv == NULL || inv->start_at >= line_end_offset);
-		}
-#endif
-
-		if (first_line)
-		{
-			state = ce->priv->root_segment;
-		}
-		else
-		{
-			state = get_segment_at_offset (ce,
-						       ce->priv->hint ? ce->priv->hint : state,
-						       line_start_offset - 1);
-		}
-
-		g_assert (state->context != NULL);
-
-		ce->priv->hint2 = ce->priv->hint;
-
-		if (ce->priv->hint2 != NULL && ce->priv->hint2->parent != state)
-			ce->priv->hint2 = NULL;
-
-		state = analyze_line (ce, state, &line);
-
-		/* At this point analyze_line() could have disabled highlighting */
-		if (ce->priv->disabled)
+			line_reader_destroy (&reader);
+			g_timer_destroy (timer);
+			disable_syntax_analysis (ce);
+			g_rec_mutex_unlock (&ctx_data->lock);
 			return;
+		}
 
 #ifdef ENABLE_CHECK_TREE
 		{
 			Segment *inv = get_invalid_segment (ce);
-			g_assert (inv == NULL || inv->start_at >= line_end_offset);
+			g_assert (inv == NULL || START_OF (ce, inv) >= line_end_offset);
 		}
 #endif
 
-		/* XXX this is wrong */
-		/* I don't know anymore why it's wrong, I guess it means
-		 * "may be inefficient" */
-		if (ce->priv->hint2 != NULL)
-			ce->priv->hint = ce->priv->hint2;
-		else
-			ce->priv->hint = state;
-
-		line_info_destroy (&line);
-
 		gtk_source_region_add_subregion (ce->priv->refresh_region, &line_start, &line_end);
 		analyzed_end = line_end_offset;
 		invalid = get_invalid_segment (ce);
@@ -5487,34 +6286,18 @@ update_syntax (GtkSourceContextEngine *ce,
 		{
 			GtkTextIter iter;
 
-			gtk_text_buffer_get_iter_at_offset (buffer, &iter, invalid->start_at);
+			gtk_text_buffer_get_iter_at_offset (buffer, &iter, START_OF (ce, invalid));
 			gtk_text_iter_set_line_offset (&iter, 0);
 
 			if (gtk_text_iter_get_offset (&iter) == line_end_offset)
 				next_line_invalid = TRUE;
 		}
 
-		if (!next_line_invalid)
+		if (!next_line_invalid &&
+		    !merge_next_line_state (ce, state, line_end_offset))
 		{
-			Segment *old_state, *hint;
-
-			hint = ce->priv->hint ? ce->priv->hint : state;
-			old_state = get_segment_at_offset (ce, hint, line_end_offset);
-
-			/* We can merge old and new stuff if: contexts are the same,
-			 * and the segment on the next line is continuation of the
-			 * segment from previous line. */
-			if (old_state != state &&
-			    (old_state->context != state->context || state->is_start))
-			{
-				need_invalidate_next = TRUE;
-				next_line_invalid = TRUE;
-			}
-			else
-			{
-				segment_merge (ce, state, old_state);
-				CHECK_TREE (ce);
-			}
+			need_invalidate_next = TRUE;
+			next_line_invalid = TRUE;
 		}
 
 		if ((time != 0 && g_timer_elapsed (timer, NULL) * 1000 > time) ||
@@ -5535,7 +6318,7 @@ update_syntax (GtkSourceContextEngine *ce,
 		}
 		else
 		{
-			gtk_text_buffer_get_iter_at_offset (buffer, &line_start, invalid->start_at);
+			gtk_text_buffer_get_iter_at_offset (buffer, &line_start, START_OF (ce, invalid));
 			gtk_text_iter_set_line_offset (&line_start, 0);
 			line_start_offset = gtk_text_iter_get_offset (&line_start);
 			line_end = line_start;
@@ -5546,6 +6329,8 @@ update_syntax (GtkSourceContextEngine *ce,
 		first_line = (0 == line_start_offset);
 	}
 
+	line_reader_destroy (&reader);
+
 	if (analyzed_end == gtk_text_buffer_get_char_count (buffer))
 	{
 		g_assert (g_slist_length (ce->priv->invalid) <= 1);
@@ -5574,6 +6359,651 @@ update_syntax (GtkSourceContextEngine *ce,
 out:
 	/* must call context_thaw, so this is the only return point */
 	context_thaw (ce->priv->root_context);
+	g_rec_mutex_unlock (&ctx_data->lock);
+}
+
+/**
+ * analyze_area:
+ * @ce: #GtkSourceContextEngine.
+ * @start: start of the area, at a line start. It's set to the start of
+ * the analyzed text.
+ * @end: end of the area, at a line start or the buffer end. It's set to
+ * the end of the analyzed text.
+ *
+ * Analyzes the invalid text in the area, without analyzing the text
+ * before it. If the area is inside an invalid segment, including the
+ * first one, the segment is split and the analysis starts in the root
+ * context, which is a guess; when update_syntax later gets to the area,
+ * it reanalyzes the lines whose state was guessed wrong just like it
+ * does after an edit, since merge_next_line_state fails there. If the
+ * invalid text in the area follows analyzed text, the analysis continues
+ * from the state in the tree.
+ *
+ * Returns: whether something was analyzed. If the analysis took too
+ * much time, the syntax analysis is disabled and %FALSE is returned.
+ */
+static gboolean
+analyze_area (GtkSourceContextEngine *ce,
+	      GtkTextIter            *start,
+	      GtkTextIter            *end)
+{
+	GtkSourceContextData *ctx_data;
+	GtkTextBuffer *buffer;
+	GtkTextIter line_start, line_end;
+	Segment *state;
+	Segment *invalid = NULL;
+	GSList *l;
+	gint start_offset, end_offset;
+	gboolean guess_state = FALSE;
+	gboolean analyzed = FALSE;
+	LineReader reader;
+
+	ctx_data = ce->priv->ctx_data;
+	buffer = ce->priv->buffer;
+
+	start_offset = gtk_text_iter_get_offset (start);
+	end_offset = gtk_text_iter_get_offset (end);
+
+	if (start_offset >= end_offset)
+		return FALSE;
+
+	g_rec_mutex_lock (&ctx_data->lock);
+	context_freeze (ce->priv->root_context);
+	update_tree (ce);
+
+	for (l = ce->priv->invalid; l != NULL; l = l->next)
+	{
+		Segment *segment = l->data;
+
+		if (START_OF (ce, segment) >= end_offset)
+			break;
+
+		if (END_OF (ce, segment) > start_offset ||
+		    (START_OF (ce, segment) == END_OF (ce, segment) &&
+		     START_OF (ce, segment) == start_offset))
+		{
+			invalid = segment;
+			break;
+		}
+	}
+
+	if (invalid == NULL)
+		goto out;
+
+	if (START_OF (ce, invalid) < start_offset)
+	{
+		if (invalid->parent != ce->priv->root_segment)
+			goto out;
+
+		/* Cut the area out of the invalid segment. */
+		if (END_OF (ce, invalid) > end_offset)
+			segment_erase_middle_ (ce, invalid, start_offset, end_offset);
+		else
+			SET_END_OF (ce, invalid, start_offset);
+
+		ce->priv->hint = invalid;
+		guess_state = TRUE;
+	}
+	else
+	{
+		/* The text before it is analyzed, continue from there. */
+		gtk_text_buffer_get_iter_at_offset (buffer, start, START_OF (ce, invalid));
+		gtk_text_iter_set_line_offset (start, 0);
+		start_offset = gtk_text_iter_get_offset (start);
+
+		if (start_offset == 0 ||
+		    !range_is_analyzed (ce, start_offset - 1, start_offset - 1))
+			goto out;
+	}
+
+	state = ce->priv->root_segment;
+	line_start = *start;
+	line_end = line_start;
+	gtk_text_iter_forward_line (&line_end);
+	line_reader_init (&reader, buffer, end_offset - start_offset);
+
+	while (gtk_text_iter_get_offset (&line_start) < end_offset &&
+	       !gtk_text_iter_equal (&line_start, &line_end))
+	{
+		LineInfo line;
+
+		get_line_info (&reader, &line_start, &line_end, &line);
+
+		if (!reanalyze_line (ce, &line, guess_state, &state))
+		{
+			line_reader_destroy (&reader);
+			context_thaw (ce->priv->root_context);
+			g_rec_mutex_unlock (&ctx_data->lock);
+			disable_syntax_analysis (ce);
+			return FALSE;
+		}
+
+		guess_state = FALSE;
+
+		line_start = line_end;
+		gtk_text_iter_forward_line (&line_end);
+	}
+
+	line_reader_destroy (&reader);
+
+	/* Same as in update_syntax: the next line must be analyzed again
+	 * if its old state is not a continuation of the new one. */
+	end_offset = gtk_text_iter_get_offset (&line_start);
+	if (!gtk_text_iter_is_end (&line_start) &&
+	    !merge_next_line_state (ce, state, end_offset))
+	{
+		insert_range (ce, end_offset, 0);
+	}
+
+	CHECK_TREE (ce);
+
+	*end = line_start;
+	analyzed = TRUE;
+
+	gtk_source_region_add_subregion (ce->priv->refresh_region, start, end);
+	refresh_range (ce, start, end);
+
+	PROFILE (g_print ("analyzed area from %d to %d\n",
+			  start_offset, end_offset));
+
+out:
+	context_thaw (ce->priv->root_context);
+	g_rec_mutex_unlock (&ctx_data->lock);
+
+	return analyzed;
+}
+
+/**
+ * analyze_viewport:
+ * @ce: #GtkSourceContextEngine.
+ *
+ * Analyzes the visible area saved by update_highlight, see analyze_area(),
+ * and makes the idle worker fill the text around it, see
+ * fill_around_viewport().
+ */
+static void
+analyze_viewport (GtkSourceContextEngine *ce)
+{
+	GtkTextBuffer *buffer;
+	GtkTextIter start, end;
+
+	if (!ce->priv->viewport_pending)
+		return;
+
+	ce->priv->viewport_pending = FALSE;
+
+	stop_background_analysis (ce, TRUE);
+
+	if (ce->priv->disabled)
+		return;
+
+	buffer = ce->priv->buffer;
+
+	gtk_text_buffer_get_iter_at_mark (buffer, &start, ce->priv->viewport_start);
+	gtk_text_buffer_get_iter_at_mark (buffer, &end, ce->priv->viewport_end);
+
+	gtk_text_iter_set_line_offset (&start, 0);
+	if (!gtk_text_iter_starts_line (&end))
+		gtk_text_iter_forward_line (&end);
+
+	if (analyze_area (ce, &start, &end))
+	{
+		gtk_text_buffer_move_mark (buffer, ce->priv->viewport_start, &start);
+		gtk_text_buffer_move_mark (buffer, ce->priv->viewport_end, &end);
+		ce->priv->viewport_fill_above = VIEWPORT_FILL_MAX_LINES;
+		ce->priv->viewport_fill_below = VIEWPORT_FILL_MAX_LINES;
+	}
+	else
+	{
+		ce->priv->viewport_fill_above = 0;
+		ce->priv->viewport_fill_below = 0;
+	}
+}
+
+/**
+ * fill_around_viewport:
+ * @ce: #GtkSourceContextEngine.
+ * @time: maximal amount of time in milliseconds allowed to spend here.
+ *
+ * Extends the text analyzed by analyze_viewport() by batches of lines,
+ * alternately below and above it, until VIEWPORT_FILL_MAX_LINES lines
+ * are analyzed on each side or it meets text which is already analyzed.
+ * The batches below continue from the state at the end of the analyzed
+ * text; each batch above starts from a guessed state, like the visible
+ * area, and update_syntax reconciles the states when it gets there.
+ */
+static void
+fill_around_viewport (GtkSourceContextEngine *ce,
+		      gint                    time)
+{
+	GtkTextBuffer *buffer = ce->priv->buffer;
+	GTimer *timer;
+
+	stop_background_analysis (ce, TRUE);
+
+	timer = g_timer_new ();
+
+	while (!ce->priv->disabled &&
+	       (ce->priv->viewport_fill_above > 0 || ce->priv->viewport_fill_below > 0) &&
+	       g_timer_elapsed (timer, NULL) * 1000 < time)
+	{
+		GtkTextIter start, end;
+		gint n_lines;
+
+		if (ce->priv->viewport_fill_below > 0)
+		{
+			n_lines = MIN (VIEWPORT_FILL_BATCH_LINES, ce->priv->viewport_fill_below);
+
+			gtk_text_buffer_get_iter_at_mark (buffer, &start, ce->priv->viewport_end);
+			end = start;
+			gtk_text_iter_forward_lines (&end, n_lines);
+
+			if (analyze_area (ce, &start, &end))
+			{
+				gtk_text_buffer_move_mark (buffer, ce->priv->viewport_end, &end);
+				ce->priv->viewport_fill_below -= n_lines;
+			}
+			else
+			{
+				ce->priv->viewport_fill_below = 0;
+			}
+
+			if (ce->priv->disabled)
+				break;
+		}
+
+		if (ce->priv->viewport_fill_above > 0)
+		{
+			n_lines = MIN (VIEWPORT_FILL_BATCH_LINES, ce->priv->viewport_fill_above);
+
+			gtk_text_buffer_get_iter_at_mark (buffer, &end, ce->priv->viewport_start);
+			start = end;
+			gtk_text_iter_backward_lines (&start, n_lines);
+
+			if (analyze_area (ce, &start, &end))
+			{
+				gtk_text_buffer_move_mark (buffer, ce->priv->viewport_start, &start);
+				ce->priv->viewport_fill_above -= n_lines;
+			}
+			else
+			{
+				ce->priv->viewport_fill_above = 0;
+			}
+		}
+	}
+
+	g_timer_destroy (timer);
+}
+
+/* BACKGROUND ANALYSIS ---------------------------------------------------- */
+
+/**
+ * analysis_job_find_line:
+ * @job: #AnalysisJob.
+ * @pos: byte index of a line start in the job text.
+ * @line_start: character offset of that line.
+ * @offset: character offset to look for.
+ * @line_pos: where to store byte index of the found line.
+ *
+ * Finds the line containing @offset, starting at line @line_start.
+ *
+ * Returns: character offset of the line start, or -1 if @offset
+ * is not in the job text.
+ */
+static gint
+analysis_job_find_line (AnalysisJob *job,
+			gint         pos,
+			gint         line_start,
+			gint         offset,
+			gint        *line_pos)
+{
+	if (offset < line_start)
+		return -1;
+
+	while (pos < job->byte_length)
+	{
+		LineInfo line;
+		gint line_length;
+
+		line_length = line_info_from_text (&line,
+						   job->text + pos,
+						   job->byte_length - pos,
+						   line_start,
+						   job->char_offsets);
+
+		/* Only the last line in the buffer has no line terminator. */
+		if (offset < NEXT_LINE_OFFSET (&line) || line.eol_length == 0)
+		{
+			*line_pos = pos;
+			return line_start;
+		}
+
+		pos += line_length;
+		line_start = NEXT_LINE_OFFSET (&line);
+	}
+
+	/* Empty last line. */
+	if (job->at_buffer_end && offset == line_start)
+	{
+		*line_pos = pos;
+		return line_start;
+	}
+
+	return -1;
+}
+
+static gboolean
+background_analysis_done_cb (AnalysisJob *job)
+{
+	if (job->ce != NULL)
+		stop_background_analysis (job->ce, TRUE);
+
+	g_free (job->text);
+	g_array_free (job->char_offsets, TRUE);
+	g_slice_free (AnalysisJob, job);
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * background_analysis_thread:
+ * @job: #AnalysisJob.
+ *
+ * Worker thread function. It does the same as update_syntax() for
+ * the lines in @job, except it does not look at the buffer, and
+ * it does not analyze the last line of the job text unless it's the
+ * last line of the buffer: we need to know where the next line ends to
+ * decide whether it's invalid.
+ */
+static gpointer
+background_analysis_thread (AnalysisJob *job)
+{
+	GtkSourceContextEngine *ce = job->ce;
+	GRecMutex *lock = &ce->priv->ctx_data->lock;
+	Segment *state = ce->priv->root_segment;
+	gint line_start_offset = job->start_at;
+	gint pos = 0;
+
+	g_rec_mutex_lock (lock);
+	context_freeze (ce->priv->root_context);
+	g_rec_mutex_unlock (lock);
+
+	while (pos < job->byte_length && !g_atomic_int_get (&job->cancelled))
+	{
+		LineInfo line;
+		Segment *invalid;
+		gint next_pos;
+		gint line_end_offset;
+		gint invalid_line_start = -1;
+		gint invalid_line_pos = 0;
+		gboolean next_line_invalid = FALSE;
+		gboolean need_invalidate_next = FALSE;
+		gboolean done;
+
+		next_pos = pos + line_info_from_text (&line,
+						      job->text + pos,
+						      job->byte_length - pos,
+						      line_start_offset,
+						      job->char_offsets);
+		line_end_offset = NEXT_LINE_OFFSET (&line);
+
+		if (next_pos >= job->byte_length && !job->at_buffer_end)
+			break;
+
+		g_rec_mutex_lock (lock);
+
+		if (!reanalyze_line (ce, &line, FALSE, &state))
+		{
+			job->disabled = TRUE;
+			g_rec_mutex_unlock (lock);
+			break;
+		}
+
+		job->analyzed_end = line_end_offset;
+
+		/* Not get_invalid_segment(), invalid_region belongs
+		 * to the main thread. */
+		invalid = ce->priv->invalid != NULL ? ce->priv->invalid->data : NULL;
+
+		if (invalid != NULL)
+		{
+			invalid_line_start = analysis_job_find_line (job,
+								     next_pos,
+								     line_end_offset,
+								     START_OF (ce, invalid),
+								     &invalid_line_pos);
+
+			if (invalid_line_start == line_end_offset)
+				next_line_invalid = TRUE;
+		}
+
+		if (!next_line_invalid &&
+		    !merge_next_line_state (ce, state, line_end_offset))
+		{
+			need_invalidate_next = TRUE;
+			next_line_invalid = TRUE;
+		}
+
+		done = g_atomic_int_get (&job->cancelled) ||
+		       next_pos >= job->byte_length ||
+		       (!next_line_invalid && invalid_line_start < 0);
+
+		if (done && need_invalidate_next)
+			insert_range (ce, line_end_offset, 0);
+
+		g_rec_mutex_unlock (lock);
+
+		if (done)
+			break;
+
+		if (next_line_invalid)
+		{
+			pos = next_pos;
+			line_start_offset = line_end_offset;
+		}
+		else
+		{
+			pos = invalid_line_pos;
+			line_start_offset = invalid_line_start;
+		}
+	}
+
+	g_rec_mutex_lock (lock);
+
+	if (!job->disabled &&
+	    job->at_buffer_end &&
+	    job->analyzed_end == job->end_at &&
+	    ce->priv->invalid != NULL)
+	{
+		g_assert (g_slist_length (ce->priv->invalid) == 1);
+		segment_remove (ce, ce->priv->invalid->data);
+	}
+
+	context_thaw (ce->priv->root_context);
+	g_rec_mutex_unlock (lock);
+
+	/* This must be the last thing the thread does, see
+	 * stop_background_analysis(). */
+	g_idle_add_full (FIRST_UPDATE_PRIORITY,
+			 (GSourceFunc) background_analysis_done_cb,
+			 job, NULL);
+
+	return NULL;
+}
+
+/**
+ * tree_offset_to_buffer_offset:
+ * @ce: #GtkSourceContextEngine.
+ * @offset: offset in the syntax tree.
+ * @round_up: what to do with offsets in changed text.
+ *
+ * Returns: the offset in the buffer corresponding to @offset, taking into
+ * account changes not yet applied to the tree by update_tree(). Offsets
+ * inside changed text are moved to its start, or to its end if @round_up
+ * is %TRUE.
+ */
+static gint
+tree_offset_to_buffer_offset (GtkSourceContextEngine *ce,
+			      gint                    offset,
+			      gboolean                round_up)
+{
+	InvalidRegion *region = &ce->priv->invalid_region;
+	GtkTextIter iter;
+	gint start, end;
+
+	if (region->empty)
+		return offset;
+
+	gtk_text_buffer_get_iter_at_mark (ce->priv->buffer, &iter, region->start);
+	start = gtk_text_iter_get_offset (&iter);
+	gtk_text_buffer_get_iter_at_mark (ce->priv->buffer, &iter, region->end);
+	end = gtk_text_iter_get_offset (&iter);
+
+	if (offset <= start)
+		return offset;
+	else if (offset >= end - region->delta)
+		return offset + region->delta;
+	else
+		return round_up ? end : start;
+}
+
+/**
+ * start_background_analysis:
+ * @ce: #GtkSourceContextEngine.
+ *
+ * Starts analyzing a batch of lines after the first invalid one
+ * in a worker thread. It does nothing for small buffers, and
+ * leaves the first and the last line to update_syntax().
+ *
+ * Returns: whether the thread was started.
+ */
+static gboolean
+start_background_analysis (GtkSourceContextEngine *ce)
+{
+	GtkTextBuffer *buffer = ce->priv->buffer;
+	GtkTextIter start, end;
+	Segment *invalid;
+	AnalysisJob *job;
+	GError *error = NULL;
+
+	g_assert (ce->priv->job == NULL);
+
+	if (gtk_text_buffer_get_char_count (buffer) < BACKGROUND_ANALYSIS_MIN_CHARS)
+		return FALSE;
+
+	/* Make tree offsets match the buffer before copying the text. */
+	g_rec_mutex_lock (&ce->priv->ctx_data->lock);
+	update_tree (ce);
+	invalid = get_invalid_segment (ce);
+	g_rec_mutex_unlock (&ce->priv->ctx_data->lock);
+
+	if (invalid == NULL)
+		return FALSE;
+
+	gtk_text_buffer_get_iter_at_offset (buffer, &start, START_OF (ce, invalid));
+	gtk_text_iter_set_line_offset (&start, 0);
+
+	if (gtk_text_iter_is_start (&start) || gtk_text_iter_is_end (&start))
+		return FALSE;
+
+	/* Take one more line, the worker needs to look at it. */
+	end = start;
+	gtk_text_iter_forward_chars (&end, BACKGROUND_ANALYSIS_BATCH_CHARS);
+	if (!gtk_text_iter_starts_line (&end))
+		gtk_text_iter_forward_line (&end);
+	gtk_text_iter_forward_line (&end);
+
+	job = g_slice_new0 (AnalysisJob);
+	job->ce = ce;
+	job->start_at = gtk_text_iter_get_offset (&start);
+	job->end_at = gtk_text_iter_get_offset (&end);
+	job->analyzed_end = job->start_at;
+	job->at_buffer_end = gtk_text_iter_is_end (&end);
+	job->text = gtk_text_buffer_get_slice (buffer, &start, &end, TRUE);
+	job->byte_length = strlen (job->text);
+	job->char_offsets = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	job->thread = g_thread_try_new ("gtksourceview-highlight",
+					(GThreadFunc) background_analysis_thread,
+					job,
+					&error);
+
+	if (job->thread == NULL)
+	{
+		g_warning ("Cannot start syntax analysis thread: %s", error->message);
+		g_clear_error (&error);
+		g_free (job->text);
+		g_array_free (job->char_offsets, TRUE);
+		g_slice_free (AnalysisJob, job);
+		return FALSE;
+	}
+
+	ce->priv->job = job;
+	return TRUE;
+}
+
+/**
+ * stop_background_analysis:
+ * @ce: #GtkSourceContextEngine.
+ * @apply_results: whether to refresh the analyzed area.
+ *
+ * Interrupts the worker thread if there is one, and waits for it; the
+ * thread stops at the end of the line being analyzed. Everything analyzed
+ * so far stays in the tree. The job itself is freed later by the idle
+ * callback installed by the thread.
+ * Always safe to call.
+ */
+static void
+stop_background_analysis (GtkSourceContextEngine *ce,
+			  gboolean                apply_results)
+{
+	AnalysisJob *job = ce->priv->job;
+	GtkTextIter start, end;
+	gint start_offset, end_offset;
+
+	if (job == NULL)
+		return;
+
+	g_atomic_int_set (&job->cancelled, TRUE);
+	g_thread_join (job->thread);
+	job->thread = NULL;
+	job->ce = NULL;
+	ce->priv->job = NULL;
+
+	if (!apply_results)
+		return;
+
+	if (job->disabled)
+	{
+		disable_syntax_analysis (ce);
+		return;
+	}
+
+	if (job->analyzed_end > job->start_at)
+	{
+		start_offset = tree_offset_to_buffer_offset (ce, job->start_at, FALSE);
+		end_offset = tree_offset_to_buffer_offset (ce, job->analyzed_end, TRUE);
+
+		/* The tree must match the buffer before looking at it. */
+		g_rec_mutex_lock (&ce->priv->ctx_data->lock);
+		update_tree (ce);
+		g_rec_mutex_unlock (&ce->priv->ctx_data->lock);
+
+		gtk_text_buffer_get_iter_at_offset (ce->priv->buffer, &start, start_offset);
+		gtk_text_buffer_get_iter_at_offset (ce->priv->buffer, &end, end_offset);
+
+		gtk_source_region_add_subregion (ce->priv->refresh_region, &start, &end);
+		refresh_range (ce, &start, &end);
+	}
+
+	if (!all_analyzed (ce))
+	{
+		install_idle_worker (ce);
+	}
+	else
+	{
+		PROFILE (print_memory_usage (ce));
+	}
 }
 
 
@@ -6400,8 +7830,14 @@ check_segment (GtkSourceContextEngine *ce,
 	Segment *child;
 
 	g_assert (segment != NULL);
-	g_assert (segment->start_at <= segment->end_at);
-	g_assert (!segment->next || segment->next->start_at >= segment->end_at);
+	g_assert (START_OF (ce, segment) <= END_OF (ce, segment));
+	g_assert (!segment->next || START_OF (ce, segment->next) >= END_OF (ce, segment));
+
+	/* Offsets after the gap must be stored relative to the end. */
+	g_assert (segment->stored_start < 0 || segment->stored_start <= ce->priv->gap);
+	g_assert (segment->stored_end < 0 || segment->stored_end <= ce->priv->gap);
+	g_assert (START_OF (ce, segment) >= ce->priv->gap || segment->stored_start >= 0);
+	g_assert (END_OF (ce, segment) >= ce->priv->gap || segment->stored_end >= 0);
 
 	if (SEGMENT_IS_INVALID (segment))
 		g_assert (g_slist_find (ce->priv->invalid, segment) != NULL);
@@ -6414,8 +7850,8 @@ check_segment (GtkSourceContextEngine *ce,
 	for (child = segment->children; child != NULL; child = child->next)
 	{
 		g_assert (child->parent == segment);
-		g_assert (child->start_at >= segment->start_at);
-		g_assert (child->end_at <= segment->end_at);
+		g_assert (START_OF (ce, child) >= START_OF (ce, segment));
+		g_assert (END_OF (ce, child) <= END_OF (ce, segment));
 		g_assert (child->prev || child == segment->children);
 		g_assert (child->next || child == segment->last_child);
 		check_segment (ce, child);
@@ -6472,10 +7908,10 @@ check_tree (GtkSourceContextEngine *ce)
 
 	check_regex ();
 
-	g_assert (root->start_at == 0);
+	g_assert (START_OF (ce, root) == 0);
 
 	if (ce->priv->invalid_region.empty)
-		g_assert (root->end_at == gtk_text_buffer_get_char_count (ce->priv->buffer));
+		g_assert (END_OF (ce, root) == gtk_text_buffer_get_char_count (ce->priv->buffer));
 
 	g_assert (!root->parent);
 	check_segment (ce, root);
@@ -6486,27 +7922,29 @@ check_tree (GtkSourceContextEngine *ce)
 }
 
 static void
-check_segment_children (Segment *segment)
+check_segment_children (GtkSourceContextEngine *ce,
+			Segment                *segment)
 {
 	Segment *ch;
 
 	g_assert (segment != NULL);
-	check_segment_list (segment->parent);
+	check_segment_list (ce, segment->parent);
 
 	for (ch = segment->children; ch != NULL; ch = ch->next)
 	{
 		g_assert (ch->parent == segment);
-		g_assert (ch->start_at <= ch->end_at);
-		g_assert (!ch->next || ch->next->start_at >= ch->end_at);
-		g_assert (ch->start_at >= segment->start_at);
-		g_assert (ch->end_at <= segment->end_at);
+		g_assert (START_OF (ce, ch) <= END_OF (ce, ch));
+		g_assert (!ch->next || START_OF (ce, ch->next) >= END_OF (ce, ch));
+		g_assert (START_OF (ce, ch) >= START_OF (ce, segment));
+		g_assert (END_OF (ce, ch) <= END_OF (ce, segment));
 		g_assert (ch->prev || ch == segment->children);
 		g_assert (ch->next || ch == segment->last_child);
 	}
 }
 
 static void
-check_segment_list (Segment *segment)
+check_segment_list (GtkSourceContextEngine *ce,
+		    Segment                *segment)
 {
 	Segment *ch;
 
@@ -6516,8 +7954,8 @@ check_segment_list (Segment *segment)
 	for (ch = segment->children; ch != NULL; ch = ch->next)
 	{
 		g_assert (ch->parent == segment);
-		g_assert (ch->start_at <= ch->end_at);
-		g_assert (!ch->next || ch->next->start_at >= ch->end_at);
+		g_assert (START_OF (ce, ch) <= END_OF (ce, ch));
+		g_assert (!ch->next || START_OF (ce, ch->next) >= END_OF (ce, ch));
 		g_assert (ch->prev || ch == segment->children);
 		g_assert (ch->next || ch == segment->last_child);
 	}
@@ -0,0 +1,757 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gtksourcefilesearch.h"
+#include <string.h>
+#include "gtksourcesearchsettings.h"
+#include "gtksourceencoding.h"
+#include "gtksourceencoding-private.h"
+#include "gtksourceutils-private.h"
+
+/**
+ * SECTION:filesearch
+ * @Short_description: Search in files without loading them in buffers
+ * @Title: GtkSourceFileSearch
+ * @See_also: #GtkSourceSearchSettings, #GtkSourceSearchContext,
+ * #GtkSourceFileLoader
+ *
+ * A #GtkSourceFileSearch object searches a list of files with the options of a
+ * #GtkSourceSearchSettings, without creating a #GtkSourceBuffer for each file.
+ * It is useful to search in a whole project, with the same settings as the
+ * search in the opened documents.
+ *
+ * The contents of a file is decoded with the first candidate encoding that
+ * can convert it to UTF-8, like #GtkSourceFileLoader does. The files are
+ * searched in worker threads, and the occurrences found are reported, file by
+ * file, with the #GtkSourceFileSearch::match-found signal.
+ *
+ * The search is done on the whole contents of each file, with a #GRegex. When
+ * the regex search is disabled, the search text is escaped. The matching is
+ * thus slightly different than the one of #GtkSourceSearchContext: the case
+ * insensitive matching doesn't normalize the text, and the word boundaries are
+ * the ones of "\b" in a regex.
+ */
+
+enum
+{
+	PROP_0,
+	PROP_SETTINGS
+};
+
+enum
+{
+	SIGNAL_MATCH_FOUND,
+	N_SIGNALS
+};
+
+struct _GtkSourceFileSearchPrivate
+{
+	GtkSourceSearchSettings *settings;
+
+	/* List of const GtkSourceEncoding*. */
+	GSList *candidate_encodings;
+};
+
+typedef struct
+{
+	gint line;
+	gint start_byte;
+	gint end_byte;
+} FileSearchMatch;
+
+/* Shared by the worker threads. Only nb_remaining_files is modified, in the
+ * main thread.
+ */
+typedef struct
+{
+	GRegex *regex;
+	GSList *candidate_encodings;
+	GFile **files;
+	guint nb_files;
+	guint nb_remaining_files;
+	GCancellable *cancellable;
+	GMainContext *context;
+	gint priority;
+} SearchData;
+
+/* The occurrences found in a file, sent to the main thread. */
+typedef struct
+{
+	GTask *task;
+	GFile *file;
+	GArray *matches;
+} FileResult;
+
+static guint signals[N_SIGNALS];
+
+G_DEFINE_TYPE_WITH_PRIVATE (GtkSourceFileSearch, gtk_source_file_search, G_TYPE_OBJECT)
+
+static void
+search_data_free (SearchData *data)
+{
+	guint i;
+
+	for (i = 0; i < data->nb_files; i++)
+	{
+		g_object_unref (data->files[i]);
+	}
+
+	g_free (data->files);
+	g_clear_pointer (&data->regex, g_regex_unref);
+	g_slist_free (data->candidate_encodings);
+	g_clear_object (&data->cancellable);
+	g_main_context_unref (data->context);
+	g_slice_free (SearchData, data);
+}
+
+static void
+file_result_free (FileResult *result)
+{
+	g_object_unref (result->task);
+	g_object_unref (result->file);
+	g_array_unref (result->matches);
+	g_slice_free (FileResult, result);
+}
+
+static GRegex *
+create_regex (GtkSourceSearchSettings  *settings,
+	      GError                  **error)
+{
+	const gchar *search_text = gtk_source_search_settings_get_search_text (settings);
+	GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE | G_REGEX_MULTILINE;
+	gchar *pattern;
+	GRegex *regex;
+
+	if (!gtk_source_search_settings_get_case_sensitive (settings))
+	{
+		compile_flags |= G_REGEX_CASELESS;
+	}
+
+	if (gtk_source_search_settings_get_regex_enabled (settings))
+	{
+		pattern = g_strdup (search_text);
+	}
+	else
+	{
+		pattern = g_regex_escape_string (search_text, -1);
+	}
+
+	if (gtk_source_search_settings_get_at_word_boundaries (settings))
+	{
+		gchar *tmp = pattern;
+
+		pattern = g_strdup_printf ("\\b%s\\b", tmp);
+		g_free (tmp);
+	}
+
+	regex = g_regex_new (pattern,
+			     compile_flags,
+			     G_REGEX_MATCH_NOTEMPTY,
+			     error);
+
+	g_free (pattern);
+	return regex;
+}
+
+/* Returns the raw contents of @file. If the file is local, it is mapped in
+ * memory and *mapped_file must be unreffed when the contents is no longer
+ * needed. Otherwise the returned contents must be freed.
+ */
+static gchar *
+load_file (GFile         *file,
+	   GCancellable  *cancellable,
+	   GMappedFile  **mapped_file,
+	   gsize         *length)
+{
+	gchar *path;
+	gchar *contents = NULL;
+
+	*mapped_file = NULL;
+	*length = 0;
+
+	path = g_file_get_path (file);
+
+	if (path != NULL)
+	{
+		*mapped_file = g_mapped_file_new (path, FALSE, NULL);
+		g_free (path);
+
+		if (*mapped_file == NULL)
+		{
+			return NULL;
+		}
+
+		*length = g_mapped_file_get_length (*mapped_file);
+		return g_mapped_file_get_contents (*mapped_file);
+	}
+
+	if (!g_file_load_contents (file, cancellable, &contents, length, NULL, NULL))
+	{
+		return NULL;
+	}
+
+	return contents;
+}
+
+/* Returns the contents converted to UTF-8 with the first candidate encoding
+ * that can convert it, or NULL. If the contents is valid UTF-8 it is returned
+ * as is, without the byte order mark. Otherwise *converted must be freed.
+ */
+static const gchar *
+decode_contents (const gchar  *contents,
+		 gsize         length,
+		 GSList       *candidate_encodings,
+		 gchar       **converted,
+		 gsize        *text_length)
+{
+	const GtkSourceEncoding *utf8 = gtk_source_encoding_get_utf8 ();
+	GSList *l;
+
+	*converted = NULL;
+
+	for (l = candidate_encodings; l != NULL; l = l->next)
+	{
+		const GtkSourceEncoding *encoding = l->data;
+		gsize bytes_read = 0;
+
+		if (encoding == utf8)
+		{
+			if (g_utf8_validate (contents, length, NULL))
+			{
+				if (length >= 3 && memcmp (contents, "\xef\xbb\xbf", 3) == 0)
+				{
+					contents += 3;
+					length -= 3;
+				}
+
+				*text_length = length;
+				return contents;
+			}
+
+			continue;
+		}
+
+		*converted = g_convert (contents,
+					length,
+					"UTF-8",
+					gtk_source_encoding_get_charset (encoding),
+					&bytes_read,
+					text_length,
+					NULL);
+
+		if (*converted != NULL && bytes_read == length)
+		{
+			return *converted;
+		}
+
+		g_clear_pointer (converted, g_free);
+	}
+
+	return NULL;
+}
+
+static void
+scan_text (SearchData  *data,
+	   const gchar *text,
+	   gsize        text_length,
+	   GArray      *matches)
+{
+	const gchar *text_end = text + text_length;
+	const gchar *pos = text;
+	const gchar *line_start = text;
+	gint line = 0;
+	GMatchInfo *match_info;
+
+	g_regex_match_full (data->regex, text, text_length, 0, 0, &match_info, NULL);
+
+	while (g_match_info_matches (match_info) &&
+	       !g_cancellable_is_cancelled (data->cancellable))
+	{
+		FileSearchMatch match;
+		gint start_pos;
+		gint end_pos;
+
+		g_match_info_fetch_pos (match_info, 0, &start_pos, &end_pos);
+
+		/* Count the lines up to the start of the match. "\r\n" and a
+		 * lone '\r' are line terminators too, like in a GtkTextBuffer.
+		 */
+		for (; pos < text + start_pos; pos++)
+		{
+			if (*pos == '\n' ||
+			    (*pos == '\r' && (pos + 1 == text_end || pos[1] != '\n')))
+			{
+				line++;
+				line_start = pos + 1;
+			}
+		}
+
+		match.line = line;
+		match.start_byte = text + start_pos - line_start;
+		match.end_byte = text + end_pos - line_start;
+		g_array_append_val (matches, match);
+
+		g_match_info_next (match_info, NULL);
+	}
+
+	g_match_info_free (match_info);
+}
+
+static void
+search_file (SearchData *data,
+	     GFile      *file,
+	     GArray     *matches)
+{
+	GMappedFile *mapped_file;
+	gchar *contents;
+	gsize length;
+	const gchar *text;
+	gchar *converted;
+	gsize text_length;
+
+	contents = load_file (file, data->cancellable, &mapped_file, &length);
+
+	/* The positions in a GRegex subject are gint's. */
+	if (contents == NULL || length > G_MAXINT)
+	{
+		goto out;
+	}
+
+	text = decode_contents (contents,
+				length,
+				data->candidate_encodings,
+				&converted,
+				&text_length);
+
+	if (text != NULL && text_length <= G_MAXINT)
+	{
+		scan_text (data, text, text_length, matches);
+	}
+
+	g_free (converted);
+
+out:
+	if (mapped_file != NULL)
+	{
+		g_mapped_file_unref (mapped_file);
+	}
+	else
+	{
+		g_free (contents);
+	}
+}
+
+static gboolean
+file_result_cb (gpointer user_data)
+{
+	FileResult *result = user_data;
+	GtkSourceFileSearch *search = g_task_get_source_object (result->task);
+	SearchData *data = g_task_get_task_data (result->task);
+	guint i;
+
+	if (!g_cancellable_is_cancelled (data->cancellable))
+	{
+		for (i = 0; i < result->matches->len; i++)
+		{
+			FileSearchMatch *match = &g_array_index (result->matches, FileSearchMatch, i);
+
+			g_signal_emit (search,
+				       signals[SIGNAL_MATCH_FOUND],
+				       0,
+				       result->file,
+				       match->line,
+				       match->start_byte,
+				       match->end_byte);
+		}
+	}
+
+	data->nb_remaining_files--;
+
+	if (data->nb_remaining_files == 0)
+	{
+		if (!g_task_return_error_if_cancelled (result->task))
+		{
+			g_task_return_boolean (result->task, TRUE);
+		}
+
+		/* Reference taken in gtk_source_file_search_search_async(). */
+		g_object_unref (result->task);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+search_file_thread (gpointer data,
+		    gpointer user_data)
+{
+	GTask *task = user_data;
+	SearchData *search_data = g_task_get_task_data (task);
+	guint file_num = GPOINTER_TO_UINT (data) - 1;
+	FileResult *result;
+
+	result = g_slice_new (FileResult);
+	result->task = g_object_ref (task);
+	result->file = g_object_ref (search_data->files[file_num]);
+	result->matches = g_array_new (FALSE, FALSE, sizeof (FileSearchMatch));
+
+	if (!g_cancellable_is_cancelled (search_data->cancellable))
+	{
+		search_file (search_data, result->file, result->matches);
+	}
+
+	g_main_context_invoke_full (search_data->context,
+				    search_data->priority,
+				    file_result_cb,
+				    result,
+				    (GDestroyNotify) file_result_free);
+}
+
+static void
+gtk_source_file_search_get_property (GObject    *object,
+				     guint       prop_id,
+				     GValue     *value,
+				     GParamSpec *pspec)
+{
+	GtkSourceFileSearch *search;
+
+	g_return_if_fail (GTK_SOURCE_IS_FILE_SEARCH (object));
+
+	search = GTK_SOURCE_FILE_SEARCH (object);
+
+	switch (prop_id)
+	{
+		case PROP_SETTINGS:
+			g_value_set_object (value, search->priv->settings);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtk_source_file_search_set_property (GObject      *object,
+				     guint         prop_id,
+				     const GValue *value,
+				     GParamSpec   *pspec)
+{
+	GtkSourceFileSearch *search;
+
+	g_return_if_fail (GTK_SOURCE_IS_FILE_SEARCH (object));
+
+	search = GTK_SOURCE_FILE_SEARCH (object);
+
+	switch (prop_id)
+	{
+		case PROP_SETTINGS:
+			g_assert (search->priv->settings == NULL);
+			search->priv->settings = g_value_dup_object (value);
+
+			if (search->priv->settings == NULL)
+			{
+				search->priv->settings = gtk_source_search_settings_new ();
+			}
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtk_source_file_search_dispose (GObject *object)
+{
+	GtkSourceFileSearch *search = GTK_SOURCE_FILE_SEARCH (object);
+
+	g_clear_object (&search->priv->settings);
+
+	G_OBJECT_CLASS (gtk_source_file_search_parent_class)->dispose (object);
+}
+
+static void
+gtk_source_file_search_finalize (GObject *object)
+{
+	GtkSourceFileSearch *search = GTK_SOURCE_FILE_SEARCH (object);
+
+	g_slist_free (search->priv->candidate_encodings);
+
+	G_OBJECT_CLASS (gtk_source_file_search_parent_class)->finalize (object);
+}
+
+static void
+gtk_source_file_search_class_init (GtkSourceFileSearchClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->get_property = gtk_source_file_search_get_property;
+	object_class->set_property = gtk_source_file_search_set_property;
+	object_class->dispose = gtk_source_file_search_dispose;
+	object_class->finalize = gtk_source_file_search_finalize;
+
+	/**
+	 * GtkSourceFileSearch:settings:
+	 *
+	 * The #GtkSourceSearchSettings associated to the search. They are
+	 * read when a search is started.
+	 *
+	 * Since: 4.2
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_SETTINGS,
+					 g_param_spec_object ("settings",
+							      "Settings",
+							      "The associated GtkSourceSearchSettings",
+							      GTK_SOURCE_TYPE_SEARCH_SETTINGS,
+							      G_PARAM_READWRITE |
+							      G_PARAM_CONSTRUCT_ONLY |
+							      G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceFileSearch::match-found:
+	 * @search: the #GtkSourceFileSearch.
+	 * @file: the #GFile containing the occurrence.
+	 * @line: the line of the start of the occurrence, counting from 0.
+	 * @start_byte: the start of the occurrence, in bytes from the start of
+	 *   @line.
+	 * @end_byte: the end of the occurrence, in bytes from the start of
+	 *   @line. It can be after the end of @line if the occurrence spans
+	 *   several lines.
+	 *
+	 * The ::match-found signal is emitted in the main context of the
+	 * thread that has started the search, for each occurrence found. The
+	 * positions are in the contents of @file converted to UTF-8. The
+	 * occurrences of a file are emitted together, in order, and the files
+	 * are reported in the order in which their search finishes.
+	 *
+	 * Since: 4.2
+	 */
+	signals[SIGNAL_MATCH_FOUND] =
+		g_signal_new ("match-found",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL, NULL,
+			      G_TYPE_NONE,
+			      4,
+			      G_TYPE_FILE,
+			      G_TYPE_INT,
+			      G_TYPE_INT,
+			      G_TYPE_INT);
+}
+
+static void
+gtk_source_file_search_init (GtkSourceFileSearch *search)
+{
+	search->priv = gtk_source_file_search_get_instance_private (search);
+	search->priv->candidate_encodings = gtk_source_encoding_get_default_candidates ();
+}
+
+/**
+ * gtk_source_file_search_new:
+ * @settings: (nullable): a #GtkSourceSearchSettings, or %NULL.
+ *
+ * Creates a new file search. If @settings is %NULL, a new
+ * #GtkSourceSearchSettings object is created.
+ *
+ * Returns: a new file search.
+ * Since: 4.2
+ */
+GtkSourceFileSearch *
+gtk_source_file_search_new (GtkSourceSearchSettings *settings)
+{
+	g_return_val_if_fail (settings == NULL || GTK_SOURCE_IS_SEARCH_SETTINGS (settings), NULL);
+
+	return g_object_new (GTK_SOURCE_TYPE_FILE_SEARCH,
+			     "settings", settings,
+			     NULL);
+}
+
+/**
+ * gtk_source_file_search_get_settings:
+ * @search: a #GtkSourceFileSearch.
+ *
+ * Returns: (transfer none): the search settings.
+ * Since: 4.2
+ */
+GtkSourceSearchSettings *
+gtk_source_file_search_get_settings (GtkSourceFileSearch *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_FILE_SEARCH (search), NULL);
+
+	return search->priv->settings;
+}
+
+/**
+ * gtk_source_file_search_set_candidate_encodings:
+ * @search: a #GtkSourceFileSearch.
+ * @candidate_encodings: (element-type GtkSourceEncoding): a list of
+ *   #GtkSourceEncoding<!-- -->s.
+ *
+ * Sets the candidate encodings used to decode the files, in the same way as
+ * gtk_source_file_loader_set_candidate_encodings(). By default the candidates
+ * are the ones of gtk_source_encoding_get_default_candidates(). A file that
+ * can not be decoded with any candidate is not searched.
+ *
+ * The candidate encodings are read when a search is started.
+ *
+ * Since: 4.2
+ */
+void
+gtk_source_file_search_set_candidate_encodings (GtkSourceFileSearch *search,
+						GSList              *candidate_encodings)
+{
+	GSList *list;
+
+	g_return_if_fail (GTK_SOURCE_IS_FILE_SEARCH (search));
+
+	list = g_slist_copy (candidate_encodings);
+	list = _gtk_source_encoding_remove_duplicates (list, GTK_SOURCE_ENCODING_DUPLICATES_KEEP_FIRST);
+
+	g_slist_free (search->priv->candidate_encodings);
+	search->priv->candidate_encodings = list;
+}
+
+/**
+ * gtk_source_file_search_search_async:
+ * @search: a #GtkSourceFileSearch.
+ * @files: (element-type GFile): the files to search.
+ * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
+ *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the search is
+ *   finished.
+ * @user_data: user data to pass to @callback.
+ *
+ * Searches @files with the current search settings, in worker threads. The
+ * occurrences are reported with the #GtkSourceFileSearch::match-found signal,
+ * before @callback is called. The files that can not be read or decoded are
+ * skipped.
+ *
+ * Several searches can run at the same time.
+ *
+ * Since: 4.2
+ */
+void
+gtk_source_file_search_search_async (GtkSourceFileSearch *search,
+				     GList               *files,
+				     gint                 io_priority,
+				     GCancellable        *cancellable,
+				     GAsyncReadyCallback  callback,
+				     gpointer             user_data)
+{
+	GTask *task;
+	SearchData *data;
+	GThreadPool *pool;
+	GError *error = NULL;
+	GList *l;
+	guint nb_threads;
+	guint i;
+
+	g_return_if_fail (GTK_SOURCE_IS_FILE_SEARCH (search));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	task = g_task_new (search, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+
+	if (files == NULL ||
+	    gtk_source_search_settings_get_search_text (search->priv->settings) == NULL)
+	{
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	data = g_slice_new0 (SearchData);
+	data->regex = create_regex (search->priv->settings, &error);
+
+	if (data->regex == NULL)
+	{
+		g_task_return_error (task, error);
+		g_slice_free (SearchData, data);
+		g_object_unref (task);
+		return;
+	}
+
+	data->candidate_encodings = g_slist_copy (search->priv->candidate_encodings);
+	data->nb_files = g_list_length (files);
+	data->nb_remaining_files = data->nb_files;
+	data->files = g_new (GFile *, data->nb_files);
+	data->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+	data->context = g_main_context_ref_thread_default ();
+	data->priority = io_priority;
+
+	for (l = files, i = 0; l != NULL; l = l->next, i++)
+	{
+		data->files[i] = g_object_ref (l->data);
+	}
+
+	g_task_set_task_data (task, data, (GDestroyNotify) search_data_free);
+
+	/* The files are always read in worker threads, so with
+	 * GTK_SOURCE_SEARCH_THREADS=0 they are searched in one thread.
+	 */
+	nb_threads = MAX (_gtk_source_utils_get_nb_search_threads (), 1);
+
+	pool = g_thread_pool_new (search_file_thread,
+				  task,
+				  MIN (nb_threads, data->nb_files),
+				  FALSE,
+				  NULL);
+
+	for (i = 0; i < data->nb_files; i++)
+	{
+		g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+	}
+
+	/* The queued files are still searched, the threads exit afterwards.
+	 * The reference to the task is released when the last FileResult is
+	 * received, in file_result_cb().
+	 */
+	g_thread_pool_free (pool, FALSE, FALSE);
+}
+
+/**
+ * gtk_source_file_search_search_finish:
+ * @search: a #GtkSourceFileSearch.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes a search started with gtk_source_file_search_search_async(). An
+ * error is returned if the search has been cancelled, or if the regex of the
+ * search settings is invalid.
+ *
+ * Returns: whether the search has been done.
+ * Since: 4.2
+ */
+gboolean
+gtk_source_file_search_search_finish (GtkSourceFileSearch  *search,
+				      GAsyncResult         *result,
+				      GError              **error)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_FILE_SEARCH (search), FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, search), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
@@ -0,0 +1,83 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTK_SOURCE_FILE_SEARCH_H
+#define GTK_SOURCE_FILE_SEARCH_H
+
+#if !defined (GTK_SOURCE_H_INSIDE) && !defined (GTK_SOURCE_COMPILATION)
+#error "Only <gtksourceview/gtksource.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <gtksourceview/gtksourcetypes.h>
+
+G_BEGIN_DECLS
+
+#define GTK_SOURCE_TYPE_FILE_SEARCH             (gtk_source_file_search_get_type ())
+#define GTK_SOURCE_FILE_SEARCH(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTK_SOURCE_TYPE_FILE_SEARCH, GtkSourceFileSearch))
+#define GTK_SOURCE_FILE_SEARCH_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), GTK_SOURCE_TYPE_FILE_SEARCH, GtkSourceFileSearchClass))
+#define GTK_SOURCE_IS_FILE_SEARCH(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTK_SOURCE_TYPE_FILE_SEARCH))
+#define GTK_SOURCE_IS_FILE_SEARCH_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), GTK_SOURCE_TYPE_FILE_SEARCH))
+#define GTK_SOURCE_FILE_SEARCH_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), GTK_SOURCE_TYPE_FILE_SEARCH, GtkSourceFileSearchClass))
+
+typedef struct _GtkSourceFileSearchClass    GtkSourceFileSearchClass;
+typedef struct _GtkSourceFileSearchPrivate  GtkSourceFileSearchPrivate;
+
+struct _GtkSourceFileSearch
+{
+	GObject parent;
+
+	GtkSourceFileSearchPrivate *priv;
+};
+
+struct _GtkSourceFileSearchClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[10];
+};
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+GType			 gtk_source_file_search_get_type			(void) G_GNUC_CONST;
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+GtkSourceFileSearch	*gtk_source_file_search_new				(GtkSourceSearchSettings *settings);
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+GtkSourceSearchSettings	*gtk_source_file_search_get_settings			(GtkSourceFileSearch     *search);
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+void			 gtk_source_file_search_set_candidate_encodings		(GtkSourceFileSearch     *search,
+										 GSList                  *candidate_encodings);
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+void			 gtk_source_file_search_search_async			(GtkSourceFileSearch     *search,
+										 GList                   *files,
+										 gint                     io_priority,
+										 GCancellable            *cancellable,
+										 GAsyncReadyCallback      callback,
+										 gpointer                 user_data);
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+gboolean		 gtk_source_file_search_search_finish			(GtkSourceFileSearch     *search,
+										 GAsyncResult            *result,
+										 GError                 **error);
+
+G_END_DECLS
+
+#endif /* GTK_SOURCE_FILE_SEARCH_H */
@@ -30,6 +30,9 @@ G_BEGIN_DECLS
 #define GTK_SOURCE_LANGUAGE_VERSION_1_0  100
 #define GTK_SOURCE_LANGUAGE_VERSION_2_0  200
 
+/* GVariant type of _gtk_source_language_serialize(). */
+#define GTK_SOURCE_LANGUAGE_VARIANT_TYPE "(smssbmsbbia{ss})"
+
 typedef struct _GtkSourceStyleInfo GtkSourceStyleInfo;
 
 struct _GtkSourceStyleInfo
@@ -47,6 +50,14 @@ struct _GtkSourceLanguagePrivate
 	gchar                    *name;
 	gchar                    *section;
 
+	/* The name and section as written in the lang file, before the
+	 * translation. untranslated_section is NULL for the default section.
+	 */
+	gchar                    *untranslated_name;
+	gchar                    *untranslated_section;
+	guint                     name_translatable : 1;
+	guint                     section_translatable : 1;
+
 	/* Maps ids to GtkSourceStyleInfo objects */
 	/* Names of styles defined in other lang files are not stored */
 	GHashTable               *styles;
@@ -66,6 +77,14 @@ G_GNUC_INTERNAL
 GtkSourceLanguage 	 *_gtk_source_language_new_from_file 		(const gchar		   *filename,
 									 GtkSourceLanguageManager  *lm);
 
+G_GNUC_INTERNAL
+GtkSourceLanguage 	 *_gtk_source_language_new_from_variant		(GVariant		   *variant,
+									 const gchar		   *filename,
+									 GtkSourceLanguageManager  *lm);
+
+G_GNUC_INTERNAL
+GVariant		 *_gtk_source_language_serialize		(GtkSourceLanguage        *language);
+
 G_GNUC_INTERNAL
 GtkSourceLanguageManager *_gtk_source_language_get_language_manager 	(GtkSourceLanguage        *language);
 
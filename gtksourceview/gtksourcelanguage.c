@@ -69,6 +69,15 @@ static GtkSourceLanguage *process_language_node (xmlTextReaderPtr	 reader,
 						 const gchar		*filename);
 static gboolean		  force_styles		(GtkSourceLanguage	*language);
 
+static void
+set_language_manager (GtkSourceLanguage        *lang,
+		      GtkSourceLanguageManager *lm)
+{
+	lang->priv->language_manager = lm;
+	g_object_add_weak_pointer (G_OBJECT (lm),
+				   (gpointer) &lang->priv->language_manager);
+}
+
 GtkSourceLanguage *
 _gtk_source_language_new_from_file (const gchar              *filename,
 				    GtkSourceLanguageManager *lm)
@@ -134,14 +143,128 @@ _gtk_source_language_new_from_file (const gchar              *filename,
 
 	if (lang != NULL)
 	{
-		lang->priv->language_manager = lm;
-		g_object_add_weak_pointer (G_OBJECT (lm),
-					   (gpointer) &lang->priv->language_manager);
+		set_language_manager (lang, lm);
 	}
 
 	return lang;
 }
 
+/**
+ * _gtk_source_language_new_from_variant:
+ * @variant: a #GVariant returned by _gtk_source_language_serialize().
+ * @filename: the lang file of the language.
+ * @lm: a #GtkSourceLanguageManager.
+ *
+ * Creates a language from the metadata kept in the cache of the language
+ * manager, without reading @filename. The name and section are translated
+ * with the current locale.
+ *
+ * Returns: a new #GtkSourceLanguage.
+ */
+GtkSourceLanguage *
+_gtk_source_language_new_from_variant (GVariant                 *variant,
+				       const gchar              *filename,
+				       GtkSourceLanguageManager *lm)
+{
+	GtkSourceLanguage *lang;
+	GVariantIter *properties;
+	const gchar *key;
+	const gchar *value;
+	gboolean name_translatable;
+	gboolean section_translatable;
+	gboolean hidden;
+
+	g_return_val_if_fail (g_variant_is_of_type (variant, G_VARIANT_TYPE (GTK_SOURCE_LANGUAGE_VARIANT_TYPE)), NULL);
+	g_return_val_if_fail (filename != NULL, NULL);
+	g_return_val_if_fail (lm != NULL, NULL);
+
+	lang = g_object_new (GTK_SOURCE_TYPE_LANGUAGE, NULL);
+
+	lang->priv->lang_file_name = g_strdup (filename);
+
+	g_variant_get (variant,
+		       "(smssbmsbbia{ss})",
+		       &lang->priv->id,
+		       &lang->priv->translation_domain,
+		       &lang->priv->untranslated_name,
+		       &name_translatable,
+		       &lang->priv->untranslated_section,
+		       &section_translatable,
+		       &hidden,
+		       &lang->priv->version,
+		       &properties);
+
+	lang->priv->name_translatable = name_translatable;
+	lang->priv->section_translatable = section_translatable;
+	lang->priv->hidden = hidden;
+
+	if (name_translatable)
+		lang->priv->name = _gtk_source_language_translate_string (lang, lang->priv->untranslated_name);
+	else
+		lang->priv->name = g_strdup (lang->priv->untranslated_name);
+
+	if (lang->priv->untranslated_section == NULL)
+		lang->priv->section = g_strdup (DEFAULT_SECTION);
+	else if (section_translatable)
+		lang->priv->section = _gtk_source_language_translate_string (lang, lang->priv->untranslated_section);
+	else
+		lang->priv->section = g_strdup (lang->priv->untranslated_section);
+
+	while (g_variant_iter_next (properties, "{&s&s}", &key, &value))
+	{
+		g_hash_table_insert (lang->priv->properties,
+				     g_strdup (key),
+				     g_strdup (value));
+	}
+
+	g_variant_iter_free (properties);
+
+	set_language_manager (lang, lm);
+
+	return lang;
+}
+
+/**
+ * _gtk_source_language_serialize:
+ * @language: a #GtkSourceLanguage.
+ *
+ * Serializes the metadata of @language, i.e. what is read from the lang file
+ * before the definitions of the contexts. See
+ * _gtk_source_language_new_from_variant().
+ *
+ * Returns: (transfer floating): a #GVariant of type
+ * %GTK_SOURCE_LANGUAGE_VARIANT_TYPE.
+ */
+GVariant *
+_gtk_source_language_serialize (GtkSourceLanguage *language)
+{
+	GVariantBuilder properties;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_LANGUAGE (language), NULL);
+
+	g_variant_builder_init (&properties, G_VARIANT_TYPE ("a{ss}"));
+
+	g_hash_table_iter_init (&iter, language->priv->properties);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+	{
+		g_variant_builder_add (&properties, "{ss}", key, value);
+	}
+
+	return g_variant_new ("(smssbmsbbia{ss})",
+			      language->priv->id,
+			      language->priv->translation_domain,
+			      language->priv->untranslated_name,
+			      (gboolean) language->priv->name_translatable,
+			      language->priv->untranslated_section,
+			      (gboolean) language->priv->section_translatable,
+			      language->priv->hidden,
+			      language->priv->version,
+			      &properties);
+}
+
 static void
 gtk_source_language_get_property (GObject    *object,
 				  guint       prop_id,
@@ -209,6 +332,8 @@ gtk_source_language_finalize (GObject *object)
 	g_free (lang->priv->translation_domain);
 	g_free (lang->priv->name);
 	g_free (lang->priv->section);
+	g_free (lang->priv->untranslated_name);
+	g_free (lang->priv->untranslated_section);
 	g_free (lang->priv->id);
 	g_hash_table_destroy (lang->priv->properties);
 
@@ -401,9 +526,12 @@ process_language_node (xmlTextReaderPtr reader, const gchar *filename)
 	else
 	{
 		lang->priv->name = _gtk_source_language_translate_string (lang, (gchar*) tmp);
+		lang->priv->name_translatable = TRUE;
 		untranslated_name = tmp;
 	}
 
+	lang->priv->untranslated_name = g_strdup ((gchar*) untranslated_name);
+
 	tmp = xmlTextReaderGetAttribute (reader, BAD_CAST "id");
 	if (tmp != NULL)
 	{
@@ -426,11 +554,14 @@ process_language_node (xmlTextReaderPtr reader, const gchar *filename)
 		else
 			lang->priv->section = g_strdup ((gchar *) tmp);
 
+		lang->priv->untranslated_section = g_strdup ((gchar *) tmp);
 		xmlFree (tmp);
 	}
 	else
 	{
 		lang->priv->section = _gtk_source_language_translate_string (lang, (gchar*) tmp);
+		lang->priv->untranslated_section = g_strdup ((gchar *) tmp);
+		lang->priv->section_translatable = TRUE;
 		xmlFree (tmp);
 	}
 
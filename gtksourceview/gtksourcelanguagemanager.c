@@ -50,6 +50,17 @@
 #define LANGUAGE_DIR		"language-specs"
 #define LANG_FILE_SUFFIX	".lang"
 
+/* The metadata of the languages is cached in the user cache directory, so that
+ * the lang files don't need to be parsed to know the available languages. There
+ * is one cache file per search path, named after a checksum of the search path.
+ * An entry of the cache is used only if the lang file has the same modification
+ * time, in microseconds, and size as when the entry was written.
+ */
+#define LANGUAGE_CACHE_PREFIX	"languages-"
+#define LANGUAGE_CACHE_SUFFIX	".cache"
+#define LANGUAGE_CACHE_VERSION	2
+#define LANGUAGE_CACHE_TYPE	"(ua(sxt" GTK_SOURCE_LANGUAGE_VARIANT_TYPE "))"
+
 enum {
 	PROP_0,
 	PROP_SEARCH_PATH,
@@ -342,11 +353,214 @@ language_compare (const gchar **id1, const gchar **id2, GHashTable *language_ids
 	return g_utf8_collate (name1, name2);
 }
 
+static gchar *
+get_language_cache_filename (GtkSourceLanguageManager *lm)
+{
+	gchar *search_path;
+	gchar *checksum;
+	gchar *basename;
+	gchar *filename;
+
+	search_path = g_strjoinv ("\n", (gchar **) gtk_source_language_manager_get_search_path (lm));
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, search_path, -1);
+	basename = g_strconcat (LANGUAGE_CACHE_PREFIX, checksum, LANGUAGE_CACHE_SUFFIX, NULL);
+
+	filename = g_build_filename (g_get_user_cache_dir (),
+				     "gtksourceview-" GSV_API_VERSION,
+				     basename,
+				     NULL);
+
+	g_free (search_path);
+	g_free (checksum);
+	g_free (basename);
+	return filename;
+}
+
+/* Returns a hash table of the cache entries, indexed by the lang file name.
+ * The mapped file must be kept while the entries are used.
+ */
+static GHashTable *
+load_language_cache (GtkSourceLanguageManager *lm)
+{
+	GHashTable *entries;
+	gchar *filename;
+	GMappedFile *mapped_file;
+	GBytes *bytes;
+	GVariant *cache;
+	GVariant *array;
+	guint32 version;
+	gsize i;
+
+	entries = g_hash_table_new_full (g_str_hash,
+					 g_str_equal,
+					 NULL,
+					 (GDestroyNotify) g_variant_unref);
+
+	filename = get_language_cache_filename (lm);
+	mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+	g_free (filename);
+
+	if (mapped_file == NULL)
+	{
+		return entries;
+	}
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	g_mapped_file_unref (mapped_file);
+
+	/* GVariant can be safely used with invalid data, a corrupted cache
+	 * doesn't need special care.
+	 */
+	cache = g_variant_new_from_bytes (G_VARIANT_TYPE (LANGUAGE_CACHE_TYPE), bytes, FALSE);
+	g_variant_ref_sink (cache);
+	g_bytes_unref (bytes);
+
+	g_variant_get_child (cache, 0, "u", &version);
+
+	if (version != LANGUAGE_CACHE_VERSION)
+	{
+		g_variant_unref (cache);
+		return entries;
+	}
+
+	array = g_variant_get_child_value (cache, 1);
+
+	for (i = 0; i < g_variant_n_children (array); i++)
+	{
+		GVariant *entry;
+		const gchar *lang_file_name;
+
+		entry = g_variant_get_child_value (array, i);
+		g_variant_get_child (entry, 0, "&s", &lang_file_name);
+		g_hash_table_insert (entries, (gpointer) lang_file_name, entry);
+	}
+
+	g_variant_unref (array);
+	g_variant_unref (cache);
+
+	return entries;
+}
+
+static void
+save_language_cache (GtkSourceLanguageManager *lm,
+		     GVariantBuilder          *builder)
+{
+	GVariant *cache;
+	gchar *filename;
+	gchar *dirname;
+
+	cache = g_variant_new ("(u@a(sxt" GTK_SOURCE_LANGUAGE_VARIANT_TYPE "))",
+			       LANGUAGE_CACHE_VERSION,
+			       g_variant_builder_end (builder));
+	g_variant_ref_sink (cache);
+
+	filename = get_language_cache_filename (lm);
+	dirname = g_path_get_dirname (filename);
+
+	/* The cache is only an optimization, errors are ignored. */
+	if (g_mkdir_with_parents (dirname, 0755) == 0)
+	{
+		g_file_set_contents (filename,
+				     g_variant_get_data (cache),
+				     g_variant_get_size (cache),
+				     NULL);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_variant_unref (cache);
+}
+
+/* Creates the language of @filename from its entry in @cache_entries if it
+ * is up to date, or by reading the file. The entry to write in the new cache
+ * is added to @builder.
+ */
+static GtkSourceLanguage *
+load_language (GtkSourceLanguageManager *lm,
+	       const gchar              *filename,
+	       GHashTable               *cache_entries,
+	       GVariantBuilder          *builder,
+	       gboolean                 *cache_changed)
+{
+	GtkSourceLanguage *lang;
+	GFile *file;
+	GFileInfo *info;
+	gint64 file_mtime;
+	guint64 file_size;
+	GVariant *entry;
+
+	file = g_file_new_for_path (filename);
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  NULL);
+	g_object_unref (file);
+
+	if (info == NULL)
+	{
+		*cache_changed = TRUE;
+		return _gtk_source_language_new_from_file (filename, lm);
+	}
+
+	file_mtime = (gint64) g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		     g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	file_size = (guint64) g_file_info_get_size (info);
+	g_object_unref (info);
+
+	entry = g_hash_table_lookup (cache_entries, filename);
+
+	if (entry != NULL)
+	{
+		gint64 mtime;
+		guint64 size;
+		GVariant *lang_variant;
+
+		g_variant_get_child (entry, 1, "x", &mtime);
+		g_variant_get_child (entry, 2, "t", &size);
+
+		if (mtime == file_mtime && size == file_size)
+		{
+			lang_variant = g_variant_get_child_value (entry, 3);
+			lang = _gtk_source_language_new_from_variant (lang_variant, filename, lm);
+			g_variant_unref (lang_variant);
+
+			if (lang != NULL)
+			{
+				g_variant_builder_add_value (builder, entry);
+				return lang;
+			}
+		}
+	}
+
+	*cache_changed = TRUE;
+
+	lang = _gtk_source_language_new_from_file (filename, lm);
+
+	if (lang != NULL)
+	{
+		g_variant_builder_add (builder,
+				       "(sxt@" GTK_SOURCE_LANGUAGE_VARIANT_TYPE ")",
+				       filename,
+				       file_mtime,
+				       file_size,
+				       _gtk_source_language_serialize (lang));
+	}
+
+	return lang;
+}
+
 static void
 ensure_languages (GtkSourceLanguageManager *lm)
 {
 	GSList *filenames, *l;
 	GPtrArray *ids_array = NULL;
+	GHashTable *cache_entries;
+	GVariantBuilder builder;
+	gboolean cache_changed = FALSE;
+	guint n_cached = 0;
 
 	if (lm->priv->language_ids != NULL)
 		return;
@@ -358,6 +572,9 @@ ensure_languages (GtkSourceLanguageManager *lm)
 						     LANG_FILE_SUFFIX,
 						     TRUE);
 
+	cache_entries = load_language_cache (lm);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sxt" GTK_SOURCE_LANGUAGE_VARIANT_TYPE ")"));
+
 	for (l = filenames; l != NULL; l = l->next)
 	{
 		GtkSourceLanguage *lang;
@@ -365,7 +582,7 @@ ensure_languages (GtkSourceLanguageManager *lm)
 
 		filename = l->data;
 
-		lang = _gtk_source_language_new_from_file (filename, lm);
+		lang = load_language (lm, filename, cache_entries, &builder, &cache_changed);
 
 		if (lang == NULL)
 		{
@@ -373,6 +590,8 @@ ensure_languages (GtkSourceLanguageManager *lm)
 			continue;
 		}
 
+		n_cached++;
+
 		if (g_hash_table_lookup (lm->priv->language_ids, lang->priv->id) == NULL)
 		{
 			g_hash_table_insert (lm->priv->language_ids,
@@ -404,6 +623,17 @@ ensure_languages (GtkSourceLanguageManager *lm)
 		lm->priv->ids = (gchar **)g_ptr_array_free (ids_array, FALSE);
 	}
 
+	/* Also rewrite the cache when lang files have been removed. */
+	if (cache_changed || n_cached != g_hash_table_size (cache_entries))
+	{
+		save_language_cache (lm, &builder);
+	}
+	else
+	{
+		g_variant_builder_clear (&builder);
+	}
+
+	g_hash_table_unref (cache_entries);
 	g_slist_free_full (filenames, g_free);
 }
 
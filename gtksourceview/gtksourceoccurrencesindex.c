@@ -0,0 +1,711 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gtksourceoccurrencesindex.h"
+
+#include <string.h>
+
+/* The occurrences index of a GtkSourceSearchContext: the non-overlapping
+ * occurrences of the search, as character offsets, sorted by offset.
+ *
+ * The occurrences are stored in blocks of at most BLOCK_SIZE (start, length)
+ * entries, packed in an array, instead of one allocation per occurrence. The
+ * starts are relative to the base of their block, which is the start of its
+ * first occurrence. A full block is split in two halves.
+ *
+ * The base of a block is itself stored relatively, as the gap from the base of
+ * the previous block. So on text insertion or deletion, only the entries of one
+ * block and the gap of the next block are changed, all the following blocks are
+ * shifted with it. The gaps and the numbers of entries are summed in a Fenwick
+ * tree (binary indexed tree), so the base of a block, the block containing an
+ * offset, and the position of an occurrence are found in O(log n). Shifting
+ * the occurrences is thus O(BLOCK_SIZE + log n). Only inserting a block
+ * elsewhere than at the end, or removing blocks, rebuilds the tree, in
+ * O(n / BLOCK_SIZE).
+ */
+
+#define BLOCK_SIZE 128
+
+typedef struct
+{
+	/* Relative to the base of the block. */
+	gint start;
+	gint length;
+} Entry;
+
+typedef struct
+{
+	/* The base of the block minus the base of the previous block, or the
+	 * base for the first block.
+	 */
+	gint gap;
+
+	guint n_entries;
+	Entry entries[BLOCK_SIZE];
+} Block;
+
+/* A node of the Fenwick tree. */
+typedef struct
+{
+	gint gap;
+	gint n_entries;
+} Sums;
+
+struct _GtkSourceOccurrencesIndex
+{
+	/* The blocks sorted by offset. Outside of
+	 * _gtk_source_occurrences_index_remove(), none of them is empty.
+	 */
+	GPtrArray *blocks;
+
+	/* The Fenwick tree of the gaps and numbers of entries of the blocks,
+	 * as Sums. The node 0 is unused, the node j contains the sums of the
+	 * blocks [j - lowbit (j); j[.
+	 */
+	GArray *sums;
+
+	guint n_occurrences;
+};
+
+static void
+block_free (Block *block)
+{
+	g_slice_free (Block, block);
+}
+
+static inline Block *
+get_block (GtkSourceOccurrencesIndex *index,
+	   guint                      block_num)
+{
+	return g_ptr_array_index (index->blocks, block_num);
+}
+
+static inline guint
+lowbit (guint j)
+{
+	return j & (~j + 1);
+}
+
+static inline Sums *
+get_sums (GtkSourceOccurrencesIndex *index,
+	  guint                      node)
+{
+	return &g_array_index (index->sums, Sums, node);
+}
+
+/* Rebuilds the Fenwick tree from the blocks, in linear time. */
+static void
+sums_rebuild (GtkSourceOccurrencesIndex *index)
+{
+	guint n_blocks = index->blocks->len;
+	guint node;
+
+	g_array_set_size (index->sums, n_blocks + 1);
+
+	for (node = 1; node <= n_blocks; node++)
+	{
+		Block *block = get_block (index, node - 1);
+		Sums *sums = get_sums (index, node);
+
+		sums->gap = block->gap;
+		sums->n_entries = block->n_entries;
+	}
+
+	for (node = 1; node <= n_blocks; node++)
+	{
+		guint parent = node + lowbit (node);
+
+		if (parent <= n_blocks)
+		{
+			get_sums (index, parent)->gap += get_sums (index, node)->gap;
+			get_sums (index, parent)->n_entries += get_sums (index, node)->n_entries;
+		}
+	}
+}
+
+/* Adds the last block to the Fenwick tree. */
+static void
+sums_append (GtkSourceOccurrencesIndex *index)
+{
+	guint node = index->blocks->len;
+	Block *block = get_block (index, node - 1);
+	Sums sums;
+	guint child;
+
+	sums.gap = block->gap;
+	sums.n_entries = block->n_entries;
+
+	for (child = node - 1; child > node - lowbit (node); child -= lowbit (child))
+	{
+		sums.gap += get_sums (index, child)->gap;
+		sums.n_entries += get_sums (index, child)->n_entries;
+	}
+
+	g_array_append_val (index->sums, sums);
+}
+
+/* Adds the deltas to the gap and the number of entries of a block. */
+static void
+update_block (GtkSourceOccurrencesIndex *index,
+	      guint                      block_num,
+	      gint                       gap_delta,
+	      gint                       n_entries_delta)
+{
+	Block *block = get_block (index, block_num);
+	guint node;
+
+	block->gap += gap_delta;
+	block->n_entries += n_entries_delta;
+
+	for (node = block_num + 1; node < index->sums->len; node += lowbit (node))
+	{
+		get_sums (index, node)->gap += gap_delta;
+		get_sums (index, node)->n_entries += n_entries_delta;
+	}
+}
+
+static gint
+get_block_base (GtkSourceOccurrencesIndex *index,
+		guint                      block_num)
+{
+	gint base = 0;
+	guint node;
+
+	for (node = block_num + 1; node > 0; node -= lowbit (node))
+	{
+		base += get_sums (index, node)->gap;
+	}
+
+	return base;
+}
+
+/* Returns the number of entries of the blocks before @block_num. */
+static guint
+count_entries_before (GtkSourceOccurrencesIndex *index,
+		      guint                      block_num)
+{
+	guint n_entries = 0;
+	guint node;
+
+	for (node = block_num; node > 0; node -= lowbit (node))
+	{
+		n_entries += get_sums (index, node)->n_entries;
+	}
+
+	return n_entries;
+}
+
+/* Returns the number of blocks whose base is at or before @offset. The gaps
+ * are not negative, so the bases are sorted and the tree can be descended.
+ */
+static guint
+count_blocks_before (GtkSourceOccurrencesIndex *index,
+		     gint                       offset)
+{
+	guint n_blocks = index->blocks->len;
+	guint node = 0;
+	guint step = 1;
+
+	if (n_blocks == 0)
+	{
+		return 0;
+	}
+
+	while (step <= n_blocks / 2)
+	{
+		step *= 2;
+	}
+
+	for (; step > 0; step /= 2)
+	{
+		if (node + step <= n_blocks &&
+		    get_sums (index, node + step)->gap <= offset)
+		{
+			node += step;
+			offset -= get_sums (index, node)->gap;
+		}
+	}
+
+	return node;
+}
+
+/* Returns the position of the first entry of @block starting at or after
+ * @offset, or the number of entries.
+ */
+static guint
+block_search (Block *block,
+	      gint   base,
+	      gint   offset)
+{
+	guint min = 0;
+	guint max = block->n_entries;
+
+	while (min < max)
+	{
+		guint middle = min + (max - min) / 2;
+
+		if (base + block->entries[middle].start < offset)
+		{
+			min = middle + 1;
+		}
+		else
+		{
+			max = middle;
+		}
+	}
+
+	return min;
+}
+
+/* Makes the start of the first entry the base of the block. */
+static void
+rebase_block (GtkSourceOccurrencesIndex *index,
+	      guint                      block_num)
+{
+	Block *block = get_block (index, block_num);
+	gint shift = block->entries[0].start;
+	guint i;
+
+	if (shift == 0)
+	{
+		return;
+	}
+
+	for (i = 0; i < block->n_entries; i++)
+	{
+		block->entries[i].start -= shift;
+	}
+
+	update_block (index, block_num, shift, 0);
+
+	if (block_num + 1 < index->blocks->len)
+	{
+		update_block (index, block_num + 1, -shift, 0);
+	}
+}
+
+/* Moves the second half of the block @block_num to a new block. */
+static void
+split_block (GtkSourceOccurrencesIndex *index,
+	     guint                      block_num)
+{
+	Block *block = get_block (index, block_num);
+	Block *new_block;
+	guint half = block->n_entries / 2;
+	gint shift = block->entries[half].start;
+	guint i;
+
+	new_block = g_slice_new (Block);
+	new_block->gap = shift;
+	new_block->n_entries = block->n_entries - half;
+
+	for (i = 0; i < new_block->n_entries; i++)
+	{
+		new_block->entries[i].start = block->entries[half + i].start - shift;
+		new_block->entries[i].length = block->entries[half + i].length;
+	}
+
+	if (block_num + 1 == index->blocks->len)
+	{
+		update_block (index, block_num, 0, -(gint) new_block->n_entries);
+		g_ptr_array_add (index->blocks, new_block);
+		sums_append (index);
+		return;
+	}
+
+	block->n_entries = half;
+	get_block (index, block_num + 1)->gap -= shift;
+	g_ptr_array_insert (index->blocks, block_num + 1, new_block);
+	sums_rebuild (index);
+}
+
+/* Removes the @n_blocks empty blocks starting at @block_num. */
+static void
+remove_empty_blocks (GtkSourceOccurrencesIndex *index,
+		     guint                      block_num,
+		     guint                      n_blocks)
+{
+	gint gap = 0;
+	guint i;
+
+	for (i = block_num; i < block_num + n_blocks; i++)
+	{
+		gap += get_block (index, i)->gap;
+	}
+
+	if (block_num + n_blocks < index->blocks->len)
+	{
+		get_block (index, block_num + n_blocks)->gap += gap;
+	}
+
+	g_ptr_array_remove_range (index->blocks, block_num, n_blocks);
+	sums_rebuild (index);
+}
+
+GtkSourceOccurrencesIndex *
+_gtk_source_occurrences_index_new (void)
+{
+	GtkSourceOccurrencesIndex *index;
+
+	index = g_slice_new (GtkSourceOccurrencesIndex);
+	index->blocks = g_ptr_array_new_with_free_func ((GDestroyNotify) block_free);
+	index->sums = g_array_sized_new (FALSE, TRUE, sizeof (Sums), 1);
+	g_array_set_size (index->sums, 1);
+	index->n_occurrences = 0;
+
+	return index;
+}
+
+void
+_gtk_source_occurrences_index_free (GtkSourceOccurrencesIndex *index)
+{
+	if (index != NULL)
+	{
+		g_ptr_array_unref (index->blocks);
+		g_array_unref (index->sums);
+		g_slice_free (GtkSourceOccurrencesIndex, index);
+	}
+}
+
+void
+_gtk_source_occurrences_index_clear (GtkSourceOccurrencesIndex *index)
+{
+	g_ptr_array_set_size (index->blocks, 0);
+	g_array_set_size (index->sums, 1);
+	index->n_occurrences = 0;
+}
+
+guint
+_gtk_source_occurrences_index_get_length (GtkSourceOccurrencesIndex *index)
+{
+	return index->n_occurrences;
+}
+
+/* Adds the occurrence [start; end[, which must not overlap the other
+ * occurrences.
+ */
+void
+_gtk_source_occurrences_index_add (GtkSourceOccurrencesIndex *index,
+				   gint                       start,
+				   gint                       end)
+{
+	GtkSourceOccurrencesIter iter;
+	Block *block;
+	guint block_num;
+	guint pos;
+	gint base;
+
+	g_return_if_fail (start <= end);
+
+	_gtk_source_occurrences_index_iter_at_offset (index, &iter, start);
+	block_num = iter.block_num;
+	pos = iter.pos;
+
+	if (index->blocks->len == 0)
+	{
+		block = g_slice_new (Block);
+		block->gap = start;
+		block->n_entries = 0;
+		g_ptr_array_add (index->blocks, block);
+		sums_append (index);
+	}
+	else if (pos == 0 && block_num > 0)
+	{
+		/* At the end of the previous block, so the base of the block
+		 * doesn't change. So only the first block can get a new first
+		 * entry.
+		 */
+		block_num--;
+		pos = get_block (index, block_num)->n_entries;
+	}
+
+	block = get_block (index, block_num);
+
+	if (block->n_entries == BLOCK_SIZE)
+	{
+		split_block (index, block_num);
+
+		if (pos > block->n_entries)
+		{
+			pos -= block->n_entries;
+			block_num++;
+			block = get_block (index, block_num);
+		}
+	}
+
+	base = get_block_base (index, block_num);
+
+	memmove (&block->entries[pos + 1],
+		 &block->entries[pos],
+		 (block->n_entries - pos) * sizeof (Entry));
+
+	block->entries[pos].start = start - base;
+	block->entries[pos].length = end - start;
+	update_block (index, block_num, 0, 1);
+	index->n_occurrences++;
+
+	if (pos == 0)
+	{
+		rebase_block (index, block_num);
+	}
+}
+
+/* Removes the occurrences starting in [start_offset; end_offset[. */
+void
+_gtk_source_occurrences_index_remove (GtkSourceOccurrencesIndex *index,
+				      gint                       start_offset,
+				      gint                       end_offset)
+{
+	GtkSourceOccurrencesIter iter;
+	guint block_num;
+	guint pos;
+	guint first_empty_block = 0;
+	guint n_empty_blocks = 0;
+
+	if (start_offset >= end_offset)
+	{
+		return;
+	}
+
+	_gtk_source_occurrences_index_iter_at_offset (index, &iter, start_offset);
+	block_num = iter.block_num;
+	pos = iter.pos;
+
+	while (block_num < index->blocks->len)
+	{
+		Block *block = get_block (index, block_num);
+		guint end_pos = block_search (block, get_block_base (index, block_num), end_offset);
+		guint n_removed = end_pos - pos;
+		gboolean done = end_pos < block->n_entries;
+
+		memmove (&block->entries[pos],
+			 &block->entries[end_pos],
+			 (block->n_entries - end_pos) * sizeof (Entry));
+
+		update_block (index, block_num, 0, -(gint) n_removed);
+		index->n_occurrences -= n_removed;
+
+		/* The empty blocks are contiguous, they are removed at the
+		 * end, so the tree is rebuilt only once.
+		 */
+		if (block->n_entries == 0)
+		{
+			if (n_empty_blocks == 0)
+			{
+				first_empty_block = block_num;
+			}
+
+			n_empty_blocks++;
+		}
+		else if (pos == 0)
+		{
+			rebase_block (index, block_num);
+		}
+
+		if (done)
+		{
+			break;
+		}
+
+		block_num++;
+		pos = 0;
+	}
+
+	if (n_empty_blocks > 0)
+	{
+		remove_empty_blocks (index, first_empty_block, n_empty_blocks);
+	}
+}
+
+/* Adds @delta to the occurrences starting at or after @offset. The order of
+ * the occurrences must be kept, so when text is deleted, the occurrences in
+ * the deleted text must have been removed before.
+ */
+void
+_gtk_source_occurrences_index_shift (GtkSourceOccurrencesIndex *index,
+				     gint                       offset,
+				     gint                       delta)
+{
+	GtkSourceOccurrencesIter iter;
+	guint block_num;
+
+	_gtk_source_occurrences_index_iter_at_offset (index, &iter, offset);
+
+	if (_gtk_source_occurrences_index_iter_is_end (&iter))
+	{
+		return;
+	}
+
+	block_num = iter.block_num;
+
+	if (iter.pos > 0)
+	{
+		Block *block = get_block (index, block_num);
+		guint i;
+
+		for (i = iter.pos; i < block->n_entries; i++)
+		{
+			block->entries[i].start += delta;
+		}
+
+		block_num++;
+	}
+
+	/* Shifts the following blocks too. */
+	if (block_num < index->blocks->len)
+	{
+		update_block (index, block_num, delta, 0);
+	}
+}
+
+static void
+iter_init (GtkSourceOccurrencesIndex *index,
+	   GtkSourceOccurrencesIter  *iter,
+	   guint                      block_num)
+{
+	iter->index = index;
+	iter->block_num = block_num;
+	iter->pos = 0;
+	iter->base = block_num < index->blocks->len ? get_block_base (index, block_num) : 0;
+}
+
+/* Sets @iter at the first occurrence starting at or after @offset, or at the
+ * end of the index.
+ */
+void
+_gtk_source_occurrences_index_iter_at_offset (GtkSourceOccurrencesIndex *index,
+					      GtkSourceOccurrencesIter  *iter,
+					      gint                       offset)
+{
+	guint n_blocks;
+	Block *block;
+
+	n_blocks = count_blocks_before (index, offset);
+
+	if (n_blocks == 0)
+	{
+		iter_init (index, iter, 0);
+		return;
+	}
+
+	iter_init (index, iter, n_blocks - 1);
+	block = get_block (index, n_blocks - 1);
+	iter->pos = block_search (block, iter->base, offset);
+
+	if (iter->pos == block->n_entries)
+	{
+		iter_init (index, iter, n_blocks);
+	}
+}
+
+gboolean
+_gtk_source_occurrences_index_iter_is_end (const GtkSourceOccurrencesIter *iter)
+{
+	return iter->block_num >= iter->index->blocks->len;
+}
+
+/* Returns FALSE if @iter is moved to the end of the index. */
+gboolean
+_gtk_source_occurrences_index_iter_next (GtkSourceOccurrencesIter *iter)
+{
+	GPtrArray *blocks;
+
+	g_return_val_if_fail (!_gtk_source_occurrences_index_iter_is_end (iter), FALSE);
+
+	blocks = iter->index->blocks;
+	iter->pos++;
+
+	if (iter->pos < get_block (iter->index, iter->block_num)->n_entries)
+	{
+		return TRUE;
+	}
+
+	iter->block_num++;
+	iter->pos = 0;
+
+	if (iter->block_num == blocks->len)
+	{
+		iter->base = 0;
+		return FALSE;
+	}
+
+	iter->base += get_block (iter->index, iter->block_num)->gap;
+	return TRUE;
+}
+
+/* Returns FALSE, without moving @iter, if it is at the first occurrence. */
+gboolean
+_gtk_source_occurrences_index_iter_prev (GtkSourceOccurrencesIter *iter)
+{
+	if (iter->pos > 0)
+	{
+		iter->pos--;
+		return TRUE;
+	}
+
+	if (iter->block_num == 0)
+	{
+		return FALSE;
+	}
+
+	if (_gtk_source_occurrences_index_iter_is_end (iter))
+	{
+		iter_init (iter->index, iter, iter->block_num - 1);
+	}
+	else
+	{
+		iter->base -= get_block (iter->index, iter->block_num)->gap;
+		iter->block_num--;
+	}
+
+	iter->pos = get_block (iter->index, iter->block_num)->n_entries - 1;
+	return TRUE;
+}
+
+void
+_gtk_source_occurrences_index_iter_get (const GtkSourceOccurrencesIter *iter,
+					gint                           *start,
+					gint                           *end)
+{
+	const Entry *entry;
+
+	g_return_if_fail (!_gtk_source_occurrences_index_iter_is_end (iter));
+
+	entry = &get_block (iter->index, iter->block_num)->entries[iter->pos];
+
+	if (start != NULL)
+	{
+		*start = iter->base + entry->start;
+	}
+
+	if (end != NULL)
+	{
+		*end = iter->base + entry->start + entry->length;
+	}
+}
+
+/* Returns the number of occurrences before @iter. */
+guint
+_gtk_source_occurrences_index_iter_get_position (const GtkSourceOccurrencesIter *iter)
+{
+	return count_entries_before (iter->index, iter->block_num) + iter->pos;
+}
@@ -0,0 +1,92 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTK_SOURCE_OCCURRENCES_INDEX_H
+#define GTK_SOURCE_OCCURRENCES_INDEX_H
+
+#include <glib.h>
+#include "gtksourcetypes-private.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GtkSourceOccurrencesIndex GtkSourceOccurrencesIndex;
+
+/* A position in the index, allocated on the stack. It is invalidated by any
+ * change of the index. The fields are private.
+ */
+typedef struct
+{
+	GtkSourceOccurrencesIndex *index;
+	guint block_num;
+	guint pos;
+	gint base;
+} GtkSourceOccurrencesIter;
+
+GTK_SOURCE_INTERNAL
+GtkSourceOccurrencesIndex *
+		_gtk_source_occurrences_index_new		(void);
+
+GTK_SOURCE_INTERNAL
+void		_gtk_source_occurrences_index_free		(GtkSourceOccurrencesIndex *index);
+
+GTK_SOURCE_INTERNAL
+void		_gtk_source_occurrences_index_clear		(GtkSourceOccurrencesIndex *index);
+
+GTK_SOURCE_INTERNAL
+guint		_gtk_source_occurrences_index_get_length	(GtkSourceOccurrencesIndex *index);
+
+GTK_SOURCE_INTERNAL
+void		_gtk_source_occurrences_index_add		(GtkSourceOccurrencesIndex *index,
+								 gint                       start,
+								 gint                       end);
+
+GTK_SOURCE_INTERNAL
+void		_gtk_source_occurrences_index_remove		(GtkSourceOccurrencesIndex *index,
+								 gint                       start_offset,
+								 gint                       end_offset);
+
+GTK_SOURCE_INTERNAL
+void		_gtk_source_occurrences_index_shift		(GtkSourceOccurrencesIndex *index,
+								 gint                       offset,
+								 gint                       delta);
+
+GTK_SOURCE_INTERNAL
+void		_gtk_source_occurrences_index_iter_at_offset	(GtkSourceOccurrencesIndex *index,
+								 GtkSourceOccurrencesIter  *iter,
+								 gint                       offset);
+
+GTK_SOURCE_INTERNAL
+gboolean	_gtk_source_occurrences_index_iter_is_end	(const GtkSourceOccurrencesIter *iter);
+
+GTK_SOURCE_INTERNAL
+gboolean	_gtk_source_occurrences_index_iter_next		(GtkSourceOccurrencesIter  *iter);
+
+GTK_SOURCE_INTERNAL
+gboolean	_gtk_source_occurrences_index_iter_prev		(GtkSourceOccurrencesIter  *iter);
+
+GTK_SOURCE_INTERNAL
+void		_gtk_source_occurrences_index_iter_get		(const GtkSourceOccurrencesIter *iter,
+								 gint                      *start,
+								 gint                      *end);
+
+GTK_SOURCE_INTERNAL
+guint		_gtk_source_occurrences_index_iter_get_position	(const GtkSourceOccurrencesIter *iter);
+
+G_END_DECLS
+
+#endif /* GTK_SOURCE_OCCURRENCES_INDEX_H */
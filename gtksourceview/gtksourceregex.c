@@ -32,7 +32,23 @@
 /*
  * GRegex wrapper which adds a few features needed for syntax highlighting,
  * in particular resolving "\%{...@start}" and forbidding the use of \C.
+ *
+ * When configured with --enable-pcre2-jit, the regexes are also compiled with
+ * the PCRE2 JIT compiler, and matched with it. The matches then don't need a
+ * new GMatchInfo each time. The GRegex is still used to check the pattern, and
+ * when the JIT compiler is not available or fails to match.
+ */
+
+/* Number of resolved regexes kept for each regex containing references to
+ * the start regex.
  */
+#define RESOLVED_CACHE_SIZE 32
+
+typedef struct
+{
+	gchar *pattern;
+	GtkSourceRegex *regex;
+} ResolvedCacheEntry;
 
 /* Regex used to match "\%{...@start}". */
 static GRegex *
@@ -55,10 +71,32 @@ struct _GtkSourceRegex
 		struct {
 			gchar *pattern;
 			GRegexCompileFlags flags;
+
+			/* The last resolved regexes, most recently used
+			 * first, see _gtk_source_regex_resolve(). */
+			GQueue resolved_cache;
+			GHashTable *resolved_index; /* pattern -> GList link */
+			guint cache_hits;
+			guint cache_misses;
 		} info;
 		struct {
 			GRegex *regex;
 			GMatchInfo *match;
+
+			/* For anchored regexes, the bytes a match can start
+			 * with, see compute_first_bytes(). */
+			guint8 first_bytes[32];
+			guint has_first_bytes : 1;
+
+#ifdef ENABLE_PCRE2_JIT
+			pcre2_code *jit_code;
+			pcre2_match_data *jit_match_data;
+			const gchar *jit_subject;
+			gint jit_n_matches;
+
+			/* Whether the last match was done with jit_code. */
+			guint jit_used : 1;
+#endif
 		} regex;
 	} u;
 
@@ -101,6 +139,735 @@ find_single_byte_escape (const gchar *string)
 	return FALSE;
 }
 
+/* First-byte sets.
+ *
+ * Most start and match regexes of the language definitions begin with a
+ * keyword or a fixed prefix. They are anchored, so when next_segment() tries
+ * the child contexts at a position, nearly all of them fail on the first
+ * character. Knowing the bytes a match can start with lets
+ * _gtk_source_regex_match() fail without calling PCRE at all.
+ *
+ * The set is computed with a small parser which only needs to be
+ * conservative: a byte may be in the set even if no match can start with
+ * it, and all the bytes >= 0x80 are added as soon as a non-ASCII character,
+ * a Unicode property or a caseless letter is involved. Constructs which
+ * aren't understood (backreferences, recursion, conditionals, \Q...\E, ...)
+ * or a regex that can match the empty string disable the prefilter.
+ */
+
+typedef struct
+{
+	const gchar *p;
+	guint caseless : 1;
+	guint extended : 1;
+} FirstBytesParser;
+
+typedef enum
+{
+	ESCAPE_UNSUPPORTED,
+	ESCAPE_CHAR,
+	ESCAPE_SET,
+	ESCAPE_ASSERTION
+} EscapeKind;
+
+static gboolean parse_alternation (FirstBytesParser *parser,
+				   guint8           *set,
+				   gboolean         *nullable);
+
+static void
+first_bytes_add_range (guint8 *set,
+		       guint   first,
+		       guint   last)
+{
+	guint c;
+
+	for (c = first; c <= last; c++)
+	{
+		set[c >> 3] |= 1 << (c & 7);
+	}
+}
+
+static void
+first_bytes_add_all (guint8 *set)
+{
+	memset (set, 0xff, 32);
+}
+
+static void
+first_bytes_union (guint8       *set,
+		   const guint8 *other)
+{
+	gint i;
+
+	for (i = 0; i < 32; i++)
+	{
+		set[i] |= other[i];
+	}
+}
+
+static void
+first_bytes_add_char (guint8   *set,
+		      gunichar  ch,
+		      gboolean  caseless)
+{
+	if (ch >= 0x80)
+	{
+		/* A non-ASCII character can be caseless-equal to an ASCII
+		 * one, e.g. the Kelvin sign and 'k'. */
+		if (caseless)
+		{
+			first_bytes_add_all (set);
+		}
+		else
+		{
+			gchar buf[6];
+
+			g_unichar_to_utf8 (ch, buf);
+			first_bytes_add_range (set, (guchar) buf[0], (guchar) buf[0]);
+		}
+
+		return;
+	}
+
+	first_bytes_add_range (set, ch, ch);
+
+	if (caseless && g_ascii_isalpha (ch))
+	{
+		first_bytes_add_range (set, g_ascii_tolower (ch), g_ascii_tolower (ch));
+		first_bytes_add_range (set, g_ascii_toupper (ch), g_ascii_toupper (ch));
+		first_bytes_add_range (set, 0x80, 0xff);
+	}
+}
+
+static void
+first_bytes_add_char_range (guint8   *set,
+			    gunichar  first,
+			    gunichar  last,
+			    gboolean  caseless)
+{
+	gunichar ch;
+
+	if (last >= 0x80)
+	{
+		first_bytes_add_range (set, 0x80, 0xff);
+
+		if (caseless)
+			first_bytes_add_all (set);
+
+		last = 0x7f;
+	}
+
+	for (ch = first; ch <= last; ch++)
+	{
+		first_bytes_add_char (set, ch, caseless);
+	}
+}
+
+static EscapeKind
+parse_escape (FirstBytesParser *parser,
+	      gboolean          in_class,
+	      gunichar         *ch,
+	      guint8           *set)
+{
+	const gchar *p = parser->p + 1;
+	gchar c = *p;
+
+	if (c == '\0')
+		return ESCAPE_UNSUPPORTED;
+
+	p++;
+	parser->p = p;
+
+	switch (c)
+	{
+		case 'n':
+			*ch = '\n';
+			return ESCAPE_CHAR;
+		case 't':
+			*ch = '\t';
+			return ESCAPE_CHAR;
+		case 'r':
+			*ch = '\r';
+			return ESCAPE_CHAR;
+		case 'f':
+			*ch = '\f';
+			return ESCAPE_CHAR;
+		case 'e':
+			*ch = 0x1b;
+			return ESCAPE_CHAR;
+		case 'a':
+			*ch = 0x07;
+			return ESCAPE_CHAR;
+
+		case 'b':
+			if (in_class)
+			{
+				*ch = '\b';
+				return ESCAPE_CHAR;
+			}
+			return ESCAPE_ASSERTION;
+
+		case 'B':
+		case 'A':
+		case 'z':
+		case 'Z':
+		case 'G':
+		case 'K':
+			return in_class ? ESCAPE_UNSUPPORTED : ESCAPE_ASSERTION;
+
+		/* GRegex uses Unicode properties for \d, \w and \s. */
+		case 'd':
+			first_bytes_add_range (set, '0', '9');
+			first_bytes_add_range (set, 0x80, 0xff);
+			return ESCAPE_SET;
+		case 'w':
+			first_bytes_add_range (set, '0', '9');
+			first_bytes_add_range (set, 'A', 'Z');
+			first_bytes_add_range (set, 'a', 'z');
+			first_bytes_add_range (set, '_', '_');
+			first_bytes_add_range (set, 0x80, 0xff);
+			return ESCAPE_SET;
+		case 's':
+		case 'h':
+		case 'v':
+			first_bytes_add_range (set, '\t', '\r');
+			first_bytes_add_range (set, ' ', ' ');
+			first_bytes_add_range (set, 0x80, 0xff);
+			return ESCAPE_SET;
+
+		case 'p':
+		case 'P':
+			if (*p == '{')
+			{
+				p = strchr (p, '}');
+				if (p == NULL)
+					return ESCAPE_UNSUPPORTED;
+			}
+			else if (*p == '\0')
+			{
+				return ESCAPE_UNSUPPORTED;
+			}
+			parser->p = p + 1;
+			first_bytes_add_all (set);
+			return ESCAPE_SET;
+
+		case 'D':
+		case 'W':
+		case 'S':
+		case 'H':
+		case 'V':
+		case 'N':
+		case 'R':
+		case 'X':
+			first_bytes_add_all (set);
+			return ESCAPE_SET;
+
+		case 'x':
+			*ch = 0;
+			if (*p == '{')
+			{
+				p++;
+				while (g_ascii_isxdigit (*p) && *ch <= 0x10ffff)
+				{
+					*ch = *ch * 16 + g_ascii_xdigit_value (*p);
+					p++;
+				}
+				if (*p != '}' || *ch > 0x10ffff)
+					return ESCAPE_UNSUPPORTED;
+				p++;
+			}
+			else
+			{
+				gint i;
+
+				for (i = 0; i < 2 && g_ascii_isxdigit (*p); i++)
+				{
+					*ch = *ch * 16 + g_ascii_xdigit_value (*p);
+					p++;
+				}
+			}
+			parser->p = p;
+			return ESCAPE_CHAR;
+
+		default:
+			/* Backreferences, octal numbers, \Q...\E, \c, \g, \k,
+			 * ... */
+			if (g_ascii_isalnum (c))
+				return ESCAPE_UNSUPPORTED;
+
+			*ch = g_utf8_get_char (p - 1);
+			parser->p = g_utf8_next_char (p - 1);
+			return ESCAPE_CHAR;
+	}
+}
+
+/* Parses a class member, either a character or a set given by an escape. */
+static EscapeKind
+parse_class_member (FirstBytesParser *parser,
+		    gunichar         *ch,
+		    guint8           *set)
+{
+	if (*parser->p == '\\')
+		return parse_escape (parser, TRUE, ch, set);
+
+	*ch = g_utf8_get_char (parser->p);
+	parser->p = g_utf8_next_char (parser->p);
+	return ESCAPE_CHAR;
+}
+
+static gboolean
+parse_class (FirstBytesParser *parser,
+	     guint8           *set)
+{
+	gboolean negated = FALSE;
+	gboolean first = TRUE;
+
+	parser->p++;
+
+	if (*parser->p == '^')
+	{
+		negated = TRUE;
+		parser->p++;
+	}
+
+	while (first || *parser->p != ']')
+	{
+		gunichar ch;
+		gunichar last;
+		EscapeKind kind;
+
+		first = FALSE;
+
+		if (*parser->p == '\0')
+			return FALSE;
+
+		/* POSIX classes, e.g. [:alpha:] */
+		if (parser->p[0] == '[' && parser->p[1] == ':')
+		{
+			const gchar *end = strstr (parser->p + 2, ":]");
+
+			if (end == NULL)
+				return FALSE;
+
+			parser->p = end + 2;
+			first_bytes_add_all (set);
+			continue;
+		}
+
+		kind = parse_class_member (parser, &ch, set);
+
+		if (kind == ESCAPE_UNSUPPORTED || kind == ESCAPE_ASSERTION)
+			return FALSE;
+
+		if (kind == ESCAPE_SET)
+			continue;
+
+		if (parser->p[0] == '-' && parser->p[1] != ']' && parser->p[1] != '\0')
+		{
+			parser->p++;
+
+			if (parse_class_member (parser, &last, set) != ESCAPE_CHAR ||
+			    last < ch)
+			{
+				return FALSE;
+			}
+
+			first_bytes_add_char_range (set, ch, last, parser->caseless);
+		}
+		else
+		{
+			first_bytes_add_char (set, ch, parser->caseless);
+		}
+	}
+
+	parser->p++;
+
+	if (negated)
+		first_bytes_add_all (set);
+
+	return TRUE;
+}
+
+/* Skips the white spaces and comments of extended regexes. Returns whether
+ * something was skipped. */
+static gboolean
+skip_extended_blanks (FirstBytesParser *parser)
+{
+	const gchar *start = parser->p;
+
+	if (!parser->extended)
+		return FALSE;
+
+	while (TRUE)
+	{
+		if (g_ascii_isspace (*parser->p))
+		{
+			parser->p++;
+		}
+		else if (*parser->p == '#')
+		{
+			while (*parser->p != '\0' && *parser->p != '\n')
+				parser->p++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	return parser->p != start;
+}
+
+static gboolean
+parse_quantifier (FirstBytesParser *parser,
+		  gboolean         *nullable)
+{
+	skip_extended_blanks (parser);
+
+	switch (*parser->p)
+	{
+		case '?':
+		case '*':
+			*nullable = TRUE;
+			parser->p++;
+			break;
+
+		case '+':
+			parser->p++;
+			break;
+
+		case '{':
+		{
+			const gchar *p = parser->p + 1;
+			gboolean min_is_zero;
+
+			if (!g_ascii_isdigit (*p))
+			{
+				/* "{,n}" is a quantifier only for some PCRE
+				 * versions. Anything else is a literal. */
+				return *p != ',';
+			}
+
+			min_is_zero = TRUE;
+			while (g_ascii_isdigit (*p))
+			{
+				if (*p != '0')
+					min_is_zero = FALSE;
+				p++;
+			}
+
+			if (*p == ',')
+			{
+				p++;
+				while (g_ascii_isdigit (*p))
+					p++;
+			}
+
+			if (*p != '}')
+				return TRUE;
+
+			*nullable = *nullable || min_is_zero;
+			parser->p = p + 1;
+			break;
+		}
+
+		default:
+			return TRUE;
+	}
+
+	/* Lazy or possessive quantifier. */
+	if (*parser->p == '?' || *parser->p == '+')
+		parser->p++;
+
+	return TRUE;
+}
+
+static gboolean
+parse_group (FirstBytesParser *parser,
+	     guint8           *set,
+	     gboolean         *nullable)
+{
+	FirstBytesParser saved = *parser;
+	guint8 inner_set[32] = { 0 };
+	gboolean lookaround = FALSE;
+	const gchar *p = parser->p + 1;
+
+	if (*p == '*')
+	{
+		/* Verbs, e.g. (*UTF8). */
+		return FALSE;
+	}
+
+	if (*p == '?')
+	{
+		p++;
+
+		switch (*p)
+		{
+			case '#':
+				p = strchr (p, ')');
+				if (p == NULL)
+					return FALSE;
+				parser->p = p + 1;
+				*nullable = TRUE;
+				return TRUE;
+
+			case ':':
+			case '>':
+			case '|':
+				p++;
+				break;
+
+			case '=':
+			case '!':
+				lookaround = TRUE;
+				p++;
+				break;
+
+			/* Lookbehind or named group. */
+			case '<':
+				if (p[1] == '=' || p[1] == '!')
+				{
+					lookaround = TRUE;
+					p += 2;
+					break;
+				}
+				/* fall through */
+			case 'P':
+			case '\'':
+			{
+				gchar end = *p == '\'' ? '\'' : '>';
+
+				if (*p == 'P')
+				{
+					p++;
+					if (*p != '<')
+						return FALSE;
+				}
+
+				p = strchr (p + 1, end);
+				if (p == NULL)
+					return FALSE;
+				p++;
+				break;
+			}
+
+			default:
+			{
+				gboolean on = TRUE;
+
+				/* Option setting, e.g. (?i-x) or (?i:...). */
+				while (*p != ')' && *p != ':')
+				{
+					switch (*p)
+					{
+						case '-':
+							on = FALSE;
+							break;
+						case 'i':
+							parser->caseless = on;
+							break;
+						case 'x':
+							parser->extended = on;
+							break;
+						case 'm':
+						case 's':
+						case 'n':
+						case 'J':
+						case 'U':
+						case 'X':
+							break;
+						default:
+							return FALSE;
+					}
+					p++;
+				}
+
+				if (*p == ')')
+				{
+					/* The options apply to the rest of
+					 * the enclosing group. */
+					parser->p = p + 1;
+					*nullable = TRUE;
+					return TRUE;
+				}
+
+				p++;
+				break;
+			}
+		}
+	}
+
+	parser->p = p;
+
+	if (!parse_alternation (parser, inner_set, nullable) ||
+	    *parser->p != ')')
+	{
+		return FALSE;
+	}
+
+	parser->caseless = saved.caseless;
+	parser->extended = saved.extended;
+	parser->p++;
+
+	if (lookaround)
+	{
+		/* Assertions don't consume characters, ignoring them only
+		 * makes the set bigger. */
+		*nullable = TRUE;
+	}
+	else
+	{
+		first_bytes_union (set, inner_set);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+parse_item (FirstBytesParser *parser,
+	    guint8           *set,
+	    gboolean         *nullable)
+{
+	gunichar ch;
+
+	if (skip_extended_blanks (parser))
+	{
+		*nullable = TRUE;
+		return TRUE;
+	}
+
+	*nullable = FALSE;
+
+	switch (*parser->p)
+	{
+		case '(':
+			if (!parse_group (parser, set, nullable))
+				return FALSE;
+			break;
+
+		case '[':
+			if (!parse_class (parser, set))
+				return FALSE;
+			break;
+
+		case '.':
+			first_bytes_add_all (set);
+			parser->p++;
+			break;
+
+		case '^':
+		case '$':
+			*nullable = TRUE;
+			parser->p++;
+			break;
+
+		case '\\':
+			switch (parse_escape (parser, FALSE, &ch, set))
+			{
+				case ESCAPE_CHAR:
+					first_bytes_add_char (set, ch, parser->caseless);
+					break;
+				case ESCAPE_SET:
+					break;
+				case ESCAPE_ASSERTION:
+					*nullable = TRUE;
+					break;
+				case ESCAPE_UNSUPPORTED:
+				default:
+					return FALSE;
+			}
+			break;
+
+		case '*':
+		case '+':
+		case '?':
+			return FALSE;
+
+		default:
+			ch = g_utf8_get_char (parser->p);
+			first_bytes_add_char (set, ch, parser->caseless);
+			parser->p = g_utf8_next_char (parser->p);
+			break;
+	}
+
+	return parse_quantifier (parser, nullable);
+}
+
+static gboolean
+parse_branch (FirstBytesParser *parser,
+	      guint8           *set,
+	      gboolean         *nullable)
+{
+	*nullable = TRUE;
+
+	while (*parser->p != '\0' && *parser->p != '|' && *parser->p != ')')
+	{
+		guint8 item_set[32] = { 0 };
+		gboolean item_nullable;
+
+		if (!parse_item (parser, item_set, &item_nullable))
+			return FALSE;
+
+		/* Once an item must consume a character, the next items
+		 * can't start the match. */
+		if (*nullable)
+		{
+			first_bytes_union (set, item_set);
+			*nullable = item_nullable;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+parse_alternation (FirstBytesParser *parser,
+		   guint8           *set,
+		   gboolean         *nullable)
+{
+	*nullable = FALSE;
+
+	while (TRUE)
+	{
+		gboolean branch_nullable;
+
+		if (!parse_branch (parser, set, &branch_nullable))
+			return FALSE;
+
+		*nullable = *nullable || branch_nullable;
+
+		if (*parser->p != '|')
+			break;
+
+		/* Option changes carry over to the next alternatives. */
+		parser->p++;
+	}
+
+	return TRUE;
+}
+
+/* Returns whether the first bytes of the matches of @pattern are known,
+ * and stores them in @set. */
+static gboolean
+compute_first_bytes (const gchar        *pattern,
+		     GRegexCompileFlags  flags,
+		     guint8             *set)
+{
+	FirstBytesParser parser;
+	gboolean nullable;
+
+	parser.p = pattern;
+	parser.caseless = (flags & G_REGEX_CASELESS) != 0;
+	parser.extended = (flags & G_REGEX_EXTENDED) != 0;
+
+	memset (set, 0, 32);
+
+	return (parse_alternation (&parser, set, &nullable) &&
+		*parser.p == '\0' &&
+		!nullable);
+}
+
 /**
  * gtk_source_regex_new:
  * @pattern: the regular expression.
@@ -150,11 +917,40 @@ _gtk_source_regex_new (const gchar           *pattern,
 			g_slice_free (GtkSourceRegex, regex);
 			regex = NULL;
 		}
+		else
+		{
+			if (flags & G_REGEX_ANCHORED)
+			{
+				regex->u.regex.has_first_bytes =
+					compute_first_bytes (pattern, flags,
+							     regex->u.regex.first_bytes);
+			}
+
+#ifdef ENABLE_PCRE2_JIT
+			regex->u.regex.jit_code = _gtk_source_regex_jit_compile (pattern,
+										 flags | G_REGEX_NEWLINE_LF,
+										 PCRE2_JIT_COMPLETE);
+
+			if (regex->u.regex.jit_code != NULL)
+			{
+				regex->u.regex.jit_match_data =
+					pcre2_match_data_create_from_pattern (regex->u.regex.jit_code, NULL);
+			}
+#endif
+		}
 	}
 
 	return regex;
 }
 
+static void
+resolved_cache_entry_free (ResolvedCacheEntry *entry)
+{
+	_gtk_source_regex_unref (entry->regex);
+	g_free (entry->pattern);
+	g_slice_free (ResolvedCacheEntry, entry);
+}
+
 GtkSourceRegex *
 _gtk_source_regex_ref (GtkSourceRegex *regex)
 {
@@ -173,15 +969,209 @@ _gtk_source_regex_unref (GtkSourceRegex *regex)
 			g_regex_unref (regex->u.regex.regex);
 			if (regex->u.regex.match)
 				g_match_info_free (regex->u.regex.match);
+#ifdef ENABLE_PCRE2_JIT
+			if (regex->u.regex.jit_match_data != NULL)
+				pcre2_match_data_free (regex->u.regex.jit_match_data);
+			if (regex->u.regex.jit_code != NULL)
+				pcre2_code_free (regex->u.regex.jit_code);
+#endif
 		}
 		else
 		{
+			ResolvedCacheEntry *entry;
+
 			g_free (regex->u.info.pattern);
+
+			while ((entry = g_queue_pop_head (&regex->u.info.resolved_cache)) != NULL)
+			{
+				resolved_cache_entry_free (entry);
+			}
+
+			if (regex->u.info.resolved_index != NULL)
+				g_hash_table_destroy (regex->u.info.resolved_index);
 		}
 		g_slice_free (GtkSourceRegex, regex);
 	}
 }
 
+#ifdef ENABLE_PCRE2_JIT
+/* Compiles @pattern, which must be valid for g_regex_new() with the same
+ * @flags, with the PCRE2 JIT compiler. Returns %NULL if it's not possible.
+ */
+pcre2_code *
+_gtk_source_regex_jit_compile (const gchar        *pattern,
+			       GRegexCompileFlags  flags,
+			       guint32             jit_options)
+{
+	pcre2_compile_context *compile_context;
+	pcre2_code *code;
+	guint32 options = PCRE2_UTF | PCRE2_UCP | PCRE2_NO_UTF_CHECK;
+	gint error_code;
+	PCRE2_SIZE error_offset;
+
+	if (flags & G_REGEX_CASELESS)
+		options |= PCRE2_CASELESS;
+	if (flags & G_REGEX_MULTILINE)
+		options |= PCRE2_MULTILINE;
+	if (flags & G_REGEX_DOTALL)
+		options |= PCRE2_DOTALL;
+	if (flags & G_REGEX_EXTENDED)
+		options |= PCRE2_EXTENDED;
+	if (flags & G_REGEX_ANCHORED)
+		options |= PCRE2_ANCHORED;
+	if (flags & G_REGEX_DOLLAR_ENDONLY)
+		options |= PCRE2_DOLLAR_ENDONLY;
+	if (flags & G_REGEX_UNGREEDY)
+		options |= PCRE2_UNGREEDY;
+	if (flags & G_REGEX_NO_AUTO_CAPTURE)
+		options |= PCRE2_NO_AUTO_CAPTURE;
+	if (flags & G_REGEX_DUPNAMES)
+		options |= PCRE2_DUPNAMES;
+
+	compile_context = pcre2_compile_context_create (NULL);
+
+	/* Like GRegex, recognize any newline by default. */
+	pcre2_set_newline (compile_context,
+			   (flags & G_REGEX_NEWLINE_LF) != 0 ? PCRE2_NEWLINE_LF : PCRE2_NEWLINE_ANY);
+
+	code = pcre2_compile ((PCRE2_SPTR) pattern,
+			      PCRE2_ZERO_TERMINATED,
+			      options,
+			      &error_code,
+			      &error_offset,
+			      compile_context);
+
+	pcre2_compile_context_free (compile_context);
+
+	if (code == NULL)
+	{
+		return NULL;
+	}
+
+	/* Fails if the JIT compiler is not available on this platform. */
+	if (pcre2_jit_compile (code, jit_options) != 0)
+	{
+		pcre2_code_free (code);
+		return NULL;
+	}
+
+	return code;
+}
+#endif
+
+/* Like g_match_info_fetch_pos(), for the last match of @regex. */
+static gboolean
+regex_fetch_pos (GtkSourceRegex *regex,
+		 gint            num,
+		 gint           *start_pos, /* byte offsets */
+		 gint           *end_pos)   /* byte offsets */
+{
+#ifdef ENABLE_PCRE2_JIT
+	if (regex->u.regex.jit_used)
+	{
+		PCRE2_SIZE *ovector;
+
+		if (num < 0 || num >= regex->u.regex.jit_n_matches)
+			return FALSE;
+
+		ovector = pcre2_get_ovector_pointer (regex->u.regex.jit_match_data);
+
+		if (ovector[2 * num] == PCRE2_UNSET)
+		{
+			*start_pos = -1;
+			*end_pos = -1;
+		}
+		else
+		{
+			*start_pos = ovector[2 * num];
+			*end_pos = ovector[2 * num + 1];
+		}
+
+		return TRUE;
+	}
+#endif
+
+	return g_match_info_fetch_pos (regex->u.regex.match, num, start_pos, end_pos);
+}
+
+/* Like g_match_info_fetch_named_pos(), for the last match of @regex. */
+static gboolean
+regex_fetch_named_pos (GtkSourceRegex *regex,
+		       const gchar    *name,
+		       gint           *start_pos, /* byte offsets */
+		       gint           *end_pos)   /* byte offsets */
+{
+#ifdef ENABLE_PCRE2_JIT
+	if (regex->u.regex.jit_used)
+	{
+		PCRE2_SPTR first;
+		PCRE2_SPTR last;
+		PCRE2_SPTR entry;
+		gint entry_size;
+
+		entry_size = pcre2_substring_nametable_scan (regex->u.regex.jit_code,
+							     (PCRE2_SPTR) name,
+							     &first,
+							     &last);
+		if (entry_size <= 0)
+			return FALSE;
+
+		/* With duplicate names, GRegex returns the first group
+		 * which is set. */
+		for (entry = first; entry <= last; entry += entry_size)
+		{
+			gint num = (entry[0] << 8) | entry[1];
+
+			if (regex_fetch_pos (regex, num, start_pos, end_pos) &&
+			    *start_pos != -1)
+			{
+				return TRUE;
+			}
+		}
+
+		return regex_fetch_pos (regex, (first[0] << 8) | first[1], start_pos, end_pos);
+	}
+#endif
+
+	return g_match_info_fetch_named_pos (regex->u.regex.match, name, start_pos, end_pos);
+}
+
+#ifdef ENABLE_PCRE2_JIT
+static gchar *
+regex_jit_substring (GtkSourceRegex *regex,
+		     gboolean        found,
+		     gint            start_pos,
+		     gint            end_pos)
+{
+	if (!found)
+		return NULL;
+
+	if (start_pos == -1)
+		return g_strdup ("");
+
+	return g_strndup (regex->u.regex.jit_subject + start_pos, end_pos - start_pos);
+}
+#endif
+
+static gchar *
+regex_fetch_named (GtkSourceRegex *regex,
+		   const gchar    *name)
+{
+#ifdef ENABLE_PCRE2_JIT
+	if (regex->u.regex.jit_used)
+	{
+		gint start_pos;
+		gint end_pos;
+		gboolean found;
+
+		found = regex_fetch_named_pos (regex, name, &start_pos, &end_pos);
+		return regex_jit_substring (regex, found, start_pos, end_pos);
+	}
+#endif
+
+	return g_match_info_fetch_named (regex->u.regex.match, name);
+}
+
 struct RegexResolveData {
 	GtkSourceRegex *start_regex;
 	const gchar *matched_text;
@@ -202,13 +1192,11 @@ replace_start_regex (const GMatchInfo *match_info,
 
 	if (num < 0)
 	{
-		subst = g_match_info_fetch_named (data->start_regex->u.regex.match,
-						  num_string);
+		subst = regex_fetch_named (data->start_regex, num_string);
 	}
 	else
 	{
-		subst = g_match_info_fetch (data->start_regex->u.regex.match,
-					    num);
+		subst = _gtk_source_regex_fetch (data->start_regex, num);
 	}
 
 	if (subst != NULL)
@@ -245,7 +1233,9 @@ replace_start_regex (const GMatchInfo *match_info,
  * If the regular expression contains references to the start regular
  * expression in the form "\%{start_sub_pattern@start}", it replaces
  * them (they are extracted from @start_regex and @matched_text) and
- * returns the new regular expression.
+ * returns the new regular expression. The last resolved regular
+ * expressions are kept in a cache, and returned again when the
+ * replacements give the same pattern.
  *
  * Returns: a #GtkSourceRegex.
  */
@@ -257,6 +1247,8 @@ _gtk_source_regex_resolve (GtkSourceRegex *regex,
 	gchar *expanded_regex;
 	GtkSourceRegex *new_regex;
 	struct RegexResolveData data;
+	ResolvedCacheEntry *entry;
+	GList *link;
 
 	if (regex == NULL || regex->resolved)
 		return _gtk_source_regex_ref (regex);
@@ -268,6 +1260,33 @@ _gtk_source_regex_resolve (GtkSourceRegex *regex,
 					       -1, 0, 0,
 					       replace_start_regex,
 					       &data, NULL);
+
+	/* The same end is often resolved many times, e.g. "EOF" for shell
+	 * heredocs or the tag names in XML. The expanded pattern is cheap to
+	 * compute compared to the compilation.
+	 */
+	if (regex->u.info.resolved_index == NULL)
+	{
+		regex->u.info.resolved_index = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	link = g_hash_table_lookup (regex->u.info.resolved_index, expanded_regex);
+
+	if (link != NULL)
+	{
+		regex->u.info.cache_hits++;
+
+		g_queue_unlink (&regex->u.info.resolved_cache, link);
+		g_queue_push_head_link (&regex->u.info.resolved_cache, link);
+
+		g_free (expanded_regex);
+
+		entry = link->data;
+		return _gtk_source_regex_ref (entry->regex);
+	}
+
+	regex->u.info.cache_misses++;
+
 	new_regex = _gtk_source_regex_new (expanded_regex, regex->u.info.flags, NULL);
 	if (new_regex == NULL || !new_regex->resolved)
 	{
@@ -278,11 +1297,52 @@ _gtk_source_regex_resolve (GtkSourceRegex *regex,
 		new_regex = _gtk_source_regex_new ("$never-match^", 0, NULL);
 	}
 
-	g_free (expanded_regex);
+	if (g_queue_get_length (&regex->u.info.resolved_cache) >= RESOLVED_CACHE_SIZE)
+	{
+		entry = g_queue_pop_tail (&regex->u.info.resolved_cache);
+		g_hash_table_remove (regex->u.info.resolved_index, entry->pattern);
+		resolved_cache_entry_free (entry);
+	}
+
+	entry = g_slice_new (ResolvedCacheEntry);
+	entry->pattern = expanded_regex;
+	entry->regex = _gtk_source_regex_ref (new_regex);
+
+	g_queue_push_head (&regex->u.info.resolved_cache, entry);
+	g_hash_table_insert (regex->u.info.resolved_index,
+			     entry->pattern,
+			     regex->u.info.resolved_cache.head);
 
 	return new_regex;
 }
 
+/**
+ * _gtk_source_regex_get_resolve_stats:
+ * @regex: a #GtkSourceRegex.
+ * @hits: (out): return location for the number of regexes resolved from
+ *   the cache.
+ * @misses: (out): return location for the number of regexes compiled.
+ *
+ * Gets the statistics of the cache used by _gtk_source_regex_resolve().
+ * Both are 0 if @regex doesn't contain references to the start regex.
+ */
+void
+_gtk_source_regex_get_resolve_stats (GtkSourceRegex *regex,
+				     guint          *hits,
+				     guint          *misses)
+{
+	if (regex->resolved)
+	{
+		*hits = 0;
+		*misses = 0;
+	}
+	else
+	{
+		*hits = regex->u.info.cache_hits;
+		*misses = regex->u.info.cache_misses;
+	}
+}
+
 gboolean
 _gtk_source_regex_is_resolved (GtkSourceRegex *regex)
 {
@@ -305,6 +1365,48 @@ _gtk_source_regex_match (GtkSourceRegex *regex,
 		regex->u.regex.match = NULL;
 	}
 
+#ifdef ENABLE_PCRE2_JIT
+	regex->u.regex.jit_used = FALSE;
+#endif
+
+	/* The regex is anchored and can't match the empty string. */
+	if (regex->u.regex.has_first_bytes)
+	{
+		guchar c;
+
+		if (byte_length >= 0 && byte_pos >= byte_length)
+			return FALSE;
+
+		c = (guchar) line[byte_pos];
+		if ((regex->u.regex.first_bytes[c >> 3] & (1 << (c & 7))) == 0)
+			return FALSE;
+	}
+
+#ifdef ENABLE_PCRE2_JIT
+	if (regex->u.regex.jit_code != NULL)
+	{
+		gint rc;
+
+		rc = pcre2_jit_match (regex->u.regex.jit_code,
+				      (PCRE2_SPTR) line,
+				      byte_length < 0 ? PCRE2_ZERO_TERMINATED : (PCRE2_SIZE) byte_length,
+				      byte_pos,
+				      0,
+				      regex->u.regex.jit_match_data,
+				      NULL);
+
+		/* On other errors, e.g. if the JIT stack is too small, use the
+		 * GRegex. */
+		if (rc > 0 || rc == PCRE2_ERROR_NOMATCH)
+		{
+			regex->u.regex.jit_used = TRUE;
+			regex->u.regex.jit_subject = line;
+			regex->u.regex.jit_n_matches = MAX (rc, 0);
+			return rc > 0;
+		}
+	}
+#endif
+
 	result = g_regex_match_full (regex->u.regex.regex, line,
 				     byte_length, byte_pos,
 				     0, &regex->u.regex.match,
@@ -319,35 +1421,19 @@ _gtk_source_regex_fetch (GtkSourceRegex *regex,
 {
 	g_assert (regex->resolved);
 
-	return g_match_info_fetch (regex->u.regex.match, num);
-}
-
-void
-_gtk_source_regex_fetch_pos (GtkSourceRegex *regex,
-			     const gchar    *text,
-			     gint            num,
-			     gint           *start_pos, /* character offsets */
-			     gint           *end_pos)   /* character offsets */
-{
-	gint byte_start_pos, byte_end_pos;
-
-	g_assert (regex->resolved);
-
-	/* g_match_info_fetch_pos() can return TRUE with start_pos/end_pos set to -1 */
-	if (!g_match_info_fetch_pos (regex->u.regex.match, num, &byte_start_pos, &byte_end_pos))
+#ifdef ENABLE_PCRE2_JIT
+	if (regex->u.regex.jit_used)
 	{
-		if (start_pos != NULL)
-			*start_pos = -1;
-		if (end_pos != NULL)
-			*end_pos = -1;
-	}
-	else
-	{
-		if (start_pos != NULL)
-			*start_pos = g_utf8_pointer_to_offset (text, text + MAX (0, byte_start_pos));
-		if (end_pos != NULL)
-			*end_pos = g_utf8_pointer_to_offset (text, text + MAX (0, byte_end_pos));
+		gint start_pos;
+		gint end_pos;
+		gboolean found;
+
+		found = regex_fetch_pos (regex, num, &start_pos, &end_pos);
+		return regex_jit_substring (regex, found, start_pos, end_pos);
 	}
+#endif
+
+	return g_match_info_fetch (regex->u.regex.match, num);
 }
 
 void
@@ -361,7 +1447,7 @@ _gtk_source_regex_fetch_pos_bytes (GtkSourceRegex *regex,
 
 	g_assert (regex->resolved);
 
-	if (!g_match_info_fetch_pos (regex->u.regex.match, num, &start_pos, &end_pos))
+	if (!regex_fetch_pos (regex, num, &start_pos, &end_pos))
 	{
 		start_pos = -1;
 		end_pos = -1;
@@ -374,30 +1460,26 @@ _gtk_source_regex_fetch_pos_bytes (GtkSourceRegex *regex,
 }
 
 void
-_gtk_source_regex_fetch_named_pos (GtkSourceRegex *regex,
-				   const gchar    *text,
-				   const gchar    *name,
-				   gint           *start_pos, /* character offsets */
-				   gint           *end_pos)   /* character offsets */
+_gtk_source_regex_fetch_named_pos_bytes (GtkSourceRegex *regex,
+					 const gchar    *name,
+					 gint           *start_pos_p, /* byte offsets */
+					 gint           *end_pos_p)   /* byte offsets */
 {
-	gint byte_start_pos, byte_end_pos;
+	gint start_pos;
+	gint end_pos;
 
 	g_assert (regex->resolved);
 
-	if (!g_match_info_fetch_named_pos (regex->u.regex.match, name, &byte_start_pos, &byte_end_pos))
+	if (!regex_fetch_named_pos (regex, name, &start_pos, &end_pos))
 	{
-		if (start_pos != NULL)
-			*start_pos = -1;
-		if (end_pos != NULL)
-			*end_pos = -1;
-	}
-	else
-	{
-		if (start_pos != NULL)
-			*start_pos = g_utf8_pointer_to_offset (text, text + byte_start_pos);
-		if (end_pos != NULL)
-			*end_pos = g_utf8_pointer_to_offset (text, text + byte_end_pos);
+		start_pos = -1;
+		end_pos = -1;
 	}
+
+	if (start_pos_p != NULL)
+		*start_pos_p = start_pos;
+	if (end_pos_p != NULL)
+		*end_pos_p = end_pos;
 }
 
 const gchar *
@@ -25,6 +25,11 @@
 #include <glib.h>
 #include "gtksourcetypes-private.h"
 
+#ifdef ENABLE_PCRE2_JIT
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
 G_BEGIN_DECLS
 
 GTK_SOURCE_INTERNAL
@@ -46,6 +51,11 @@ GtkSourceRegex	*_gtk_source_regex_resolve	(GtkSourceRegex *regex,
 GTK_SOURCE_INTERNAL
 gboolean	 _gtk_source_regex_is_resolved	(GtkSourceRegex *regex);
 
+GTK_SOURCE_INTERNAL
+void		 _gtk_source_regex_get_resolve_stats (GtkSourceRegex *regex,
+						      guint          *hits,
+						      guint          *misses);
+
 GTK_SOURCE_INTERNAL
 gboolean	_gtk_source_regex_match		(GtkSourceRegex *regex,
 						 const gchar    *line,
@@ -56,13 +66,6 @@ GTK_SOURCE_INTERNAL
 gchar		*_gtk_source_regex_fetch	(GtkSourceRegex *regex,
 						 gint            num);
 
-GTK_SOURCE_INTERNAL
-void		 _gtk_source_regex_fetch_pos	(GtkSourceRegex *regex,
-						 const gchar    *text,
-						 gint            num,
-						 gint           *start_pos, /* character offsets */
-						 gint           *end_pos);  /* character offsets */
-
 GTK_SOURCE_INTERNAL
 void		 _gtk_source_regex_fetch_pos_bytes (GtkSourceRegex *regex,
 						    gint            num,
@@ -70,15 +73,21 @@ void		 _gtk_source_regex_fetch_pos_bytes (GtkSourceRegex *regex,
 						    gint           *end_pos_p);  /* byte offsets */
 
 GTK_SOURCE_INTERNAL
-void		 _gtk_source_regex_fetch_named_pos (GtkSourceRegex *regex,
-						    const gchar    *text,
-						    const gchar    *name,
-						    gint           *start_pos, /* character offsets */
-						    gint           *end_pos);  /* character offsets */
+void		 _gtk_source_regex_fetch_named_pos_bytes (GtkSourceRegex *regex,
+							  const gchar    *name,
+							  gint           *start_pos_p, /* byte offsets */
+							  gint           *end_pos_p);  /* byte offsets */
 
 GTK_SOURCE_INTERNAL
 const gchar	*_gtk_source_regex_get_pattern	(GtkSourceRegex *regex);
 
+#ifdef ENABLE_PCRE2_JIT
+GTK_SOURCE_INTERNAL
+pcre2_code	*_gtk_source_regex_jit_compile	(const gchar        *pattern,
+						 GRegexCompileFlags  flags,
+						 guint32             jit_options);
+#endif
+
 G_END_DECLS
 
 #endif /* GTK_SOURCE_REGEX_H */
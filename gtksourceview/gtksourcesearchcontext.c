@@ -24,6 +24,7 @@
 
 #include "gtksourcesearchcontext.h"
 #include <string.h>
+#include <glib/gi18n-lib.h>
 #include "gtksourcesearchsettings.h"
 #include "gtksourcebuffer.h"
 #include "gtksourcebuffer-private.h"
@@ -31,9 +32,12 @@
 #include "gtksourcestyle.h"
 #include "gtksourcestylescheme.h"
 #include "gtksourceutils.h"
+#include "gtksourceutils-private.h"
 #include "gtksourceregion.h"
 #include "gtksourceiter.h"
+#include "gtksourceoccurrencesindex.h"
 #include "gtksource-enumtypes.h"
+#include "gtksourceregex.h"
 
 /**
  * SECTION:searchcontext
@@ -96,37 +100,36 @@
 
 /* Implementation overview:
  *
- * When the state of the search changes (the text to search or the options), we
- * have to update the highlighting and the properties values (the number of
- * occurrences). To do so, a simple solution is to first remove all the
- * found_tag, so we have a clean buffer to analyze. The problem with this
- * solution is that there is some flickering when the user modifies the text to
- * search, because removing all the found_tag's can take some time. So we keep
- * the old found_tag's, and when we must highlight the matches in a certain
- * region, we first remove the found_tag's in this region and then we highlight
- * the newly found matches by applying the found_tag to them.
+ * The occurrences found by scanning the buffer are stored in the occurrences
+ * index, a GtkSourceOccurrencesIndex sorted by offset. The found_tag is only
+ * a view of the index: it is applied to the occurrences located in the ranges
+ * given to _gtk_source_search_context_update_highlight(), i.e. the visible
+ * regions of the GtkSourceViews. These ranges are the tagged_ranges. When an
+ * occurrence is found in a tagged range, it is tagged directly. For big
+ * buffers with a lot of occurrences, tagging all of them would make each
+ * buffer modification slower, since GtkTextBuffer must update the tag toggles.
+ * When more than MAX_TAGGED_OCCURRENCES occurrences are tagged, the found_tag
+ * is kept only in the range that has just been highlighted, so the tags of
+ * the regions no longer visible are removed.
+ *
+ * When the state of the search changes (the text to search or the options), the
+ * index is cleared, the found_tag is removed from the tagged ranges, and an
+ * idle callback is installed, which will scan the buffer to find the
+ * occurrences. To avoid flickering, the visible region on the screen is put in
+ * a higher priority region to scan, so the idle callback will first scan this
+ * region.
  *
  * If we only want to highlight the matches, without counting the number of
- * occurrences, a good solution would be to highlight only the visible region of
- * the buffer on the screen. So it would be useless to always scan all the
- * buffer.
+ * occurrences, a good solution would be to scan only the visible region of the
+ * buffer on the screen. But we actually want the number of occurrences! So we
+ * have to scan all the buffer.
  *
- * But we actually want the number of occurrences! So we have to scan all the
- * buffer. When the state of the search changes, an idle callback is installed,
- * which will scan the buffer to highlight the matches. To avoid flickering, the
- * visible region on the screen is put in a higher priority region to highlight,
- * so the idle callback will first scan this region.
- *
- * Why highlighting the non-visible matches? What we want is to (1) highlight
- * the visible matches and (2) count the number of occurrences. The code would
- * indeed be simpler if these two tasks were clearly separated (in two different
- * idle callbacks, with different regions to scan). With this simpler solution,
- * we would always use forward_search() and backward_search() to navigate
- * through the occurrences. But we can do better than that!
- * forward_to_tag_toggle() and backward_to_tag_toggle() are far more efficient:
- * once the buffer has been scanned, going to the previous or the next
- * occurrence is done in O(log n), with n the length of the buffer. We must just
- * pay attention to contiguous matches.
+ * Why storing the non-visible matches? The code would indeed be simpler if the
+ * highlighting and the counting were clearly separated. With this simpler
+ * solution, we would always use forward_search() and backward_search() to
+ * navigate through the occurrences. But we can do better than that! Once the
+ * buffer has been scanned, going to the previous or the next occurrence is a
+ * lookup in the index, done in O(log n), with n the number of occurrences.
  *
  * While the user is typing the text in the search entry, the buffer is scanned
  * to count the number of occurrences. And when the user wants to do an
@@ -139,27 +142,25 @@
  * Once the buffer is scanned, switching between the occurrences will be almost
  * instantaneous.
  *
- * So how to count the number of occurrences then? Remember that the buffer
- * contents can be modified during the scan, and that we keep the old
- * found_tag's. Moreover, when we encounter an old found_tag region, in the
- * general case we can not say how many occurrences there are in this region,
- * since a found_tag region can contain contiguous matches. Take for example the
- * found_tag region "aa": was it the "aa" search match, or two times "a"?
- * The implemented solution is to set occurrences_count to 0 when the search
- * state changes, even if old matches are still there. Because it is not
- * possible to count the old matches to decrement occurrences_count (and storing
- * the previous search text would not be sufficient, because even older matches
- * can still be there). To increment and decrement occurrences_count, there is
- * the scan_region, the region to scan. If an occurrence is contained in
- * scan_region, it means that it has not already been scanned, so
- * occurrences_count doesn't take into account this occurrence. On the other
- * hand, if we find an occurrence outside scan_region, the occurrence is
- * normally correctly highlighted, and occurrences_count take it into account.
- *
- * So when we highlight or when we remove the highlight of an occurrence (on
- * text insertion, deletion, when scanning, etc.), we increment or decrement
- * occurrences_count depending on whether the occurrence was already taken into
- * account by occurrences_count.
+ * To increment and decrement occurrences_count, there is the scan_region, the
+ * region to scan. If an occurrence is contained in scan_region, it means that
+ * it has not already been scanned, so occurrences_count doesn't take into
+ * account this occurrence. On the other hand, if an occurrence of the index is
+ * outside scan_region, occurrences_count takes it into account.
+ *
+ * So when we add or remove an occurrence (on text insertion, deletion, when
+ * scanning, etc.), we increment or decrement occurrences_count depending on
+ * whether the occurrence was already taken into account by occurrences_count.
+ *
+ * The position of an occurrence is also computed with the index, in O(log n).
+ * On text insertion and deletion, the offsets located after the change are
+ * shifted, as well as the tagged ranges. The index stores the offsets
+ * relatively, so the shift is O(log n) too, see gtksourceoccurrencesindex.c.
+ *
+ * Since the index stores the boundaries of each occurrence, contiguous matches
+ * are not a problem. Take for example the buffer "aaaa" with the search text
+ * "aa". The two occurrences are at positions [0:2] and [2:4]. If we begin to
+ * search at position 1, the index directly gives [2:4].
  *
  * If the code seems too complicated and contains strange bugs, you have two
  * choices:
@@ -172,19 +173,10 @@
  * Known issue
  * -----------
  *
- * Contiguous matches have a performance problem. In some cases it can lead to
- * an O(N^2) time complexity. For example if the buffer is full of contiguous
- * matches, and we want to navigate through all of them. If an iter is in the
- * middle of a found_tag region, we don't know where are the nearest occurrence
- * boundaries. Take for example the buffer "aaaa" with the search text "aa". The
- * two occurrences are at positions [0:2] and [2:4]. If we begin to search at
- * position 1, we can not take [1:3] as an occurrence. So what the code do is to
- * go backward to the start of the found_tag region, and do a basic search
- * inside the found_tag region to find the occurrence boundaries.
- *
- * So this is really a corner case, but it's better to be aware of that.
- * To fix the problem, one solution would be to have two found_tag, and
- * alternate them for contiguous matches.
+ * The tagged ranges are shared by all the views of the buffer. With several
+ * views showing distant parts of a buffer containing a lot of occurrences,
+ * the found_tag can be removed and applied again when the views are redrawn
+ * one after the other.
  */
 
 /* Regex search:
@@ -204,8 +196,13 @@
  * a match can modify a match located in the neighborhood. Take for example the
  * regex "(aa)+" with the buffer contents "aaa". There is one occurrence: the
  * first two letters. If we insert an extra 'a' at the end of the buffer, the
- * occurrence is modified to take the next two letters. That's why the buffer
- * is re-scanned entirely on each insertion or deletion in the buffer.
+ * occurrence is modified to take the next two letters. That's why, on each
+ * insertion or deletion in the buffer, the occurrences are removed and scanned
+ * again in the neighbouring lines: max-match-span lines before and after the
+ * modification, or REGEX_SEARCH_WINDOW_LINES lines if there is no limit (see
+ * below). The scan starts at the beginning of the first occurrence overlapping
+ * that range, and a partial match can go past its end. A match starting more
+ * lines before the modification is not updated until the search is restarted.
  *
  * For searching the matches, the easiest solution is to retrieve all the buffer
  * contents, and search the occurrences on this big string. But it takes a lot
@@ -222,6 +219,21 @@
  * match nor a partial match), we take the next segment, with the last
  * max_lookbehind characters from the previous segment.
  *
+ * A segment is a window of REGEX_SEARCH_WINDOW_LINES lines. The subject string
+ * is kept in a scratch buffer between the segments of a chunk: the text that is
+ * still needed (the max_lookbehind characters, or the beginning of a partial
+ * match) is reused, and only the new lines are retrieved from the buffer. A
+ * partial match can thus grow the subject without copying it again. A regex
+ * like "(?s)BEGIN.*?END" can lead to a partial match until the end of the
+ * buffer, so the subject stops growing once it reaches
+ * REGEX_SEARCH_MAX_SUBJECT_SIZE bytes: it is then scanned without partial
+ * matching, and a longer match is not found. The
+ * GtkSourceSearchSettings:max-match-span property bounds the subject in the
+ * same way, in lines: a partial match starting at line L doesn't grow the
+ * subject after line L + max-match-span, and the worker threads of the
+ * parallel scan (see below) don't extend a chunk further than max-match-span
+ * lines.
+ *
  * Improvement idea
  * ----------------
  *
@@ -249,14 +261,46 @@
  *
  * It happens with test-search, with this file as the buffer (~3500 lines).
  *
- * Improvement idea
- * ----------------
+ * JIT compilation
+ * ---------------
  *
  * GRegex currently doesn't support JIT pattern compilation:
  * https://bugzilla.gnome.org/show_bug.cgi?id=679155
  *
- * Once available, it can be a nice performance improvement (but it must be
- * measured, since g_regex_new() is slower with JIT enabled).
+ * When configured with --enable-pcre2-jit, the regex is also compiled with the
+ * PCRE2 JIT compiler, and the scan of the buffer uses it (see
+ * regex_search_scan_subject()). The GRegex is still used to check the
+ * pattern, for the forward and backward searches and for the replacements.
+ * When a JIT match fails, for example because the JIT stack is exhausted, the
+ * rest of the subject is scanned with the GRegex instead.
+ * Compiling is slower with the JIT, but it is done only once per pattern,
+ * and test-search-performances shows the gain for the scan.
+ *
+ * Parallel scan
+ * -------------
+ *
+ * For big buffers (see PARALLEL_SCAN_MIN_LINES), the whole buffer is also
+ * scanned in worker threads when the search starts. The buffer contents is
+ * retrieved once, with gtk_text_iter_get_slice() so that the character offsets
+ * are buffer offsets, and split into chunks of lines. The regex subjects are
+ * the visible text, so this is done only when the slice is the visible text,
+ * i.e. without invisible text, pixbufs and child anchors. Each chunk is scanned by a
+ * thread of a GThreadPool, on a subject that starts at the chunk and goes a bit
+ * further (the overlap), so that matches spanning several lines are found. The
+ * text can be longer than G_MAXINT bytes, the subjects can't. A match
+ * longer than the overlap gives a partial match, and the chunk is scanned
+ * again with a bigger overlap, like for the segments above.
+ *
+ * When all the chunks are scanned, the matches are merged in the main thread.
+ * When the last match of a chunk ends in the next chunk, the matches of the
+ * next chunk are searched again from the end of that match, until they are
+ * the same as the ones found by the worker thread. The occurrences are then
+ * highlighted, except in the part of the buffer that has been scanned in the
+ * meantime by a forward or backward search. A buffer modification cancels the
+ * parallel scan, the rest of the buffer is then scanned in the main thread.
+ *
+ * The number of threads is the number of processors, or the value of the
+ * GTK_SOURCE_SEARCH_THREADS environment variable. 0 disables the parallel scan.
  *
  * Known issue
  * -----------
@@ -292,6 +336,48 @@
  */
 #define SCAN_BATCH_SIZE 100
 
+/* Minimum number of lines in the buffer to scan it in worker threads, for the
+ * regex search. See the "Parallel scan" section above.
+ */
+#define PARALLEL_SCAN_MIN_LINES 10000
+
+/* The number of chunks per thread. Having more chunks than threads balances the
+ * load when some chunks contain more matches.
+ */
+#define PARALLEL_SCAN_CHUNKS_PER_THREAD 4
+
+/* Maximum size of a chunk, in bytes. The chunks are ranges of lines of about
+ * that size at most, so that their subjects stay below G_MAXINT bytes even for
+ * buffers bigger than that.
+ */
+#define PARALLEL_SCAN_MAX_CHUNK_SIZE (64 * 1024 * 1024)
+
+/* Number of bytes after a chunk that are also part of its subject, so that
+ * most multi-line matches can be found without re-scanning.
+ */
+#define PARALLEL_SCAN_OVERLAP 1024
+
+/* Maximum number of occurrences having the found_tag. When it is exceeded, the
+ * found_tag is kept only in the range that has just been highlighted, i.e. it
+ * is removed from the parts of the buffer that are no longer visible.
+ */
+#define MAX_TAGGED_OCCURRENCES 10000
+
+/* Number of lines of a segment for the regex search, and maximum size in bytes
+ * of the subject string when a partial match is grown. See the "Regex search"
+ * section above.
+ */
+#define REGEX_SEARCH_WINDOW_LINES 16
+#define REGEX_SEARCH_MAX_SUBJECT_SIZE (4 * 1024 * 1024)
+
+/* Number of lines retrieved at once by the literal search. */
+#define LITERAL_SEARCH_CHUNK_LINES 1000
+
+/* Maximum number of search results kept for the search-as-you-type, see
+ * incremental_search_update().
+ */
+#define MAX_INCREMENTAL_SNAPSHOTS 16
+
 enum
 {
 	PROP_0,
@@ -313,8 +399,9 @@ struct _GtkSourceSearchContextPrivate
 
 	GtkSourceSearchSettings *settings;
 
-	/* The tag to apply to search occurrences. Even if the highlighting is
-	 * disabled, the tag is applied.
+	/* The tag to apply to search occurrences. It is applied only in the
+	 * ranges given to _gtk_source_search_context_update_highlight(), and
+	 * only if the highlighting is enabled.
 	 */
 	GtkTextTag *found_tag;
 
@@ -346,13 +433,188 @@ struct _GtkSourceSearchContextPrivate
 	GRegex *regex;
 	GError *regex_error;
 
+#ifdef ENABLE_PCRE2_JIT
+	/* JIT-compiled copy of @regex, used to scan the buffer. NULL if the
+	 * JIT compiler is not available.
+	 */
+	pcre2_code *jit_code;
+	pcre2_match_data *jit_match_data;
+	pcre2_match_context *jit_match_context;
+	pcre2_jit_stack *jit_stack;
+#endif
+
+	/* Scratch buffer for the regex search. It contains the visible text
+	 * between the offsets regex_subject_start and regex_subject_end, or
+	 * nothing if regex_subject_start is -1. See regex_search_get_subject().
+	 */
+	GString *regex_subject;
+	gint regex_subject_start;
+	gint regex_subject_end;
+
+	/* The search text of the occurrences index. */
+	gchar *indexed_search_text;
+
+	/* The IncrementalSnapshot's of the shorter search texts, the most
+	 * recent at the head.
+	 */
+	GQueue incremental_snapshots;
+
+	/* The Boyer-Moore-Horspool shift table of the search text, for the
+	 * literal search. See literal_search_find().
+	 */
+	gsize literal_shift[256];
+	gsize literal_length;
+
+	/* The regex search running in worker threads, if any. */
+	GTask *parallel_scan_task;
+
 	gint occurrences_count;
+
+	/* Incremented on each change in the buffer, to know whether a snapshot
+	 * of the buffer is still up-to-date. See
+	 * gtk_source_search_context_replace_all_async().
+	 */
+	guint buffer_stamp;
+
+	/* Incremented on each change of the search settings. */
+	guint settings_stamp;
+
+	/* The scanned occurrences. */
+	GtkSourceOccurrencesIndex *occurrences_index;
+
+	/* The ranges where the found_tag is applied to the occurrences, as
+	 * OffsetRange's sorted and disjoint.
+	 */
+	GArray *tagged_ranges;
+
 	gulong idle_scan_id;
 
 	GtkSourceStyle *match_style;
 	guint highlight : 1;
+
+	/* Whether the search text is on a single line, a prerequisite for
+	 * the literal search.
+	 */
+	guint literal_single_line : 1;
 };
 
+typedef struct
+{
+	gint start;
+	gint end;
+} OffsetRange;
+
+/* The occurrences of a previous search text. */
+typedef struct
+{
+	gchar *search_text;
+
+	/* Array of OffsetRange's. */
+	GArray *occurrences;
+} IncrementalSnapshot;
+
+typedef struct
+{
+	gint start;
+	gint end;
+
+	/* The replacement text, or NULL to use the text given to
+	 * gtk_source_search_context_replace_all().
+	 */
+	gchar *replacement;
+} ReplaceAllMatch;
+
+/* The data of gtk_source_search_context_replace_all_async(), shared with the
+ * worker thread.
+ */
+typedef struct
+{
+	/* Snapshot of the buffer contents, or NULL if the matches are searched
+	 * in the main thread.
+	 */
+	gchar *text;
+	guint buffer_stamp;
+	guint settings_stamp;
+
+	/* The regex, or the search text and its shift table for a literal
+	 * search.
+	 */
+	GRegex *regex;
+	gint max_match_span;
+	gchar *search_text;
+	gsize literal_shift[256];
+	gsize literal_length;
+
+	/* For a literal search at word boundaries, the matches can overlap:
+	 * the ones that are not at word boundaries are removed in the main
+	 * thread.
+	 */
+	guint at_word_boundaries : 1;
+
+	gchar *replace;
+	guint has_regex_references : 1;
+
+	/* The ReplaceAllMatch's found in the worker thread. */
+	GArray *matches;
+
+	/* When the matches are searched in the main thread: the task of
+	 * gtk_source_search_context_replace_all_async(), and the offset where
+	 * the next idle step starts.
+	 */
+	GTask *task;
+	gint offset;
+} ReplaceAllAsync;
+
+/* A regex match found by the parallel scan. The offsets are in characters,
+ * relative to the start of the chunk in the worker threads and absolute once
+ * merged.
+ */
+typedef struct
+{
+	gsize start_byte;
+	gsize end_byte;
+	gint start_offset;
+	gint end_offset;
+} ParallelScanMatch;
+
+typedef struct
+{
+	/* In bytes, in the text of the ParallelScan. The chunk is
+	 * [start_byte; end_byte[, and the matches are searched in the
+	 * subject [0; limit_byte[.
+	 */
+	gsize start_byte;
+	gsize end_byte;
+	gsize limit_byte;
+
+	/* Length of the chunk, in characters. */
+	gint nb_chars;
+
+	GArray *matches;
+	GError *error;
+} ParallelScanChunk;
+
+typedef struct
+{
+	GRegex *regex;
+	gchar *text;
+	gsize text_length;
+
+	/* See parallel_scan_get_subject_start(). */
+	gint max_lookbehind;
+
+	/* See GtkSourceSearchSettings:max-match-span. */
+	gint max_match_span;
+
+	ParallelScanChunk *chunks;
+	guint nb_chunks;
+
+	/* Reference held until the last chunk is scanned. */
+	GTask *task;
+	GCancellable *cancellable;
+	gint nb_remaining_chunks;
+} ParallelScan;
+
 /* Data for the asynchronous forward and backward search tasks. */
 typedef struct
 {
@@ -369,6 +631,8 @@ typedef struct
 G_DEFINE_TYPE_WITH_PRIVATE (GtkSourceSearchContext, gtk_source_search_context, G_TYPE_OBJECT);
 
 static void		install_idle_scan		(GtkSourceSearchContext *search);
+static void		replace_all_async_start		(GtkSourceSearchContext *search,
+							 GTask                  *task);
 
 #ifdef ENABLE_DEBUG
 static void
@@ -507,3306 +771,5971 @@ get_last_subregion (GtkSourceRegion *region,
 	return found;
 }
 
-static void
-clear_task (GtkSourceSearchContext *search)
+/* Gets the occurrence containing the character at @offset. */
+static gboolean
+get_occurrence_at (GtkSourceSearchContext *search,
+		   gint                    offset,
+		   OffsetRange            *occurrence)
 {
-	g_clear_object (&search->priv->task_region);
+	GtkSourceOccurrencesIter iter;
 
-	if (search->priv->task != NULL)
+	_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index, &iter, offset + 1);
+
+	if (!_gtk_source_occurrences_index_iter_prev (&iter))
 	{
-		GCancellable *cancellable = g_task_get_cancellable (search->priv->task);
+		return FALSE;
+	}
 
-		if (cancellable != NULL)
-		{
-			g_cancellable_cancel (cancellable);
-			g_task_return_error_if_cancelled (search->priv->task);
-		}
+	_gtk_source_occurrences_index_iter_get (&iter, &occurrence->start, &occurrence->end);
 
-		g_clear_object (&search->priv->task);
-	}
+	return occurrence->end > offset;
 }
 
-static void
-clear_search (GtkSourceSearchContext *search)
+/* Gets the first occurrence starting at or after @offset. */
+static gboolean
+get_next_occurrence (GtkSourceSearchContext *search,
+		     gint                    offset,
+		     OffsetRange            *occurrence)
 {
-	g_clear_object (&search->priv->scan_region);
-	g_clear_object (&search->priv->high_priority_region);
+	GtkSourceOccurrencesIter iter;
 
-	if (search->priv->idle_scan_id != 0)
+	_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index, &iter, offset);
+
+	if (_gtk_source_occurrences_index_iter_is_end (&iter))
 	{
-		g_source_remove (search->priv->idle_scan_id);
-		search->priv->idle_scan_id = 0;
+		return FALSE;
 	}
 
-	if (search->priv->regex_error != NULL)
+	_gtk_source_occurrences_index_iter_get (&iter, &occurrence->start, &occurrence->end);
+	return TRUE;
+}
+
+/* Gets the last occurrence ending at or before @offset. */
+static gboolean
+get_previous_occurrence (GtkSourceSearchContext *search,
+			 gint                    offset,
+			 OffsetRange            *occurrence)
+{
+	GtkSourceOccurrencesIter iter;
+
+	_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index, &iter, offset);
+
+	/* The occurrences don't overlap, so at most two iterations. */
+	while (_gtk_source_occurrences_index_iter_prev (&iter))
 	{
-		g_clear_error (&search->priv->regex_error);
-		g_object_notify (G_OBJECT (search), "regex-error");
+		_gtk_source_occurrences_index_iter_get (&iter, &occurrence->start, &occurrence->end);
+
+		if (occurrence->end <= offset)
+		{
+			return TRUE;
+		}
 	}
 
-	clear_task (search);
+	return FALSE;
+}
 
-	search->priv->occurrences_count = 0;
+static void
+get_occurrence_iters (GtkSourceSearchContext *search,
+		      const OffsetRange      *occurrence,
+		      GtkTextIter            *match_start,
+		      GtkTextIter            *match_end)
+{
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, match_start, occurrence->start);
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, match_end, occurrence->end);
 }
 
-static GtkTextSearchFlags
-get_text_search_flags (GtkSourceSearchContext *search)
+static void
+apply_found_tag (GtkSourceSearchContext *search,
+		 gint                    start_offset,
+		 gint                    end_offset)
 {
-	GtkTextSearchFlags flags = GTK_TEXT_SEARCH_TEXT_ONLY | GTK_TEXT_SEARCH_VISIBLE_ONLY;
+	GtkTextIter start;
+	GtkTextIter end;
 
-	if (!gtk_source_search_settings_get_case_sensitive (search->priv->settings))
-	{
-		flags |= GTK_TEXT_SEARCH_CASE_INSENSITIVE;
-	}
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &start, start_offset);
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &end, end_offset);
 
-	return flags;
+	gtk_text_buffer_apply_tag (search->priv->buffer,
+				   search->priv->found_tag,
+				   &start,
+				   &end);
 }
 
-/* @start_pos is in bytes. */
 static void
-regex_search_get_real_start (GtkSourceSearchContext *search,
-			     const GtkTextIter      *start,
-			     GtkTextIter            *real_start,
-			     gint                   *start_pos)
+remove_found_tag (GtkSourceSearchContext *search,
+		  gint                    start_offset,
+		  gint                    end_offset)
 {
-	gint max_lookbehind = g_regex_get_max_lookbehind (search->priv->regex);
-	gint i;
-	gchar *text;
+	GtkTextIter start;
+	GtkTextIter end;
 
-	*real_start = *start;
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &start, start_offset);
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &end, end_offset);
 
-	for (i = 0; i < max_lookbehind; i++)
+	gtk_text_buffer_remove_tag (search->priv->buffer,
+				    search->priv->found_tag,
+				    &start,
+				    &end);
+}
+
+/* Removes the found_tag from the part of [start_offset; end_offset[ located in
+ * the tagged ranges. The found_tag is not applied elsewhere.
+ */
+static void
+untag_range (GtkSourceSearchContext *search,
+	     gint                    start_offset,
+	     gint                    end_offset)
+{
+	guint i;
+
+	for (i = 0; i < search->priv->tagged_ranges->len; i++)
 	{
-		if (!gtk_text_iter_backward_char (real_start))
+		OffsetRange *range = &g_array_index (search->priv->tagged_ranges, OffsetRange, i);
+
+		if (range->start >= end_offset)
 		{
 			break;
 		}
+
+		if (start_offset < range->end)
+		{
+			remove_found_tag (search,
+					  MAX (range->start, start_offset),
+					  MIN (range->end, end_offset));
+		}
 	}
+}
 
-	text = gtk_text_iter_get_visible_text (real_start, start);
-	*start_pos = strlen (text);
+/* Removes the occurrences starting in [start; end[, without updating
+ * occurrences_count.
+ */
+static void
+clear_occurrences_in_range (GtkSourceSearchContext *search,
+			    const GtkTextIter      *start,
+			    const GtkTextIter      *end)
+{
+	gint start_offset = gtk_text_iter_get_offset (start);
+	gint end_offset = gtk_text_iter_get_offset (end);
 
-	g_free (text);
+	untag_range (search, start_offset, end_offset);
+	_gtk_source_occurrences_index_remove (search->priv->occurrences_index, start_offset, end_offset);
 }
 
-static GRegexMatchFlags
-regex_search_get_match_options (const GtkTextIter *real_start,
-				const GtkTextIter *end)
+/* Applies the found_tag to the part of @occurrence located in the tagged
+ * ranges.
+ */
+static void
+tag_occurrence (GtkSourceSearchContext *search,
+		const OffsetRange      *occurrence)
 {
-	GRegexMatchFlags match_options = 0;
+	guint i;
 
-	if (!gtk_text_iter_starts_line (real_start))
+	for (i = 0; i < search->priv->tagged_ranges->len; i++)
 	{
-		match_options |= G_REGEX_MATCH_NOTBOL;
+		OffsetRange *range = &g_array_index (search->priv->tagged_ranges, OffsetRange, i);
+		gint start = MAX (occurrence->start, range->start);
+		gint end = MIN (occurrence->end, range->end);
+
+		if (range->start >= occurrence->end)
+		{
+			break;
+		}
+
+		if (start < end)
+		{
+			apply_found_tag (search, start, end);
+		}
 	}
+}
 
-	if (!gtk_text_iter_ends_line (end))
+static void
+add_occurrence (GtkSourceSearchContext *search,
+		const GtkTextIter      *match_start,
+		const GtkTextIter      *match_end)
+{
+	OffsetRange occurrence;
+
+	occurrence.start = gtk_text_iter_get_offset (match_start);
+	occurrence.end = gtk_text_iter_get_offset (match_end);
+
+	_gtk_source_occurrences_index_add (search->priv->occurrences_index,
+					   occurrence.start,
+					   occurrence.end);
+
+	tag_occurrence (search, &occurrence);
+
+	search->priv->occurrences_count++;
+}
+
+/* Applies the found_tag to the occurrences in [start_offset; end_offset[, that
+ * is not yet in the tagged ranges.
+ */
+static void
+tag_untagged_range (GtkSourceSearchContext *search,
+		    gint                    start_offset,
+		    gint                    end_offset)
+{
+	OffsetRange occurrence;
+	GtkSourceOccurrencesIter iter;
+
+	if (get_occurrence_at (search, start_offset, &occurrence) &&
+	    occurrence.start < start_offset)
 	{
-		match_options |= G_REGEX_MATCH_NOTEOL;
+		apply_found_tag (search, start_offset, MIN (occurrence.end, end_offset));
 	}
 
-	if (!gtk_text_iter_is_end (end))
+	for (_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index, &iter, start_offset);
+	     !_gtk_source_occurrences_index_iter_is_end (&iter);
+	     _gtk_source_occurrences_index_iter_next (&iter))
 	{
-		match_options |= G_REGEX_MATCH_PARTIAL_HARD;
-	}
+		_gtk_source_occurrences_index_iter_get (&iter, &occurrence.start, &occurrence.end);
 
-	return match_options;
+		if (occurrence.start >= end_offset)
+		{
+			break;
+		}
+
+		apply_found_tag (search, occurrence.start, MIN (occurrence.end, end_offset));
+	}
 }
 
-/* Get the @match_start and @match_end iters of the @match_info.
- * g_match_info_fetch_pos() returns byte positions. To get the iters, we need to
- * know the number of UTF-8 characters. A GMatchInfo can contain several matches
- * (with g_match_info_next()). So instead of calling g_utf8_strlen() each time
- * at the beginning of @subject, @iter and @iter_byte_pos are used to remember
- * where g_utf8_strlen() stopped.
- */
-static gboolean
-regex_search_fetch_match (GMatchInfo  *match_info,
-			  const gchar *subject,
-			  gssize       subject_length,
-			  GtkTextIter *iter,
-			  gint        *iter_byte_pos,
-			  GtkTextIter *match_start,
-			  GtkTextIter *match_end)
+static void
+tagged_ranges_add (GtkSourceSearchContext *search,
+		   gint                    start_offset,
+		   gint                    end_offset)
 {
-	gint start_byte_pos;
-	gint end_byte_pos;
-	gint nb_chars;
+	GArray *ranges = search->priv->tagged_ranges;
+	OffsetRange new_range;
+	guint i = 0;
 
-	g_assert (*iter_byte_pos <= subject_length);
-	g_assert (match_start != NULL);
-	g_assert (match_end != NULL);
+	new_range.start = start_offset;
+	new_range.end = end_offset;
 
-	if (!g_match_info_matches (match_info))
+	while (i < ranges->len &&
+	       g_array_index (ranges, OffsetRange, i).end < new_range.start)
 	{
-		return FALSE;
+		i++;
 	}
 
-	if (!g_match_info_fetch_pos (match_info, 0, &start_byte_pos, &end_byte_pos))
+	/* Merge the overlapping and adjacent ranges. */
+	while (i < ranges->len &&
+	       g_array_index (ranges, OffsetRange, i).start <= new_range.end)
 	{
-		g_warning ("Impossible to fetch regex match position.");
-		return FALSE;
+		OffsetRange *range = &g_array_index (ranges, OffsetRange, i);
+
+		new_range.start = MIN (new_range.start, range->start);
+		new_range.end = MAX (new_range.end, range->end);
+		g_array_remove_index (ranges, i);
 	}
 
-	g_assert (start_byte_pos < subject_length);
-	g_assert (end_byte_pos <= subject_length);
-	g_assert (*iter_byte_pos <= start_byte_pos);
-	g_assert (start_byte_pos < end_byte_pos);
+	g_array_insert_val (ranges, i, new_range);
+}
 
-	nb_chars = g_utf8_strlen (subject + *iter_byte_pos,
-				  start_byte_pos - *iter_byte_pos);
+/* Returns the number of occurrences starting before @offset. */
+static gint
+get_nb_occurrences_before (GtkSourceSearchContext *search,
+			   gint                    offset)
+{
+	GtkSourceOccurrencesIter iter;
 
-	*match_start = *iter;
-	gtk_text_iter_forward_chars (match_start, nb_chars);
+	_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index, &iter, offset);
 
-	nb_chars = g_utf8_strlen (subject + start_byte_pos,
-				  end_byte_pos - start_byte_pos);
+	return _gtk_source_occurrences_index_iter_get_position (&iter);
+}
 
-	*match_end = *match_start;
-	gtk_text_iter_forward_chars (match_end, nb_chars);
+static gint
+get_nb_tagged_occurrences (GtkSourceSearchContext *search)
+{
+	gint nb_occurrences = 0;
+	guint i;
 
-	*iter = *match_end;
-	*iter_byte_pos = end_byte_pos;
+	for (i = 0; i < search->priv->tagged_ranges->len; i++)
+	{
+		OffsetRange *range = &g_array_index (search->priv->tagged_ranges, OffsetRange, i);
 
-	return TRUE;
+		nb_occurrences += get_nb_occurrences_before (search, range->end);
+		nb_occurrences -= get_nb_occurrences_before (search, range->start);
+	}
+
+	return nb_occurrences;
 }
 
-/* If you retrieve only [match_start, match_end] from the GtkTextBuffer, it
- * does not match the regex if the regex contains look-ahead assertions. For
- * that, get the @real_end. Note that [match_start, real_end] is not the minimum
- * amount of text that still matches the regex, it can contain several
- * occurrences, so you can add the G_REGEX_MATCH_ANCHORED option to match only
- * the first occurrence.
- * Note that @limit is the limit for @match_end, not @real_end.
+/* When there are too many occurrences in the tagged ranges, remove the
+ * found_tag everywhere except in [start_offset; end_offset[, the range that
+ * has just been tagged.
  */
-static gboolean
-basic_forward_regex_search (GtkSourceSearchContext *search,
-			    const GtkTextIter      *start_at,
-			    GtkTextIter            *match_start,
-			    GtkTextIter            *match_end,
-			    GtkTextIter            *real_end,
-			    const GtkTextIter      *limit)
+static void
+trim_tagged_ranges (GtkSourceSearchContext *search,
+		    gint                    start_offset,
+		    gint                    end_offset)
 {
-	GtkTextIter real_start;
-	GtkTextIter end;
-	gint start_pos;
-	gboolean found = FALSE;
-	gint nb_lines = 1;
+	OffsetRange kept_range;
+	guint i;
 
-	if (search->priv->regex == NULL ||
-	    search->priv->regex_error != NULL)
+	if (get_nb_tagged_occurrences (search) <= MAX_TAGGED_OCCURRENCES)
 	{
-		return FALSE;
+		return;
 	}
 
-	regex_search_get_real_start (search, start_at, &real_start, &start_pos);
-
-	if (limit == NULL)
-	{
-		gtk_text_buffer_get_end_iter (search->priv->buffer, &end);
-	}
-	else
+	for (i = 0; i < search->priv->tagged_ranges->len; i++)
 	{
-		end = *limit;
-	}
+		OffsetRange *range = &g_array_index (search->priv->tagged_ranges, OffsetRange, i);
 
-	while (TRUE)
-	{
-		GRegexMatchFlags match_options;
-		gchar *subject;
-		gssize subject_length;
-		GMatchInfo *match_info;
-		GtkTextIter iter;
-		gint iter_byte_pos;
-		GtkTextIter m_start;
-		GtkTextIter m_end;
+		if (range->start < start_offset)
+		{
+			remove_found_tag (search, range->start, MIN (range->end, start_offset));
+		}
 
-		match_options = regex_search_get_match_options (&real_start, &end);
-		subject = gtk_text_iter_get_visible_text (&real_start, &end);
-		subject_length = strlen (subject);
+		if (range->end > end_offset)
+		{
+			remove_found_tag (search, MAX (range->start, end_offset), range->end);
+		}
+	}
 
-		g_regex_match_full (search->priv->regex,
-				    subject,
-				    subject_length,
-				    start_pos,
-				    match_options,
-				    &match_info,
-				    &search->priv->regex_error);
+	kept_range.start = start_offset;
+	kept_range.end = end_offset;
 
-		iter = real_start;
-		iter_byte_pos = 0;
+	g_array_set_size (search->priv->tagged_ranges, 0);
+	g_array_append_val (search->priv->tagged_ranges, kept_range);
+}
 
-		found = regex_search_fetch_match (match_info,
-						  subject,
-						  subject_length,
-						  &iter,
-						  &iter_byte_pos,
-						  &m_start,
-						  &m_end);
+/* Applies the found_tag to the occurrences in [start; end] that are not yet
+ * tagged, and adds [start; end] to the tagged ranges.
+ */
+static void
+tag_range (GtkSourceSearchContext *search,
+	   const GtkTextIter      *start,
+	   const GtkTextIter      *end)
+{
+	gint start_offset = gtk_text_iter_get_offset (start);
+	gint end_offset = gtk_text_iter_get_offset (end);
+	gint pos = start_offset;
+	guint i;
 
-		if (!found && g_match_info_is_partial_match (match_info))
-		{
-			gtk_text_iter_forward_lines (&end, nb_lines);
-			nb_lines <<= 1;
+	if (start_offset >= end_offset)
+	{
+		return;
+	}
 
-			g_free (subject);
-			g_match_info_free (match_info);
-			continue;
-		}
+	text_tag_set_highest_priority (search->priv->found_tag,
+				       search->priv->buffer);
 
-		/* Check that the match is not beyond the limit. This can happen
-		 * if a partial match is found on the first iteration. Then the
-		 * partial match was actually not a good match, but a second
-		 * good match is found.
-		 */
-		if (found && limit != NULL && gtk_text_iter_compare (limit, &m_end) < 0)
-		{
-			found = FALSE;
-		}
+	for (i = 0; i < search->priv->tagged_ranges->len; i++)
+	{
+		OffsetRange *range = &g_array_index (search->priv->tagged_ranges, OffsetRange, i);
 
-		if (search->priv->regex_error != NULL)
+		if (range->start >= end_offset)
 		{
-			g_object_notify (G_OBJECT (search), "regex-error");
-			found = FALSE;
+			break;
 		}
 
-		if (found)
+		if (range->start > pos)
 		{
-			if (match_start != NULL)
-			{
-				*match_start = m_start;
-			}
-
-			if (match_end != NULL)
-			{
-				*match_end = m_end;
-			}
-
-			if (real_end != NULL)
-			{
-				*real_end = end;
-			}
+			tag_untagged_range (search, pos, range->start);
 		}
 
-		g_free (subject);
-		g_match_info_free (match_info);
-		break;
+		pos = MAX (pos, range->end);
 	}
 
-	return found;
+	if (pos >= end_offset)
+	{
+		/* Already tagged, the common case when redrawing. */
+		return;
+	}
+
+	tag_untagged_range (search, pos, end_offset);
+
+	tagged_ranges_add (search, start_offset, end_offset);
+	trim_tagged_ranges (search, start_offset, end_offset);
 }
 
-static gboolean
-basic_forward_search (GtkSourceSearchContext *search,
-		      const GtkTextIter      *iter,
-		      GtkTextIter            *match_start,
-		      GtkTextIter            *match_end,
-		      const GtkTextIter      *limit)
+/* Removes the found_tag from the whole buffer. */
+static void
+clear_tagged_ranges (GtkSourceSearchContext *search)
 {
-	GtkTextIter begin_search = *iter;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
-	GtkTextSearchFlags flags;
+	GtkTextIter start;
+	GtkTextIter end;
 
-	if (search_text == NULL)
-	{
-		return FALSE;
-	}
+	g_array_set_size (search->priv->tagged_ranges, 0);
 
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
-	{
-		return basic_forward_regex_search (search,
-						   iter,
-						   match_start,
-						   match_end,
-						   NULL,
-						   limit);
-	}
+	gtk_text_buffer_get_bounds (search->priv->buffer, &start, &end);
+	gtk_text_buffer_remove_tag (search->priv->buffer,
+				    search->priv->found_tag,
+				    &start,
+				    &end);
+}
 
-	flags = get_text_search_flags (search);
+static void
+tagged_ranges_insert_text (GtkSourceSearchContext *search,
+			   gint                    offset,
+			   gint                    nb_chars)
+{
+	guint i;
 
-	while (TRUE)
+	for (i = 0; i < search->priv->tagged_ranges->len; i++)
 	{
-		gboolean found = gtk_text_iter_forward_search (&begin_search,
-							       search_text,
-							       flags,
-							       match_start,
-							       match_end,
-							       limit);
+		OffsetRange *range = &g_array_index (search->priv->tagged_ranges, OffsetRange, i);
 
-		if (!found || !gtk_source_search_settings_get_at_word_boundaries (search->priv->settings))
+		if (range->start > offset)
 		{
-			return found;
+			range->start += nb_chars;
 		}
 
-		if (_gtk_source_iter_starts_extra_natural_word (match_start, FALSE) &&
-		    _gtk_source_iter_ends_extra_natural_word (match_end, FALSE))
+		if (range->end > offset)
 		{
-			return TRUE;
+			range->end += nb_chars;
 		}
-
-		begin_search = *match_end;
 	}
 }
 
-/* We fake the backward regex search by doing a forward search, and taking the
- * last match.
- */
-static gboolean
-basic_backward_regex_search (GtkSourceSearchContext *search,
-			     const GtkTextIter      *start_at,
-			     GtkTextIter            *match_start,
-			     GtkTextIter            *match_end,
-			     const GtkTextIter      *limit)
+static gint
+get_offset_after_deletion (gint offset,
+			   gint delete_start,
+			   gint delete_end)
 {
-	GtkTextIter lower_bound;
-	GtkTextIter m_start;
-	GtkTextIter m_end;
-	gboolean found = FALSE;
-
-	if (search->priv->regex == NULL ||
-	    search->priv->regex_error != NULL)
+	if (offset <= delete_start)
 	{
-		return FALSE;
+		return offset;
 	}
 
-	if (limit == NULL)
-	{
-		gtk_text_buffer_get_start_iter (search->priv->buffer, &lower_bound);
-	}
-	else
+	if (offset >= delete_end)
 	{
-		lower_bound = *limit;
+		return offset - (delete_end - delete_start);
 	}
 
-	while (basic_forward_regex_search (search, &lower_bound, &m_start, &m_end, NULL, start_at))
+	return delete_start;
+}
+
+static void
+tagged_ranges_delete_text (GtkSourceSearchContext *search,
+			   gint                    delete_start,
+			   gint                    delete_end)
+{
+	guint i = 0;
+
+	while (i < search->priv->tagged_ranges->len)
 	{
-		found = TRUE;
+		OffsetRange *range = &g_array_index (search->priv->tagged_ranges, OffsetRange, i);
 
-		if (match_start != NULL)
+		range->start = get_offset_after_deletion (range->start, delete_start, delete_end);
+		range->end = get_offset_after_deletion (range->end, delete_start, delete_end);
+
+		if (range->start >= range->end)
 		{
-			*match_start = m_start;
+			g_array_remove_index (search->priv->tagged_ranges, i);
 		}
-
-		if (match_end != NULL)
+		else
 		{
-			*match_end = m_end;
+			i++;
 		}
-
-		lower_bound = m_end;
 	}
-
-	return found;
 }
 
+/* Returns TRUE if [start; end] has already been scanned. */
 static gboolean
-basic_backward_search (GtkSourceSearchContext *search,
-		       const GtkTextIter      *iter,
-		       GtkTextIter            *match_start,
-		       GtkTextIter            *match_end,
-		       const GtkTextIter      *limit)
+is_scanned (GtkSourceSearchContext *search,
+	    const GtkTextIter      *start,
+	    const GtkTextIter      *end)
 {
-	GtkTextIter begin_search = *iter;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
-	GtkTextSearchFlags flags;
+	GtkSourceRegion *region;
+	gboolean empty;
 
-	if (search_text == NULL)
+	if (gtk_source_region_is_empty (search->priv->scan_region))
 	{
-		return FALSE;
+		return TRUE;
 	}
 
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
-	{
-		return basic_backward_regex_search (search,
-						    iter,
-						    match_start,
-						    match_end,
-						    limit);
-	}
+	region = gtk_source_region_intersect_subregion (search->priv->scan_region,
+							start,
+							end);
 
-	flags = get_text_search_flags (search);
+	empty = gtk_source_region_is_empty (region);
+	g_clear_object (&region);
 
-	while (TRUE)
-	{
-		gboolean found = gtk_text_iter_backward_search (&begin_search,
-							        search_text,
-							        flags,
-							        match_start,
-							        match_end,
-							        limit);
+	return empty;
+}
 
-		if (!found || !gtk_source_search_settings_get_at_word_boundaries (search->priv->settings))
-		{
-			return found;
-		}
+static void
+clear_task (GtkSourceSearchContext *search)
+{
+	g_clear_object (&search->priv->task_region);
 
-		if (_gtk_source_iter_starts_extra_natural_word (match_start, FALSE) &&
-		    _gtk_source_iter_ends_extra_natural_word (match_end, FALSE))
+	if (search->priv->task != NULL)
+	{
+		GCancellable *cancellable = g_task_get_cancellable (search->priv->task);
+
+		if (cancellable != NULL)
 		{
-			return TRUE;
+			g_cancellable_cancel (cancellable);
+			g_task_return_error_if_cancelled (search->priv->task);
 		}
 
-		begin_search = *match_start;
+		g_clear_object (&search->priv->task);
 	}
 }
 
 static void
-forward_backward_data_free (ForwardBackwardData *data)
+clear_parallel_scan (GtkSourceSearchContext *search)
 {
-	if (data->start_at != NULL)
+	if (search->priv->parallel_scan_task != NULL)
 	{
-		GtkTextBuffer *buffer = gtk_text_mark_get_buffer (data->start_at);
-		gtk_text_buffer_delete_mark (buffer, data->start_at);
+		g_cancellable_cancel (g_task_get_cancellable (search->priv->parallel_scan_task));
+		g_clear_object (&search->priv->parallel_scan_task);
 	}
-
-	g_slice_free (ForwardBackwardData, data);
 }
 
-/* Returns TRUE if finished. */
-static gboolean
-smart_forward_search_async_step (GtkSourceSearchContext *search,
-				 GtkTextIter            *start_at,
-				 gboolean               *wrapped_around)
+static void
+clear_search (GtkSourceSearchContext *search)
 {
-	GtkTextIter iter = *start_at;
-	GtkTextIter limit;
-	GtkTextIter region_start = *start_at;
-	GtkSourceRegion *region = NULL;
-	ForwardBackwardData *task_data;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+	g_clear_object (&search->priv->scan_region);
+	g_clear_object (&search->priv->high_priority_region);
 
-	if (gtk_text_iter_is_end (start_at))
+	if (search->priv->idle_scan_id != 0)
 	{
-		if (search_text != NULL &&
-		    !*wrapped_around &&
-		    gtk_source_search_settings_get_wrap_around (search->priv->settings))
-		{
-			gtk_text_buffer_get_start_iter (search->priv->buffer, start_at);
-			*wrapped_around = TRUE;
-			return FALSE;
-		}
-
-		task_data = g_slice_new0 (ForwardBackwardData);
-		task_data->found = FALSE;
-		task_data->is_forward = TRUE;
-		task_data->wrapped_around = *wrapped_around;
-
-		g_task_return_pointer (search->priv->task,
-				       task_data,
-				       (GDestroyNotify)forward_backward_data_free);
-
-		g_clear_object (&search->priv->task);
-		return TRUE;
+		g_source_remove (search->priv->idle_scan_id);
+		search->priv->idle_scan_id = 0;
 	}
 
-	if (!gtk_text_iter_has_tag (&iter, search->priv->found_tag))
-	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->priv->found_tag);
-	}
-	else if (!gtk_text_iter_starts_tag (&iter, search->priv->found_tag))
+	if (search->priv->regex_error != NULL)
 	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->priv->found_tag);
-		region_start = iter;
+		g_clear_error (&search->priv->regex_error);
+		g_object_notify (G_OBJECT (search), "regex-error");
 	}
 
-	limit = iter;
-	gtk_text_iter_forward_to_tag_toggle (&limit, search->priv->found_tag);
+	clear_task (search);
+	clear_parallel_scan (search);
 
-	if (search->priv->scan_region != NULL)
-	{
-		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-								&region_start,
-								&limit);
-	}
+	search->priv->occurrences_count = 0;
+	_gtk_source_occurrences_index_clear (search->priv->occurrences_index);
 
-	if (gtk_source_region_is_empty (region))
+	/* Keep the tagged ranges, the new occurrences found there will be
+	 * tagged during the scan.
+	 */
+	if (search->priv->buffer != NULL)
 	{
-		GtkTextIter match_start;
-		GtkTextIter match_end;
-
-		g_clear_object (&region);
-
-		while (basic_forward_search (search, &iter, &match_start, &match_end, &limit))
-		{
-			if (gtk_text_iter_compare (&match_start, start_at) < 0)
-			{
-				iter = match_end;
-				continue;
-			}
-
-			task_data = g_slice_new0 (ForwardBackwardData);
-			task_data->found = TRUE;
-			task_data->match_start = match_start;
-			task_data->match_end = match_end;
-			task_data->is_forward = TRUE;
-			task_data->wrapped_around = *wrapped_around;
-
-			g_task_return_pointer (search->priv->task,
-					       task_data,
-					       (GDestroyNotify)forward_backward_data_free);
-
-			g_clear_object (&search->priv->task);
-			return TRUE;
-		}
-
-		*start_at = limit;
-		return FALSE;
+		untag_range (search, 0, G_MAXINT);
 	}
+}
 
-	task_data = g_slice_new0 (ForwardBackwardData);
-	task_data->is_forward = TRUE;
-	task_data->wrapped_around = *wrapped_around;
-	task_data->start_at = gtk_text_buffer_create_mark (search->priv->buffer,
-							   NULL,
-							   start_at,
-							   TRUE);
-
-	g_task_set_task_data (search->priv->task,
-			      task_data,
-			      (GDestroyNotify)forward_backward_data_free);
-
-	g_clear_object (&search->priv->task_region);
-	search->priv->task_region = region;
+static GtkTextSearchFlags
+get_text_search_flags (GtkSourceSearchContext *search)
+{
+	GtkTextSearchFlags flags = GTK_TEXT_SEARCH_TEXT_ONLY | GTK_TEXT_SEARCH_VISIBLE_ONLY;
 
-	install_idle_scan (search);
+	if (!gtk_source_search_settings_get_case_sensitive (search->priv->settings))
+	{
+		flags |= GTK_TEXT_SEARCH_CASE_INSENSITIVE;
+	}
 
-	/* The idle that scan the task region will call
-	 * smart_forward_search_async() to continue the task. But for the
-	 * moment, we are done.
-	 */
-	return TRUE;
+	return flags;
 }
 
+/* @start_pos is in bytes. */
 static void
-smart_forward_search_async (GtkSourceSearchContext *search,
-			    const GtkTextIter      *start_at,
-			    gboolean                wrapped_around)
+regex_search_get_real_start (GtkSourceSearchContext *search,
+			     const GtkTextIter      *start,
+			     GtkTextIter            *real_start,
+			     gint                   *start_pos)
 {
-	GtkTextIter iter = *start_at;
-
-	/* A recursive function would have been more natural, but a loop is
-	 * better to avoid stack overflows.
-	 */
-	while (!smart_forward_search_async_step (search, &iter, &wrapped_around));
-}
-
+	gint max_lookbehind = g_regex_get_max_lookbehind (search->priv->regex);
+	gint i;
+	gchar *text;
 
-/* Returns TRUE if finished. */
-static gboolean
-smart_backward_search_async_step (GtkSourceSearchContext *search,
-				  GtkTextIter            *start_at,
-				  gboolean               *wrapped_around)
-{
-	GtkTextIter iter = *start_at;
-	GtkTextIter limit;
-	GtkTextIter region_end = *start_at;
-	GtkSourceRegion *region = NULL;
-	ForwardBackwardData *task_data;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+	*real_start = *start;
 
-	if (gtk_text_iter_is_start (start_at))
+	for (i = 0; i < max_lookbehind; i++)
 	{
-		if (search_text != NULL &&
-		    !*wrapped_around &&
-		    gtk_source_search_settings_get_wrap_around (search->priv->settings))
+		if (!gtk_text_iter_backward_char (real_start))
 		{
-			gtk_text_buffer_get_end_iter (search->priv->buffer, start_at);
-			*wrapped_around = TRUE;
-			return FALSE;
+			break;
 		}
+	}
 
-		task_data = g_slice_new0 (ForwardBackwardData);
-		task_data->found = FALSE;
-		task_data->is_forward = FALSE;
-		task_data->wrapped_around = *wrapped_around;
+	text = gtk_text_iter_get_visible_text (real_start, start);
+	*start_pos = strlen (text);
 
-		g_task_return_pointer (search->priv->task,
-				       task_data,
-				       (GDestroyNotify)forward_backward_data_free);
+	g_free (text);
+}
 
-		g_clear_object (&search->priv->task);
-		return TRUE;
-	}
+static GRegexMatchFlags
+regex_search_get_match_options (const GtkTextIter *real_start,
+				const GtkTextIter *end)
+{
+	GRegexMatchFlags match_options = 0;
 
-	if (gtk_text_iter_starts_tag (&iter, search->priv->found_tag) ||
-	    (!gtk_text_iter_has_tag (&iter, search->priv->found_tag) &&
-	     !gtk_text_iter_ends_tag (&iter, search->priv->found_tag)))
+	if (!gtk_text_iter_starts_line (real_start))
 	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->priv->found_tag);
+		match_options |= G_REGEX_MATCH_NOTBOL;
 	}
-	else if (gtk_text_iter_has_tag (&iter, search->priv->found_tag))
+
+	if (!gtk_text_iter_ends_line (end))
 	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->priv->found_tag);
-		region_end = iter;
+		match_options |= G_REGEX_MATCH_NOTEOL;
 	}
 
-	limit = iter;
-	gtk_text_iter_backward_to_tag_toggle (&limit, search->priv->found_tag);
-
-	if (search->priv->scan_region != NULL)
+	if (!gtk_text_iter_is_end (end))
 	{
-		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-								&limit,
-								&region_end);
+		match_options |= G_REGEX_MATCH_PARTIAL_HARD;
 	}
 
-	if (gtk_source_region_is_empty (region))
-	{
-		GtkTextIter match_start;
-		GtkTextIter match_end;
+	return match_options;
+}
 
-		g_clear_object (&region);
+/* Whether the character at @iter is not in the visible text, i.e. it is
+ * invisible, or it is a pixbuf or a child anchor.
+ */
+static gboolean
+is_hidden_char (const GtkTextIter *iter)
+{
+	GtkTextIter next = *iter;
+	gchar *text;
+	gboolean hidden;
 
-		while (basic_backward_search (search, &iter, &match_start, &match_end, &limit))
-		{
-			if (gtk_text_iter_compare (start_at, &match_end) < 0)
-			{
-				iter = match_start;
-				continue;
-			}
+	gtk_text_iter_forward_char (&next);
+	text = gtk_text_iter_get_visible_text (iter, &next);
+	hidden = text[0] == '\0';
+	g_free (text);
 
-			task_data = g_slice_new0 (ForwardBackwardData);
-			task_data->found = TRUE;
-			task_data->match_start = match_start;
-			task_data->match_end = match_end;
-			task_data->is_forward = FALSE;
-			task_data->wrapped_around = *wrapped_around;
+	return hidden;
+}
 
-			g_task_return_pointer (search->priv->task,
-					       task_data,
-					       (GDestroyNotify)forward_backward_data_free);
+/* The regex subjects are the visible text, like for the non-regex search with
+ * GTK_TEXT_SEARCH_VISIBLE_ONLY and GTK_TEXT_SEARCH_TEXT_ONLY. Moves @iter
+ * forward by @count characters of the visible text, @iter is then just after
+ * the last one.
+ */
+static void
+forward_visible_text_chars (GtkTextIter *iter,
+			    gint         count)
+{
+	while (count > 0 && !gtk_text_iter_is_end (iter))
+	{
+		GtkTextIter next = *iter;
+		gchar *text;
 
-			g_clear_object (&search->priv->task);
-			return TRUE;
+		if (is_hidden_char (iter) &&
+		    gtk_text_iter_get_char (iter) != GTK_TEXT_UNKNOWN_CHAR)
+		{
+			/* Skip the whole invisible text at once. */
+			gtk_text_iter_forward_to_tag_toggle (iter, NULL);
+			continue;
 		}
 
-		*start_at = limit;
-		return FALSE;
-	}
-
-	task_data = g_slice_new0 (ForwardBackwardData);
-	task_data->is_forward = FALSE;
-	task_data->wrapped_around = *wrapped_around;
-	task_data->start_at = gtk_text_buffer_create_mark (search->priv->buffer,
-							   NULL,
-							   start_at,
-							   TRUE);
-
-	g_task_set_task_data (search->priv->task,
-			      task_data,
-			      (GDestroyNotify)forward_backward_data_free);
-
-	g_clear_object (&search->priv->task_region);
-	search->priv->task_region = region;
+		/* There are at most @count visible characters before @next. */
+		gtk_text_iter_forward_chars (&next, count);
 
-	install_idle_scan (search);
+		text = gtk_text_iter_get_visible_text (iter, &next);
+		count -= g_utf8_strlen (text, -1);
+		g_free (text);
 
-	/* The idle that scan the task region will call
-	 * smart_backward_search_async() to continue the task. But for the
-	 * moment, we are done.
-	 */
-	return TRUE;
+		*iter = next;
+	}
 }
 
+/* Moves @iter forward to the next character of the visible text. */
 static void
-smart_backward_search_async (GtkSourceSearchContext *search,
-			     const GtkTextIter      *start_at,
-			     gboolean                wrapped_around)
+skip_hidden_chars (GtkTextIter *iter)
 {
-	GtkTextIter iter = *start_at;
-
-	/* A recursive function would have been more natural, but a loop is
-	 * better to avoid stack overflows.
-	 */
-	while (!smart_backward_search_async_step (search, &iter, &wrapped_around));
+	while (!gtk_text_iter_is_end (iter) && is_hidden_char (iter))
+	{
+		if (gtk_text_iter_get_char (iter) == GTK_TEXT_UNKNOWN_CHAR)
+		{
+			gtk_text_iter_forward_char (iter);
+		}
+		else
+		{
+			gtk_text_iter_forward_to_tag_toggle (iter, NULL);
+		}
+	}
 }
 
-/* Adjust the subregion so we are sure that all matches that are visible or
- * partially visible between @start and @end are highlighted.
+/* Get the @match_start and @match_end iters of a match in @subject, from its
+ * byte positions. To get the iters, we need to know the number of UTF-8
+ * characters. A subject can contain several matches. So instead of calling
+ * g_utf8_strlen() each time at the beginning of @subject, @iter and
+ * @iter_byte_pos are used to remember where g_utf8_strlen() stopped.
+ *
+ * @subject is the visible text after the initial @iter, so the iters are moved
+ * with forward_visible_text_chars(). The hidden characters before a match are
+ * not part of it, those inside it are.
  */
 static void
-adjust_subregion (GtkSourceSearchContext *search,
-		  GtkTextIter            *start,
-		  GtkTextIter            *end)
+regex_search_get_match_iters (const gchar *subject,
+			      gssize       subject_length,
+			      gint         start_byte_pos,
+			      gint         end_byte_pos,
+			      GtkTextIter *iter,
+			      gint        *iter_byte_pos,
+			      GtkTextIter *match_start,
+			      GtkTextIter *match_end)
 {
-	DEBUG ({
-		g_print ("adjust_subregion(), before adjusting: [%u (%u), %u (%u)]\n",
-			 gtk_text_iter_get_line (start), gtk_text_iter_get_offset (start),
-			 gtk_text_iter_get_line (end), gtk_text_iter_get_offset (end));
-	});
+	gint nb_chars;
 
-	gtk_text_iter_backward_lines (start, MAX (0, search->priv->text_nb_lines - 1));
-	gtk_text_iter_forward_lines (end, MAX (0, search->priv->text_nb_lines - 1));
+	g_assert (*iter_byte_pos <= subject_length);
+	g_assert (match_start != NULL);
+	g_assert (match_end != NULL);
+	g_assert (start_byte_pos < subject_length);
+	g_assert (end_byte_pos <= subject_length);
+	g_assert (*iter_byte_pos <= start_byte_pos);
+	g_assert (start_byte_pos < end_byte_pos);
 
-	if (!gtk_text_iter_starts_line (start))
+	nb_chars = g_utf8_strlen (subject + *iter_byte_pos,
+				  start_byte_pos - *iter_byte_pos);
+
+	*match_start = *iter;
+	forward_visible_text_chars (match_start, nb_chars);
+	skip_hidden_chars (match_start);
+
+	nb_chars = g_utf8_strlen (subject + start_byte_pos,
+				  end_byte_pos - start_byte_pos);
+
+	*match_end = *match_start;
+	forward_visible_text_chars (match_end, nb_chars);
+
+	*iter = *match_end;
+	*iter_byte_pos = end_byte_pos;
+}
+
+/* Get the @match_start and @match_end iters of the @match_info.
+ * See regex_search_get_match_iters().
+ */
+static gboolean
+regex_search_fetch_match (GMatchInfo  *match_info,
+			  const gchar *subject,
+			  gssize       subject_length,
+			  GtkTextIter *iter,
+			  gint        *iter_byte_pos,
+			  GtkTextIter *match_start,
+			  GtkTextIter *match_end)
+{
+	gint start_byte_pos;
+	gint end_byte_pos;
+
+	if (!g_match_info_matches (match_info))
 	{
-		gtk_text_iter_set_line_offset (start, 0);
+		return FALSE;
 	}
 
-	if (!gtk_text_iter_ends_line (end))
+	if (!g_match_info_fetch_pos (match_info, 0, &start_byte_pos, &end_byte_pos))
 	{
-		gtk_text_iter_forward_to_line_end (end);
+		g_warning ("Impossible to fetch regex match position.");
+		return FALSE;
 	}
 
-	/* When we are in the middle of a found_tag, a simple solution is to
-	 * always backward_to_tag_toggle(). The problem is that occurrences can
-	 * be contiguous. So a full scan of the buffer can have a O(n^2) in the
-	 * worst case, if we use the simple solution. Therefore we use a more
-	 * complicated solution, that checks if we are in an old found_tag or
-	 * not.
-	 */
+	regex_search_get_match_iters (subject,
+				      subject_length,
+				      start_byte_pos,
+				      end_byte_pos,
+				      iter,
+				      iter_byte_pos,
+				      match_start,
+				      match_end);
+
+	return TRUE;
+}
+
+/* If you retrieve only [match_start, match_end] from the GtkTextBuffer, it
+ * does not match the regex if the regex contains look-ahead assertions. For
+ * that, get the @real_end. Note that [match_start, real_end] is not the minimum
+ * amount of text that still matches the regex, it can contain several
+ * occurrences, so you can add the G_REGEX_MATCH_ANCHORED option to match only
+ * the first occurrence.
+ * Note that @limit is the limit for @match_end, not @real_end.
+ */
+static gboolean
+basic_forward_regex_search (GtkSourceSearchContext *search,
+			    const GtkTextIter      *start_at,
+			    GtkTextIter            *match_start,
+			    GtkTextIter            *match_end,
+			    GtkTextIter            *real_end,
+			    const GtkTextIter      *limit)
+{
+	GtkTextIter real_start;
+	GtkTextIter end;
+	gint start_pos;
+	gboolean found = FALSE;
+	gint nb_lines = 1;
 
-	if (gtk_text_iter_has_tag (start, search->priv->found_tag))
+	if (search->priv->regex == NULL ||
+	    search->priv->regex_error != NULL)
 	{
-		if (gtk_source_region_is_empty (search->priv->scan_region))
-		{
-			/* 'start' is in a correct match, we can skip it. */
-			gtk_text_iter_forward_to_tag_toggle (start, search->priv->found_tag);
-		}
-		else
-		{
-			GtkTextIter tag_start = *start;
-			GtkTextIter tag_end = *start;
-			GtkSourceRegion *region;
+		return FALSE;
+	}
 
-			if (!gtk_text_iter_starts_tag (&tag_start, search->priv->found_tag))
-			{
-				gtk_text_iter_backward_to_tag_toggle (&tag_start, search->priv->found_tag);
-			}
+	regex_search_get_real_start (search, start_at, &real_start, &start_pos);
 
-			gtk_text_iter_forward_to_tag_toggle (&tag_end, search->priv->found_tag);
+	if (limit == NULL)
+	{
+		gtk_text_buffer_get_end_iter (search->priv->buffer, &end);
+	}
+	else
+	{
+		end = *limit;
+	}
 
-			region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-									&tag_start,
-									&tag_end);
+	while (TRUE)
+	{
+		GRegexMatchFlags match_options;
+		gchar *subject;
+		gssize subject_length;
+		GMatchInfo *match_info;
+		GtkTextIter iter;
+		gint iter_byte_pos;
+		GtkTextIter m_start;
+		GtkTextIter m_end;
 
-			if (gtk_source_region_is_empty (region))
-			{
-				/* 'region' has already been scanned, so 'start' is in a
-				 * correct match, we can skip it.
-				 */
-				*start = tag_end;
-			}
-			else
-			{
-				/* 'region' has not already been scanned completely, so
-				 * 'start' is most probably in an old match that must be
-				 * removed.
-				 */
-				*start = tag_start;
-			}
+		match_options = regex_search_get_match_options (&real_start, &end);
+		subject = gtk_text_iter_get_visible_text (&real_start, &end);
+		subject_length = strlen (subject);
 
-			g_clear_object (&region);
-		}
-	}
+		g_regex_match_full (search->priv->regex,
+				    subject,
+				    subject_length,
+				    start_pos,
+				    match_options,
+				    &match_info,
+				    &search->priv->regex_error);
 
-	/* Symmetric for 'end'. */
+		iter = real_start;
+		iter_byte_pos = 0;
 
-	if (gtk_text_iter_has_tag (end, search->priv->found_tag))
-	{
-		if (gtk_source_region_is_empty (search->priv->scan_region))
+		found = regex_search_fetch_match (match_info,
+						  subject,
+						  subject_length,
+						  &iter,
+						  &iter_byte_pos,
+						  &m_start,
+						  &m_end);
+
+		if (!found && g_match_info_is_partial_match (match_info))
 		{
-			/* 'end' is in a correct match, we can skip it. */
+			gtk_text_iter_forward_lines (&end, nb_lines);
+			nb_lines <<= 1;
 
-			if (!gtk_text_iter_starts_tag (end, search->priv->found_tag))
-			{
-				gtk_text_iter_backward_to_tag_toggle (end, search->priv->found_tag);
-			}
+			g_free (subject);
+			g_match_info_free (match_info);
+			continue;
 		}
-		else
+
+		/* Check that the match is not beyond the limit. This can happen
+		 * if a partial match is found on the first iteration. Then the
+		 * partial match was actually not a good match, but a second
+		 * good match is found.
+		 */
+		if (found && limit != NULL && gtk_text_iter_compare (limit, &m_end) < 0)
+		{
+			found = FALSE;
+		}
+
+		if (search->priv->regex_error != NULL)
 		{
-			GtkTextIter tag_start = *end;
-			GtkTextIter tag_end = *end;
-			GtkSourceRegion *region;
+			g_object_notify (G_OBJECT (search), "regex-error");
+			found = FALSE;
+		}
 
-			if (!gtk_text_iter_starts_tag (&tag_start, search->priv->found_tag))
+		if (found)
+		{
+			if (match_start != NULL)
 			{
-				gtk_text_iter_backward_to_tag_toggle (&tag_start, search->priv->found_tag);
+				*match_start = m_start;
 			}
 
-			gtk_text_iter_forward_to_tag_toggle (&tag_end, search->priv->found_tag);
-
-			region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-									&tag_start,
-									&tag_end);
-
-			if (gtk_source_region_is_empty (region))
+			if (match_end != NULL)
 			{
-				/* 'region' has already been scanned, so 'end' is in a
-				 * correct match, we can skip it.
-				 */
-				*end = tag_start;
+				*match_end = m_end;
 			}
-			else
+
+			if (real_end != NULL)
 			{
-				/* 'region' has not already been scanned completely, so
-				 * 'end' is most probably in an old match that must be
-				 * removed.
-				 */
-				*end = tag_end;
+				*real_end = end;
 			}
-
-			g_clear_object (&region);
 		}
+
+		g_free (subject);
+		g_match_info_free (match_info);
+		break;
 	}
 
-	DEBUG ({
-		g_print ("adjust_subregion(), after adjusting: [%u (%u), %u (%u)]\n",
-			 gtk_text_iter_get_line (start), gtk_text_iter_get_offset (start),
-			 gtk_text_iter_get_line (end), gtk_text_iter_get_offset (end));
-	});
+	return found;
 }
 
-/* Do not take into account the scan_region. Take the result with a grain of
- * salt. You should verify before or after calling this function that the
- * region has been scanned, to be sure that the returned occurrence is correct.
- */
 static gboolean
-smart_forward_search_without_scanning (GtkSourceSearchContext *search,
-				       const GtkTextIter      *start_at,
-				       GtkTextIter            *match_start,
-				       GtkTextIter            *match_end,
-				       const GtkTextIter      *stop_at)
+basic_forward_search (GtkSourceSearchContext *search,
+		      const GtkTextIter      *iter,
+		      GtkTextIter            *match_start,
+		      GtkTextIter            *match_end,
+		      const GtkTextIter      *limit)
 {
-	GtkTextIter iter;
+	GtkTextIter begin_search = *iter;
 	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
-
-	g_assert (start_at != NULL);
-	g_assert (match_start != NULL);
-	g_assert (match_end != NULL);
-	g_assert (stop_at != NULL);
-
-	iter = *start_at;
+	GtkTextSearchFlags flags;
 
 	if (search_text == NULL)
 	{
 		return FALSE;
 	}
 
-	while (gtk_text_iter_compare (&iter, stop_at) < 0)
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
 	{
-		GtkTextIter limit;
+		return basic_forward_regex_search (search,
+						   iter,
+						   match_start,
+						   match_end,
+						   NULL,
+						   limit);
+	}
 
-		if (!gtk_text_iter_has_tag (&iter, search->priv->found_tag))
-		{
-			gtk_text_iter_forward_to_tag_toggle (&iter, search->priv->found_tag);
-		}
-		else if (!gtk_text_iter_starts_tag (&iter, search->priv->found_tag))
-		{
-			gtk_text_iter_backward_to_tag_toggle (&iter, search->priv->found_tag);
-		}
+	flags = get_text_search_flags (search);
 
-		limit = iter;
-		gtk_text_iter_forward_to_tag_toggle (&limit, search->priv->found_tag);
+	while (TRUE)
+	{
+		gboolean found = gtk_text_iter_forward_search (&begin_search,
+							       search_text,
+							       flags,
+							       match_start,
+							       match_end,
+							       limit);
 
-		if (gtk_text_iter_compare (stop_at, &limit) < 0)
+		if (!found || !gtk_source_search_settings_get_at_word_boundaries (search->priv->settings))
 		{
-			limit = *stop_at;
+			return found;
 		}
 
-		while (basic_forward_search (search, &iter, match_start, match_end, &limit))
+		if (_gtk_source_iter_starts_extra_natural_word (match_start, FALSE) &&
+		    _gtk_source_iter_ends_extra_natural_word (match_end, FALSE))
 		{
-			if (gtk_text_iter_compare (start_at, match_start) <= 0)
-			{
-				return TRUE;
-			}
-
-			iter = *match_end;
+			return TRUE;
 		}
 
-		iter = limit;
+		/* An occurrence at word boundaries can overlap the rejected
+		 * match.
+		 */
+		begin_search = *match_start;
+		gtk_text_iter_forward_char (&begin_search);
 	}
-
-	return FALSE;
 }
 
-/* Remove the occurrences in the range. @start and @end may be adjusted, if they
- * are in a found_tag region.
- */
 static void
-remove_occurrences_in_range (GtkSourceSearchContext *search,
-			     GtkTextIter            *start,
-			     GtkTextIter            *end)
+forward_backward_data_free (ForwardBackwardData *data)
 {
-	GtkTextIter iter;
-	GtkTextIter match_start;
-	GtkTextIter match_end;
-
-	if ((gtk_text_iter_has_tag (start, search->priv->found_tag) &&
-	     !gtk_text_iter_starts_tag (start, search->priv->found_tag)) ||
-	    (gtk_source_search_settings_get_at_word_boundaries (search->priv->settings) &&
-	     gtk_text_iter_ends_tag (start, search->priv->found_tag)))
-	{
-		gtk_text_iter_backward_to_tag_toggle (start, search->priv->found_tag);
-	}
-
-	if ((gtk_text_iter_has_tag (end, search->priv->found_tag) &&
-	     !gtk_text_iter_starts_tag (end, search->priv->found_tag)) ||
-	    (gtk_source_search_settings_get_at_word_boundaries (search->priv->settings) &&
-	     gtk_text_iter_starts_tag (end, search->priv->found_tag)))
+	if (data->start_at != NULL)
 	{
-		gtk_text_iter_forward_to_tag_toggle (end, search->priv->found_tag);
+		GtkTextBuffer *buffer = gtk_text_mark_get_buffer (data->start_at);
+		gtk_text_buffer_delete_mark (buffer, data->start_at);
 	}
 
-	iter = *start;
+	g_slice_free (ForwardBackwardData, data);
+}
 
-	while (smart_forward_search_without_scanning (search, &iter, &match_start, &match_end, end))
-	{
-		if (search->priv->scan_region == NULL)
-		{
-			/* The occurrence has already been scanned, and thus
-			 * occurrence_count take it into account. */
-			search->priv->occurrences_count--;
-		}
-		else
-		{
-			GtkSourceRegion *region;
-
-			region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-									&match_start,
-									&match_end);
-
-			if (gtk_source_region_is_empty (region))
-			{
-				search->priv->occurrences_count--;
-			}
-
-			g_clear_object (&region);
-		}
-
-		iter = match_end;
-	}
-
-	gtk_text_buffer_remove_tag (search->priv->buffer,
-				    search->priv->found_tag,
-				    start,
-				    end);
-}
-
-static void
-scan_subregion (GtkSourceSearchContext *search,
-		GtkTextIter            *start,
-		GtkTextIter            *end)
+/* Returns TRUE if finished. */
+static gboolean
+smart_forward_search_async_step (GtkSourceSearchContext *search,
+				 GtkTextIter            *start_at,
+				 gboolean               *wrapped_around)
 {
-	GtkTextIter iter;
-	GtkTextIter *limit;
-	gboolean found = TRUE;
+	GtkTextIter match_start;
+	GtkTextIter limit;
+	OffsetRange next;
+	gboolean found_next;
+	GtkSourceRegion *region = NULL;
+	ForwardBackwardData *task_data;
 	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
 
-	/* Make sure the 'found' tag has the priority over syntax highlighting
-	 * tags. */
-	text_tag_set_highest_priority (search->priv->found_tag,
-				       search->priv->buffer);
-
-	adjust_subregion (search, start, end);
-	remove_occurrences_in_range (search, start, end);
-
-	if (search->priv->scan_region != NULL)
+	if (gtk_text_iter_is_end (start_at))
 	{
-		DEBUG ({
-			g_print ("Region to scan, before:\n");
-			print_region (search->priv->scan_region);
-		});
-
-		gtk_source_region_subtract_subregion (search->priv->scan_region, start, end);
+		if (search_text != NULL &&
+		    !*wrapped_around &&
+		    gtk_source_search_settings_get_wrap_around (search->priv->settings))
+		{
+			gtk_text_buffer_get_start_iter (search->priv->buffer, start_at);
+			*wrapped_around = TRUE;
+			return FALSE;
+		}
 
-		DEBUG ({
-			g_print ("Region to scan, after:\n");
-			print_region (search->priv->scan_region);
-		});
-	}
+		task_data = g_slice_new0 (ForwardBackwardData);
+		task_data->found = FALSE;
+		task_data->is_forward = TRUE;
+		task_data->wrapped_around = *wrapped_around;
 
-	if (search->priv->task_region != NULL)
-	{
-		gtk_source_region_subtract_subregion (search->priv->task_region, start, end);
-	}
+		g_task_return_pointer (search->priv->task,
+				       task_data,
+				       (GDestroyNotify)forward_backward_data_free);
 
-	if (search_text == NULL)
-	{
-		/* We have removed the found_tag, we are done. */
-		return;
+		g_clear_object (&search->priv->task);
+		return TRUE;
 	}
 
-	iter = *start;
+	found_next = get_next_occurrence (search, gtk_text_iter_get_offset (start_at), &next);
 
-	if (gtk_text_iter_is_end (end))
+	if (found_next)
 	{
-		limit = NULL;
+		get_occurrence_iters (search, &next, &match_start, &limit);
 	}
 	else
 	{
-		limit = end;
+		gtk_text_buffer_get_end_iter (search->priv->buffer, &limit);
 	}
 
-	do
+	if (search->priv->scan_region != NULL)
 	{
-		GtkTextIter match_start;
-		GtkTextIter match_end;
+		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
+								start_at,
+								&limit);
+	}
 
-		found = basic_forward_search (search, &iter, &match_start, &match_end, limit);
+	if (gtk_source_region_is_empty (region))
+	{
+		g_clear_object (&region);
 
-		if (found)
+		if (found_next)
 		{
-			gtk_text_buffer_apply_tag (search->priv->buffer,
-						   search->priv->found_tag,
-						   &match_start,
-						   &match_end);
-
-			search->priv->occurrences_count++;
-		}
+			task_data = g_slice_new0 (ForwardBackwardData);
+			task_data->found = TRUE;
+			task_data->match_start = match_start;
+			task_data->match_end = limit;
+			task_data->is_forward = TRUE;
+			task_data->wrapped_around = *wrapped_around;
 
-		iter = match_end;
+			g_task_return_pointer (search->priv->task,
+					       task_data,
+					       (GDestroyNotify)forward_backward_data_free);
 
-	} while (found);
-}
+			g_clear_object (&search->priv->task);
+			return TRUE;
+		}
 
-static void
-scan_all_region (GtkSourceSearchContext *search,
-		 GtkSourceRegion        *region)
-{
-	GtkSourceRegionIter region_iter;
+		*start_at = limit;
+		return FALSE;
+	}
 
-	gtk_source_region_get_start_region_iter (region, &region_iter);
+	task_data = g_slice_new0 (ForwardBackwardData);
+	task_data->is_forward = TRUE;
+	task_data->wrapped_around = *wrapped_around;
+	task_data->start_at = gtk_text_buffer_create_mark (search->priv->buffer,
+							   NULL,
+							   start_at,
+							   TRUE);
 
-	while (!gtk_source_region_iter_is_end (&region_iter))
-	{
-		GtkTextIter subregion_start;
-		GtkTextIter subregion_end;
+	g_task_set_task_data (search->priv->task,
+			      task_data,
+			      (GDestroyNotify)forward_backward_data_free);
 
-		if (!gtk_source_region_iter_get_subregion (&region_iter,
-							   &subregion_start,
-							   &subregion_end))
-		{
-			break;
-		}
+	g_clear_object (&search->priv->task_region);
+	search->priv->task_region = region;
 
-		scan_subregion (search,
-				&subregion_start,
-				&subregion_end);
+	install_idle_scan (search);
 
-		gtk_source_region_iter_next (&region_iter);
-	}
+	/* The idle that scan the task region will call
+	 * smart_forward_search_async() to continue the task. But for the
+	 * moment, we are done.
+	 */
+	return TRUE;
 }
 
-/* Scan a chunk of the region. If the region is small enough, all the region
- * will be scanned. But if the region is big, scanning only the chunk will not
- * block the UI normally. Begin the scan at the beginning of the region.
- */
 static void
-scan_region_forward (GtkSourceSearchContext *search,
-		     GtkSourceRegion        *region)
+smart_forward_search_async (GtkSourceSearchContext *search,
+			    const GtkTextIter      *start_at,
+			    gboolean                wrapped_around)
 {
-	gint nb_remaining_lines = SCAN_BATCH_SIZE;
-	GtkTextIter start;
-	GtkTextIter end;
+	GtkTextIter iter = *start_at;
 
-	while (nb_remaining_lines > 0 &&
-	       get_first_subregion (region, &start, &end))
-	{
-		GtkTextIter limit = start;
-		gint start_line;
-		gint limit_line;
+	/* A recursive function would have been more natural, but a loop is
+	 * better to avoid stack overflows.
+	 */
+	while (!smart_forward_search_async_step (search, &iter, &wrapped_around));
+}
 
-		gtk_text_iter_forward_lines (&limit, nb_remaining_lines);
 
-		if (gtk_text_iter_compare (&end, &limit) < 0)
+/* Returns TRUE if finished. */
+static gboolean
+smart_backward_search_async_step (GtkSourceSearchContext *search,
+				  GtkTextIter            *start_at,
+				  gboolean               *wrapped_around)
+{
+	GtkTextIter match_end;
+	GtkTextIter limit;
+	OffsetRange prev;
+	gboolean found_prev;
+	GtkSourceRegion *region = NULL;
+	ForwardBackwardData *task_data;
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+
+	if (gtk_text_iter_is_start (start_at))
+	{
+		if (search_text != NULL &&
+		    !*wrapped_around &&
+		    gtk_source_search_settings_get_wrap_around (search->priv->settings))
 		{
-			limit = end;
+			gtk_text_buffer_get_end_iter (search->priv->buffer, start_at);
+			*wrapped_around = TRUE;
+			return FALSE;
 		}
 
-		scan_subregion (search, &start, &limit);
-
-		gtk_source_region_subtract_subregion (region, &start, &limit);
+		task_data = g_slice_new0 (ForwardBackwardData);
+		task_data->found = FALSE;
+		task_data->is_forward = FALSE;
+		task_data->wrapped_around = *wrapped_around;
 
-		start_line = gtk_text_iter_get_line (&start);
-		limit_line = gtk_text_iter_get_line (&limit);
+		g_task_return_pointer (search->priv->task,
+				       task_data,
+				       (GDestroyNotify)forward_backward_data_free);
 
-		nb_remaining_lines -= limit_line - start_line;
+		g_clear_object (&search->priv->task);
+		return TRUE;
 	}
-}
 
-/* Same as scan_region_forward(), but begins the scan at the end of the region. */
-static void
-scan_region_backward (GtkSourceSearchContext *search,
-		      GtkSourceRegion        *region)
-{
-	gint nb_remaining_lines = SCAN_BATCH_SIZE;
-	GtkTextIter start;
-	GtkTextIter end;
+	found_prev = get_previous_occurrence (search, gtk_text_iter_get_offset (start_at), &prev);
 
-	while (nb_remaining_lines > 0 &&
-	       get_last_subregion (region, &start, &end))
+	if (found_prev)
 	{
-		GtkTextIter limit = end;
-		gint limit_line;
-		gint end_line;
+		get_occurrence_iters (search, &prev, &limit, &match_end);
+	}
+	else
+	{
+		gtk_text_buffer_get_start_iter (search->priv->buffer, &limit);
+	}
 
-		gtk_text_iter_backward_lines (&limit, nb_remaining_lines);
+	if (search->priv->scan_region != NULL)
+	{
+		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
+								&limit,
+								start_at);
+	}
 
-		if (gtk_text_iter_compare (&limit, &start) < 0)
-		{
-			limit = start;
-		}
+	if (gtk_source_region_is_empty (region))
+	{
+		g_clear_object (&region);
 
-		scan_subregion (search, &limit, &end);
+		if (found_prev)
+		{
+			task_data = g_slice_new0 (ForwardBackwardData);
+			task_data->found = TRUE;
+			task_data->match_start = limit;
+			task_data->match_end = match_end;
+			task_data->is_forward = FALSE;
+			task_data->wrapped_around = *wrapped_around;
 
-		gtk_source_region_subtract_subregion (region, &limit, &end);
+			g_task_return_pointer (search->priv->task,
+					       task_data,
+					       (GDestroyNotify)forward_backward_data_free);
 
-		limit_line = gtk_text_iter_get_line (&limit);
-		end_line = gtk_text_iter_get_line (&end);
+			g_clear_object (&search->priv->task);
+			return TRUE;
+		}
 
-		nb_remaining_lines -= end_line - limit_line;
+		*start_at = limit;
+		return FALSE;
 	}
-}
 
-static void
-resume_task (GtkSourceSearchContext *search)
-{
-	ForwardBackwardData *task_data = g_task_get_task_data (search->priv->task);
-	GtkTextIter start_at;
+	task_data = g_slice_new0 (ForwardBackwardData);
+	task_data->is_forward = FALSE;
+	task_data->wrapped_around = *wrapped_around;
+	task_data->start_at = gtk_text_buffer_create_mark (search->priv->buffer,
+							   NULL,
+							   start_at,
+							   TRUE);
+
+	g_task_set_task_data (search->priv->task,
+			      task_data,
+			      (GDestroyNotify)forward_backward_data_free);
 
 	g_clear_object (&search->priv->task_region);
+	search->priv->task_region = region;
 
-	gtk_text_buffer_get_iter_at_mark (search->priv->buffer,
-					  &start_at,
-					  task_data->start_at);
+	install_idle_scan (search);
 
-	if (task_data->is_forward)
-	{
-		smart_forward_search_async (search,
-					    &start_at,
-					    task_data->wrapped_around);
-	}
-	else
-	{
-		smart_backward_search_async (search,
-					     &start_at,
-					     task_data->wrapped_around);
-	}
+	/* The idle that scan the task region will call
+	 * smart_backward_search_async() to continue the task. But for the
+	 * moment, we are done.
+	 */
+	return TRUE;
 }
 
 static void
-scan_task_region (GtkSourceSearchContext *search)
+smart_backward_search_async (GtkSourceSearchContext *search,
+			     const GtkTextIter      *start_at,
+			     gboolean                wrapped_around)
 {
-	ForwardBackwardData *task_data = g_task_get_task_data (search->priv->task);
-
-	if (task_data->is_forward)
-	{
-		scan_region_forward (search, search->priv->task_region);
-	}
-	else
-	{
-		scan_region_backward (search, search->priv->task_region);
-	}
+	GtkTextIter iter = *start_at;
 
-	resume_task (search);
+	/* A recursive function would have been more natural, but a loop is
+	 * better to avoid stack overflows.
+	 */
+	while (!smart_backward_search_async_step (search, &iter, &wrapped_around));
 }
 
-static gboolean
-idle_scan_normal_search (GtkSourceSearchContext *search)
+/* Adjust the subregion so we are sure that all matches that are visible or
+ * partially visible between @start and @end are highlighted.
+ */
+static void
+adjust_subregion (GtkSourceSearchContext *search,
+		  GtkTextIter            *start,
+		  GtkTextIter            *end)
 {
-	if (search->priv->high_priority_region != NULL)
+	OffsetRange occurrence;
+
+	DEBUG ({
+		g_print ("adjust_subregion(), before adjusting: [%u (%u), %u (%u)]\n",
+			 gtk_text_iter_get_line (start), gtk_text_iter_get_offset (start),
+			 gtk_text_iter_get_line (end), gtk_text_iter_get_offset (end));
+	});
+
+	gtk_text_iter_backward_lines (start, MAX (0, search->priv->text_nb_lines - 1));
+	gtk_text_iter_forward_lines (end, MAX (0, search->priv->text_nb_lines - 1));
+
+	if (!gtk_text_iter_starts_line (start))
 	{
-		/* Normally the high priority region is not really big, since it
-		 * is the visible area on the screen. So we can highlight it in
-		 * one batch.
-		 */
-		scan_all_region (search, search->priv->high_priority_region);
+		gtk_text_iter_set_line_offset (start, 0);
+	}
 
-		g_clear_object (&search->priv->high_priority_region);
-		return G_SOURCE_CONTINUE;
+	if (!gtk_text_iter_ends_line (end))
+	{
+		gtk_text_iter_forward_to_line_end (end);
 	}
 
-	if (search->priv->task_region != NULL)
+	/* If @start is in an occurrence that has already been scanned, we can
+	 * skip it. Otherwise the occurrence is scanned again.
+	 */
+	if (get_occurrence_at (search, gtk_text_iter_get_offset (start), &occurrence))
 	{
-		scan_task_region (search);
-		return G_SOURCE_CONTINUE;
+		GtkTextIter occurrence_start;
+		GtkTextIter occurrence_end;
+
+		get_occurrence_iters (search, &occurrence, &occurrence_start, &occurrence_end);
+
+		if (is_scanned (search, &occurrence_start, &occurrence_end))
+		{
+			*start = occurrence_end;
+		}
+		else
+		{
+			*start = occurrence_start;
+		}
 	}
 
-	scan_region_forward (search, search->priv->scan_region);
+	/* Symmetric for 'end'. */
 
-	if (gtk_source_region_is_empty (search->priv->scan_region))
+	if (get_occurrence_at (search, gtk_text_iter_get_offset (end), &occurrence))
 	{
-		search->priv->idle_scan_id = 0;
+		GtkTextIter occurrence_start;
+		GtkTextIter occurrence_end;
 
-		g_object_notify (G_OBJECT (search), "occurrences-count");
+		get_occurrence_iters (search, &occurrence, &occurrence_start, &occurrence_end);
 
-		g_clear_object (&search->priv->scan_region);
-		return G_SOURCE_REMOVE;
+		if (is_scanned (search, &occurrence_start, &occurrence_end))
+		{
+			*end = occurrence_start;
+		}
+		else
+		{
+			*end = occurrence_end;
+		}
 	}
 
-	return G_SOURCE_CONTINUE;
+	DEBUG ({
+		g_print ("adjust_subregion(), after adjusting: [%u (%u), %u (%u)]\n",
+			 gtk_text_iter_get_line (start), gtk_text_iter_get_offset (start),
+			 gtk_text_iter_get_line (end), gtk_text_iter_get_offset (end));
+	});
 }
 
-/* Just remove the found_tag's located in the high-priority region. For big
- * documents, if the pattern is modified, it can take some time to re-scan all
- * the buffer, so it's better to clear the highlighting as soon as possible. If
- * the highlighting is not cleared, the user can wrongly think that the new
- * pattern matches the old occurrences.
- * The drawback of clearing the highlighting is that for small documents, there
- * is some flickering.
+/* Remove the occurrences in the range. @start and @end may be adjusted, if they
+ * are in an occurrence.
  */
 static void
-regex_search_handle_high_priority_region (GtkSourceSearchContext *search)
+remove_occurrences_in_range (GtkSourceSearchContext *search,
+			     GtkTextIter            *start,
+			     GtkTextIter            *end)
 {
-	GtkSourceRegion *region;
-	GtkSourceRegionIter region_iter;
+	gboolean at_word_boundaries = gtk_source_search_settings_get_at_word_boundaries (search->priv->settings);
+	gint start_offset = gtk_text_iter_get_offset (start);
+	gint end_offset = gtk_text_iter_get_offset (end);
+	OffsetRange occurrence;
+	gboolean found;
+	GtkSourceOccurrencesIter iter;
 
-	region = gtk_source_region_intersect_region (search->priv->high_priority_region,
-						     search->priv->scan_region);
+	found = get_occurrence_at (search, start_offset, &occurrence);
 
-	if (region == NULL)
+	if (!found && at_word_boundaries)
 	{
-		return;
+		found = (get_previous_occurrence (search, start_offset, &occurrence) &&
+			 occurrence.end == start_offset);
 	}
 
-	gtk_source_region_get_start_region_iter (region, &region_iter);
+	if (found)
+	{
+		start_offset = occurrence.start;
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, start, start_offset);
+	}
 
-	while (!gtk_source_region_iter_is_end (&region_iter))
+	if (get_occurrence_at (search, end_offset, &occurrence) &&
+	    (occurrence.start < end_offset || at_word_boundaries))
 	{
-		GtkTextIter subregion_start;
-		GtkTextIter subregion_end;
+		end_offset = occurrence.end;
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, end, end_offset);
+	}
 
-		if (!gtk_source_region_iter_get_subregion (&region_iter,
-							   &subregion_start,
-							   &subregion_end))
+	for (_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index, &iter, start_offset);
+	     !_gtk_source_occurrences_index_iter_is_end (&iter);
+	     _gtk_source_occurrences_index_iter_next (&iter))
+	{
+		GtkTextIter match_start;
+		GtkTextIter match_end;
+
+		_gtk_source_occurrences_index_iter_get (&iter, &occurrence.start, &occurrence.end);
+
+		if (occurrence.start >= end_offset)
 		{
 			break;
 		}
 
-		gtk_text_buffer_remove_tag (search->priv->buffer,
-					    search->priv->found_tag,
-					    &subregion_start,
-					    &subregion_end);
+		get_occurrence_iters (search, &occurrence, &match_start, &match_end);
 
-		gtk_source_region_iter_next (&region_iter);
+		/* If the occurrence has already been scanned, occurrences_count
+		 * takes it into account.
+		 */
+		if (is_scanned (search, &match_start, &match_end))
+		{
+			search->priv->occurrences_count--;
+		}
 	}
 
-	g_clear_object (&region);
+	untag_range (search, start_offset, end_offset);
+	_gtk_source_occurrences_index_remove (search->priv->occurrences_index, start_offset, end_offset);
 }
 
-/* Returns TRUE if the segment is finished, and FALSE on partial match. */
-static gboolean
-regex_search_scan_segment (GtkSourceSearchContext *search,
-			   const GtkTextIter      *segment_start,
-			   const GtkTextIter      *segment_end,
-			   GtkTextIter            *stopped_at)
+static void
+basic_search_scan (GtkSourceSearchContext *search,
+		   const GtkTextIter      *start,
+		   const GtkTextIter      *end)
 {
-	GtkTextIter real_start;
-	gint start_pos;
-	gchar *subject;
-	gssize subject_length;
-	GRegexMatchFlags match_options;
-	GMatchInfo *match_info;
 	GtkTextIter iter;
-	gint iter_byte_pos;
-	gboolean segment_finished;
-	GtkTextIter match_start;
-	GtkTextIter match_end;
-
-	g_assert (stopped_at != NULL);
+	const GtkTextIter *limit;
+	gboolean found = TRUE;
 
-	gtk_text_buffer_remove_tag (search->priv->buffer,
-				    search->priv->found_tag,
-				    segment_start,
-				    segment_end);
+	iter = *start;
 
-	if (search->priv->regex == NULL ||
-	    search->priv->regex_error != NULL)
+	if (gtk_text_iter_is_end (end))
 	{
-		*stopped_at = *segment_end;
-		return TRUE;
+		limit = NULL;
+	}
+	else
+	{
+		limit = end;
 	}
 
-	regex_search_get_real_start (search,
-				     segment_start,
-				     &real_start,
-				     &start_pos);
+	do
+	{
+		GtkTextIter match_start;
+		GtkTextIter match_end;
 
-	DEBUG ({
-	       g_print ("\n*** regex search - scan segment ***\n");
-	       g_print ("start position in the subject (in bytes): %d\n", start_pos);
-	});
+		found = basic_forward_search (search, &iter, &match_start, &match_end, limit);
 
-	match_options = regex_search_get_match_options (&real_start, segment_end);
+		if (found)
+		{
+			add_occurrence (search, &match_start, &match_end);
+		}
 
-	if (match_options & G_REGEX_MATCH_NOTBOL)
-	{
-		DEBUG ({
-		       g_print ("match notbol\n");
-		});
-	}
+		iter = match_end;
 
-	if (match_options & G_REGEX_MATCH_NOTEOL)
-	{
-		DEBUG ({
-		       g_print ("match noteol\n");
-		});
-	}
+	} while (found);
+}
 
-	if (match_options & G_REGEX_MATCH_PARTIAL_HARD)
+static gint
+compute_number_of_lines (const gchar *text)
+{
+	const gchar *p;
+	gint len;
+	gint nb_of_lines = 1;
+
+	if (text == NULL)
 	{
-		DEBUG ({
-		       g_print ("match partial hard\n");
-		});
+		return 0;
 	}
 
-	subject = gtk_text_iter_get_visible_text (&real_start, segment_end);
-	subject_length = strlen (subject);
+	len = strlen (text);
+	p = text;
 
-	DEBUG ({
-	       gchar *subject_escaped = gtk_source_utils_escape_search_text (subject);
-	       g_print ("subject (escaped): %s\n", subject_escaped);
-	       g_free (subject_escaped);
-	});
+	while (len > 0)
+	{
+		gint delimiter;
+		gint next_paragraph;
 
-	g_regex_match_full (search->priv->regex,
-			    subject,
-			    subject_length,
-			    start_pos,
-			    match_options,
-			    &match_info,
-			    &search->priv->regex_error);
+		pango_find_paragraph_boundary (p, len, &delimiter, &next_paragraph);
 
-	iter = real_start;
-	iter_byte_pos = 0;
+		if (delimiter == next_paragraph)
+		{
+			/* not found */
+			break;
+		}
 
-	while (regex_search_fetch_match (match_info,
-					 subject,
-					 subject_length,
-					 &iter,
-					 &iter_byte_pos,
-					 &match_start,
-					 &match_end))
-	{
-		gtk_text_buffer_apply_tag (search->priv->buffer,
-					   search->priv->found_tag,
-					   &match_start,
-					   &match_end);
+		p += next_paragraph;
+		len -= next_paragraph;
+		nb_of_lines++;
+	}
 
-		DEBUG ({
-			 gchar *match_text = gtk_text_iter_get_visible_text (&match_start, &match_end);
-			 gchar *match_escaped = gtk_source_utils_escape_search_text (match_text);
-			 g_print ("match found (escaped): %s\n", match_escaped);
-			 g_free (match_text);
-			 g_free (match_escaped);
-		});
+	return nb_of_lines;
+}
+
+/* Literal search:
+ *
+ * gtk_text_iter_forward_search() walks through the buffer line by line, and
+ * retrieves the text of each line. For a case-sensitive search of a text on a
+ * single line, the buffer contents is instead retrieved by chunks of
+ * LITERAL_SEARCH_CHUNK_LINES lines, and the search text is searched with the
+ * Boyer-Moore-Horspool algorithm. Since the search text doesn't contain a
+ * newline, the occurrences can not span two chunks.
+ *
+ * The result must be the same as with gtk_text_iter_forward_search() and the
+ * GTK_TEXT_SEARCH_TEXT_ONLY and GTK_TEXT_SEARCH_VISIBLE_ONLY flags. So the
+ * literal search is not used when the buffer can contain invisible text, and
+ * a chunk containing pixbufs or child anchors is scanned with
+ * basic_search_scan().
+ *
+ * The case-insensitive search still uses gtk_text_iter_forward_search(),
+ * which compares the casefolded and normalized texts. A byte-level algorithm
+ * would not give the same occurrences for the characters whose casefolded
+ * form has a different length.
+ */
 
-		search->priv->occurrences_count++;
+static void
+literal_search_init (GtkSourceSearchContext *search,
+		     const gchar            *text)
+{
+	gsize i;
 
-		g_match_info_next (match_info, &search->priv->regex_error);
-	}
+	search->priv->literal_length = text != NULL ? strlen (text) : 0;
+	search->priv->literal_single_line = compute_number_of_lines (text) == 1;
 
-	if (search->priv->regex_error != NULL)
+	for (i = 0; i < G_N_ELEMENTS (search->priv->literal_shift); i++)
 	{
-		g_object_notify (G_OBJECT (search), "regex-error");
+		search->priv->literal_shift[i] = search->priv->literal_length;
 	}
 
-	if (g_match_info_is_partial_match (match_info))
+	for (i = 0; i + 1 < search->priv->literal_length; i++)
 	{
-		segment_finished = FALSE;
-
-		if (gtk_text_iter_compare (segment_start, &iter) < 0)
-		{
-			*stopped_at = iter;
-		}
-		else
-		{
-			*stopped_at = *segment_start;
-		}
+		guchar c = text[i];
 
-		DEBUG ({
-		       g_print ("partial match\n");
-		});
-	}
-	else
-	{
-		*stopped_at = *segment_end;
-		segment_finished = TRUE;
+		search->priv->literal_shift[c] = search->priv->literal_length - 1 - i;
 	}
-
-	g_free (subject);
-	g_match_info_free (match_info);
-
-	return segment_finished;
 }
 
 static void
-regex_search_scan_chunk (GtkSourceSearchContext *search,
-			 const GtkTextIter      *chunk_start,
-			 const GtkTextIter      *chunk_end)
+check_invisible_tag (GtkTextTag *tag,
+		     gpointer    data)
 {
-	GtkTextIter segment_start = *chunk_start;
-
-	while (gtk_text_iter_compare (&segment_start, chunk_end) < 0)
-	{
-		GtkTextIter segment_end;
-		GtkTextIter stopped_at;
-		gint nb_lines = 1;
-
-		segment_end = segment_start;
-		gtk_text_iter_forward_line (&segment_end);
-
-		while (!regex_search_scan_segment (search,
-						   &segment_start,
-						   &segment_end,
-						   &stopped_at))
-		{
-			/* TODO: performance improvement. On partial match, use
-			 * a GString to grow the subject.
-			 */
+	gboolean *has_invisible_tag = data;
+	gboolean invisible_set;
 
-			segment_start = stopped_at;
-			gtk_text_iter_forward_lines (&segment_end, nb_lines);
-			nb_lines <<= 1;
-		}
+	g_object_get (tag, "invisible-set", &invisible_set, NULL);
 
-		segment_start = stopped_at;
+	if (invisible_set)
+	{
+		*has_invisible_tag = TRUE;
 	}
+}
 
-	gtk_source_region_subtract_subregion (search->priv->scan_region,
-					      chunk_start,
-					      &segment_start);
+static gboolean
+literal_search_is_possible (GtkSourceSearchContext *search)
+{
+	GtkTextTagTable *tag_table;
+	gboolean has_invisible_tag = FALSE;
 
-	if (search->priv->task_region != NULL)
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings) ||
+	    !gtk_source_search_settings_get_case_sensitive (search->priv->settings) ||
+	    !search->priv->literal_single_line ||
+	    search->priv->literal_length == 0)
 	{
-		gtk_source_region_subtract_subregion (search->priv->task_region,
-						      chunk_start,
-						      &segment_start);
+		return FALSE;
 	}
+
+	tag_table = gtk_text_buffer_get_tag_table (search->priv->buffer);
+	gtk_text_tag_table_foreach (tag_table, check_invisible_tag, &has_invisible_tag);
+
+	return !has_invisible_tag;
 }
 
-static void
-regex_search_scan_next_chunk (GtkSourceSearchContext *search)
+/* Returns the first occurrence of @needle in @haystack, or NULL. @shift is the
+ * shift table computed by literal_search_init(). It doesn't access the search
+ * context, so it can run in a worker thread.
+ */
+static const gchar *
+literal_search_find (const gsize *shift,
+		     const gchar *needle,
+		     gsize        needle_length,
+		     const gchar *haystack,
+		     gsize        haystack_length)
 {
-	GtkTextIter chunk_start;
-	GtkTextIter chunk_end;
+	const gchar *last_pos;
+	const gchar *p;
+	guchar last_char;
 
-	if (gtk_source_region_is_empty (search->priv->scan_region))
+	if (needle_length > haystack_length)
 	{
-		return;
+		return NULL;
 	}
 
-	if (!gtk_source_region_get_bounds (search->priv->scan_region, &chunk_start, NULL))
+	if (needle_length == 1)
 	{
-		return;
+		return memchr (haystack, needle[0], haystack_length);
 	}
 
-	chunk_end = chunk_start;
-	gtk_text_iter_forward_lines (&chunk_end, SCAN_BATCH_SIZE);
+	last_char = needle[needle_length - 1];
+	last_pos = haystack + haystack_length - needle_length;
 
-	regex_search_scan_chunk (search, &chunk_start, &chunk_end);
+	for (p = haystack; p <= last_pos; p += shift[(guchar) p[needle_length - 1]])
+	{
+		if ((guchar) p[needle_length - 1] == last_char &&
+		    memcmp (p, needle, needle_length - 1) == 0)
+		{
+			return p;
+		}
+	}
+
+	return NULL;
 }
 
-static gboolean
-idle_scan_regex_search (GtkSourceSearchContext *search)
+static void
+literal_search_scan_chunk (GtkSourceSearchContext *search,
+			   const GtkTextIter      *chunk_start,
+			   const GtkTextIter      *chunk_end)
 {
-	if (search->priv->high_priority_region != NULL)
-	{
-		regex_search_handle_high_priority_region (search);
-		g_clear_object (&search->priv->high_priority_region);
-		return G_SOURCE_CONTINUE;
-	}
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+	gboolean at_word_boundaries = gtk_source_search_settings_get_at_word_boundaries (search->priv->settings);
+	glong search_text_nb_chars = g_utf8_strlen (search_text, -1);
+	GtkTextIter iter = *chunk_start;
+	gchar *text;
+	const gchar *text_end;
+	const gchar *iter_pos;
+	const gchar *p;
 
-	regex_search_scan_next_chunk (search);
+	text = gtk_text_iter_get_slice (chunk_start, chunk_end);
+	text_end = text + strlen (text);
 
-	if (search->priv->task != NULL)
+	/* U+FFFC, the object replacement character, for the pixbufs and the
+	 * child anchors.
+	 */
+	if (strstr (text, "\xef\xbf\xbc") != NULL)
 	{
-		/* Always resume the task, even if the task region has not been
-		 * fully scanned. The task region can be huge (the whole
-		 * buffer), and an occurrence can be found earlier. Obviously it
-		 * would be better to resume the task only if an occurrence has
-		 * been found in the task region. But it would be a little more
-		 * complicated to implement, for not a big performance
-		 * improvement.
-		 */
-		resume_task (search);
-		return G_SOURCE_CONTINUE;
+		g_free (text);
+		basic_search_scan (search, chunk_start, chunk_end);
+		return;
 	}
 
-	if (gtk_source_region_is_empty (search->priv->scan_region))
-	{
-		search->priv->idle_scan_id = 0;
+	iter_pos = text;
+	p = text;
 
-		g_object_notify (G_OBJECT (search), "occurrences-count");
+	while ((p = literal_search_find (search->priv->literal_shift,
+					 search_text,
+					 search->priv->literal_length,
+					 p,
+					 text_end - p)) != NULL)
+	{
+		GtkTextIter match_start;
+		GtkTextIter match_end;
 
-		g_clear_object (&search->priv->scan_region);
-		return G_SOURCE_REMOVE;
-	}
+		gtk_text_iter_forward_chars (&iter, g_utf8_pointer_to_offset (iter_pos, p));
+		iter_pos = p;
 
-	return G_SOURCE_CONTINUE;
-}
+		match_start = iter;
+		match_end = iter;
+		gtk_text_iter_forward_chars (&match_end, search_text_nb_chars);
 
-static gboolean
-idle_scan_cb (GtkSourceSearchContext *search)
-{
-	if (search->priv->buffer == NULL)
-	{
-		search->priv->idle_scan_id = 0;
-		clear_search (search);
-		return G_SOURCE_REMOVE;
+		if (!at_word_boundaries ||
+		    (_gtk_source_iter_starts_extra_natural_word (&match_start, FALSE) &&
+		     _gtk_source_iter_ends_extra_natural_word (&match_end, FALSE)))
+		{
+			add_occurrence (search, &match_start, &match_end);
+			p += search->priv->literal_length;
+		}
+		else
+		{
+			/* An occurrence at word boundaries can overlap the
+			 * rejected match.
+			 */
+			p = g_utf8_next_char (p);
+		}
 	}
 
-	return gtk_source_search_settings_get_regex_enabled (search->priv->settings) ?
-	       idle_scan_regex_search (search) :
-	       idle_scan_normal_search (search);
+	g_free (text);
 }
 
 static void
-install_idle_scan (GtkSourceSearchContext *search)
+literal_search_scan (GtkSourceSearchContext *search,
+		     const GtkTextIter      *start,
+		     const GtkTextIter      *end)
 {
-	if (search->priv->idle_scan_id == 0)
+	GtkTextIter chunk_start = *start;
+
+	while (gtk_text_iter_compare (&chunk_start, end) < 0)
 	{
-		search->priv->idle_scan_id = g_idle_add ((GSourceFunc)idle_scan_cb, search);
+		GtkTextIter chunk_end = chunk_start;
+
+		gtk_text_iter_forward_lines (&chunk_end, LITERAL_SEARCH_CHUNK_LINES);
+
+		if (gtk_text_iter_compare (end, &chunk_end) < 0)
+		{
+			chunk_end = *end;
+		}
+
+		literal_search_scan_chunk (search, &chunk_start, &chunk_end);
+		chunk_start = chunk_end;
 	}
 }
 
-/* Returns TRUE when finished. */
-static gboolean
-smart_forward_search_step (GtkSourceSearchContext *search,
-			   GtkTextIter            *start_at,
-			   GtkTextIter            *match_start,
-			   GtkTextIter            *match_end)
+static void
+scan_subregion (GtkSourceSearchContext *search,
+		GtkTextIter            *start,
+		GtkTextIter            *end)
 {
-	GtkTextIter iter = *start_at;
-	GtkTextIter limit;
-	GtkTextIter region_start = *start_at;
-	GtkSourceRegion *region = NULL;
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
 
-	if (!gtk_text_iter_has_tag (&iter, search->priv->found_tag))
-	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->priv->found_tag);
-	}
-	else if (!gtk_text_iter_starts_tag (&iter, search->priv->found_tag))
-	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->priv->found_tag);
-		region_start = iter;
-	}
+	/* Make sure the 'found' tag has the priority over syntax highlighting
+	 * tags. */
+	text_tag_set_highest_priority (search->priv->found_tag,
+				       search->priv->buffer);
 
-	limit = iter;
-	gtk_text_iter_forward_to_tag_toggle (&limit, search->priv->found_tag);
+	adjust_subregion (search, start, end);
+	remove_occurrences_in_range (search, start, end);
 
 	if (search->priv->scan_region != NULL)
 	{
-		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-								&region_start,
-								&limit);
-	}
+		DEBUG ({
+			g_print ("Region to scan, before:\n");
+			print_region (search->priv->scan_region);
+		});
 
-	if (gtk_source_region_is_empty (region))
-	{
-		g_clear_object (&region);
+		gtk_source_region_subtract_subregion (search->priv->scan_region, start, end);
 
-		while (basic_forward_search (search, &iter, match_start, match_end, &limit))
-		{
-			if (gtk_text_iter_compare (start_at, match_start) <= 0)
-			{
-				return TRUE;
-			}
+		DEBUG ({
+			g_print ("Region to scan, after:\n");
+			print_region (search->priv->scan_region);
+		});
+	}
 
-			iter = *match_end;
-		}
+	if (search->priv->task_region != NULL)
+	{
+		gtk_source_region_subtract_subregion (search->priv->task_region, start, end);
+	}
 
-		*start_at = limit;
-		return FALSE;
+	if (search_text == NULL)
+	{
+		/* We have removed the occurrences, we are done. */
+		return;
 	}
 
-	/* Scan a chunk of the buffer, not the whole 'region'. An occurrence can
-	 * be found before the 'region' is scanned entirely.
-	 */
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	if (literal_search_is_possible (search))
 	{
-		regex_search_scan_next_chunk (search);
+		literal_search_scan (search, start, end);
 	}
 	else
 	{
-		scan_region_forward (search, region);
+		basic_search_scan (search, start, end);
 	}
+}
 
-	g_clear_object (&region);
+static void
+scan_all_region (GtkSourceSearchContext *search,
+		 GtkSourceRegion        *region)
+{
+	GtkSourceRegionIter region_iter;
 
-	return FALSE;
-}
+	gtk_source_region_get_start_region_iter (region, &region_iter);
 
-/* Doesn't wrap around. */
-static gboolean
-smart_forward_search (GtkSourceSearchContext *search,
-		      const GtkTextIter      *start_at,
-		      GtkTextIter            *match_start,
-		      GtkTextIter            *match_end)
-{
-	GtkTextIter iter = *start_at;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
-
-	g_return_val_if_fail (match_start != NULL, FALSE);
-	g_return_val_if_fail (match_end != NULL, FALSE);
-
-	if (search_text == NULL)
+	while (!gtk_source_region_iter_is_end (&region_iter))
 	{
-		return FALSE;
-	}
+		GtkTextIter subregion_start;
+		GtkTextIter subregion_end;
 
-	while (!gtk_text_iter_is_end (&iter))
-	{
-		if (smart_forward_search_step (search, &iter, match_start, match_end))
+		if (!gtk_source_region_iter_get_subregion (&region_iter,
+							   &subregion_start,
+							   &subregion_end))
 		{
-			return TRUE;
+			break;
 		}
-	}
 
-	return FALSE;
+		scan_subregion (search,
+				&subregion_start,
+				&subregion_end);
+
+		gtk_source_region_iter_next (&region_iter);
+	}
 }
 
-/* Returns TRUE when finished. */
-static gboolean
-smart_backward_search_step (GtkSourceSearchContext *search,
-			    GtkTextIter            *start_at,
-			    GtkTextIter            *match_start,
-			    GtkTextIter            *match_end)
+/* Scan a chunk of the region. If the region is small enough, all the region
+ * will be scanned. But if the region is big, scanning only the chunk will not
+ * block the UI normally. Begin the scan at the beginning of the region.
+ */
+static void
+scan_region_forward (GtkSourceSearchContext *search,
+		     GtkSourceRegion        *region)
 {
-	GtkTextIter iter = *start_at;
-	GtkTextIter limit;
-	GtkTextIter region_end = *start_at;
-	GtkSourceRegion *region = NULL;
+	gint nb_remaining_lines = SCAN_BATCH_SIZE;
+	GtkTextIter start;
+	GtkTextIter end;
 
-	if (gtk_text_iter_starts_tag (&iter, search->priv->found_tag) ||
-	    (!gtk_text_iter_has_tag (&iter, search->priv->found_tag) &&
-	     !gtk_text_iter_ends_tag (&iter, search->priv->found_tag)))
-	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->priv->found_tag);
-	}
-	else if (gtk_text_iter_has_tag (&iter, search->priv->found_tag))
+	while (nb_remaining_lines > 0 &&
+	       get_first_subregion (region, &start, &end))
 	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->priv->found_tag);
-		region_end = iter;
-	}
+		GtkTextIter limit = start;
+		gint start_line;
+		gint limit_line;
 
-	limit = iter;
-	gtk_text_iter_backward_to_tag_toggle (&limit, search->priv->found_tag);
+		gtk_text_iter_forward_lines (&limit, nb_remaining_lines);
 
-	if (search->priv->scan_region != NULL)
-	{
-		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-								&limit,
-								&region_end);
+		if (gtk_text_iter_compare (&end, &limit) < 0)
+		{
+			limit = end;
+		}
+
+		scan_subregion (search, &start, &limit);
+
+		gtk_source_region_subtract_subregion (region, &start, &limit);
+
+		start_line = gtk_text_iter_get_line (&start);
+		limit_line = gtk_text_iter_get_line (&limit);
+
+		nb_remaining_lines -= limit_line - start_line;
 	}
+}
 
-	if (gtk_source_region_is_empty (region))
+/* Same as scan_region_forward(), but begins the scan at the end of the region. */
+static void
+scan_region_backward (GtkSourceSearchContext *search,
+		      GtkSourceRegion        *region)
+{
+	gint nb_remaining_lines = SCAN_BATCH_SIZE;
+	GtkTextIter start;
+	GtkTextIter end;
+
+	while (nb_remaining_lines > 0 &&
+	       get_last_subregion (region, &start, &end))
 	{
-		g_clear_object (&region);
+		GtkTextIter limit = end;
+		gint limit_line;
+		gint end_line;
 
-		while (basic_backward_search (search, &iter, match_start, match_end, &limit))
-		{
-			if (gtk_text_iter_compare (match_end, start_at) <= 0)
-			{
-				return TRUE;
-			}
+		gtk_text_iter_backward_lines (&limit, nb_remaining_lines);
 
-			iter = *match_start;
+		if (gtk_text_iter_compare (&limit, &start) < 0)
+		{
+			limit = start;
 		}
 
-		*start_at = limit;
-		return FALSE;
+		scan_subregion (search, &limit, &end);
+
+		gtk_source_region_subtract_subregion (region, &limit, &end);
+
+		limit_line = gtk_text_iter_get_line (&limit);
+		end_line = gtk_text_iter_get_line (&end);
+
+		nb_remaining_lines -= end_line - limit_line;
 	}
+}
 
-	/* Scan a chunk of the buffer, not the whole 'region'. An occurrence can
-	 * be found before the 'region' is scanned entirely.
-	 */
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+static void
+resume_task (GtkSourceSearchContext *search)
+{
+	ForwardBackwardData *task_data = g_task_get_task_data (search->priv->task);
+	GtkTextIter start_at;
+
+	g_clear_object (&search->priv->task_region);
+
+	gtk_text_buffer_get_iter_at_mark (search->priv->buffer,
+					  &start_at,
+					  task_data->start_at);
+
+	if (task_data->is_forward)
 	{
-		regex_search_scan_next_chunk (search);
+		smart_forward_search_async (search,
+					    &start_at,
+					    task_data->wrapped_around);
 	}
 	else
 	{
-		scan_region_forward (search, region);
+		smart_backward_search_async (search,
+					     &start_at,
+					     task_data->wrapped_around);
 	}
-
-	g_clear_object (&region);
-
-	return FALSE;
 }
 
-/* Doesn't wrap around. */
-static gboolean
-smart_backward_search (GtkSourceSearchContext *search,
-		       const GtkTextIter      *start_at,
-		       GtkTextIter            *match_start,
-		       GtkTextIter            *match_end)
+static void
+scan_task_region (GtkSourceSearchContext *search)
 {
-	GtkTextIter iter = *start_at;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
-
-	g_return_val_if_fail (match_start != NULL, FALSE);
-	g_return_val_if_fail (match_end != NULL, FALSE);
+	ForwardBackwardData *task_data = g_task_get_task_data (search->priv->task);
 
-	if (search_text == NULL)
+	if (task_data->is_forward)
 	{
-		return FALSE;
+		scan_region_forward (search, search->priv->task_region);
 	}
-
-	while (!gtk_text_iter_is_start (&iter))
+	else
 	{
-		if (smart_backward_search_step (search, &iter, match_start, match_end))
-		{
-			return TRUE;
-		}
+		scan_region_backward (search, search->priv->task_region);
 	}
 
-	return FALSE;
+	resume_task (search);
 }
 
-static void
-add_subregion_to_scan (GtkSourceSearchContext *search,
-		       const GtkTextIter      *subregion_start,
-		       const GtkTextIter      *subregion_end)
+static gboolean
+idle_scan_normal_search (GtkSourceSearchContext *search)
 {
-	GtkTextIter start = *subregion_start;
-	GtkTextIter end = *subregion_end;
+	if (search->priv->high_priority_region != NULL)
+	{
+		/* Normally the high priority region is not really big, since it
+		 * is the visible area on the screen. So we can highlight it in
+		 * one batch.
+		 */
+		scan_all_region (search, search->priv->high_priority_region);
 
-	if (search->priv->scan_region == NULL)
+		g_clear_object (&search->priv->high_priority_region);
+		return G_SOURCE_CONTINUE;
+	}
+
+	if (search->priv->task_region != NULL)
 	{
-		search->priv->scan_region = gtk_source_region_new (search->priv->buffer);
+		scan_task_region (search);
+		return G_SOURCE_CONTINUE;
 	}
 
-	DEBUG ({
-		g_print ("add_subregion_to_scan(): region to scan, before:\n");
-		print_region (search->priv->scan_region);
-	});
+	scan_region_forward (search, search->priv->scan_region);
 
-	gtk_source_region_add_subregion (search->priv->scan_region, &start, &end);
+	if (gtk_source_region_is_empty (search->priv->scan_region))
+	{
+		search->priv->idle_scan_id = 0;
 
-	DEBUG ({
-		g_print ("add_subregion_to_scan(): region to scan, after:\n");
-		print_region (search->priv->scan_region);
-	});
+		g_object_notify (G_OBJECT (search), "occurrences-count");
 
-	install_idle_scan (search);
+		g_clear_object (&search->priv->scan_region);
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
 }
 
+/* Just remove the occurrences located in the high-priority region. For big
+ * documents, if the pattern is modified, it can take some time to re-scan all
+ * the buffer, so it's better to clear the highlighting as soon as possible. If
+ * the highlighting is not cleared, the user can wrongly think that the new
+ * pattern matches the old occurrences.
+ * The drawback of clearing the highlighting is that for small documents, there
+ * is some flickering.
+ */
 static void
-update_regex (GtkSourceSearchContext *search)
+regex_search_handle_high_priority_region (GtkSourceSearchContext *search)
 {
-	gboolean regex_error_changed = FALSE;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+	GtkSourceRegion *region;
+	GtkSourceRegionIter region_iter;
 
-	if (search->priv->regex != NULL)
-	{
-		g_regex_unref (search->priv->regex);
-		search->priv->regex = NULL;
-	}
+	region = gtk_source_region_intersect_region (search->priv->high_priority_region,
+						     search->priv->scan_region);
 
-	if (search->priv->regex_error != NULL)
+	if (region == NULL)
 	{
-		g_clear_error (&search->priv->regex_error);
-		regex_error_changed = TRUE;
+		return;
 	}
 
-	if (search_text != NULL &&
-	    gtk_source_search_settings_get_regex_enabled (search->priv->settings))
-	{
-		GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE | G_REGEX_MULTILINE;
-		gchar *pattern = (gchar *)search_text;
+	gtk_source_region_get_start_region_iter (region, &region_iter);
 
-		search->priv->text_nb_lines = 0;
+	while (!gtk_source_region_iter_is_end (&region_iter))
+	{
+		GtkTextIter subregion_start;
+		GtkTextIter subregion_end;
 
-		if (!gtk_source_search_settings_get_case_sensitive (search->priv->settings))
+		if (!gtk_source_region_iter_get_subregion (&region_iter,
+							   &subregion_start,
+							   &subregion_end))
 		{
-			compile_flags |= G_REGEX_CASELESS;
+			break;
 		}
 
-		if (gtk_source_search_settings_get_at_word_boundaries (search->priv->settings))
-		{
-			pattern = g_strdup_printf ("\\b%s\\b", search_text);
-		}
-
-		search->priv->regex = g_regex_new (pattern,
-						   compile_flags,
-						   G_REGEX_MATCH_NOTEMPTY,
-						   &search->priv->regex_error);
-
-		if (search->priv->regex_error != NULL)
-		{
-			regex_error_changed = TRUE;
-		}
+		clear_occurrences_in_range (search, &subregion_start, &subregion_end);
 
-		if (gtk_source_search_settings_get_at_word_boundaries (search->priv->settings))
-		{
-			g_free (pattern);
-		}
+		gtk_source_region_iter_next (&region_iter);
 	}
 
-	if (regex_error_changed)
-	{
-		g_object_notify (G_OBJECT (search), "regex-error");
-	}
+	g_clear_object (&region);
 }
 
 static void
-update (GtkSourceSearchContext *search)
+regex_search_add_occurrence (GtkSourceSearchContext *search,
+			     const GtkTextIter      *match_start,
+			     const GtkTextIter      *match_end)
 {
-	GtkTextIter start;
-	GtkTextIter end;
-	GtkSourceBufferInternal *buffer_internal;
-
-	if (search->priv->buffer == NULL)
-	{
-		return;
-	}
-
-	clear_search (search);
-	update_regex (search);
-
-	search->priv->scan_region = gtk_source_region_new (search->priv->buffer);
-
-	gtk_text_buffer_get_bounds (search->priv->buffer, &start, &end);
-	add_subregion_to_scan (search, &start, &end);
+	DEBUG ({
+		 gchar *match_text = gtk_text_iter_get_visible_text (match_start, match_end);
+		 gchar *match_escaped = gtk_source_utils_escape_search_text (match_text);
+		 g_print ("match found (escaped): %s\n", match_escaped);
+		 g_free (match_text);
+		 g_free (match_escaped);
+	});
 
-	/* Notify the GtkSourceViews that the search is starting, so that
-	 * _gtk_source_search_context_update_highlight() can be called for the
-	 * visible regions of the buffer.
-	 */
-	buffer_internal = _gtk_source_buffer_internal_get_from_buffer (GTK_SOURCE_BUFFER (search->priv->buffer));
-	_gtk_source_buffer_internal_emit_search_start (buffer_internal, search);
+	add_occurrence (search, match_start, match_end);
 }
 
-static void
-insert_text_before_cb (GtkSourceSearchContext *search,
-		       GtkTextIter            *location,
-		       gchar                  *text,
-		       gint                    length)
+/* See regex_search_scan_subject(). @iter is @iter_byte_pos bytes after the
+ * start of @subject, see regex_search_get_match_iters().
+ */
+static gboolean
+regex_search_scan_subject_gregex (GtkSourceSearchContext *search,
+				  const gchar            *subject,
+				  gssize                  subject_length,
+				  gint                    start_pos,
+				  GRegexMatchFlags        match_options,
+				  GtkTextIter            *iter,
+				  gint                    iter_byte_pos)
 {
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+	GMatchInfo *match_info;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gboolean partial_match;
 
-	clear_task (search);
+	g_regex_match_full (search->priv->regex,
+			    subject,
+			    subject_length,
+			    start_pos,
+			    match_options,
+			    &match_info,
+			    &search->priv->regex_error);
 
-	if (search_text != NULL &&
-	    !gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	while (regex_search_fetch_match (match_info,
+					 subject,
+					 subject_length,
+					 iter,
+					 &iter_byte_pos,
+					 &match_start,
+					 &match_end))
 	{
-		GtkTextIter start = *location;
-		GtkTextIter end = *location;
-
-		remove_occurrences_in_range (search, &start, &end);
-		add_subregion_to_scan (search, &start, &end);
-	}
-}
+		regex_search_add_occurrence (search, &match_start, &match_end);
 
-static void
-insert_text_after_cb (GtkSourceSearchContext *search,
-		      GtkTextIter            *location,
-		      gchar                  *text,
-		      gint                    length)
-{
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
-	{
-		update (search);
+		g_match_info_next (match_info, &search->priv->regex_error);
 	}
-	else
-	{
-		GtkTextIter start;
-		GtkTextIter end;
 
-		start = end = *location;
-
-		gtk_text_iter_backward_chars (&start,
-					      g_utf8_strlen (text, length));
+	partial_match = g_match_info_is_partial_match (match_info);
+	g_match_info_free (match_info);
 
-		add_subregion_to_scan (search, &start, &end);
-	}
+	return partial_match;
 }
 
-static void
-delete_range_before_cb (GtkSourceSearchContext *search,
-			GtkTextIter            *delete_start,
-			GtkTextIter            *delete_end)
+#ifdef ENABLE_PCRE2_JIT
+static gboolean
+regex_search_scan_subject_jit (GtkSourceSearchContext *search,
+			       const gchar            *subject,
+			       gssize                  subject_length,
+			       gint                    start_pos,
+			       GRegexMatchFlags        match_options,
+			       GtkTextIter            *iter)
 {
-	GtkTextIter start_buffer;
-	GtkTextIter end_buffer;
-	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
-
-	clear_task (search);
+	/* G_REGEX_MATCH_NOTEMPTY is a default match option of the GRegex. */
+	guint32 options = PCRE2_NOTEMPTY;
+	gint iter_byte_pos = 0;
+	gint pos = start_pos;
 
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	if (match_options & G_REGEX_MATCH_NOTBOL)
 	{
-		return;
+		options |= PCRE2_NOTBOL;
 	}
 
-	gtk_text_buffer_get_bounds (search->priv->buffer, &start_buffer, &end_buffer);
+	if (match_options & G_REGEX_MATCH_NOTEOL)
+	{
+		options |= PCRE2_NOTEOL;
+	}
 
-	if (gtk_text_iter_equal (delete_start, &start_buffer) &&
-	    gtk_text_iter_equal (delete_end, &end_buffer))
+	if (match_options & G_REGEX_MATCH_PARTIAL_HARD)
 	{
-		/* Special case when removing all the text. */
-		search->priv->occurrences_count = 0;
-		return;
+		options |= PCRE2_PARTIAL_HARD;
 	}
 
-	if (search_text != NULL)
+	while (TRUE)
 	{
-		GtkTextIter start = *delete_start;
-		GtkTextIter end = *delete_end;
+		PCRE2_SIZE *ovector;
+		GtkTextIter match_start;
+		GtkTextIter match_end;
+		gint rc;
 
-		gtk_text_iter_backward_lines (&start, search->priv->text_nb_lines);
-		gtk_text_iter_forward_lines (&end, search->priv->text_nb_lines);
+		rc = pcre2_jit_match (search->priv->jit_code,
+				      (PCRE2_SPTR) subject,
+				      subject_length,
+				      pos,
+				      options,
+				      search->priv->jit_match_data,
+				      search->priv->jit_match_context);
 
-		remove_occurrences_in_range (search, &start, &end);
-		add_subregion_to_scan (search, &start, &end);
+		if (rc == PCRE2_ERROR_PARTIAL)
+		{
+			return TRUE;
+		}
+
+		if (rc == PCRE2_ERROR_NOMATCH)
+		{
+			return FALSE;
+		}
+
+		if (rc < 0)
+		{
+			/* The pattern compiled fine, so this is a limit of the
+			 * JIT, e.g. its stack is too small for this subject.
+			 * GRegex has no such limit, the rest of the subject is
+			 * scanned with it, and it reports the real errors.
+			 */
+			DEBUG ({
+				gchar message[256];
+
+				pcre2_get_error_message (rc, (PCRE2_UCHAR *) message, sizeof (message));
+				g_print ("JIT match error, falling back to GRegex: %s\n", message);
+			});
+
+			return regex_search_scan_subject_gregex (search,
+								 subject,
+								 subject_length,
+								 pos,
+								 match_options,
+								 iter,
+								 iter_byte_pos);
+		}
+
+		ovector = pcre2_get_ovector_pointer (search->priv->jit_match_data);
+
+		regex_search_get_match_iters (subject,
+					      subject_length,
+					      ovector[0],
+					      ovector[1],
+					      iter,
+					      &iter_byte_pos,
+					      &match_start,
+					      &match_end);
+
+		regex_search_add_occurrence (search, &match_start, &match_end);
+
+		pos = ovector[1];
 	}
 }
+#endif
 
-static void
-delete_range_after_cb (GtkSourceSearchContext *search,
-		       GtkTextIter            *start,
-		       GtkTextIter            *end)
+/* Tags the occurrences in @subject after @start_pos. @iter is at the start of
+ * @subject, it is moved to the end of the last occurrence. Returns TRUE on
+ * partial match.
+ */
+static gboolean
+regex_search_scan_subject (GtkSourceSearchContext *search,
+			   const gchar            *subject,
+			   gssize                  subject_length,
+			   gint                    start_pos,
+			   GRegexMatchFlags        match_options,
+			   GtkTextIter            *iter)
 {
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+#ifdef ENABLE_PCRE2_JIT
+	if (search->priv->jit_code != NULL)
 	{
-		update (search);
-	}
-	else
-	{
-		add_subregion_to_scan (search, start, end);
+		return regex_search_scan_subject_jit (search,
+						      subject,
+						      subject_length,
+						      start_pos,
+						      match_options,
+						      iter);
 	}
+#endif
+
+	return regex_search_scan_subject_gregex (search,
+						 subject,
+						 subject_length,
+						 start_pos,
+						 match_options,
+						 iter,
+						 0);
 }
 
+/* Fills the scratch buffer with the visible text between @start and @end. If
+ * the previous subject overlaps the beginning of the range, its end is reused
+ * and only the following text is retrieved from the buffer.
+ *
+ * Because of the invisible text, the pixbufs and the child anchors, the
+ * character offsets in the subject are not buffer offsets. The bytes to remove
+ * at the beginning of the previous subject are known from the visible text of
+ * the part to remove or of the part to keep, whichever is the shortest: the
+ * lookbehind characters are kept after a finished segment, the beginning of
+ * the partial match after a partial match.
+ */
 static void
-set_buffer (GtkSourceSearchContext *search,
-	    GtkSourceBuffer        *buffer)
+regex_search_get_subject (GtkSourceSearchContext *search,
+			  const GtkTextIter      *start,
+			  const GtkTextIter      *end)
 {
-	g_assert (search->priv->buffer == NULL);
-	g_assert (search->priv->tag_table == NULL);
-
-	search->priv->buffer = GTK_TEXT_BUFFER (buffer);
-
-	g_object_add_weak_pointer (G_OBJECT (buffer),
-				   (gpointer *)&search->priv->buffer);
-
-	search->priv->tag_table = gtk_text_buffer_get_tag_table (search->priv->buffer);
-	g_object_ref (search->priv->tag_table);
+	GString *subject = search->priv->regex_subject;
+	gint start_offset = gtk_text_iter_get_offset (start);
+	gint end_offset = gtk_text_iter_get_offset (end);
+	GtkTextIter append_start = *start;
+	gchar *text;
 
-	g_signal_connect_object (buffer,
-				 "insert-text",
-				 G_CALLBACK (insert_text_before_cb),
-				 search,
-				 G_CONNECT_SWAPPED);
+	if (search->priv->regex_subject_start != -1 &&
+	    search->priv->regex_subject_start <= start_offset &&
+	    start_offset <= search->priv->regex_subject_end &&
+	    search->priv->regex_subject_end <= end_offset)
+	{
+		GtkTextIter subject_start;
+		gsize removed_length;
 
-	g_signal_connect_object (buffer,
-				 "insert-text",
-				 G_CALLBACK (insert_text_after_cb),
-				 search,
-				 G_CONNECT_AFTER | G_CONNECT_SWAPPED);
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer,
+						    &append_start,
+						    search->priv->regex_subject_end);
 
-	g_signal_connect_object (buffer,
-				 "delete-range",
-				 G_CALLBACK (delete_range_before_cb),
-				 search,
-				 G_CONNECT_SWAPPED);
+		if (start_offset - search->priv->regex_subject_start <
+		    search->priv->regex_subject_end - start_offset)
+		{
+			gtk_text_buffer_get_iter_at_offset (search->priv->buffer,
+							    &subject_start,
+							    search->priv->regex_subject_start);
 
-	g_signal_connect_object (buffer,
-				 "delete-range",
-				 G_CALLBACK (delete_range_after_cb),
-				 search,
-				 G_CONNECT_AFTER | G_CONNECT_SWAPPED);
+			text = gtk_text_iter_get_visible_text (&subject_start, start);
+			removed_length = strlen (text);
+		}
+		else
+		{
+			text = gtk_text_iter_get_visible_text (start, &append_start);
+			removed_length = subject->len - strlen (text);
+		}
 
-	search->priv->found_tag = gtk_text_buffer_create_tag (search->priv->buffer, NULL, NULL);
-	g_object_ref (search->priv->found_tag);
+		g_free (text);
 
-	sync_found_tag (search);
+		g_assert (removed_length <= subject->len);
+		g_string_erase (subject, 0, removed_length);
+	}
+	else
+	{
+		g_string_truncate (subject, 0);
+	}
 
-	g_signal_connect_object (search->priv->buffer,
-				 "notify::style-scheme",
-				 G_CALLBACK (sync_found_tag),
-				 search,
-				 G_CONNECT_SWAPPED);
+	text = gtk_text_iter_get_visible_text (&append_start, end);
+	g_string_append (subject, text);
+	g_free (text);
 
-	_gtk_source_buffer_add_search_context (buffer, search);
+	search->priv->regex_subject_start = start_offset;
+	search->priv->regex_subject_end = end_offset;
 }
 
-static gint
-compute_number_of_lines (const gchar *text)
+/* Removes the occurrences of the segment before scanning it. After a buffer
+ * modification, a segment can go past the end of the subregion to scan, on
+ * text that is already scanned: the occurrences found there are taken into
+ * account by occurrences_count, so they are also removed from it.
+ */
+static void
+regex_search_clear_segment (GtkSourceSearchContext *search,
+			    const GtkTextIter      *segment_start,
+			    const GtkTextIter      *segment_end)
 {
-	const gchar *p;
-	gint len;
-	gint nb_of_lines = 1;
-
-	if (text == NULL)
-	{
-		return 0;
-	}
+	gint end_offset = gtk_text_iter_get_offset (segment_end);
+	GtkSourceOccurrencesIter iter;
 
-	len = strlen (text);
-	p = text;
-
-	while (len > 0)
+	for (_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index,
+							   &iter,
+							   gtk_text_iter_get_offset (segment_start));
+	     !_gtk_source_occurrences_index_iter_is_end (&iter);
+	     _gtk_source_occurrences_index_iter_next (&iter))
 	{
-		gint delimiter;
-		gint next_paragraph;
+		OffsetRange occurrence;
+		GtkTextIter match_start;
+		GtkTextIter match_end;
 
-		pango_find_paragraph_boundary (p, len, &delimiter, &next_paragraph);
+		_gtk_source_occurrences_index_iter_get (&iter, &occurrence.start, &occurrence.end);
 
-		if (delimiter == next_paragraph)
+		if (occurrence.start >= end_offset)
 		{
-			/* not found */
 			break;
 		}
 
-		p += next_paragraph;
-		len -= next_paragraph;
-		nb_of_lines++;
+		get_occurrence_iters (search, &occurrence, &match_start, &match_end);
+
+		if (is_scanned (search, &match_start, &match_end))
+		{
+			search->priv->occurrences_count--;
+		}
 	}
 
-	return nb_of_lines;
+	clear_occurrences_in_range (search, segment_start, segment_end);
 }
 
-static void
-search_text_updated (GtkSourceSearchContext *search)
+/* Returns TRUE if the segment is finished, and FALSE on partial match.
+ * If @allow_partial is FALSE, a partial match at the end of the segment is not
+ * searched, so the segment is always finished.
+ */
+static gboolean
+regex_search_scan_segment (GtkSourceSearchContext *search,
+			   const GtkTextIter      *segment_start,
+			   const GtkTextIter      *segment_end,
+			   gboolean                allow_partial,
+			   GtkTextIter            *stopped_at)
 {
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
-	{
-		search->priv->text_nb_lines = 0;
-	}
-	else
-	{
-		const gchar *text = gtk_source_search_settings_get_search_text (search->priv->settings);
-		search->priv->text_nb_lines = compute_number_of_lines (text);
-	}
-}
+	GtkTextIter real_start;
+	gint start_pos;
+	const gchar *subject;
+	gssize subject_length;
+	GRegexMatchFlags match_options;
+	GtkTextIter iter;
+	gboolean partial_match;
+	gboolean segment_finished;
 
-static void
-settings_notify_cb (GtkSourceSearchContext  *search,
-		    GParamSpec              *pspec,
-		    GtkSourceSearchSettings *settings)
-{
-	const gchar *property = g_param_spec_get_name (pspec);
+	g_assert (stopped_at != NULL);
 
-	if (g_str_equal (property, "search-text"))
+	regex_search_clear_segment (search, segment_start, segment_end);
+
+	if (search->priv->regex == NULL ||
+	    search->priv->regex_error != NULL)
 	{
-		search_text_updated (search);
+		*stopped_at = *segment_end;
+		return TRUE;
 	}
 
-	update (search);
-}
+	regex_search_get_real_start (search,
+				     segment_start,
+				     &real_start,
+				     &start_pos);
 
-static void
-set_settings (GtkSourceSearchContext  *search,
-	      GtkSourceSearchSettings *settings)
-{
-	g_assert (search->priv->settings == NULL);
+	DEBUG ({
+	       g_print ("\n*** regex search - scan segment ***\n");
+	       g_print ("start position in the subject (in bytes): %d\n", start_pos);
+	});
 
-	if (settings != NULL)
+	match_options = regex_search_get_match_options (&real_start, segment_end);
+
+	if (!allow_partial)
 	{
-		search->priv->settings = g_object_ref (settings);
+		match_options &= ~G_REGEX_MATCH_PARTIAL_HARD;
 	}
-	else
+
+	if (match_options & G_REGEX_MATCH_NOTBOL)
 	{
-		search->priv->settings = gtk_source_search_settings_new ();
+		DEBUG ({
+		       g_print ("match notbol\n");
+		});
 	}
 
-	g_signal_connect_object (search->priv->settings,
-				 "notify",
-				 G_CALLBACK (settings_notify_cb),
-				 search,
-				 G_CONNECT_SWAPPED);
+	if (match_options & G_REGEX_MATCH_NOTEOL)
+	{
+		DEBUG ({
+		       g_print ("match noteol\n");
+		});
+	}
 
-	search_text_updated (search);
-	update (search);
+	if (match_options & G_REGEX_MATCH_PARTIAL_HARD)
+	{
+		DEBUG ({
+		       g_print ("match partial hard\n");
+		});
+	}
 
-	g_object_notify (G_OBJECT (search), "settings");
-}
+	regex_search_get_subject (search, &real_start, segment_end);
+	subject = search->priv->regex_subject->str;
+	subject_length = search->priv->regex_subject->len;
 
-static void
-gtk_source_search_context_dispose (GObject *object)
-{
-	GtkSourceSearchContext *search = GTK_SOURCE_SEARCH_CONTEXT (object);
+	DEBUG ({
+	       gchar *subject_escaped = gtk_source_utils_escape_search_text (subject);
+	       g_print ("subject (escaped): %s\n", subject_escaped);
+	       g_free (subject_escaped);
+	});
 
-	clear_search (search);
+	iter = real_start;
 
-	if (search->priv->found_tag != NULL &&
-	    search->priv->tag_table != NULL)
-	{
-		gtk_text_tag_table_remove (search->priv->tag_table,
-					   search->priv->found_tag);
+	partial_match = regex_search_scan_subject (search,
+						   subject,
+						   subject_length,
+						   start_pos,
+						   match_options,
+						   &iter);
 
-		g_clear_object (&search->priv->found_tag);
-		g_clear_object (&search->priv->tag_table);
+	if (search->priv->regex_error != NULL)
+	{
+		g_object_notify (G_OBJECT (search), "regex-error");
 	}
 
-	if (search->priv->buffer != NULL)
+	if (partial_match)
 	{
-		g_object_remove_weak_pointer (G_OBJECT (search->priv->buffer),
-					      (gpointer *)&search->priv->buffer);
+		segment_finished = FALSE;
 
-		search->priv->buffer = NULL;
+		if (gtk_text_iter_compare (segment_start, &iter) < 0)
+		{
+			*stopped_at = iter;
+		}
+		else
+		{
+			*stopped_at = *segment_start;
+		}
+
+		DEBUG ({
+		       g_print ("partial match\n");
+		});
+	}
+	else
+	{
+		*stopped_at = *segment_end;
+		segment_finished = TRUE;
 	}
 
-	g_clear_object (&search->priv->settings);
+	return segment_finished;
+}
 
-	G_OBJECT_CLASS (gtk_source_search_context_parent_class)->dispose (object);
+/* Returns the number of lines around a buffer modification where the regex
+ * matches can change.
+ */
+static gint
+regex_search_get_nb_context_lines (GtkSourceSearchContext *search)
+{
+	gint max_match_span = gtk_source_search_settings_get_max_match_span (search->priv->settings);
+
+	return max_match_span > 0 ? max_match_span : REGEX_SEARCH_WINDOW_LINES;
 }
 
 static void
-gtk_source_search_context_finalize (GObject *object)
+regex_search_scan_chunk (GtkSourceSearchContext *search,
+			 const GtkTextIter      *chunk_start,
+			 const GtkTextIter      *chunk_end)
 {
-	GtkSourceSearchContext *search = GTK_SOURCE_SEARCH_CONTEXT (object);
+	GtkTextIter segment_start = *chunk_start;
+	gint max_match_span = gtk_source_search_settings_get_max_match_span (search->priv->settings);
 
-	if (search->priv->regex != NULL)
-	{
-		g_regex_unref (search->priv->regex);
-	}
+	/* The buffer may have been modified since the last chunk. */
+	search->priv->regex_subject_start = -1;
 
-	g_clear_error (&search->priv->regex_error);
+	while (gtk_text_iter_compare (&segment_start, chunk_end) < 0)
+	{
+		GtkTextIter segment_end;
+		GtkTextIter stopped_at;
+		gint nb_lines = REGEX_SEARCH_WINDOW_LINES;
 
-	G_OBJECT_CLASS (gtk_source_search_context_parent_class)->finalize (object);
-}
+		segment_end = segment_start;
+		gtk_text_iter_forward_lines (&segment_end, REGEX_SEARCH_WINDOW_LINES);
 
-static void
-gtk_source_search_context_get_property (GObject    *object,
-					guint       prop_id,
-					GValue     *value,
-					GParamSpec *pspec)
-{
-	GtkSourceSearchContext *search;
+		while (!regex_search_scan_segment (search,
+						   &segment_start,
+						   &segment_end,
+						   TRUE,
+						   &stopped_at))
+		{
+			gint start_line;
 
-	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (object));
+			segment_start = stopped_at;
+			start_line = gtk_text_iter_get_line (&segment_start);
 
-	search = GTK_SOURCE_SEARCH_CONTEXT (object);
+			if (search->priv->regex_subject->len >= REGEX_SEARCH_MAX_SUBJECT_SIZE ||
+			    (max_match_span > 0 &&
+			     gtk_text_iter_get_line (&segment_end) - start_line >= max_match_span))
+			{
+				regex_search_scan_segment (search,
+							   &segment_start,
+							   &segment_end,
+							   FALSE,
+							   &stopped_at);
+				break;
+			}
 
-	switch (prop_id)
-	{
-		case PROP_BUFFER:
-			g_value_set_object (value, search->priv->buffer);
-			break;
+			gtk_text_iter_forward_lines (&segment_end, nb_lines);
+			nb_lines <<= 1;
 
-		case PROP_SETTINGS:
-			g_value_set_object (value, search->priv->settings);
-			break;
+			if (max_match_span > 0 &&
+			    gtk_text_iter_get_line (&segment_end) - start_line > max_match_span)
+			{
+				gtk_text_buffer_get_iter_at_line (search->priv->buffer,
+								  &segment_end,
+								  start_line + max_match_span);
+			}
+		}
 
-		case PROP_HIGHLIGHT:
-			g_value_set_boolean (value, search->priv->highlight);
-			break;
+		segment_start = stopped_at;
+	}
 
-		case PROP_MATCH_STYLE:
-			g_value_set_object (value, search->priv->match_style);
-			break;
+	/* Don't keep the memory of a big partial match. */
+	if (search->priv->regex_subject->allocated_len > REGEX_SEARCH_MAX_SUBJECT_SIZE / 16)
+	{
+		g_string_free (search->priv->regex_subject, TRUE);
+		search->priv->regex_subject = g_string_new (NULL);
+	}
 
-		case PROP_OCCURRENCES_COUNT:
-			g_value_set_int (value, gtk_source_search_context_get_occurrences_count (search));
-			break;
+	search->priv->regex_subject_start = -1;
 
-		case PROP_REGEX_ERROR:
-			g_value_set_pointer (value, gtk_source_search_context_get_regex_error (search));
-			break;
+	gtk_source_region_subtract_subregion (search->priv->scan_region,
+					      chunk_start,
+					      &segment_start);
 
-		default:
-			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-			break;
+	if (search->priv->task_region != NULL)
+	{
+		gtk_source_region_subtract_subregion (search->priv->task_region,
+						      chunk_start,
+						      &segment_start);
 	}
 }
 
 static void
-gtk_source_search_context_set_property (GObject      *object,
-					guint         prop_id,
-					const GValue *value,
-					GParamSpec   *pspec)
+regex_search_scan_next_chunk (GtkSourceSearchContext *search)
 {
-	GtkSourceSearchContext *search;
+	GtkSourceRegionIter region_iter;
+	GtkTextIter chunk_start;
+	GtkTextIter chunk_end;
+	GtkTextIter subregion_end;
 
-	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (object));
+	if (gtk_source_region_is_empty (search->priv->scan_region))
+	{
+		return;
+	}
 
-	search = GTK_SOURCE_SEARCH_CONTEXT (object);
+	/* After a buffer modification, the first subregion can be followed by
+	 * text that is already scanned. A subregion can also be empty, after a
+	 * text deletion.
+	 */
+	gtk_source_region_get_start_region_iter (search->priv->scan_region, &region_iter);
 
-	switch (prop_id)
+	while (TRUE)
 	{
-		case PROP_BUFFER:
-			set_buffer (search, g_value_get_object (value));
-			break;
+		if (!gtk_source_region_iter_get_subregion (&region_iter, &chunk_start, &subregion_end))
+		{
+			return;
+		}
 
-		case PROP_SETTINGS:
-			set_settings (search, g_value_get_object (value));
+		if (!gtk_text_iter_equal (&chunk_start, &subregion_end))
+		{
 			break;
+		}
 
-		case PROP_HIGHLIGHT:
-			gtk_source_search_context_set_highlight (search, g_value_get_boolean (value));
-			break;
+		gtk_source_region_iter_next (&region_iter);
+	}
 
-		case PROP_MATCH_STYLE:
-			gtk_source_search_context_set_match_style (search, g_value_get_object (value));
-			break;
+	chunk_end = chunk_start;
+	gtk_text_iter_forward_lines (&chunk_end, SCAN_BATCH_SIZE);
 
-		default:
-			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-			break;
+	if (gtk_text_iter_compare (&subregion_end, &chunk_end) < 0)
+	{
+		chunk_end = subregion_end;
 	}
+
+	regex_search_scan_chunk (search, &chunk_start, &chunk_end);
 }
 
 static void
-gtk_source_search_context_class_init (GtkSourceSearchContextClass *klass)
+parallel_scan_free (ParallelScan *scan)
 {
-	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	guint i;
 
-	object_class->dispose = gtk_source_search_context_dispose;
-	object_class->finalize = gtk_source_search_context_finalize;
-	object_class->get_property = gtk_source_search_context_get_property;
-	object_class->set_property = gtk_source_search_context_set_property;
+	for (i = 0; i < scan->nb_chunks; i++)
+	{
+		g_array_unref (scan->chunks[i].matches);
+		g_clear_error (&scan->chunks[i].error);
+	}
 
-	/**
-	 * GtkSourceSearchContext:buffer:
-	 *
-	 * The #GtkSourceBuffer associated to the search context.
-	 *
-	 * Since: 3.10
+	g_free (scan->chunks);
+	g_free (scan->text);
+	g_regex_unref (scan->regex);
+	g_clear_object (&scan->cancellable);
+	g_slice_free (ParallelScan, scan);
+}
+
+/* Returns the byte position of the start of the line after @pos, or the end of
+ * the text.
+ */
+static gsize
+parallel_scan_get_next_line_start (ParallelScan *scan,
+				   gsize         pos)
+{
+	const gchar *newline;
+
+	if (pos >= scan->text_length)
+	{
+		return scan->text_length;
+	}
+
+	newline = memchr (scan->text + pos, '\n', scan->text_length - pos);
+
+	if (newline == NULL)
+	{
+		return scan->text_length;
+	}
+
+	return newline - scan->text + 1;
+}
+
+/* The positions returned by GRegex are gints, so the subjects don't start at
+ * the beginning of the text, which can be longer than G_MAXINT bytes, but at
+ * the line range being scanned. Like regex_search_get_real_start(), the subject
+ * starts some characters before @pos for the lookbehinds.
+ */
+static gsize
+parallel_scan_get_subject_start (ParallelScan *scan,
+				 gsize         pos)
+{
+	const gchar *p = scan->text + pos;
+	gint i;
+
+	for (i = 0; i < scan->max_lookbehind && p > scan->text; i++)
+	{
+		p = g_utf8_prev_char (p);
+	}
+
+	return p - scan->text;
+}
+
+/* Same as regex_search_get_match_options(), for the subject [@subject_start;
+ * @limit[ in the text of @scan.
+ */
+static GRegexMatchFlags
+parallel_scan_get_match_options (ParallelScan *scan,
+				 gsize         subject_start,
+				 gsize         limit)
+{
+	GRegexMatchFlags match_options = 0;
+
+	if (subject_start > 0 &&
+	    scan->text[subject_start - 1] != '\n' &&
+	    scan->text[subject_start - 1] != '\r')
+	{
+		match_options |= G_REGEX_MATCH_NOTBOL;
+	}
+
+	if (limit < scan->text_length)
+	{
+		match_options |= G_REGEX_MATCH_PARTIAL_HARD;
+
+		if (scan->text[limit] != '\n' &&
+		    scan->text[limit] != '\r')
+		{
+			match_options |= G_REGEX_MATCH_NOTEOL;
+		}
+	}
+
+	return match_options;
+}
+
+/* Runs in a worker thread. */
+static void
+parallel_scan_chunk (ParallelScanChunk *chunk,
+		     ParallelScan      *scan)
+{
+	gsize subject_start = parallel_scan_get_subject_start (scan, chunk->start_byte);
+	gsize pos = chunk->start_byte;
+	gsize limit = chunk->limit_byte;
+	gsize max_limit = scan->text_length;
+	gsize cursor_byte = chunk->start_byte;
+	gint cursor_offset = 0;
+
+	if (scan->max_match_span > 0)
+	{
+		gint i;
+
+		/* A match starting on the last line of the chunk ends at
+		 * most max_match_span lines after the start of that line.
+		 */
+		max_limit = chunk->end_byte;
+
+		for (i = 1; i < scan->max_match_span && max_limit < scan->text_length; i++)
+		{
+			max_limit = parallel_scan_get_next_line_start (scan, max_limit);
+		}
+	}
+
+	max_limit = MIN (max_limit, subject_start + G_MAXINT);
+	limit = MIN (limit, max_limit);
+
+	while (TRUE)
+	{
+		GMatchInfo *match_info;
+		GRegexMatchFlags match_options;
+		gboolean chunk_finished = FALSE;
+		gboolean partial_match;
+		gsize subject_length;
+
+		match_options = parallel_scan_get_match_options (scan, subject_start, limit);
+
+		if (limit == max_limit)
+		{
+			match_options &= ~G_REGEX_MATCH_PARTIAL_HARD;
+		}
+
+		g_regex_match_full (scan->regex,
+				    scan->text + subject_start,
+				    limit - subject_start,
+				    pos - subject_start,
+				    match_options,
+				    &match_info,
+				    &chunk->error);
+
+		while (g_match_info_matches (match_info))
+		{
+			ParallelScanMatch match;
+			gint start_pos;
+			gint end_pos;
+
+			g_match_info_fetch_pos (match_info, 0, &start_pos, &end_pos);
+			match.start_byte = subject_start + start_pos;
+			match.end_byte = subject_start + end_pos;
+
+			if (match.start_byte >= chunk->end_byte)
+			{
+				chunk_finished = TRUE;
+				break;
+			}
+
+			match.start_offset = cursor_offset + g_utf8_strlen (scan->text + cursor_byte,
+									    match.start_byte - cursor_byte);
+			match.end_offset = match.start_offset + g_utf8_strlen (scan->text + match.start_byte,
+									       match.end_byte - match.start_byte);
+
+			cursor_byte = match.end_byte;
+			cursor_offset = match.end_offset;
+
+			g_array_append_val (chunk->matches, match);
+			pos = match.end_byte;
+
+			g_match_info_next (match_info, &chunk->error);
+		}
+
+		partial_match = !chunk_finished && g_match_info_is_partial_match (match_info);
+		g_match_info_free (match_info);
+
+		if (!partial_match || chunk->error != NULL)
+		{
+			break;
+		}
+
+		/* The match is longer than the overlap, try again from the end
+		 * of the last match with a subject twice as long.
+		 */
+		subject_length = limit - chunk->start_byte;
+
+		if (subject_length >= max_limit - limit)
+		{
+			limit = max_limit;
+		}
+		else
+		{
+			limit = parallel_scan_get_next_line_start (scan, limit + subject_length);
+			limit = MIN (limit, max_limit);
+		}
+	}
+
+	if (cursor_byte <= chunk->end_byte)
+	{
+		chunk->nb_chars = cursor_offset + g_utf8_strlen (scan->text + cursor_byte,
+								 chunk->end_byte - cursor_byte);
+	}
+	else
+	{
+		chunk->nb_chars = cursor_offset - g_utf8_strlen (scan->text + chunk->end_byte,
+								 cursor_byte - chunk->end_byte);
+	}
+}
+
+/* Runs in a worker thread. */
+static void
+parallel_scan_thread (gpointer data,
+		      gpointer user_data)
+{
+	ParallelScan *scan = user_data;
+	guint chunk_num = GPOINTER_TO_UINT (data) - 1;
+
+	if (!g_cancellable_is_cancelled (scan->cancellable))
+	{
+		parallel_scan_chunk (&scan->chunks[chunk_num], scan);
+	}
+
+	if (g_atomic_int_dec_and_test (&scan->nb_remaining_chunks))
+	{
+		GTask *task = scan->task;
+
+		scan->task = NULL;
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+	}
+}
+
+/* The last match of the previous chunk ends after the start of @chunk, at @pos.
+ * Find the matches from @pos sequentially, until a match is the same as one
+ * found by the worker thread. Returns the index of that match in the chunk, or
+ * the number of matches of the chunk if all the matches of the chunk have been
+ * found again.
+ */
+static guint
+parallel_scan_resync (ParallelScan      *scan,
+		      ParallelScanChunk *chunk,
+		      gsize             *pos,
+		      GArray            *matches)
+{
+	GMatchInfo *match_info;
+	gsize subject_start = parallel_scan_get_subject_start (scan, *pos);
+	gsize limit = MIN (scan->text_length, subject_start + G_MAXINT);
+	gsize cursor_byte = *pos;
+	gint cursor_offset;
+	guint chunk_match_num = 0;
+
+	g_assert (matches->len > 0);
+
+	cursor_offset = g_array_index (matches, ParallelScanMatch, matches->len - 1).end_offset;
+
+	g_regex_match_full (scan->regex,
+			    scan->text + subject_start,
+			    limit - subject_start,
+			    *pos - subject_start,
+			    parallel_scan_get_match_options (scan, subject_start, scan->text_length),
+			    &match_info,
+			    NULL);
+
+	while (g_match_info_matches (match_info))
+	{
+		ParallelScanMatch match;
+		gint start_pos;
+		gint end_pos;
+
+		g_match_info_fetch_pos (match_info, 0, &start_pos, &end_pos);
+		match.start_byte = subject_start + start_pos;
+		match.end_byte = subject_start + end_pos;
+
+		if (match.start_byte >= chunk->end_byte)
+		{
+			break;
+		}
+
+		while (chunk_match_num < chunk->matches->len &&
+		       g_array_index (chunk->matches, ParallelScanMatch, chunk_match_num).start_byte < match.start_byte)
+		{
+			chunk_match_num++;
+		}
+
+		if (chunk_match_num < chunk->matches->len)
+		{
+			ParallelScanMatch *chunk_match;
+
+			chunk_match = &g_array_index (chunk->matches, ParallelScanMatch, chunk_match_num);
+
+			if (chunk_match->start_byte == match.start_byte &&
+			    chunk_match->end_byte == match.end_byte)
+			{
+				/* From there, the scan is the same. */
+				g_match_info_free (match_info);
+				return chunk_match_num;
+			}
+		}
+
+		match.start_offset = cursor_offset + g_utf8_strlen (scan->text + cursor_byte,
+								    match.start_byte - cursor_byte);
+		match.end_offset = match.start_offset + g_utf8_strlen (scan->text + match.start_byte,
+								       match.end_byte - match.start_byte);
+
+		cursor_byte = match.end_byte;
+		cursor_offset = match.end_offset;
+
+		g_array_append_val (matches, match);
+		*pos = match.end_byte;
+
+		g_match_info_next (match_info, NULL);
+	}
+
+	g_match_info_free (match_info);
+	return chunk->matches->len;
+}
+
+/* Returns the matches of all the chunks, with absolute offsets, as if the text
+ * had been scanned sequentially.
+ */
+static GArray *
+parallel_scan_merge (ParallelScan *scan)
+{
+	GArray *matches;
+	gsize pos = 0;
+	gint chunk_offset = 0;
+	guint chunk_num;
+
+	matches = g_array_new (FALSE, FALSE, sizeof (ParallelScanMatch));
+
+	for (chunk_num = 0; chunk_num < scan->nb_chunks; chunk_num++)
+	{
+		ParallelScanChunk *chunk = &scan->chunks[chunk_num];
+		guint match_num = 0;
+
+		if (pos > chunk->start_byte)
+		{
+			match_num = parallel_scan_resync (scan, chunk, &pos, matches);
+		}
+
+		for (; match_num < chunk->matches->len; match_num++)
+		{
+			ParallelScanMatch match = g_array_index (chunk->matches, ParallelScanMatch, match_num);
+
+			match.start_offset += chunk_offset;
+			match.end_offset += chunk_offset;
+
+			g_array_append_val (matches, match);
+			pos = match.end_byte;
+		}
+
+		chunk_offset += chunk->nb_chars;
+	}
+
+	return matches;
+}
+
+/* Highlights the matches found by the parallel scan, in the part of the buffer
+ * that is not yet scanned.
+ */
+static void
+parallel_scan_apply (GtkSourceSearchContext *search,
+		     ParallelScan           *scan)
+{
+	GtkTextIter region_start;
+	GtkTextIter buffer_end;
+	GArray *matches;
+	gint region_start_offset;
+	guint i;
+
+	if (!gtk_source_region_get_bounds (search->priv->scan_region, &region_start, NULL))
+	{
+		return;
+	}
+
+	/* The regex search scans the buffer from its start, so what has
+	 * already been scanned is before region_start.
+	 */
+	region_start_offset = gtk_text_iter_get_offset (&region_start);
+	gtk_text_buffer_get_end_iter (search->priv->buffer, &buffer_end);
+
+	clear_occurrences_in_range (search, &region_start, &buffer_end);
+
+	matches = parallel_scan_merge (scan);
+
+	for (i = 0; i < matches->len; i++)
+	{
+		ParallelScanMatch *match = &g_array_index (matches, ParallelScanMatch, i);
+		GtkTextIter match_start;
+		GtkTextIter match_end;
+
+		if (match->start_offset < region_start_offset)
+		{
+			continue;
+		}
+
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &match_start, match->start_offset);
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &match_end, match->end_offset);
+
+		regex_search_add_occurrence (search, &match_start, &match_end);
+	}
+
+	g_array_unref (matches);
+
+	gtk_source_region_subtract_subregion (search->priv->scan_region,
+					      &region_start,
+					      &buffer_end);
+
+	if (search->priv->task_region != NULL)
+	{
+		gtk_source_region_subtract_subregion (search->priv->task_region,
+						      &region_start,
+						      &buffer_end);
+	}
+}
+
+static void
+parallel_scan_finished_cb (GObject      *source_object,
+			   GAsyncResult *result,
+			   gpointer      user_data)
+{
+	GtkSourceSearchContext *search = GTK_SOURCE_SEARCH_CONTEXT (source_object);
+	GTask *task = G_TASK (result);
+	ParallelScan *scan = g_task_get_task_data (task);
+	guint i;
+
+	if (task != search->priv->parallel_scan_task)
+	{
+		/* Cancelled. */
+		return;
+	}
+
+	g_clear_object (&search->priv->parallel_scan_task);
+
+	if (search->priv->buffer == NULL ||
+	    search->priv->scan_region == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < scan->nb_chunks; i++)
+	{
+		if (scan->chunks[i].error != NULL)
+		{
+			/* The scan in the main thread will report the error. */
+			install_idle_scan (search);
+			return;
+		}
+	}
+
+	parallel_scan_apply (search, scan);
+
+	/* To notify the occurrences count and resume the task. */
+	install_idle_scan (search);
+}
+
+/* Starts the scan of the whole buffer in worker threads. The regex search must
+ * be enabled and the regex valid.
+ */
+static void
+regex_search_start_parallel_scan (GtkSourceSearchContext *search)
+{
+	ParallelScan *scan;
+	GThreadPool *pool;
+	GCancellable *cancellable;
+	GArray *chunks;
+	GtkTextTagTable *tag_table;
+	GtkTextIter start;
+	GtkTextIter end;
+	guint nb_threads;
+	gsize chunk_size;
+	gsize pos;
+	gboolean has_invisible_tag = FALSE;
+	gboolean too_long = FALSE;
+	guint i;
+
+	g_assert (search->priv->parallel_scan_task == NULL);
+
+	nb_threads = _gtk_source_utils_get_nb_search_threads ();
+
+	if (nb_threads == 0 ||
+	    gtk_text_buffer_get_line_count (search->priv->buffer) < PARALLEL_SCAN_MIN_LINES)
+	{
+		return;
+	}
+
+	tag_table = gtk_text_buffer_get_tag_table (search->priv->buffer);
+	gtk_text_tag_table_foreach (tag_table, check_invisible_tag, &has_invisible_tag);
+
+	if (has_invisible_tag)
+	{
+		return;
+	}
+
+	scan = g_slice_new0 (ParallelScan);
+	scan->regex = g_regex_ref (search->priv->regex);
+	scan->max_lookbehind = g_regex_get_max_lookbehind (scan->regex);
+	scan->max_match_span = gtk_source_search_settings_get_max_match_span (search->priv->settings);
+
+	/* With the slice, the character offsets are buffer offsets. */
+	gtk_text_buffer_get_bounds (search->priv->buffer, &start, &end);
+	scan->text = gtk_text_iter_get_slice (&start, &end);
+	scan->text_length = strlen (scan->text);
+
+	/* The pixbufs and child anchors are not in the visible text. */
+	if (strstr (scan->text, "\xef\xbf\xbc") != NULL)
+	{
+		parallel_scan_free (scan);
+		return;
+	}
+
+	chunks = g_array_new (FALSE, TRUE, sizeof (ParallelScanChunk));
+	chunk_size = scan->text_length / (nb_threads * PARALLEL_SCAN_CHUNKS_PER_THREAD);
+	chunk_size = CLAMP (chunk_size, 1, PARALLEL_SCAN_MAX_CHUNK_SIZE);
+
+	for (pos = 0; pos < scan->text_length; )
+	{
+		ParallelScanChunk chunk = { 0 };
+
+		chunk.start_byte = pos;
+		chunk.end_byte = parallel_scan_get_next_line_start (scan, pos + chunk_size - 1);
+		chunk.limit_byte = parallel_scan_get_next_line_start (scan, chunk.end_byte + PARALLEL_SCAN_OVERLAP);
+		chunk.matches = g_array_new (FALSE, FALSE, sizeof (ParallelScanMatch));
+
+		g_array_append_val (chunks, chunk);
+		pos = chunk.end_byte;
+
+		/* The matches of a chunk must be found in a subject shorter
+		 * than G_MAXINT bytes. With such a long line, the buffer is
+		 * scanned in the main thread only.
+		 */
+		if (chunk.end_byte - chunk.start_byte > G_MAXINT / 2)
+		{
+			too_long = TRUE;
+			break;
+		}
+	}
+
+	scan->nb_chunks = chunks->len;
+	scan->nb_remaining_chunks = chunks->len;
+	scan->chunks = (ParallelScanChunk *) g_array_free (chunks, FALSE);
+
+	if (scan->nb_chunks == 0 || too_long)
+	{
+		parallel_scan_free (scan);
+		return;
+	}
+
+	cancellable = g_cancellable_new ();
+	scan->cancellable = g_object_ref (cancellable);
+
+	search->priv->parallel_scan_task = g_task_new (search,
+						       cancellable,
+						       parallel_scan_finished_cb,
+						       NULL);
+
+	g_task_set_task_data (search->priv->parallel_scan_task,
+			      scan,
+			      (GDestroyNotify) parallel_scan_free);
+
+	scan->task = g_object_ref (search->priv->parallel_scan_task);
+
+	pool = g_thread_pool_new ((GFunc) parallel_scan_thread,
+				  scan,
+				  nb_threads,
+				  FALSE,
+				  NULL);
+
+	for (i = 0; i < scan->nb_chunks; i++)
+	{
+		g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+	}
+
+	/* The queued chunks are still scanned, the threads exit afterwards. */
+	g_thread_pool_free (pool, FALSE, FALSE);
+
+	g_object_unref (cancellable);
+}
+
+static gboolean
+idle_scan_regex_search (GtkSourceSearchContext *search)
+{
+	if (search->priv->high_priority_region != NULL)
+	{
+		regex_search_handle_high_priority_region (search);
+		g_clear_object (&search->priv->high_priority_region);
+		return G_SOURCE_CONTINUE;
+	}
+
+	if (search->priv->parallel_scan_task != NULL &&
+	    search->priv->task == NULL)
+	{
+		/* The idle scan is installed again when the parallel scan is
+		 * finished.
+		 */
+		search->priv->idle_scan_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	regex_search_scan_next_chunk (search);
+
+	if (search->priv->task != NULL)
+	{
+		/* Always resume the task, even if the task region has not been
+		 * fully scanned. The task region can be huge (the whole
+		 * buffer), and an occurrence can be found earlier. Obviously it
+		 * would be better to resume the task only if an occurrence has
+		 * been found in the task region. But it would be a little more
+		 * complicated to implement, for not a big performance
+		 * improvement.
+		 */
+		resume_task (search);
+		return G_SOURCE_CONTINUE;
+	}
+
+	if (gtk_source_region_is_empty (search->priv->scan_region))
+	{
+		search->priv->idle_scan_id = 0;
+
+		g_object_notify (G_OBJECT (search), "occurrences-count");
+
+		g_clear_object (&search->priv->scan_region);
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+idle_scan_cb (GtkSourceSearchContext *search)
+{
+	if (search->priv->buffer == NULL)
+	{
+		search->priv->idle_scan_id = 0;
+		clear_search (search);
+		return G_SOURCE_REMOVE;
+	}
+
+	return gtk_source_search_settings_get_regex_enabled (search->priv->settings) ?
+	       idle_scan_regex_search (search) :
+	       idle_scan_normal_search (search);
+}
+
+static void
+install_idle_scan (GtkSourceSearchContext *search)
+{
+	if (search->priv->idle_scan_id == 0)
+	{
+		search->priv->idle_scan_id = g_idle_add ((GSourceFunc)idle_scan_cb, search);
+	}
+}
+
+/* Returns TRUE when finished. */
+static gboolean
+smart_forward_search_step (GtkSourceSearchContext *search,
+			   GtkTextIter            *start_at,
+			   GtkTextIter            *match_start,
+			   GtkTextIter            *match_end)
+{
+	GtkTextIter limit;
+	OffsetRange next;
+	gboolean found_next;
+	GtkSourceRegion *region = NULL;
+
+	found_next = get_next_occurrence (search, gtk_text_iter_get_offset (start_at), &next);
+
+	if (found_next)
+	{
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &limit, next.end);
+	}
+	else
+	{
+		gtk_text_buffer_get_end_iter (search->priv->buffer, &limit);
+	}
+
+	if (search->priv->scan_region != NULL)
+	{
+		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
+								start_at,
+								&limit);
+	}
+
+	if (gtk_source_region_is_empty (region))
+	{
+		g_clear_object (&region);
+
+		if (found_next)
+		{
+			get_occurrence_iters (search, &next, match_start, match_end);
+			return TRUE;
+		}
+
+		*start_at = limit;
+		return FALSE;
+	}
+
+	/* Scan a chunk of the buffer, not the whole 'region'. An occurrence can
+	 * be found before the 'region' is scanned entirely.
+	 */
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	{
+		regex_search_scan_next_chunk (search);
+	}
+	else
+	{
+		scan_region_forward (search, region);
+	}
+
+	g_clear_object (&region);
+
+	return FALSE;
+}
+
+/* Doesn't wrap around. */
+static gboolean
+smart_forward_search (GtkSourceSearchContext *search,
+		      const GtkTextIter      *start_at,
+		      GtkTextIter            *match_start,
+		      GtkTextIter            *match_end)
+{
+	GtkTextIter iter = *start_at;
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+
+	g_return_val_if_fail (match_start != NULL, FALSE);
+	g_return_val_if_fail (match_end != NULL, FALSE);
+
+	if (search_text == NULL)
+	{
+		return FALSE;
+	}
+
+	while (!gtk_text_iter_is_end (&iter))
+	{
+		if (smart_forward_search_step (search, &iter, match_start, match_end))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Returns TRUE when finished. */
+static gboolean
+smart_backward_search_step (GtkSourceSearchContext *search,
+			    GtkTextIter            *start_at,
+			    GtkTextIter            *match_start,
+			    GtkTextIter            *match_end)
+{
+	GtkTextIter limit;
+	OffsetRange prev;
+	gboolean found_prev;
+	GtkSourceRegion *region = NULL;
+
+	found_prev = get_previous_occurrence (search, gtk_text_iter_get_offset (start_at), &prev);
+
+	if (found_prev)
+	{
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &limit, prev.start);
+	}
+	else
+	{
+		gtk_text_buffer_get_start_iter (search->priv->buffer, &limit);
+	}
+
+	if (search->priv->scan_region != NULL)
+	{
+		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
+								&limit,
+								start_at);
+	}
+
+	if (gtk_source_region_is_empty (region))
+	{
+		g_clear_object (&region);
+
+		if (found_prev)
+		{
+			get_occurrence_iters (search, &prev, match_start, match_end);
+			return TRUE;
+		}
+
+		*start_at = limit;
+		return FALSE;
+	}
+
+	/* Scan a chunk of the buffer, not the whole 'region'. An occurrence can
+	 * be found before the 'region' is scanned entirely.
+	 */
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	{
+		regex_search_scan_next_chunk (search);
+	}
+	else
+	{
+		scan_region_forward (search, region);
+	}
+
+	g_clear_object (&region);
+
+	return FALSE;
+}
+
+/* Doesn't wrap around. */
+static gboolean
+smart_backward_search (GtkSourceSearchContext *search,
+		       const GtkTextIter      *start_at,
+		       GtkTextIter            *match_start,
+		       GtkTextIter            *match_end)
+{
+	GtkTextIter iter = *start_at;
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+
+	g_return_val_if_fail (match_start != NULL, FALSE);
+	g_return_val_if_fail (match_end != NULL, FALSE);
+
+	if (search_text == NULL)
+	{
+		return FALSE;
+	}
+
+	while (!gtk_text_iter_is_start (&iter))
+	{
+		if (smart_backward_search_step (search, &iter, match_start, match_end))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+add_subregion_to_scan (GtkSourceSearchContext *search,
+		       const GtkTextIter      *subregion_start,
+		       const GtkTextIter      *subregion_end)
+{
+	GtkTextIter start = *subregion_start;
+	GtkTextIter end = *subregion_end;
+
+	if (search->priv->scan_region == NULL)
+	{
+		search->priv->scan_region = gtk_source_region_new (search->priv->buffer);
+	}
+
+	DEBUG ({
+		g_print ("add_subregion_to_scan(): region to scan, before:\n");
+		print_region (search->priv->scan_region);
+	});
+
+	gtk_source_region_add_subregion (search->priv->scan_region, &start, &end);
+
+	DEBUG ({
+		g_print ("add_subregion_to_scan(): region to scan, after:\n");
+		print_region (search->priv->scan_region);
+	});
+
+	install_idle_scan (search);
+}
+
+#ifdef ENABLE_PCRE2_JIT
+static void
+clear_jit_regex (GtkSourceSearchContext *search)
+{
+	if (search->priv->jit_match_data != NULL)
+	{
+		pcre2_match_data_free (search->priv->jit_match_data);
+		search->priv->jit_match_data = NULL;
+	}
+
+	if (search->priv->jit_code != NULL)
+	{
+		pcre2_code_free (search->priv->jit_code);
+		search->priv->jit_code = NULL;
+	}
+}
+
+static void
+compile_jit_regex (GtkSourceSearchContext *search,
+		   const gchar            *pattern,
+		   GRegexCompileFlags      compile_flags)
+{
+	search->priv->jit_code = _gtk_source_regex_jit_compile (pattern,
+								compile_flags,
+								PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_HARD);
+
+	if (search->priv->jit_code == NULL)
+	{
+		return;
+	}
+
+	search->priv->jit_match_data = pcre2_match_data_create_from_pattern (search->priv->jit_code, NULL);
+
+	/* The match context and its JIT stack are kept for the lifetime of the
+	 * search context. The default JIT stack of 32 KB is too small for
+	 * patterns like "(.*\n)*".
+	 */
+	if (search->priv->jit_match_context == NULL)
+	{
+		search->priv->jit_match_context = pcre2_match_context_create (NULL);
+		search->priv->jit_stack = pcre2_jit_stack_create (32 * 1024, 1024 * 1024, NULL);
+		pcre2_jit_stack_assign (search->priv->jit_match_context, NULL, search->priv->jit_stack);
+	}
+}
+#endif
+
+static void
+update_regex (GtkSourceSearchContext *search)
+{
+	gboolean regex_error_changed = FALSE;
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+
+	if (search->priv->regex != NULL)
+	{
+		g_regex_unref (search->priv->regex);
+		search->priv->regex = NULL;
+	}
+
+#ifdef ENABLE_PCRE2_JIT
+	clear_jit_regex (search);
+#endif
+
+	if (search->priv->regex_error != NULL)
+	{
+		g_clear_error (&search->priv->regex_error);
+		regex_error_changed = TRUE;
+	}
+
+	if (search_text != NULL &&
+	    gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	{
+		GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE | G_REGEX_MULTILINE;
+		gchar *pattern = (gchar *)search_text;
+
+		search->priv->text_nb_lines = 0;
+
+		if (!gtk_source_search_settings_get_case_sensitive (search->priv->settings))
+		{
+			compile_flags |= G_REGEX_CASELESS;
+		}
+
+		if (gtk_source_search_settings_get_at_word_boundaries (search->priv->settings))
+		{
+			pattern = g_strdup_printf ("\\b%s\\b", search_text);
+		}
+
+		search->priv->regex = g_regex_new (pattern,
+						   compile_flags,
+						   G_REGEX_MATCH_NOTEMPTY,
+						   &search->priv->regex_error);
+
+		if (search->priv->regex_error != NULL)
+		{
+			regex_error_changed = TRUE;
+		}
+#ifdef ENABLE_PCRE2_JIT
+		else
+		{
+			compile_jit_regex (search, pattern, compile_flags);
+		}
+#endif
+
+		if (gtk_source_search_settings_get_at_word_boundaries (search->priv->settings))
+		{
+			g_free (pattern);
+		}
+	}
+
+	if (regex_error_changed)
+	{
+		g_object_notify (G_OBJECT (search), "regex-error");
+	}
+}
+
+/* Search-as-you-type:
+ *
+ * When the user types the search text, each new text extends the previous one
+ * most of the time. If the previous search text can not overlap itself (it
+ * doesn't end with one of its prefixes), its occurrences are all the places
+ * where it appears in the buffer. So each occurrence of the new search text
+ * starts at an occurrence of the previous one, and the new occurrences are
+ * found by checking only the previous ones, instead of scanning the whole
+ * buffer again. The results of the previous search text are kept, so when a
+ * character is removed at the end of the search text, they are restored.
+ *
+ * It is done only when the previous scan is finished, for a case-sensitive
+ * search of a text on one line, without the regex and at-word-boundaries
+ * options. Any change in the buffer or in the other settings discards the
+ * kept results.
+ */
+
+static void
+incremental_snapshot_free (IncrementalSnapshot *snapshot)
+{
+	g_free (snapshot->search_text);
+	g_array_free (snapshot->occurrences, TRUE);
+	g_slice_free (IncrementalSnapshot, snapshot);
+}
+
+static void
+clear_incremental_snapshots (GtkSourceSearchContext *search)
+{
+	IncrementalSnapshot *snapshot;
+
+	while ((snapshot = g_queue_pop_head (&search->priv->incremental_snapshots)) != NULL)
+	{
+		incremental_snapshot_free (snapshot);
+	}
+}
+
+static GArray *
+get_occurrences (GtkSourceSearchContext *search)
+{
+	GArray *occurrences;
+	GtkSourceOccurrencesIter iter;
+
+	occurrences = g_array_sized_new (FALSE,
+					 FALSE,
+					 sizeof (OffsetRange),
+					 _gtk_source_occurrences_index_get_length (search->priv->occurrences_index));
+
+	for (_gtk_source_occurrences_index_iter_at_offset (search->priv->occurrences_index, &iter, 0);
+	     !_gtk_source_occurrences_index_iter_is_end (&iter);
+	     _gtk_source_occurrences_index_iter_next (&iter))
+	{
+		OffsetRange occurrence;
+
+		_gtk_source_occurrences_index_iter_get (&iter, &occurrence.start, &occurrence.end);
+		g_array_append_val (occurrences, occurrence);
+	}
+
+	return occurrences;
+}
+
+/* Replaces the occurrences by @occurrences, sorted, for a buffer that is
+ * entirely scanned.
+ */
+static void
+set_occurrences (GtkSourceSearchContext *search,
+		 GArray                 *occurrences)
+{
+	guint i;
+
+	untag_range (search, 0, G_MAXINT);
+	_gtk_source_occurrences_index_clear (search->priv->occurrences_index);
+
+	for (i = 0; i < occurrences->len; i++)
+	{
+		OffsetRange *occurrence = &g_array_index (occurrences, OffsetRange, i);
+
+		_gtk_source_occurrences_index_add (search->priv->occurrences_index,
+						   occurrence->start,
+						   occurrence->end);
+		tag_occurrence (search, occurrence);
+	}
+
+	search->priv->occurrences_count = occurrences->len;
+	g_object_notify (G_OBJECT (search), "occurrences-count");
+}
+
+/* Returns whether @text can overlap itself, i.e. if a proper prefix of @text is
+ * also a suffix.
+ */
+static gboolean
+text_can_overlap (const gchar *text)
+{
+	gsize length = strlen (text);
+	gsize i;
+
+	for (i = 1; i < length; i++)
+	{
+		if (memcmp (text, text + length - i, i) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gboolean
+incremental_search_is_possible (GtkSourceSearchContext *search)
+{
+	return (search->priv->buffer != NULL &&
+		search->priv->indexed_search_text != NULL &&
+		search->priv->task == NULL &&
+		gtk_source_region_is_empty (search->priv->scan_region) &&
+		search->priv->literal_single_line &&
+		gtk_source_search_settings_get_case_sensitive (search->priv->settings) &&
+		!gtk_source_search_settings_get_at_word_boundaries (search->priv->settings) &&
+		!gtk_source_search_settings_get_regex_enabled (search->priv->settings));
+}
+
+/* Compares the text at @iter with @suffix, character by character. Returns
+ * FALSE if it is different, and sets @iter to the end of @suffix otherwise.
+ * Sets @skipped_char if a pixbuf or a child anchor was found, since the search
+ * doesn't see them.
+ */
+static gboolean
+incremental_search_forward_suffix (GtkTextIter *iter,
+				   const gchar *suffix,
+				   gboolean    *skipped_char)
+{
+	const gchar *p;
+
+	*skipped_char = FALSE;
+
+	for (p = suffix; *p != '\0'; p = g_utf8_next_char (p))
+	{
+		gunichar c = gtk_text_iter_get_char (iter);
+
+		if (c == GTK_TEXT_UNKNOWN_CHAR)
+		{
+			*skipped_char = TRUE;
+			return FALSE;
+		}
+
+		if (c != g_utf8_get_char (p))
+		{
+			return FALSE;
+		}
+
+		gtk_text_iter_forward_char (iter);
+	}
+
+	return TRUE;
+}
+
+/* Returns the occurrences of the search text, from @previous_occurrences, the
+ * occurrences of a prefix of the search text. @suffix is the rest of the
+ * search text.
+ */
+static GArray *
+incremental_search_refine (GtkSourceSearchContext *search,
+			   GArray                 *previous_occurrences,
+			   const gchar            *suffix)
+{
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+	GtkTextSearchFlags flags = get_text_search_flags (search);
+	GtkTextTagTable *tag_table;
+	gboolean has_invisible_tag = FALSE;
+	GArray *occurrences;
+	gint prev_match_end = 0;
+	guint i;
+
+	occurrences = g_array_new (FALSE, FALSE, sizeof (OffsetRange));
+
+	/* With invisible text, an occurrence can be longer than the search
+	 * text, so the occurrences are searched again in their line.
+	 */
+	tag_table = gtk_text_buffer_get_tag_table (search->priv->buffer);
+	gtk_text_tag_table_foreach (tag_table, check_invisible_tag, &has_invisible_tag);
+
+	for (i = 0; i < previous_occurrences->len; i++)
+	{
+		OffsetRange *previous = &g_array_index (previous_occurrences, OffsetRange, i);
+		OffsetRange occurrence;
+		GtkTextIter start;
+		GtkTextIter limit;
+		GtkTextIter match_start;
+		GtkTextIter match_end;
+		gboolean skipped_char = TRUE;
+
+		/* The occurrences don't overlap. */
+		if (previous->start < prev_match_end)
+		{
+			continue;
+		}
+
+		if (!has_invisible_tag)
+		{
+			/* The occurrence starts with the previous one, only
+			 * the characters after it need to be compared.
+			 */
+			gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &match_end, previous->end);
+
+			if (!incremental_search_forward_suffix (&match_end, suffix, &skipped_char) &&
+			    !skipped_char)
+			{
+				continue;
+			}
+		}
+
+		if (skipped_char)
+		{
+			gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &start, previous->start);
+
+			limit = start;
+			if (!gtk_text_iter_ends_line (&limit))
+			{
+				gtk_text_iter_forward_to_line_end (&limit);
+			}
+
+			if (!gtk_text_iter_forward_search (&start, search_text, flags, &match_start, &match_end, &limit) ||
+			    !gtk_text_iter_equal (&start, &match_start))
+			{
+				continue;
+			}
+		}
+
+		occurrence.start = previous->start;
+		occurrence.end = gtk_text_iter_get_offset (&match_end);
+		g_array_append_val (occurrences, occurrence);
+
+		prev_match_end = occurrence.end;
+	}
+
+	return occurrences;
+}
+
+/* Updates the occurrences from the previous ones when the search text has
+ * changed. Returns FALSE if the buffer must be scanned again.
+ */
+static gboolean
+incremental_search_update (GtkSourceSearchContext *search)
+{
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+	const gchar *previous_text = search->priv->indexed_search_text;
+	IncrementalSnapshot *snapshot;
+	GArray *occurrences;
+
+	if (search_text == NULL ||
+	    !incremental_search_is_possible (search))
+	{
+		return FALSE;
+	}
+
+	/* A character has been removed: restore the results of that search
+	 * text, if they are kept.
+	 */
+	while ((snapshot = g_queue_peek_head (&search->priv->incremental_snapshots)) != NULL)
+	{
+		if (strlen (snapshot->search_text) <= strlen (search_text))
+		{
+			break;
+		}
+
+		incremental_snapshot_free (g_queue_pop_head (&search->priv->incremental_snapshots));
+	}
+
+	if (snapshot != NULL && g_str_equal (snapshot->search_text, search_text))
+	{
+		g_queue_pop_head (&search->priv->incremental_snapshots);
+
+		set_occurrences (search, snapshot->occurrences);
+
+		g_free (search->priv->indexed_search_text);
+		search->priv->indexed_search_text = g_strdup (search_text);
+
+		incremental_snapshot_free (snapshot);
+		return TRUE;
+	}
+
+	/* The search text has been extended. */
+	if (!g_str_has_prefix (search_text, previous_text) ||
+	    g_str_equal (search_text, previous_text) ||
+	    previous_text[0] == '\0' ||
+	    text_can_overlap (previous_text))
+	{
+		return FALSE;
+	}
+
+	snapshot = g_slice_new (IncrementalSnapshot);
+	snapshot->search_text = g_strdup (previous_text);
+	snapshot->occurrences = get_occurrences (search);
+
+	occurrences = incremental_search_refine (search,
+						 snapshot->occurrences,
+						 search_text + strlen (previous_text));
+	set_occurrences (search, occurrences);
+	g_array_free (occurrences, TRUE);
+
+	g_queue_push_head (&search->priv->incremental_snapshots, snapshot);
+
+	if (g_queue_get_length (&search->priv->incremental_snapshots) > MAX_INCREMENTAL_SNAPSHOTS)
+	{
+		incremental_snapshot_free (g_queue_pop_tail (&search->priv->incremental_snapshots));
+	}
+
+	g_free (search->priv->indexed_search_text);
+	search->priv->indexed_search_text = g_strdup (search_text);
+
+	return TRUE;
+}
+
+static void
+update (GtkSourceSearchContext *search)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	GtkSourceBufferInternal *buffer_internal;
+
+	if (search->priv->buffer == NULL)
+	{
+		return;
+	}
+
+	clear_search (search);
+	update_regex (search);
+
+	clear_incremental_snapshots (search);
+	g_free (search->priv->indexed_search_text);
+	search->priv->indexed_search_text = g_strdup (gtk_source_search_settings_get_search_text (search->priv->settings));
+
+	search->priv->scan_region = gtk_source_region_new (search->priv->buffer);
+
+	gtk_text_buffer_get_bounds (search->priv->buffer, &start, &end);
+	add_subregion_to_scan (search, &start, &end);
+
+	if (search->priv->regex != NULL &&
+	    search->priv->regex_error == NULL)
+	{
+		regex_search_start_parallel_scan (search);
+	}
+
+	/* Notify the GtkSourceViews that the search is starting, so that
+	 * _gtk_source_search_context_update_highlight() can be called for the
+	 * visible regions of the buffer.
+	 */
+	buffer_internal = _gtk_source_buffer_internal_get_from_buffer (GTK_SOURCE_BUFFER (search->priv->buffer));
+	_gtk_source_buffer_internal_emit_search_start (buffer_internal, search);
+}
+
+static void
+insert_text_before_cb (GtkSourceSearchContext *search,
+		       GtkTextIter            *location,
+		       gchar                  *text,
+		       gint                    length)
+{
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+
+	search->priv->buffer_stamp++;
+	clear_task (search);
+	clear_parallel_scan (search);
+	clear_incremental_snapshots (search);
+
+	if (search_text != NULL)
+	{
+		GtkTextIter start = *location;
+		GtkTextIter end = *location;
+
+		remove_occurrences_in_range (search, &start, &end);
+		add_subregion_to_scan (search, &start, &end);
+	}
+}
+
+static void
+insert_text_after_cb (GtkSourceSearchContext *search,
+		      GtkTextIter            *location,
+		      gchar                  *text,
+		      gint                    length)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	glong nb_chars;
+
+	start = end = *location;
+
+	nb_chars = g_utf8_strlen (text, length);
+	gtk_text_iter_backward_chars (&start, nb_chars);
+
+	tagged_ranges_insert_text (search, gtk_text_iter_get_offset (&start), nb_chars);
+
+	_gtk_source_occurrences_index_shift (search->priv->occurrences_index,
+					     gtk_text_iter_get_offset (&start),
+					     nb_chars);
+
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	{
+		/* The inserted text can modify the matches of the
+		 * neighbouring lines, see the "Regex search" section above.
+		 */
+		gint nb_lines = regex_search_get_nb_context_lines (search);
+
+		gtk_text_iter_backward_lines (&start, nb_lines);
+		gtk_text_iter_forward_lines (&end, nb_lines);
+
+		remove_occurrences_in_range (search, &start, &end);
+	}
+
+	add_subregion_to_scan (search, &start, &end);
+}
+
+static void
+delete_range_before_cb (GtkSourceSearchContext *search,
+			GtkTextIter            *delete_start,
+			GtkTextIter            *delete_end)
+{
+	GtkTextIter start_buffer;
+	GtkTextIter end_buffer;
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->priv->settings);
+
+	search->priv->buffer_stamp++;
+	clear_task (search);
+	clear_parallel_scan (search);
+	clear_incremental_snapshots (search);
+
+	tagged_ranges_delete_text (search,
+				   gtk_text_iter_get_offset (delete_start),
+				   gtk_text_iter_get_offset (delete_end));
+
+	gtk_text_buffer_get_bounds (search->priv->buffer, &start_buffer, &end_buffer);
+
+	if (gtk_text_iter_equal (delete_start, &start_buffer) &&
+	    gtk_text_iter_equal (delete_end, &end_buffer))
+	{
+		/* Special case when removing all the text. */
+		search->priv->occurrences_count = 0;
+		_gtk_source_occurrences_index_clear (search->priv->occurrences_index);
+		return;
+	}
+
+	if (search_text != NULL)
+	{
+		GtkTextIter start = *delete_start;
+		GtkTextIter end = *delete_end;
+		gint nb_lines = search->priv->text_nb_lines;
+
+		if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+		{
+			nb_lines = regex_search_get_nb_context_lines (search);
+		}
+
+		gtk_text_iter_backward_lines (&start, nb_lines);
+		gtk_text_iter_forward_lines (&end, nb_lines);
+
+		remove_occurrences_in_range (search, &start, &end);
+		add_subregion_to_scan (search, &start, &end);
+	}
+
+	_gtk_source_occurrences_index_remove (search->priv->occurrences_index,
+					      gtk_text_iter_get_offset (delete_start),
+					      gtk_text_iter_get_offset (delete_end));
+	_gtk_source_occurrences_index_shift (search->priv->occurrences_index,
+					     gtk_text_iter_get_offset (delete_end),
+					     gtk_text_iter_get_offset (delete_start) - gtk_text_iter_get_offset (delete_end));
+}
+
+static void
+delete_range_after_cb (GtkSourceSearchContext *search,
+		       GtkTextIter            *start,
+		       GtkTextIter            *end)
+{
+	add_subregion_to_scan (search, start, end);
+}
+
+static void
+set_buffer (GtkSourceSearchContext *search,
+	    GtkSourceBuffer        *buffer)
+{
+	g_assert (search->priv->buffer == NULL);
+	g_assert (search->priv->tag_table == NULL);
+
+	search->priv->buffer = GTK_TEXT_BUFFER (buffer);
+
+	g_object_add_weak_pointer (G_OBJECT (buffer),
+				   (gpointer *)&search->priv->buffer);
+
+	search->priv->tag_table = gtk_text_buffer_get_tag_table (search->priv->buffer);
+	g_object_ref (search->priv->tag_table);
+
+	g_signal_connect_object (buffer,
+				 "insert-text",
+				 G_CALLBACK (insert_text_before_cb),
+				 search,
+				 G_CONNECT_SWAPPED);
+
+	g_signal_connect_object (buffer,
+				 "insert-text",
+				 G_CALLBACK (insert_text_after_cb),
+				 search,
+				 G_CONNECT_AFTER | G_CONNECT_SWAPPED);
+
+	g_signal_connect_object (buffer,
+				 "delete-range",
+				 G_CALLBACK (delete_range_before_cb),
+				 search,
+				 G_CONNECT_SWAPPED);
+
+	g_signal_connect_object (buffer,
+				 "delete-range",
+				 G_CALLBACK (delete_range_after_cb),
+				 search,
+				 G_CONNECT_AFTER | G_CONNECT_SWAPPED);
+
+	search->priv->found_tag = gtk_text_buffer_create_tag (search->priv->buffer, NULL, NULL);
+	g_object_ref (search->priv->found_tag);
+
+	sync_found_tag (search);
+
+	g_signal_connect_object (search->priv->buffer,
+				 "notify::style-scheme",
+				 G_CALLBACK (sync_found_tag),
+				 search,
+				 G_CONNECT_SWAPPED);
+
+	_gtk_source_buffer_add_search_context (buffer, search);
+}
+
+static void
+search_text_updated (GtkSourceSearchContext *search)
+{
+	literal_search_init (search, gtk_source_search_settings_get_search_text (search->priv->settings));
+
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
+	{
+		search->priv->text_nb_lines = 0;
+	}
+	else
+	{
+		const gchar *text = gtk_source_search_settings_get_search_text (search->priv->settings);
+		search->priv->text_nb_lines = compute_number_of_lines (text);
+	}
+}
+
+static void
+settings_notify_cb (GtkSourceSearchContext  *search,
+		    GParamSpec              *pspec,
+		    GtkSourceSearchSettings *settings)
+{
+	const gchar *property = g_param_spec_get_name (pspec);
+
+	search->priv->settings_stamp++;
+
+	if (g_str_equal (property, "search-text"))
+	{
+		search_text_updated (search);
+
+		if (incremental_search_update (search))
+		{
+			return;
+		}
+	}
+
+	update (search);
+}
+
+static void
+set_settings (GtkSourceSearchContext  *search,
+	      GtkSourceSearchSettings *settings)
+{
+	g_assert (search->priv->settings == NULL);
+
+	if (settings != NULL)
+	{
+		search->priv->settings = g_object_ref (settings);
+	}
+	else
+	{
+		search->priv->settings = gtk_source_search_settings_new ();
+	}
+
+	g_signal_connect_object (search->priv->settings,
+				 "notify",
+				 G_CALLBACK (settings_notify_cb),
+				 search,
+				 G_CONNECT_SWAPPED);
+
+	search_text_updated (search);
+	update (search);
+
+	g_object_notify (G_OBJECT (search), "settings");
+}
+
+static void
+gtk_source_search_context_dispose (GObject *object)
+{
+	GtkSourceSearchContext *search = GTK_SOURCE_SEARCH_CONTEXT (object);
+
+	clear_search (search);
+
+	if (search->priv->found_tag != NULL &&
+	    search->priv->tag_table != NULL)
+	{
+		gtk_text_tag_table_remove (search->priv->tag_table,
+					   search->priv->found_tag);
+
+		g_clear_object (&search->priv->found_tag);
+		g_clear_object (&search->priv->tag_table);
+	}
+
+	if (search->priv->buffer != NULL)
+	{
+		g_object_remove_weak_pointer (G_OBJECT (search->priv->buffer),
+					      (gpointer *)&search->priv->buffer);
+
+		search->priv->buffer = NULL;
+	}
+
+	g_clear_object (&search->priv->settings);
+
+	G_OBJECT_CLASS (gtk_source_search_context_parent_class)->dispose (object);
+}
+
+static void
+gtk_source_search_context_finalize (GObject *object)
+{
+	GtkSourceSearchContext *search = GTK_SOURCE_SEARCH_CONTEXT (object);
+
+	if (search->priv->regex != NULL)
+	{
+		g_regex_unref (search->priv->regex);
+	}
+
+#ifdef ENABLE_PCRE2_JIT
+	clear_jit_regex (search);
+
+	if (search->priv->jit_match_context != NULL)
+	{
+		pcre2_match_context_free (search->priv->jit_match_context);
+		pcre2_jit_stack_free (search->priv->jit_stack);
+	}
+#endif
+
+	g_clear_error (&search->priv->regex_error);
+	_gtk_source_occurrences_index_free (search->priv->occurrences_index);
+	g_array_free (search->priv->tagged_ranges, TRUE);
+	g_free (search->priv->indexed_search_text);
+	clear_incremental_snapshots (search);
+	g_string_free (search->priv->regex_subject, TRUE);
+
+	G_OBJECT_CLASS (gtk_source_search_context_parent_class)->finalize (object);
+}
+
+static void
+gtk_source_search_context_get_property (GObject    *object,
+					guint       prop_id,
+					GValue     *value,
+					GParamSpec *pspec)
+{
+	GtkSourceSearchContext *search;
+
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (object));
+
+	search = GTK_SOURCE_SEARCH_CONTEXT (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			g_value_set_object (value, search->priv->buffer);
+			break;
+
+		case PROP_SETTINGS:
+			g_value_set_object (value, search->priv->settings);
+			break;
+
+		case PROP_HIGHLIGHT:
+			g_value_set_boolean (value, search->priv->highlight);
+			break;
+
+		case PROP_MATCH_STYLE:
+			g_value_set_object (value, search->priv->match_style);
+			break;
+
+		case PROP_OCCURRENCES_COUNT:
+			g_value_set_int (value, gtk_source_search_context_get_occurrences_count (search));
+			break;
+
+		case PROP_REGEX_ERROR:
+			g_value_set_pointer (value, gtk_source_search_context_get_regex_error (search));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtk_source_search_context_set_property (GObject      *object,
+					guint         prop_id,
+					const GValue *value,
+					GParamSpec   *pspec)
+{
+	GtkSourceSearchContext *search;
+
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (object));
+
+	search = GTK_SOURCE_SEARCH_CONTEXT (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			set_buffer (search, g_value_get_object (value));
+			break;
+
+		case PROP_SETTINGS:
+			set_settings (search, g_value_get_object (value));
+			break;
+
+		case PROP_HIGHLIGHT:
+			gtk_source_search_context_set_highlight (search, g_value_get_boolean (value));
+			break;
+
+		case PROP_MATCH_STYLE:
+			gtk_source_search_context_set_match_style (search, g_value_get_object (value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtk_source_search_context_class_init (GtkSourceSearchContextClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->dispose = gtk_source_search_context_dispose;
+	object_class->finalize = gtk_source_search_context_finalize;
+	object_class->get_property = gtk_source_search_context_get_property;
+	object_class->set_property = gtk_source_search_context_set_property;
+
+	/**
+	 * GtkSourceSearchContext:buffer:
+	 *
+	 * The #GtkSourceBuffer associated to the search context.
+	 *
+	 * Since: 3.10
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_BUFFER,
+					 g_param_spec_object ("buffer",
+							      "Buffer",
+							      "The associated GtkSourceBuffer",
+							      GTK_SOURCE_TYPE_BUFFER,
+							      G_PARAM_READWRITE |
+							      G_PARAM_CONSTRUCT_ONLY |
+							      G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceSearchContext:settings:
+	 *
+	 * The #GtkSourceSearchSettings associated to the search context.
+	 *
+	 * This property is construct-only since version 4.0.
+	 *
+	 * Since: 3.10
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_SETTINGS,
+					 g_param_spec_object ("settings",
+							      "Settings",
+							      "The associated GtkSourceSearchSettings",
+							      GTK_SOURCE_TYPE_SEARCH_SETTINGS,
+							      G_PARAM_READWRITE |
+							      G_PARAM_CONSTRUCT_ONLY |
+							      G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceSearchContext:highlight:
+	 *
+	 * Highlight the search occurrences.
+	 *
+	 * Since: 3.10
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_HIGHLIGHT,
+					 g_param_spec_boolean ("highlight",
+							       "Highlight",
+							       "Highlight search occurrences",
+							       TRUE,
+							       G_PARAM_READWRITE |
+							       G_PARAM_CONSTRUCT |
+							       G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceSearchContext:match-style:
+	 *
+	 * A #GtkSourceStyle, or %NULL for theme's scheme default style.
+	 *
+	 * Since: 3.16
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_MATCH_STYLE,
+					 g_param_spec_object ("match-style",
+							      "Match style",
+							      "The text style for matches",
+							      GTK_SOURCE_TYPE_STYLE,
+							      G_PARAM_READWRITE |
+							      G_PARAM_CONSTRUCT |
+							      G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceSearchContext:occurrences-count:
+	 *
+	 * The total number of search occurrences. If the search is disabled,
+	 * the value is 0. If the buffer is not already fully scanned, the value
+	 * is -1.
+	 *
+	 * Since: 3.10
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_OCCURRENCES_COUNT,
+					 g_param_spec_int ("occurrences-count",
+							   "Occurrences count",
+							   "Total number of search occurrences",
+							   -1,
+							   G_MAXINT,
+							   0,
+							   G_PARAM_READABLE |
+							   G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceSearchContext:regex-error:
+	 *
+	 * If the regex search pattern doesn't follow all the rules, this
+	 * #GError property will be set. If the pattern is valid, the value is
+	 * %NULL.
+	 *
+	 * Free with g_error_free().
+	 *
+	 * Since: 3.10
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_REGEX_ERROR,
+					 g_param_spec_pointer ("regex-error",
+							       "Regex error",
+							       "Regular expression error",
+							       G_PARAM_READABLE |
+							       G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gtk_source_search_context_init (GtkSourceSearchContext *search)
+{
+	search->priv = gtk_source_search_context_get_instance_private (search);
+	search->priv->occurrences_index = _gtk_source_occurrences_index_new ();
+	search->priv->tagged_ranges = g_array_new (FALSE, FALSE, sizeof (OffsetRange));
+	search->priv->regex_subject = g_string_new (NULL);
+	search->priv->regex_subject_start = -1;
+}
+
+/**
+ * gtk_source_search_context_new:
+ * @buffer: a #GtkSourceBuffer.
+ * @settings: (nullable): a #GtkSourceSearchSettings, or %NULL.
+ *
+ * Creates a new search context, associated with @buffer, and customized with
+ * @settings. If @settings is %NULL, a new #GtkSourceSearchSettings object will
+ * be created, that you can retrieve with
+ * gtk_source_search_context_get_settings().
+ *
+ * Returns: a new search context.
+ * Since: 3.10
+ */
+GtkSourceSearchContext *
+gtk_source_search_context_new (GtkSourceBuffer         *buffer,
+			       GtkSourceSearchSettings *settings)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
+	g_return_val_if_fail (settings == NULL || GTK_SOURCE_IS_SEARCH_SETTINGS (settings), NULL);
+
+	return g_object_new (GTK_SOURCE_TYPE_SEARCH_CONTEXT,
+			     "buffer", buffer,
+			     "settings", settings,
+			     NULL);
+}
+
+/**
+ * gtk_source_search_context_get_buffer:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Returns: (transfer none): the associated buffer.
+ * Since: 3.10
+ */
+GtkSourceBuffer *
+gtk_source_search_context_get_buffer (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+
+	return GTK_SOURCE_BUFFER (search->priv->buffer);
+}
+
+/**
+ * gtk_source_search_context_get_settings:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Returns: (transfer none): the search settings.
+ * Since: 3.10
+ */
+GtkSourceSearchSettings *
+gtk_source_search_context_get_settings (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+
+	return search->priv->settings;
+}
+
+/**
+ * gtk_source_search_context_get_highlight:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Returns: whether to highlight the search occurrences.
+ * Since: 3.10
+ */
+gboolean
+gtk_source_search_context_get_highlight (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+
+	return search->priv->highlight;
+}
+
+/**
+ * gtk_source_search_context_set_highlight:
+ * @search: a #GtkSourceSearchContext.
+ * @highlight: the setting.
+ *
+ * Enables or disables the search occurrences highlighting.
+ *
+ * Since: 3.10
+ */
+void
+gtk_source_search_context_set_highlight (GtkSourceSearchContext *search,
+					 gboolean                highlight)
+{
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+
+	highlight = highlight != FALSE;
+
+	if (search->priv->highlight != highlight)
+	{
+		search->priv->highlight = highlight;
+		sync_found_tag (search);
+
+		/* The found_tag is applied only when the highlighting is
+		 * enabled, ask the views to highlight their visible regions.
+		 */
+		if (highlight && search->priv->buffer != NULL)
+		{
+			GtkSourceBufferInternal *buffer_internal;
+
+			buffer_internal = _gtk_source_buffer_internal_get_from_buffer (GTK_SOURCE_BUFFER (search->priv->buffer));
+			_gtk_source_buffer_internal_emit_search_start (buffer_internal, search);
+		}
+
+		g_object_notify (G_OBJECT (search), "highlight");
+	}
+}
+
+/**
+ * gtk_source_search_context_get_match_style:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Returns: (transfer none): the #GtkSourceStyle to apply on search matches.
+ *
+ * Since: 3.16
+ */
+GtkSourceStyle *
+gtk_source_search_context_get_match_style (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+
+	return search->priv->match_style;
+}
+
+/**
+ * gtk_source_search_context_set_match_style:
+ * @search: a #GtkSourceSearchContext.
+ * @match_style: (nullable): a #GtkSourceStyle, or %NULL.
+ *
+ * Set the style to apply on search matches. If @match_style is %NULL, default
+ * theme's scheme 'match-style' will be used.
+ * To enable or disable the search highlighting, use
+ * gtk_source_search_context_set_highlight().
+ *
+ * Since: 3.16
+ */
+void
+gtk_source_search_context_set_match_style (GtkSourceSearchContext *search,
+					   GtkSourceStyle         *match_style)
+{
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+	g_return_if_fail (match_style == NULL || GTK_SOURCE_IS_STYLE (match_style));
+
+	if (search->priv->match_style == match_style)
+	{
+		return;
+	}
+
+	if (search->priv->match_style != NULL)
+	{
+		g_object_unref (search->priv->match_style);
+	}
+
+	search->priv->match_style = match_style;
+
+	if (match_style != NULL)
+	{
+		g_object_ref (match_style);
+	}
+
+	g_object_notify (G_OBJECT (search), "match-style");
+}
+
+/**
+ * gtk_source_search_context_get_regex_error:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Regular expression patterns must follow certain rules. If
+ * #GtkSourceSearchSettings:search-text breaks a rule, the error can be retrieved
+ * with this function. The error domain is #G_REGEX_ERROR.
+ *
+ * Free the return value with g_error_free().
+ *
+ * Returns: (nullable): the #GError, or %NULL if the pattern is valid.
+ * Since: 3.10
+ */
+GError *
+gtk_source_search_context_get_regex_error (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+
+	if (search->priv->regex_error == NULL)
+	{
+		return NULL;
+	}
+
+	return g_error_copy (search->priv->regex_error);
+}
+
+/**
+ * gtk_source_search_context_get_occurrences_count:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Gets the total number of search occurrences. If the buffer is not already
+ * fully scanned, the total number of occurrences is unknown, and -1 is
+ * returned.
+ *
+ * Returns: the total number of search occurrences, or -1 if unknown.
+ * Since: 3.10
+ */
+gint
+gtk_source_search_context_get_occurrences_count (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), -1);
+
+	if (!gtk_source_region_is_empty (search->priv->scan_region))
+	{
+		return -1;
+	}
+
+	return search->priv->occurrences_count;
+}
+
+/**
+ * gtk_source_search_context_get_occurrence_position:
+ * @search: a #GtkSourceSearchContext.
+ * @match_start: the start of the occurrence.
+ * @match_end: the end of the occurrence.
+ *
+ * Gets the position of a search occurrence. If the buffer is not already fully
+ * scanned, the position may be unknown, and -1 is returned. If 0 is returned,
+ * it means that this part of the buffer has already been scanned, and that
+ * @match_start and @match_end don't delimit an occurrence.
+ *
+ * Returns: the position of the search occurrence. The first occurrence has the
+ * position 1 (not 0). Returns 0 if @match_start and @match_end don't delimit
+ * an occurrence. Returns -1 if the position is not yet known.
+ *
+ * Since: 3.10
+ */
+gint
+gtk_source_search_context_get_occurrence_position (GtkSourceSearchContext *search,
+						   const GtkTextIter      *match_start,
+						   const GtkTextIter      *match_end)
+{
+	OffsetRange occurrence;
+	GtkTextIter iter;
+	gint position = 0;
+	GtkSourceRegion *region;
+	gboolean empty;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), -1);
+	g_return_val_if_fail (match_start != NULL, -1);
+	g_return_val_if_fail (match_end != NULL, -1);
+
+	if (search->priv->buffer == NULL)
+	{
+		return -1;
+	}
+
+	/* Verify that the [match_start; match_end] region has been scanned. */
+
+	if (search->priv->scan_region != NULL)
+	{
+		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
+								match_start,
+								match_end);
+
+		empty = gtk_source_region_is_empty (region);
+
+		g_clear_object (&region);
+
+		if (!empty)
+		{
+			return -1;
+		}
+	}
+
+	/* Verify that the occurrence is correct. */
+
+	if (!get_occurrence_at (search, gtk_text_iter_get_offset (match_start), &occurrence) ||
+	    occurrence.start != gtk_text_iter_get_offset (match_start) ||
+	    occurrence.end != gtk_text_iter_get_offset (match_end))
+	{
+		return 0;
+	}
+
+	/* Verify that the scan region is empty between the start of the buffer
+	 * and the end of the occurrence.
 	 */
-	g_object_class_install_property (object_class,
-					 PROP_BUFFER,
-					 g_param_spec_object ("buffer",
-							      "Buffer",
-							      "The associated GtkSourceBuffer",
-							      GTK_SOURCE_TYPE_BUFFER,
-							      G_PARAM_READWRITE |
-							      G_PARAM_CONSTRUCT_ONLY |
-							      G_PARAM_STATIC_STRINGS));
 
-	/**
-	 * GtkSourceSearchContext:settings:
-	 *
-	 * The #GtkSourceSearchSettings associated to the search context.
-	 *
-	 * This property is construct-only since version 4.0.
-	 *
-	 * Since: 3.10
-	 */
-	g_object_class_install_property (object_class,
-					 PROP_SETTINGS,
-					 g_param_spec_object ("settings",
-							      "Settings",
-							      "The associated GtkSourceSearchSettings",
-							      GTK_SOURCE_TYPE_SEARCH_SETTINGS,
-							      G_PARAM_READWRITE |
-							      G_PARAM_CONSTRUCT_ONLY |
-							      G_PARAM_STATIC_STRINGS));
+	gtk_text_buffer_get_start_iter (search->priv->buffer, &iter);
+
+	if (search->priv->scan_region != NULL)
+	{
+		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
+								&iter,
+								match_end);
+
+		empty = gtk_source_region_is_empty (region);
+
+		g_clear_object (&region);
+
+		if (!empty)
+		{
+			return -1;
+		}
+	}
+
+	/* Everything is fine, the previous occurrences are in the index. */
+
+	position = get_nb_occurrences_before (search, gtk_text_iter_get_offset (match_start));
+
+	return position + 1;
+}
+
+/**
+ * gtk_source_search_context_forward:
+ * @search: a #GtkSourceSearchContext.
+ * @iter: start of search.
+ * @match_start: (out) (optional): return location for start of match, or %NULL.
+ * @match_end: (out) (optional): return location for end of match, or %NULL.
+ * @has_wrapped_around: (out) (optional): return location to know whether the
+ *   search has wrapped around, or %NULL.
+ *
+ * Synchronous forward search. It is recommended to use the asynchronous
+ * functions instead, to not block the user interface. However, if you are sure
+ * that the @buffer is small, this function is more convenient to use.
+ *
+ * If the #GtkSourceSearchSettings:wrap-around property is %FALSE, this function
+ * doesn't try to wrap around.
+ *
+ * The @has_wrapped_around out parameter is set independently of whether a match
+ * is found. So if this function returns %FALSE, @has_wrapped_around will have
+ * the same value as the #GtkSourceSearchSettings:wrap-around property.
+ *
+ * Returns: whether a match was found.
+ * Since: 4.0
+ */
+gboolean
+gtk_source_search_context_forward (GtkSourceSearchContext *search,
+				   const GtkTextIter      *iter,
+				   GtkTextIter            *match_start,
+				   GtkTextIter            *match_end,
+				   gboolean               *has_wrapped_around)
+{
+	GtkTextIter m_start;
+	GtkTextIter m_end;
+	gboolean found;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+	g_return_val_if_fail (iter != NULL, FALSE);
+
+	if (has_wrapped_around != NULL)
+	{
+		*has_wrapped_around = FALSE;
+	}
+
+	if (search->priv->buffer == NULL)
+	{
+		return FALSE;
+	}
+
+	found = smart_forward_search (search, iter, &m_start, &m_end);
+
+	if (!found && gtk_source_search_settings_get_wrap_around (search->priv->settings))
+	{
+		GtkTextIter start_iter;
+		gtk_text_buffer_get_start_iter (search->priv->buffer, &start_iter);
+
+		found = smart_forward_search (search, &start_iter, &m_start, &m_end);
+
+		if (has_wrapped_around != NULL)
+		{
+			*has_wrapped_around = TRUE;
+		}
+	}
+
+	if (found && match_start != NULL)
+	{
+		*match_start = m_start;
+	}
+
+	if (found && match_end != NULL)
+	{
+		*match_end = m_end;
+	}
+
+	return found;
+}
+
+/**
+ * gtk_source_search_context_forward_async:
+ * @search: a #GtkSourceSearchContext.
+ * @iter: start of search.
+ * @cancellable: (nullable): a #GCancellable, or %NULL.
+ * @callback: a #GAsyncReadyCallback to call when the operation is finished.
+ * @user_data: the data to pass to the @callback function.
+ *
+ * The asynchronous version of gtk_source_search_context_forward().
+ *
+ * See the documentation of gtk_source_search_context_forward() for more
+ * details.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * If the operation is cancelled, the @callback will only be called if
+ * @cancellable was not %NULL. gtk_source_search_context_forward_async() takes
+ * ownership of @cancellable, so you can unref it after calling this function.
+ *
+ * Since: 3.10
+ */
+void
+gtk_source_search_context_forward_async (GtkSourceSearchContext *search,
+					 const GtkTextIter      *iter,
+					 GCancellable           *cancellable,
+					 GAsyncReadyCallback     callback,
+					 gpointer                user_data)
+{
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+	g_return_if_fail (iter != NULL);
+
+	if (search->priv->buffer == NULL)
+	{
+		return;
+	}
+
+	clear_task (search);
+	search->priv->task = g_task_new (search, cancellable, callback, user_data);
+
+	smart_forward_search_async (search, iter, FALSE);
+}
+
+/**
+ * gtk_source_search_context_forward_finish:
+ * @search: a #GtkSourceSearchContext.
+ * @result: a #GAsyncResult.
+ * @match_start: (out) (optional): return location for start of match, or %NULL.
+ * @match_end: (out) (optional): return location for end of match, or %NULL.
+ * @has_wrapped_around: (out) (optional): return location to know whether the
+ *   search has wrapped around, or %NULL.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes a forward search started with
+ * gtk_source_search_context_forward_async().
+ *
+ * See the documentation of gtk_source_search_context_forward() for more
+ * details.
+ *
+ * Returns: whether a match was found.
+ * Since: 4.0
+ */
+gboolean
+gtk_source_search_context_forward_finish (GtkSourceSearchContext  *search,
+					  GAsyncResult            *result,
+					  GtkTextIter             *match_start,
+					  GtkTextIter             *match_end,
+					  gboolean                *has_wrapped_around,
+					  GError                 **error)
+{
+	ForwardBackwardData *data;
+	gboolean found;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+
+	if (has_wrapped_around != NULL)
+	{
+		*has_wrapped_around = FALSE;
+	}
+
+	if (search->priv->buffer == NULL)
+	{
+		return FALSE;
+	}
+
+	g_return_val_if_fail (g_task_is_valid (result, search), FALSE);
+
+	data = g_task_propagate_pointer (G_TASK (result), error);
+
+	if (data == NULL)
+	{
+		return FALSE;
+	}
+
+	found = data->found;
+
+	if (found)
+	{
+		if (match_start != NULL)
+		{
+			*match_start = data->match_start;
+		}
+
+		if (match_end != NULL)
+		{
+			*match_end = data->match_end;
+		}
+	}
+
+	if (has_wrapped_around != NULL)
+	{
+		*has_wrapped_around = data->wrapped_around;
+	}
+
+	forward_backward_data_free (data);
+	return found;
+}
+
+/**
+ * gtk_source_search_context_backward:
+ * @search: a #GtkSourceSearchContext.
+ * @iter: start of search.
+ * @match_start: (out) (optional): return location for start of match, or %NULL.
+ * @match_end: (out) (optional): return location for end of match, or %NULL.
+ * @has_wrapped_around: (out) (optional): return location to know whether the
+ *   search has wrapped around, or %NULL.
+ *
+ * Synchronous backward search. It is recommended to use the asynchronous
+ * functions instead, to not block the user interface. However, if you are sure
+ * that the @buffer is small, this function is more convenient to use.
+ *
+ * If the #GtkSourceSearchSettings:wrap-around property is %FALSE, this function
+ * doesn't try to wrap around.
+ *
+ * The @has_wrapped_around out parameter is set independently of whether a match
+ * is found. So if this function returns %FALSE, @has_wrapped_around will have
+ * the same value as the #GtkSourceSearchSettings:wrap-around property.
+ *
+ * Returns: whether a match was found.
+ * Since: 4.0
+ */
+gboolean
+gtk_source_search_context_backward (GtkSourceSearchContext *search,
+				    const GtkTextIter      *iter,
+				    GtkTextIter            *match_start,
+				    GtkTextIter            *match_end,
+				    gboolean               *has_wrapped_around)
+{
+	GtkTextIter m_start;
+	GtkTextIter m_end;
+	gboolean found;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+	g_return_val_if_fail (iter != NULL, FALSE);
 
-	/**
-	 * GtkSourceSearchContext:highlight:
-	 *
-	 * Highlight the search occurrences.
-	 *
-	 * Since: 3.10
-	 */
-	g_object_class_install_property (object_class,
-					 PROP_HIGHLIGHT,
-					 g_param_spec_boolean ("highlight",
-							       "Highlight",
-							       "Highlight search occurrences",
-							       TRUE,
-							       G_PARAM_READWRITE |
-							       G_PARAM_CONSTRUCT |
-							       G_PARAM_STATIC_STRINGS));
+	if (has_wrapped_around != NULL)
+	{
+		*has_wrapped_around = FALSE;
+	}
 
-	/**
-	 * GtkSourceSearchContext:match-style:
-	 *
-	 * A #GtkSourceStyle, or %NULL for theme's scheme default style.
-	 *
-	 * Since: 3.16
-	 */
-	g_object_class_install_property (object_class,
-					 PROP_MATCH_STYLE,
-					 g_param_spec_object ("match-style",
-							      "Match style",
-							      "The text style for matches",
-							      GTK_SOURCE_TYPE_STYLE,
-							      G_PARAM_READWRITE |
-							      G_PARAM_CONSTRUCT |
-							      G_PARAM_STATIC_STRINGS));
+	if (search->priv->buffer == NULL)
+	{
+		return FALSE;
+	}
 
-	/**
-	 * GtkSourceSearchContext:occurrences-count:
-	 *
-	 * The total number of search occurrences. If the search is disabled,
-	 * the value is 0. If the buffer is not already fully scanned, the value
-	 * is -1.
-	 *
-	 * Since: 3.10
-	 */
-	g_object_class_install_property (object_class,
-					 PROP_OCCURRENCES_COUNT,
-					 g_param_spec_int ("occurrences-count",
-							   "Occurrences count",
-							   "Total number of search occurrences",
-							   -1,
-							   G_MAXINT,
-							   0,
-							   G_PARAM_READABLE |
-							   G_PARAM_STATIC_STRINGS));
+	found = smart_backward_search (search, iter, &m_start, &m_end);
 
-	/**
-	 * GtkSourceSearchContext:regex-error:
-	 *
-	 * If the regex search pattern doesn't follow all the rules, this
-	 * #GError property will be set. If the pattern is valid, the value is
-	 * %NULL.
-	 *
-	 * Free with g_error_free().
-	 *
-	 * Since: 3.10
-	 */
-	g_object_class_install_property (object_class,
-					 PROP_REGEX_ERROR,
-					 g_param_spec_pointer ("regex-error",
-							       "Regex error",
-							       "Regular expression error",
-							       G_PARAM_READABLE |
-							       G_PARAM_STATIC_STRINGS));
-}
+	if (!found && gtk_source_search_settings_get_wrap_around (search->priv->settings))
+	{
+		GtkTextIter end_iter;
 
-static void
-gtk_source_search_context_init (GtkSourceSearchContext *search)
-{
-	search->priv = gtk_source_search_context_get_instance_private (search);
+		gtk_text_buffer_get_end_iter (search->priv->buffer, &end_iter);
+
+		found = smart_backward_search (search, &end_iter, &m_start, &m_end);
+
+		if (has_wrapped_around != NULL)
+		{
+			*has_wrapped_around = TRUE;
+		}
+	}
+
+	if (found && match_start != NULL)
+	{
+		*match_start = m_start;
+	}
+
+	if (found && match_end != NULL)
+	{
+		*match_end = m_end;
+	}
+
+	return found;
 }
 
 /**
- * gtk_source_search_context_new:
- * @buffer: a #GtkSourceBuffer.
- * @settings: (nullable): a #GtkSourceSearchSettings, or %NULL.
+ * gtk_source_search_context_backward_async:
+ * @search: a #GtkSourceSearchContext.
+ * @iter: start of search.
+ * @cancellable: (nullable): a #GCancellable, or %NULL.
+ * @callback: a #GAsyncReadyCallback to call when the operation is finished.
+ * @user_data: the data to pass to the @callback function.
  *
- * Creates a new search context, associated with @buffer, and customized with
- * @settings. If @settings is %NULL, a new #GtkSourceSearchSettings object will
- * be created, that you can retrieve with
- * gtk_source_search_context_get_settings().
+ * The asynchronous version of gtk_source_search_context_backward().
+ *
+ * See the documentation of gtk_source_search_context_backward() for more
+ * details.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * If the operation is cancelled, the @callback will only be called if
+ * @cancellable was not %NULL. gtk_source_search_context_backward_async() takes
+ * ownership of @cancellable, so you can unref it after calling this function.
  *
- * Returns: a new search context.
  * Since: 3.10
  */
-GtkSourceSearchContext *
-gtk_source_search_context_new (GtkSourceBuffer         *buffer,
-			       GtkSourceSearchSettings *settings)
+void
+gtk_source_search_context_backward_async (GtkSourceSearchContext *search,
+					  const GtkTextIter      *iter,
+					  GCancellable           *cancellable,
+					  GAsyncReadyCallback     callback,
+					  gpointer                user_data)
 {
-	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
-	g_return_val_if_fail (settings == NULL || GTK_SOURCE_IS_SEARCH_SETTINGS (settings), NULL);
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+	g_return_if_fail (iter != NULL);
 
-	return g_object_new (GTK_SOURCE_TYPE_SEARCH_CONTEXT,
-			     "buffer", buffer,
-			     "settings", settings,
-			     NULL);
+	if (search->priv->buffer == NULL)
+	{
+		return;
+	}
+
+	clear_task (search);
+	search->priv->task = g_task_new (search, cancellable, callback, user_data);
+
+	smart_backward_search_async (search, iter, FALSE);
 }
 
 /**
- * gtk_source_search_context_get_buffer:
+ * gtk_source_search_context_backward_finish:
  * @search: a #GtkSourceSearchContext.
+ * @result: a #GAsyncResult.
+ * @match_start: (out) (optional): return location for start of match, or %NULL.
+ * @match_end: (out) (optional): return location for end of match, or %NULL.
+ * @has_wrapped_around: (out) (optional): return location to know whether the
+ *   search has wrapped around, or %NULL.
+ * @error: a #GError, or %NULL.
  *
- * Returns: (transfer none): the associated buffer.
- * Since: 3.10
+ * Finishes a backward search started with
+ * gtk_source_search_context_backward_async().
+ *
+ * See the documentation of gtk_source_search_context_backward() for more
+ * details.
+ *
+ * Returns: whether a match was found.
+ * Since: 4.0
  */
-GtkSourceBuffer *
-gtk_source_search_context_get_buffer (GtkSourceSearchContext *search)
+gboolean
+gtk_source_search_context_backward_finish (GtkSourceSearchContext  *search,
+					   GAsyncResult            *result,
+					   GtkTextIter             *match_start,
+					   GtkTextIter             *match_end,
+					   gboolean                *has_wrapped_around,
+					   GError                 **error)
 {
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+	return gtk_source_search_context_forward_finish (search,
+							 result,
+							 match_start,
+							 match_end,
+							 has_wrapped_around,
+							 error);
+}
+
+/* Returns the text that replaces the [match_start, match_end] regex match, or
+ * NULL on error.
+ */
+static gchar *
+regex_get_replacement (GtkSourceSearchContext  *search,
+		       const GtkTextIter       *match_start,
+		       const GtkTextIter       *match_end,
+		       const gchar             *replace,
+		       GError                 **error)
+{
+	GtkTextIter real_start;
+	GtkTextIter real_end;
+	GtkTextIter match_start_check;
+	GtkTextIter match_end_check;
+	gint start_pos;
+	gchar *subject;
+	gchar *suffix;
+	gchar *subject_replaced;
+	gchar *replacement = NULL;
+	GRegexMatchFlags match_options;
+	GError *tmp_error = NULL;
+
+	if (search->priv->regex == NULL ||
+	    search->priv->regex_error != NULL)
+	{
+		return NULL;
+	}
+
+	regex_search_get_real_start (search, match_start, &real_start, &start_pos);
+	g_assert_cmpint (start_pos, >=, 0);
+
+	if (!basic_forward_regex_search (search,
+					 match_start,
+					 &match_start_check,
+					 &match_end_check,
+					 &real_end,
+					 match_end))
+	{
+		g_assert_not_reached ();
+	}
+
+	g_assert (gtk_text_iter_equal (match_start, &match_start_check));
+	g_assert (gtk_text_iter_equal (match_end, &match_end_check));
+
+	subject = gtk_text_iter_get_visible_text (&real_start, &real_end);
+
+	suffix = gtk_text_iter_get_visible_text (match_end, &real_end);
+	if (suffix == NULL)
+	{
+		suffix = g_strdup ("");
+	}
 
-	return GTK_SOURCE_BUFFER (search->priv->buffer);
-}
+	match_options = regex_search_get_match_options (&real_start, &real_end);
+	match_options |= G_REGEX_MATCH_ANCHORED;
 
-/**
- * gtk_source_search_context_get_settings:
- * @search: a #GtkSourceSearchContext.
- *
- * Returns: (transfer none): the search settings.
- * Since: 3.10
- */
-GtkSourceSearchSettings *
-gtk_source_search_context_get_settings (GtkSourceSearchContext *search)
-{
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+	subject_replaced = g_regex_replace (search->priv->regex,
+					    subject,
+					    -1,
+					    start_pos,
+					    replace,
+					    match_options,
+					    &tmp_error);
 
-	return search->priv->settings;
-}
+	if (tmp_error != NULL)
+	{
+		g_propagate_error (error, tmp_error);
+		goto end;
+	}
 
-/**
- * gtk_source_search_context_get_highlight:
- * @search: a #GtkSourceSearchContext.
- *
- * Returns: whether to highlight the search occurrences.
- * Since: 3.10
- */
-gboolean
-gtk_source_search_context_get_highlight (GtkSourceSearchContext *search)
-{
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+	g_return_val_if_fail (g_str_has_suffix (subject_replaced, suffix), NULL);
 
-	return search->priv->highlight;
+	/* Truncate subject_replaced to not contain the suffix, so we can
+	 * replace only [match_start, match_end], not [match_start, real_end].
+	 * The first solution is slightly simpler, and avoids the need to
+	 * re-scan [match_end, real_end] for matches, which is convenient for a
+	 * replace all.
+	 */
+	subject_replaced[strlen (subject_replaced) - strlen (suffix)] = '\0';
+	g_return_val_if_fail (strlen (subject_replaced) >= (guint)start_pos, NULL);
+
+	replacement = g_strdup (subject_replaced + start_pos);
+
+end:
+	g_free (subject);
+	g_free (suffix);
+	g_free (subject_replaced);
+	return replacement;
 }
 
-/**
- * gtk_source_search_context_set_highlight:
- * @search: a #GtkSourceSearchContext.
- * @highlight: the setting.
- *
- * Enables or disables the search occurrences highlighting.
- *
- * Since: 3.10
+/* If correctly replaced, returns %TRUE and @match_end is updated to point to
+ * the replacement end.
  */
-void
-gtk_source_search_context_set_highlight (GtkSourceSearchContext *search,
-					 gboolean                highlight)
+static gboolean
+regex_replace (GtkSourceSearchContext  *search,
+	       const GtkTextIter       *match_start,
+	       GtkTextIter             *match_end,
+	       const gchar             *replace,
+	       GError                 **error)
 {
-	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+	GtkTextIter match_start_copy;
+	gchar *replacement;
 
-	highlight = highlight != FALSE;
+	replacement = regex_get_replacement (search, match_start, match_end, replace, error);
 
-	if (search->priv->highlight != highlight)
+	if (replacement == NULL)
 	{
-		search->priv->highlight = highlight;
-		sync_found_tag (search);
-
-		g_object_notify (G_OBJECT (search), "highlight");
+		return FALSE;
 	}
-}
 
-/**
- * gtk_source_search_context_get_match_style:
- * @search: a #GtkSourceSearchContext.
- *
- * Returns: (transfer none): the #GtkSourceStyle to apply on search matches.
- *
- * Since: 3.16
- */
-GtkSourceStyle *
-gtk_source_search_context_get_match_style (GtkSourceSearchContext *search)
-{
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+	match_start_copy = *match_start;
 
-	return search->priv->match_style;
+	gtk_text_buffer_begin_user_action (search->priv->buffer);
+	gtk_text_buffer_delete (search->priv->buffer, &match_start_copy, match_end);
+	gtk_text_buffer_insert (search->priv->buffer, match_end, replacement, -1);
+	gtk_text_buffer_end_user_action (search->priv->buffer);
+
+	g_free (replacement);
+	return TRUE;
 }
 
 /**
- * gtk_source_search_context_set_match_style:
+ * gtk_source_search_context_replace:
  * @search: a #GtkSourceSearchContext.
- * @match_style: (nullable): a #GtkSourceStyle, or %NULL.
+ * @match_start: the start of the match to replace.
+ * @match_end: the end of the match to replace.
+ * @replace: the replacement text.
+ * @replace_length: the length of @replace in bytes, or -1.
+ * @error: location to a #GError, or %NULL to ignore errors.
  *
- * Set the style to apply on search matches. If @match_style is %NULL, default
- * theme's scheme 'match-style' will be used.
- * To enable or disable the search highlighting, use
- * gtk_source_search_context_set_highlight().
+ * Replaces a search match by another text. If @match_start and @match_end
+ * doesn't correspond to a search match, %FALSE is returned.
  *
- * Since: 3.16
+ * @match_start and @match_end iters are revalidated to point to the replacement
+ * text boundaries.
+ *
+ * For a regular expression replacement, you can check if @replace is valid by
+ * calling g_regex_check_replacement(). The @replace text can contain
+ * backreferences; read the g_regex_replace() documentation for more details.
+ *
+ * Returns: whether the match has been replaced.
+ * Since: 4.0
  */
-void
-gtk_source_search_context_set_match_style (GtkSourceSearchContext *search,
-					   GtkSourceStyle         *match_style)
+gboolean
+gtk_source_search_context_replace (GtkSourceSearchContext  *search,
+				   GtkTextIter             *match_start,
+				   GtkTextIter             *match_end,
+				   const gchar             *replace,
+				   gint                     replace_length,
+				   GError                 **error)
 {
-	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
-	g_return_if_fail (match_style == NULL || GTK_SOURCE_IS_STYLE (match_style));
+	GtkTextIter start;
+	GtkTextIter end;
+	GtkTextMark *start_mark;
+	gboolean replaced = FALSE;
 
-	if (search->priv->match_style == match_style)
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+	g_return_val_if_fail (match_start != NULL, FALSE);
+	g_return_val_if_fail (match_end != NULL, FALSE);
+	g_return_val_if_fail (replace != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (search->priv->buffer == NULL)
 	{
-		return;
+		return FALSE;
 	}
 
-	if (search->priv->match_style != NULL)
+	if (!smart_forward_search (search, match_start, &start, &end))
 	{
-		g_object_unref (search->priv->match_style);
+		return FALSE;
 	}
 
-	search->priv->match_style = match_style;
-
-	if (match_style != NULL)
+	if (!gtk_text_iter_equal (match_start, &start) ||
+	    !gtk_text_iter_equal (match_end, &end))
 	{
-		g_object_ref (match_style);
+		return FALSE;
 	}
 
-	g_object_notify (G_OBJECT (search), "match-style");
-}
-
-/**
- * gtk_source_search_context_get_regex_error:
- * @search: a #GtkSourceSearchContext.
- *
- * Regular expression patterns must follow certain rules. If
- * #GtkSourceSearchSettings:search-text breaks a rule, the error can be retrieved
- * with this function. The error domain is #G_REGEX_ERROR.
- *
- * Free the return value with g_error_free().
- *
- * Returns: (nullable): the #GError, or %NULL if the pattern is valid.
- * Since: 3.10
- */
-GError *
-gtk_source_search_context_get_regex_error (GtkSourceSearchContext *search)
-{
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+	start_mark = gtk_text_buffer_create_mark (search->priv->buffer, NULL, &start, TRUE);
 
-	if (search->priv->regex_error == NULL)
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
 	{
-		return NULL;
+		replaced = regex_replace (search, &start, &end, replace, error);
 	}
+	else
+	{
+		gtk_text_buffer_begin_user_action (search->priv->buffer);
+		gtk_text_buffer_delete (search->priv->buffer, &start, &end);
+		gtk_text_buffer_insert (search->priv->buffer, &end, replace, replace_length);
+		gtk_text_buffer_end_user_action (search->priv->buffer);
 
-	return g_error_copy (search->priv->regex_error);
-}
-
-/**
- * gtk_source_search_context_get_occurrences_count:
- * @search: a #GtkSourceSearchContext.
- *
- * Gets the total number of search occurrences. If the buffer is not already
- * fully scanned, the total number of occurrences is unknown, and -1 is
- * returned.
- *
- * Returns: the total number of search occurrences, or -1 if unknown.
- * Since: 3.10
- */
-gint
-gtk_source_search_context_get_occurrences_count (GtkSourceSearchContext *search)
-{
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), -1);
+		replaced = TRUE;
+	}
 
-	if (!gtk_source_region_is_empty (search->priv->scan_region))
+	if (replaced)
 	{
-		return -1;
+		gtk_text_buffer_get_iter_at_mark (search->priv->buffer, match_start, start_mark);
+		*match_end = end;
 	}
 
-	return search->priv->occurrences_count;
+	gtk_text_buffer_delete_mark (search->priv->buffer, start_mark);
+
+	return replaced;
 }
 
-/**
- * gtk_source_search_context_get_occurrence_position:
- * @search: a #GtkSourceSearchContext.
- * @match_start: the start of the occurrence.
- * @match_end: the end of the occurrence.
- *
- * Gets the position of a search occurrence. If the buffer is not already fully
- * scanned, the position may be unknown, and -1 is returned. If 0 is returned,
- * it means that this part of the buffer has already been scanned, and that
- * @match_start and @match_end don't delimit an occurrence.
- *
- * Returns: the position of the search occurrence. The first occurrence has the
- * position 1 (not 0). Returns 0 if @match_start and @match_end don't delimit
- * an occurrence. Returns -1 if the position is not yet known.
- *
- * Since: 3.10
- */
-gint
-gtk_source_search_context_get_occurrence_position (GtkSourceSearchContext *search,
-						   const GtkTextIter      *match_start,
-						   const GtkTextIter      *match_end)
+static void
+replace_all_match_clear (ReplaceAllMatch *match)
 {
-	GtkTextIter m_start;
-	GtkTextIter m_end;
-	GtkTextIter iter;
-	gboolean found;
-	gint position = 0;
-	GtkSourceRegion *region;
-	gboolean empty;
+	g_free (match->replacement);
+}
 
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), -1);
-	g_return_val_if_fail (match_start != NULL, -1);
-	g_return_val_if_fail (match_end != NULL, -1);
+static void
+replace_all_replace_match (GtkSourceSearchContext *search,
+			   const ReplaceAllMatch  *match,
+			   const gchar            *replace,
+			   gint                    replace_length)
+{
+	GtkTextIter match_start;
+	GtkTextIter match_end;
 
-	if (search->priv->buffer == NULL)
-	{
-		return -1;
-	}
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &match_start, match->start);
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &match_end, match->end);
 
-	/* Verify that the [match_start; match_end] region has been scanned. */
+	gtk_text_buffer_delete (search->priv->buffer, &match_start, &match_end);
 
-	if (search->priv->scan_region != NULL)
+	if (match->replacement != NULL)
 	{
-		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-								match_start,
-								match_end);
+		gtk_text_buffer_insert (search->priv->buffer, &match_end, match->replacement, -1);
+	}
+	else
+	{
+		gtk_text_buffer_insert (search->priv->buffer, &match_end, replace, replace_length);
+	}
+}
 
-		empty = gtk_source_region_is_empty (region);
+/* Replaces @matches in one user action, with one deletion and one insertion
+ * per match. Only the matched text is deleted, so the tags and the marks of the
+ * text between the matches are kept. Replacing several matches at once, with
+ * the text between them, would lose those: the tags could be applied again,
+ * but there is no cheap way to find the GtkTextMarks of a range.
+ */
+static void
+replace_all_apply (GtkSourceSearchContext *search,
+		   GArray                 *matches,
+		   const gchar            *replace,
+		   gint                    replace_length)
+{
+	gboolean highlight_matching_brackets;
+	guint i;
 
-		g_clear_object (&region);
+	g_signal_handlers_block_by_func (search->priv->buffer, insert_text_before_cb, search);
+	g_signal_handlers_block_by_func (search->priv->buffer, insert_text_after_cb, search);
+	g_signal_handlers_block_by_func (search->priv->buffer, delete_range_before_cb, search);
+	g_signal_handlers_block_by_func (search->priv->buffer, delete_range_after_cb, search);
 
-		if (!empty)
-		{
-			return -1;
-		}
-	}
+	search->priv->buffer_stamp++;
 
-	/* Verify that the occurrence is correct. */
+	highlight_matching_brackets =
+		gtk_source_buffer_get_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->priv->buffer));
 
-	found = smart_forward_search_without_scanning (search,
-						       match_start,
-						       &m_start,
-						       &m_end,
-						       match_end);
+	gtk_source_buffer_set_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->priv->buffer),
+							   FALSE);
 
-	if (!found ||
-	    !gtk_text_iter_equal (match_start, &m_start) ||
-	    !gtk_text_iter_equal (match_end, &m_end))
-	{
-		return 0;
-	}
+	_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (search->priv->buffer));
 
-	/* Verify that the scan region is empty between the start of the buffer
-	 * and the end of the occurrence.
+	/* Replace the matches from the end, so the offsets of the previous
+	 * matches stay valid.
 	 */
+	gtk_text_buffer_begin_user_action (search->priv->buffer);
 
-	gtk_text_buffer_get_start_iter (search->priv->buffer, &iter);
-
-	if (search->priv->scan_region != NULL)
+	for (i = matches->len; i > 0; i--)
 	{
-		region = gtk_source_region_intersect_subregion (search->priv->scan_region,
-								&iter,
-								match_end);
+		replace_all_replace_match (search,
+					   &g_array_index (matches, ReplaceAllMatch, i - 1),
+					   replace,
+					   replace_length);
+	}
 
-		empty = gtk_source_region_is_empty (region);
+	gtk_text_buffer_end_user_action (search->priv->buffer);
 
-		g_clear_object (&region);
+	_gtk_source_buffer_restore_selection (GTK_SOURCE_BUFFER (search->priv->buffer));
 
-		if (!empty)
-		{
-			return -1;
-		}
-	}
+	gtk_source_buffer_set_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->priv->buffer),
+							   highlight_matching_brackets);
 
-	/* Everything is fine, count the number of previous occurrences. */
+	g_signal_handlers_unblock_by_func (search->priv->buffer, insert_text_before_cb, search);
+	g_signal_handlers_unblock_by_func (search->priv->buffer, insert_text_after_cb, search);
+	g_signal_handlers_unblock_by_func (search->priv->buffer, delete_range_before_cb, search);
+	g_signal_handlers_unblock_by_func (search->priv->buffer, delete_range_after_cb, search);
 
-	while (smart_forward_search_without_scanning (search, &iter, &m_start, &m_end, match_start))
-	{
-		position++;
-		iter = m_end;
-	}
+	/* The tagged ranges have not been updated during the replacements. */
+	clear_tagged_ranges (search);
 
-	return position + 1;
+	update (search);
 }
 
 /**
- * gtk_source_search_context_forward:
+ * gtk_source_search_context_replace_all:
  * @search: a #GtkSourceSearchContext.
- * @iter: start of search.
- * @match_start: (out) (optional): return location for start of match, or %NULL.
- * @match_end: (out) (optional): return location for end of match, or %NULL.
- * @has_wrapped_around: (out) (optional): return location to know whether the
- *   search has wrapped around, or %NULL.
+ * @replace: the replacement text.
+ * @replace_length: the length of @replace in bytes, or -1.
+ * @error: location to a #GError, or %NULL to ignore errors.
  *
- * Synchronous forward search. It is recommended to use the asynchronous
- * functions instead, to not block the user interface. However, if you are sure
- * that the @buffer is small, this function is more convenient to use.
+ * Replaces all search matches by another text. It is a synchronous function, so
+ * it can block the user interface.
  *
- * If the #GtkSourceSearchSettings:wrap-around property is %FALSE, this function
- * doesn't try to wrap around.
+ * All the matches are searched first, and then replaced one by one in one user
+ * action, so that undoing the replacements is done in one step. The text
+ * between the matches is not modified, its tags and marks are kept.
  *
- * The @has_wrapped_around out parameter is set independently of whether a match
- * is found. So if this function returns %FALSE, @has_wrapped_around will have
- * the same value as the #GtkSourceSearchSettings:wrap-around property.
+ * For a regular expression replacement, you can check if @replace is valid by
+ * calling g_regex_check_replacement(). The @replace text can contain
+ * backreferences; read the g_regex_replace() documentation for more details.
  *
- * Returns: whether a match was found.
- * Since: 4.0
+ * Returns: the number of replaced matches.
+ * Since: 3.10
  */
-gboolean
-gtk_source_search_context_forward (GtkSourceSearchContext *search,
-				   const GtkTextIter      *iter,
-				   GtkTextIter            *match_start,
-				   GtkTextIter            *match_end,
-				   gboolean               *has_wrapped_around)
+guint
+gtk_source_search_context_replace_all (GtkSourceSearchContext  *search,
+				       const gchar             *replace,
+				       gint                     replace_length,
+				       GError                 **error)
 {
-	GtkTextIter m_start;
-	GtkTextIter m_end;
-	gboolean found;
-
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
-	g_return_val_if_fail (iter != NULL, FALSE);
+	GtkTextIter iter;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	GArray *matches;
+	guint nb_matches_replaced;
+	gboolean has_regex_references = FALSE;
 
-	if (has_wrapped_around != NULL)
-	{
-		*has_wrapped_around = FALSE;
-	}
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), 0);
+	g_return_val_if_fail (replace != NULL, 0);
+	g_return_val_if_fail (error == NULL || *error == NULL, 0);
 
 	if (search->priv->buffer == NULL)
 	{
-		return FALSE;
+		return 0;
 	}
 
-	found = smart_forward_search (search, iter, &m_start, &m_end);
-
-	if (!found && gtk_source_search_settings_get_wrap_around (search->priv->settings))
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
 	{
-		GtkTextIter start_iter;
-		gtk_text_buffer_get_start_iter (search->priv->buffer, &start_iter);
-
-		found = smart_forward_search (search, &start_iter, &m_start, &m_end);
+		GError *tmp_error = NULL;
 
-		if (has_wrapped_around != NULL)
+		if (search->priv->regex == NULL ||
+		    search->priv->regex_error != NULL)
 		{
-			*has_wrapped_around = TRUE;
+			return 0;
 		}
-	}
 
-	if (found && match_start != NULL)
-	{
-		*match_start = m_start;
-	}
+		g_regex_check_replacement (replace,
+					   &has_regex_references,
+					   &tmp_error);
 
-	if (found && match_end != NULL)
-	{
-		*match_end = m_end;
+		if (tmp_error != NULL)
+		{
+			g_propagate_error (error, tmp_error);
+			return 0;
+		}
 	}
 
-	return found;
-}
+	/* First find all the matches, with their replacement if it depends on
+	 * the match. The buffer is modified only afterwards.
+	 */
+	matches = g_array_new (FALSE, FALSE, sizeof (ReplaceAllMatch));
+	g_array_set_clear_func (matches, (GDestroyNotify) replace_all_match_clear);
 
-/**
- * gtk_source_search_context_forward_async:
- * @search: a #GtkSourceSearchContext.
- * @iter: start of search.
- * @cancellable: (nullable): a #GCancellable, or %NULL.
- * @callback: a #GAsyncReadyCallback to call when the operation is finished.
- * @user_data: the data to pass to the @callback function.
- *
- * The asynchronous version of gtk_source_search_context_forward().
- *
- * See the documentation of gtk_source_search_context_forward() for more
- * details.
- *
- * See the #GAsyncResult documentation to know how to use this function.
- *
- * If the operation is cancelled, the @callback will only be called if
- * @cancellable was not %NULL. gtk_source_search_context_forward_async() takes
- * ownership of @cancellable, so you can unref it after calling this function.
- *
- * Since: 3.10
- */
-void
-gtk_source_search_context_forward_async (GtkSourceSearchContext *search,
-					 const GtkTextIter      *iter,
-					 GCancellable           *cancellable,
-					 GAsyncReadyCallback     callback,
-					 gpointer                user_data)
-{
-	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
-	g_return_if_fail (iter != NULL);
+	gtk_text_buffer_get_start_iter (search->priv->buffer, &iter);
 
-	if (search->priv->buffer == NULL)
+	while (smart_forward_search (search, &iter, &match_start, &match_end))
 	{
-		return;
-	}
+		ReplaceAllMatch match;
 
-	clear_task (search);
-	search->priv->task = g_task_new (search, cancellable, callback, user_data);
+		match.start = gtk_text_iter_get_offset (&match_start);
+		match.end = gtk_text_iter_get_offset (&match_end);
+		match.replacement = NULL;
 
-	smart_forward_search_async (search, iter, FALSE);
-}
+		if (has_regex_references)
+		{
+			match.replacement = regex_get_replacement (search, &match_start, &match_end, replace, error);
 
-/**
- * gtk_source_search_context_forward_finish:
- * @search: a #GtkSourceSearchContext.
- * @result: a #GAsyncResult.
- * @match_start: (out) (optional): return location for start of match, or %NULL.
- * @match_end: (out) (optional): return location for end of match, or %NULL.
- * @has_wrapped_around: (out) (optional): return location to know whether the
- *   search has wrapped around, or %NULL.
- * @error: a #GError, or %NULL.
- *
- * Finishes a forward search started with
- * gtk_source_search_context_forward_async().
- *
- * See the documentation of gtk_source_search_context_forward() for more
- * details.
- *
- * Returns: whether a match was found.
- * Since: 4.0
- */
-gboolean
-gtk_source_search_context_forward_finish (GtkSourceSearchContext  *search,
-					  GAsyncResult            *result,
-					  GtkTextIter             *match_start,
-					  GtkTextIter             *match_end,
-					  gboolean                *has_wrapped_around,
-					  GError                 **error)
-{
-	ForwardBackwardData *data;
-	gboolean found;
+			if (match.replacement == NULL)
+			{
+				break;
+			}
+		}
 
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+		g_array_append_val (matches, match);
 
-	if (has_wrapped_around != NULL)
-	{
-		*has_wrapped_around = FALSE;
-	}
+		iter = match_end;
 
-	if (search->priv->buffer == NULL)
-	{
-		return FALSE;
+		/* Avoid an infinite loop with an empty match. */
+		if (gtk_text_iter_equal (&match_start, &match_end) &&
+		    !gtk_text_iter_forward_char (&iter))
+		{
+			break;
+		}
 	}
 
-	g_return_val_if_fail (g_task_is_valid (result, search), FALSE);
+	nb_matches_replaced = matches->len;
+
+	replace_all_apply (search, matches, replace, replace_length);
+
+	g_array_free (matches, TRUE);
+
+	return nb_matches_replaced;
+}
+
+static void
+replace_all_async_free (ReplaceAllAsync *data)
+{
+	g_free (data->text);
+	g_clear_pointer (&data->regex, g_regex_unref);
+	g_free (data->search_text);
+	g_free (data->replace);
+	g_clear_pointer (&data->matches, g_array_unref);
+	g_clear_object (&data->task);
+	g_slice_free (ReplaceAllAsync, data);
+}
 
-	data = g_task_propagate_pointer (G_TASK (result), error);
+/* Whether the matches can be searched in a worker thread, on a snapshot of the
+ * buffer. As for the literal search, the invisible text and the case
+ * insensitive non-regex search are not supported.
+ */
+static gboolean
+replace_all_async_is_possible (GtkSourceSearchContext *search)
+{
+	GtkTextTagTable *tag_table;
+	gboolean has_invisible_tag = FALSE;
 
-	if (data == NULL)
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
 	{
-		return FALSE;
+		tag_table = gtk_text_buffer_get_tag_table (search->priv->buffer);
+		gtk_text_tag_table_foreach (tag_table, check_invisible_tag, &has_invisible_tag);
+
+		return !has_invisible_tag;
 	}
 
-	found = data->found;
+	return literal_search_is_possible (search);
+}
 
-	if (found)
-	{
-		if (match_start != NULL)
-		{
-			*match_start = data->match_start;
-		}
+static void
+replace_all_async_add_match (ReplaceAllAsync  *data,
+			     const gchar     **cursor,
+			     gint             *cursor_offset,
+			     const gchar      *match_start,
+			     const gchar      *match_end,
+			     gchar            *replacement)
+{
+	ReplaceAllMatch match;
 
-		if (match_end != NULL)
-		{
-			*match_end = data->match_end;
-		}
-	}
+	match.start = *cursor_offset + g_utf8_strlen (*cursor, match_start - *cursor);
+	match.end = match.start + g_utf8_strlen (match_start, match_end - match_start);
+	match.replacement = replacement;
 
-	if (has_wrapped_around != NULL)
-	{
-		*has_wrapped_around = data->wrapped_around;
-	}
+	g_array_append_val (data->matches, match);
 
-	forward_backward_data_free (data);
-	return found;
+	*cursor = match_end;
+	*cursor_offset = match.end;
 }
 
-/**
- * gtk_source_search_context_backward:
- * @search: a #GtkSourceSearchContext.
- * @iter: start of search.
- * @match_start: (out) (optional): return location for start of match, or %NULL.
- * @match_end: (out) (optional): return location for end of match, or %NULL.
- * @has_wrapped_around: (out) (optional): return location to know whether the
- *   search has wrapped around, or %NULL.
- *
- * Synchronous backward search. It is recommended to use the asynchronous
- * functions instead, to not block the user interface. However, if you are sure
- * that the @buffer is small, this function is more convenient to use.
- *
- * If the #GtkSourceSearchSettings:wrap-around property is %FALSE, this function
- * doesn't try to wrap around.
- *
- * The @has_wrapped_around out parameter is set independently of whether a match
- * is found. So if this function returns %FALSE, @has_wrapped_around will have
- * the same value as the #GtkSourceSearchSettings:wrap-around property.
- *
- * Returns: whether a match was found.
- * Since: 4.0
+/* Runs in a worker thread. Same as regex_search_scan_segment(), on the text of
+ * @scan. @cursor and @cursor_offset are for replace_all_async_add_match().
  */
-gboolean
-gtk_source_search_context_backward (GtkSourceSearchContext *search,
-				    const GtkTextIter      *iter,
-				    GtkTextIter            *match_start,
-				    GtkTextIter            *match_end,
-				    gboolean               *has_wrapped_around)
+static gboolean
+replace_all_async_scan_segment (ReplaceAllAsync  *data,
+				ParallelScan     *scan,
+				gsize             segment_start,
+				gsize             segment_end,
+				gboolean          allow_partial,
+				const gchar     **cursor,
+				gint             *cursor_offset,
+				gsize            *stopped_at,
+				GError          **error)
 {
-	GtkTextIter m_start;
-	GtkTextIter m_end;
-	gboolean found;
-
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
-	g_return_val_if_fail (iter != NULL, FALSE);
+	gsize subject_start = parallel_scan_get_subject_start (scan, segment_start);
+	const gchar *subject = scan->text + subject_start;
+	gsize last_match_end = segment_start;
+	GRegexMatchFlags match_options;
+	GMatchInfo *match_info;
+	gboolean partial_match;
 
-	if (has_wrapped_around != NULL)
-	{
-		*has_wrapped_around = FALSE;
-	}
+	match_options = parallel_scan_get_match_options (scan, subject_start, segment_end);
 
-	if (search->priv->buffer == NULL)
+	if (!allow_partial)
 	{
-		return FALSE;
+		match_options &= ~G_REGEX_MATCH_PARTIAL_HARD;
 	}
 
-	found = smart_backward_search (search, iter, &m_start, &m_end);
+	g_regex_match_full (data->regex,
+			    subject,
+			    segment_end - subject_start,
+			    segment_start - subject_start,
+			    match_options,
+			    &match_info,
+			    error);
 
-	if (!found && gtk_source_search_settings_get_wrap_around (search->priv->settings))
+	while (*error == NULL &&
+	       g_match_info_matches (match_info))
 	{
-		GtkTextIter end_iter;
-
-		gtk_text_buffer_get_end_iter (search->priv->buffer, &end_iter);
+		gchar *replacement = NULL;
+		gint start_pos;
+		gint end_pos;
 
-		found = smart_backward_search (search, &end_iter, &m_start, &m_end);
+		g_match_info_fetch_pos (match_info, 0, &start_pos, &end_pos);
 
-		if (has_wrapped_around != NULL)
+		if (data->has_regex_references)
 		{
-			*has_wrapped_around = TRUE;
+			replacement = g_match_info_expand_references (match_info, data->replace, error);
+
+			if (replacement == NULL)
+			{
+				break;
+			}
 		}
-	}
 
-	if (found && match_start != NULL)
-	{
-		*match_start = m_start;
+		replace_all_async_add_match (data,
+					     cursor,
+					     cursor_offset,
+					     subject + start_pos,
+					     subject + end_pos,
+					     replacement);
+
+		last_match_end = subject_start + end_pos;
+
+		g_match_info_next (match_info, error);
 	}
 
-	if (found && match_end != NULL)
+	partial_match = g_match_info_is_partial_match (match_info);
+	g_match_info_free (match_info);
+
+	if (partial_match && *error == NULL)
 	{
-		*match_end = m_end;
+		*stopped_at = last_match_end;
+		return FALSE;
 	}
 
-	return found;
+	*stopped_at = segment_end;
+	return TRUE;
 }
 
-/**
- * gtk_source_search_context_backward_async:
- * @search: a #GtkSourceSearchContext.
- * @iter: start of search.
- * @cancellable: (nullable): a #GCancellable, or %NULL.
- * @callback: a #GAsyncReadyCallback to call when the operation is finished.
- * @user_data: the data to pass to the @callback function.
- *
- * The asynchronous version of gtk_source_search_context_backward().
- *
- * See the documentation of gtk_source_search_context_backward() for more
- * details.
- *
- * See the #GAsyncResult documentation to know how to use this function.
- *
- * If the operation is cancelled, the @callback will only be called if
- * @cancellable was not %NULL. gtk_source_search_context_backward_async() takes
- * ownership of @cancellable, so you can unref it after calling this function.
- *
- * Since: 3.10
+/* Runs in a worker thread. Returns the position @nb_lines lines after @pos,
+ * at the start of a line, or the end of the text.
  */
-void
-gtk_source_search_context_backward_async (GtkSourceSearchContext *search,
-					  const GtkTextIter      *iter,
-					  GCancellable           *cancellable,
-					  GAsyncReadyCallback     callback,
-					  gpointer                user_data)
+static gsize
+replace_all_async_forward_lines (ParallelScan *scan,
+				 gsize         pos,
+				 gint          nb_lines)
 {
-	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
-	g_return_if_fail (iter != NULL);
+	gint i;
 
-	if (search->priv->buffer == NULL)
+	for (i = 0; i < nb_lines && pos < scan->text_length; i++)
 	{
-		return;
+		pos = parallel_scan_get_next_line_start (scan, pos);
 	}
 
-	clear_task (search);
-	search->priv->task = g_task_new (search, cancellable, callback, user_data);
-
-	smart_backward_search_async (search, iter, FALSE);
+	return pos;
 }
 
-/**
- * gtk_source_search_context_backward_finish:
- * @search: a #GtkSourceSearchContext.
- * @result: a #GAsyncResult.
- * @match_start: (out) (optional): return location for start of match, or %NULL.
- * @match_end: (out) (optional): return location for end of match, or %NULL.
- * @has_wrapped_around: (out) (optional): return location to know whether the
- *   search has wrapped around, or %NULL.
- * @error: a #GError, or %NULL.
- *
- * Finishes a backward search started with
- * gtk_source_search_context_backward_async().
- *
- * See the documentation of gtk_source_search_context_backward() for more
- * details.
- *
- * Returns: whether a match was found.
- * Since: 4.0
+/* Runs in a worker thread. The text is scanned by segments of lines, like
+ * regex_search_scan_chunk() does in the main thread, so that a partial match
+ * extends the subject only up to GtkSourceSearchSettings:max-match-span lines
+ * or REGEX_SEARCH_MAX_SUBJECT_SIZE bytes, and the matches are the same as
+ * with gtk_source_search_context_replace_all().
  */
-gboolean
-gtk_source_search_context_backward_finish (GtkSourceSearchContext  *search,
-					   GAsyncResult            *result,
-					   GtkTextIter             *match_start,
-					   GtkTextIter             *match_end,
-					   gboolean                *has_wrapped_around,
-					   GError                 **error)
+static void
+replace_all_async_scan_regex (ReplaceAllAsync  *data,
+			      GCancellable     *cancellable,
+			      GError          **error)
 {
-	return gtk_source_search_context_forward_finish (search,
-							 result,
-							 match_start,
-							 match_end,
-							 has_wrapped_around,
-							 error);
+	ParallelScan scan = { 0 };
+	const gchar *cursor = data->text;
+	gint cursor_offset = 0;
+	gsize segment_start = 0;
+
+	/* The helpers of the parallel scan only use the text of the scan. */
+	scan.regex = data->regex;
+	scan.text = data->text;
+	scan.text_length = strlen (data->text);
+	scan.max_lookbehind = g_regex_get_max_lookbehind (data->regex);
+	scan.max_match_span = data->max_match_span;
+
+	while (segment_start < scan.text_length &&
+	       *error == NULL &&
+	       !g_cancellable_is_cancelled (cancellable))
+	{
+		gsize segment_end;
+		gsize stopped_at;
+		gboolean allow_partial = TRUE;
+		gint nb_lines = REGEX_SEARCH_WINDOW_LINES;
+
+		segment_end = replace_all_async_forward_lines (&scan, segment_start, REGEX_SEARCH_WINDOW_LINES);
+
+		while (!replace_all_async_scan_segment (data,
+							&scan,
+							segment_start,
+							segment_end,
+							allow_partial,
+							&cursor,
+							&cursor_offset,
+							&stopped_at,
+							error))
+		{
+			gsize subject_length = segment_end - parallel_scan_get_subject_start (&scan, segment_start);
+			const gchar *p;
+			gint span = 0;
+
+			segment_start = stopped_at;
+
+			for (p = scan.text + segment_start;
+			     (p = memchr (p, '\n', scan.text + segment_end - p)) != NULL;
+			     p++)
+			{
+				span++;
+			}
+
+			if (subject_length >= REGEX_SEARCH_MAX_SUBJECT_SIZE ||
+			    (scan.max_match_span > 0 && span >= scan.max_match_span))
+			{
+				allow_partial = FALSE;
+				continue;
+			}
+
+			segment_end = replace_all_async_forward_lines (&scan, segment_end, nb_lines);
+			nb_lines <<= 1;
+
+			if (scan.max_match_span > 0)
+			{
+				segment_end = MIN (segment_end,
+						   replace_all_async_forward_lines (&scan,
+										    segment_start,
+										    scan.max_match_span));
+			}
+		}
+
+		segment_start = stopped_at;
+	}
 }
 
-/* If correctly replaced, returns %TRUE and @match_end is updated to point to
- * the replacement end.
- */
-static gboolean
-regex_replace (GtkSourceSearchContext  *search,
-	       const GtkTextIter       *match_start,
-	       GtkTextIter             *match_end,
-	       const gchar             *replace,
-	       GError                 **error)
+/* Runs in a worker thread. */
+static void
+replace_all_async_thread (GTask        *task,
+			  gpointer      source_object,
+			  gpointer      task_data,
+			  GCancellable *cancellable)
 {
-	GtkTextIter real_start;
-	GtkTextIter real_end;
-	GtkTextIter match_start_check;
-	GtkTextIter match_end_check;
-	GtkTextIter match_start_copy;
-	gint start_pos;
-	gchar *subject;
-	gchar *suffix;
-	gchar *subject_replaced;
-	GRegexMatchFlags match_options;
-	GError *tmp_error = NULL;
-	gboolean replaced = FALSE;
+	ReplaceAllAsync *data = task_data;
+	GError *error = NULL;
 
-	if (search->priv->regex == NULL ||
-	    search->priv->regex_error != NULL)
+	if (data->regex != NULL)
 	{
-		return FALSE;
+		replace_all_async_scan_regex (data, cancellable, &error);
+	}
+	else
+	{
+		const gchar *text = data->text;
+		const gchar *text_end = text + strlen (text);
+		const gchar *cursor = text;
+		gint cursor_offset = 0;
+		const gchar *p = text;
+
+		while (!g_cancellable_is_cancelled (cancellable) &&
+		       (p = literal_search_find (data->literal_shift,
+						 data->search_text,
+						 data->literal_length,
+						 p,
+						 text_end - p)) != NULL)
+		{
+			replace_all_async_add_match (data,
+						     &cursor,
+						     &cursor_offset,
+						     p,
+						     p + data->literal_length,
+						     NULL);
+
+			if (data->at_word_boundaries)
+			{
+				p = g_utf8_next_char (p);
+			}
+			else
+			{
+				p += data->literal_length;
+			}
+		}
 	}
 
-	regex_search_get_real_start (search, match_start, &real_start, &start_pos);
-	g_assert_cmpint (start_pos, >=, 0);
-
-	if (!basic_forward_regex_search (search,
-					 match_start,
-					 &match_start_check,
-					 &match_end_check,
-					 &real_end,
-					 match_end))
+	if (error != NULL)
 	{
-		g_assert_not_reached ();
+		g_task_return_error (task, error);
 	}
+	else
+	{
+		g_task_return_boolean (task, TRUE);
+	}
+}
 
-	g_assert (gtk_text_iter_equal (match_start, &match_start_check));
-	g_assert (gtk_text_iter_equal (match_end, &match_end_check));
+/* In the main thread, when the matches have been found in the worker thread. */
+static void
+replace_all_async_found_cb (GtkSourceSearchContext *search,
+			    GAsyncResult           *result,
+			    GTask                  *task)
+{
+	ReplaceAllAsync *data = g_task_get_task_data (G_TASK (result));
+	GArray *matches;
+	gint prev_match_end = 0;
+	gboolean at_word_boundaries;
+	guint nb_matches_replaced;
+	GError *error = NULL;
+	guint i;
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
 
-	subject = gtk_text_iter_get_visible_text (&real_start, &real_end);
+	if (g_task_return_error_if_cancelled (task))
+	{
+		g_object_unref (task);
+		return;
+	}
 
-	suffix = gtk_text_iter_get_visible_text (match_end, &real_end);
-	if (suffix == NULL)
+	if (search->priv->buffer == NULL)
+	{
+		g_task_return_int (task, 0);
+		g_object_unref (task);
+		return;
+	}
+
+	/* The buffer or the search settings have changed in the meantime, the
+	 * matches are searched again on the new contents.
+	 */
+	if (data->buffer_stamp != search->priv->buffer_stamp ||
+	    data->settings_stamp != search->priv->settings_stamp)
 	{
-		suffix = g_strdup ("");
+		replace_all_async_start (search, task);
+		return;
 	}
 
-	match_options = regex_search_get_match_options (&real_start, &real_end);
-	match_options |= G_REGEX_MATCH_ANCHORED;
+	at_word_boundaries = data->at_word_boundaries;
 
-	subject_replaced = g_regex_replace (search->priv->regex,
-					    subject,
-					    -1,
-					    start_pos,
-					    replace,
-					    match_options,
-					    &tmp_error);
+	matches = g_array_new (FALSE, FALSE, sizeof (ReplaceAllMatch));
+	g_array_set_clear_func (matches, (GDestroyNotify) replace_all_match_clear);
 
-	if (tmp_error != NULL)
+	for (i = 0; i < data->matches->len; i++)
 	{
-		g_propagate_error (error, tmp_error);
-		goto end;
-	}
+		ReplaceAllMatch *match = &g_array_index (data->matches, ReplaceAllMatch, i);
+		GtkTextIter match_start;
+		GtkTextIter match_end;
 
-	g_return_val_if_fail (g_str_has_suffix (subject_replaced, suffix), FALSE);
+		if (at_word_boundaries &&
+		    match->start < prev_match_end)
+		{
+			/* Overlaps the previous match. */
+			continue;
+		}
 
-	/* Truncate subject_replaced to not contain the suffix, so we can
-	 * replace only [match_start, match_end], not [match_start, real_end].
-	 * The first solution is slightly simpler, and avoids the need to
-	 * re-scan [match_end, real_end] for matches, which is convenient for a
-	 * replace all.
-	 */
-	subject_replaced[strlen (subject_replaced) - strlen (suffix)] = '\0';
-	g_return_val_if_fail (strlen (subject_replaced) >= (guint)start_pos, FALSE);
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &match_start, match->start);
+		gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &match_end, match->end);
 
-	match_start_copy = *match_start;
+		if (at_word_boundaries &&
+		    !(_gtk_source_iter_starts_extra_natural_word (&match_start, FALSE) &&
+		      _gtk_source_iter_ends_extra_natural_word (&match_end, FALSE)))
+		{
+			continue;
+		}
 
-	gtk_text_buffer_begin_user_action (search->priv->buffer);
-	gtk_text_buffer_delete (search->priv->buffer, &match_start_copy, match_end);
-	gtk_text_buffer_insert (search->priv->buffer, match_end, subject_replaced + start_pos, -1);
-	gtk_text_buffer_end_user_action (search->priv->buffer);
+		/* The replacement is now owned by @matches. */
+		g_array_append_val (matches, *match);
+		match->replacement = NULL;
 
-	replaced = TRUE;
+		prev_match_end = match->end;
+	}
 
-end:
-	g_free (subject);
-	g_free (suffix);
-	g_free (subject_replaced);
-	return replaced;
+	nb_matches_replaced = matches->len;
+
+	replace_all_apply (search, matches, data->replace, -1);
+
+	g_array_free (matches, TRUE);
+
+	g_task_return_int (task, nb_matches_replaced);
+	g_object_unref (task);
 }
 
-/**
- * gtk_source_search_context_replace:
- * @search: a #GtkSourceSearchContext.
- * @match_start: the start of the match to replace.
- * @match_end: the end of the match to replace.
- * @replace: the replacement text.
- * @replace_length: the length of @replace in bytes, or -1.
- * @error: location to a #GError, or %NULL to ignore errors.
- *
- * Replaces a search match by another text. If @match_start and @match_end
- * doesn't correspond to a search match, %FALSE is returned.
- *
- * @match_start and @match_end iters are revalidated to point to the replacement
- * text boundaries.
- *
- * For a regular expression replacement, you can check if @replace is valid by
- * calling g_regex_check_replacement(). The @replace text can contain
- * backreferences; read the g_regex_replace() documentation for more details.
- *
- * Returns: whether the match has been replaced.
- * Since: 4.0
+/* In the main thread, when the matches can't be searched in a worker thread.
+ * Each step scans a chunk of the buffer, like the idle scan of the
+ * occurrences, so the user interface is not blocked.
  */
-gboolean
-gtk_source_search_context_replace (GtkSourceSearchContext  *search,
-				   GtkTextIter             *match_start,
-				   GtkTextIter             *match_end,
-				   const gchar             *replace,
-				   gint                     replace_length,
-				   GError                 **error)
+static gboolean
+replace_all_async_idle_cb (ReplaceAllAsync *data)
 {
-	GtkTextIter start;
-	GtkTextIter end;
-	GtkTextMark *start_mark;
-	gboolean replaced = FALSE;
-
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
-	g_return_val_if_fail (match_start != NULL, FALSE);
-	g_return_val_if_fail (match_end != NULL, FALSE);
-	g_return_val_if_fail (replace != NULL, FALSE);
-	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+	GtkSourceSearchContext *search = g_task_get_source_object (data->task);
+	GtkTextIter iter;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	guint nb_matches_replaced;
+	GError *error = NULL;
 
-	if (search->priv->buffer == NULL)
+	if (g_task_return_error_if_cancelled (data->task))
 	{
-		return FALSE;
+		return G_SOURCE_REMOVE;
 	}
 
-	if (!smart_forward_search (search, match_start, &start, &end))
+	if (search->priv->buffer == NULL)
 	{
-		return FALSE;
+		g_task_return_int (data->task, 0);
+		return G_SOURCE_REMOVE;
 	}
 
-	if (!gtk_text_iter_equal (match_start, &start) ||
-	    !gtk_text_iter_equal (match_end, &end))
+	if (data->buffer_stamp != search->priv->buffer_stamp ||
+	    data->settings_stamp != search->priv->settings_stamp)
 	{
-		return FALSE;
+		replace_all_async_start (search, g_object_ref (data->task));
+		return G_SOURCE_REMOVE;
 	}
 
-	start_mark = gtk_text_buffer_create_mark (search->priv->buffer, NULL, &start, TRUE);
+	gtk_text_buffer_get_iter_at_offset (search->priv->buffer, &iter, data->offset);
 
-	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
-	{
-		replaced = regex_replace (search, &start, &end, replace, error);
-	}
-	else
+	while (smart_forward_search_step (search, &iter, &match_start, &match_end))
 	{
-		gtk_text_buffer_begin_user_action (search->priv->buffer);
-		gtk_text_buffer_delete (search->priv->buffer, &start, &end);
-		gtk_text_buffer_insert (search->priv->buffer, &end, replace, replace_length);
-		gtk_text_buffer_end_user_action (search->priv->buffer);
+		ReplaceAllMatch match;
 
-		replaced = TRUE;
+		match.start = gtk_text_iter_get_offset (&match_start);
+		match.end = gtk_text_iter_get_offset (&match_end);
+		match.replacement = NULL;
+
+		if (data->has_regex_references)
+		{
+			match.replacement = regex_get_replacement (search,
+								   &match_start,
+								   &match_end,
+								   data->replace,
+								   &error);
+
+			if (error != NULL)
+			{
+				g_task_return_error (data->task, error);
+				return G_SOURCE_REMOVE;
+			}
+		}
+
+		g_array_append_val (data->matches, match);
+
+		iter = match_end;
+
+		/* Avoid an infinite loop with an empty match. */
+		if (gtk_text_iter_equal (&match_start, &match_end))
+		{
+			gtk_text_iter_forward_char (&iter);
+		}
 	}
 
-	if (replaced)
+	if (!gtk_text_iter_is_end (&iter))
 	{
-		gtk_text_buffer_get_iter_at_mark (search->priv->buffer, match_start, start_mark);
-		*match_end = end;
+		data->offset = gtk_text_iter_get_offset (&iter);
+		return G_SOURCE_CONTINUE;
 	}
 
-	gtk_text_buffer_delete_mark (search->priv->buffer, start_mark);
+	nb_matches_replaced = data->matches->len;
 
-	return replaced;
+	replace_all_apply (search, data->matches, data->replace, -1);
+
+	g_task_return_int (data->task, nb_matches_replaced);
+	return G_SOURCE_REMOVE;
 }
 
-/**
- * gtk_source_search_context_replace_all:
- * @search: a #GtkSourceSearchContext.
- * @replace: the replacement text.
- * @replace_length: the length of @replace in bytes, or -1.
- * @error: location to a #GError, or %NULL to ignore errors.
- *
- * Replaces all search matches by another text. It is a synchronous function, so
- * it can block the user interface.
- *
- * For a regular expression replacement, you can check if @replace is valid by
- * calling g_regex_check_replacement(). The @replace text can contain
- * backreferences; read the g_regex_replace() documentation for more details.
- *
- * Returns: the number of replaced matches.
- * Since: 3.10
+/* Searches the matches, in a worker thread if possible, on a snapshot of the
+ * buffer. Takes the ownership of @task.
  */
-guint
-gtk_source_search_context_replace_all (GtkSourceSearchContext  *search,
-				       const gchar             *replace,
-				       gint                     replace_length,
-				       GError                 **error)
+static void
+replace_all_async_start (GtkSourceSearchContext *search,
+			 GTask                  *task)
 {
-	GtkTextIter iter;
-	GtkTextIter match_start;
-	GtkTextIter match_end;
-	guint nb_matches_replaced = 0;
-	gboolean highlight_matching_brackets;
+	const gchar *replace = g_task_get_task_data (task);
+	GTask *find_task;
+	ReplaceAllAsync *data;
+	GtkTextIter start;
+	GtkTextIter end;
 	gboolean has_regex_references = FALSE;
 
-	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), 0);
-	g_return_val_if_fail (replace != NULL, 0);
-	g_return_val_if_fail (error == NULL || *error == NULL, 0);
-
-	if (search->priv->buffer == NULL)
+	if (search->priv->buffer == NULL ||
+	    gtk_source_search_settings_get_search_text (search->priv->settings) == NULL)
 	{
-		return 0;
+		g_task_return_int (task, 0);
+		g_object_unref (task);
+		return;
 	}
 
 	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
 	{
-		GError *tmp_error = NULL;
+		GError *error = NULL;
 
 		if (search->priv->regex == NULL ||
 		    search->priv->regex_error != NULL)
 		{
-			return 0;
+			g_task_return_int (task, 0);
+			g_object_unref (task);
+			return;
 		}
 
-		g_regex_check_replacement (replace,
-					   &has_regex_references,
-					   &tmp_error);
+		g_regex_check_replacement (replace, &has_regex_references, &error);
 
-		if (tmp_error != NULL)
+		if (error != NULL)
 		{
-			g_propagate_error (error, tmp_error);
-			return 0;
+			g_task_return_error (task, error);
+			g_object_unref (task);
+			return;
 		}
 	}
 
-	g_signal_handlers_block_by_func (search->priv->buffer, insert_text_before_cb, search);
-	g_signal_handlers_block_by_func (search->priv->buffer, insert_text_after_cb, search);
-	g_signal_handlers_block_by_func (search->priv->buffer, delete_range_before_cb, search);
-	g_signal_handlers_block_by_func (search->priv->buffer, delete_range_after_cb, search);
-
-	highlight_matching_brackets =
-		gtk_source_buffer_get_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->priv->buffer));
+	data = g_slice_new0 (ReplaceAllAsync);
+	data->replace = g_strdup (replace);
+	data->has_regex_references = has_regex_references;
+	data->buffer_stamp = search->priv->buffer_stamp;
+	data->settings_stamp = search->priv->settings_stamp;
+	data->matches = g_array_new (FALSE, FALSE, sizeof (ReplaceAllMatch));
+	g_array_set_clear_func (data->matches, (GDestroyNotify) replace_all_match_clear);
 
-	gtk_source_buffer_set_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->priv->buffer),
-							   FALSE);
+	if (replace_all_async_is_possible (search))
+	{
+		gtk_text_buffer_get_bounds (search->priv->buffer, &start, &end);
+		data->text = gtk_text_iter_get_slice (&start, &end);
 
-	_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (search->priv->buffer));
+		/* The GRegex positions are gint's, and the pixbufs and child
+		 * anchors, U+FFFC in the slice, are not in the visible text.
+		 */
+		if (strlen (data->text) > G_MAXINT ||
+		    strstr (data->text, "\xef\xbf\xbc") != NULL)
+		{
+			g_clear_pointer (&data->text, g_free);
+		}
+	}
 
-	gtk_text_buffer_get_start_iter (search->priv->buffer, &iter);
+	if (data->text == NULL)
+	{
+		data->task = task;
 
-	gtk_text_buffer_begin_user_action (search->priv->buffer);
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 (GSourceFunc) replace_all_async_idle_cb,
+				 data,
+				 (GDestroyNotify) replace_all_async_free);
+		return;
+	}
 
-	while (smart_forward_search (search, &iter, &match_start, &match_end))
+	if (gtk_source_search_settings_get_regex_enabled (search->priv->settings))
 	{
-		if (has_regex_references)
-		{
-			if (!regex_replace (search, &match_start, &match_end, replace, error))
-			{
-				break;
-			}
-		}
-		else
-		{
-			gtk_text_buffer_delete (search->priv->buffer, &match_start, &match_end);
-			gtk_text_buffer_insert (search->priv->buffer, &match_end, replace, replace_length);
-		}
-
-		nb_matches_replaced++;
-		iter = match_end;
+		data->regex = g_regex_ref (search->priv->regex);
+		data->max_match_span = gtk_source_search_settings_get_max_match_span (search->priv->settings);
+	}
+	else
+	{
+		data->search_text = g_strdup (gtk_source_search_settings_get_search_text (search->priv->settings));
+		data->at_word_boundaries = gtk_source_search_settings_get_at_word_boundaries (search->priv->settings);
+		data->literal_length = search->priv->literal_length;
+		memcpy (data->literal_shift, search->priv->literal_shift, sizeof (data->literal_shift));
 	}
 
-	gtk_text_buffer_end_user_action (search->priv->buffer);
+	find_task = g_task_new (search,
+				g_task_get_cancellable (task),
+				(GAsyncReadyCallback) replace_all_async_found_cb,
+				task);
 
-	_gtk_source_buffer_restore_selection (GTK_SOURCE_BUFFER (search->priv->buffer));
+	g_task_set_task_data (find_task, data, (GDestroyNotify) replace_all_async_free);
+	g_task_run_in_thread (find_task, replace_all_async_thread);
+	g_object_unref (find_task);
+}
 
-	gtk_source_buffer_set_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->priv->buffer),
-							   highlight_matching_brackets);
+/**
+ * gtk_source_search_context_replace_all_async:
+ * @search: a #GtkSourceSearchContext.
+ * @replace: the replacement text.
+ * @replace_length: the length of @replace in bytes, or -1.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the operation
+ *   is finished.
+ * @user_data: the data to pass to the @callback function.
+ *
+ * The asynchronous version of gtk_source_search_context_replace_all(). The
+ * matches are searched in a worker thread, on a copy of the buffer contents,
+ * and then replaced in the main thread, in one user action.
+ *
+ * It is useful to replace the matches in a lot of buffers: the matches of all
+ * the buffers are searched in parallel, and @callback is called for each buffer
+ * when its matches are replaced. If the buffer or the search settings are
+ * modified in the meantime, the matches are searched again. If @cancellable is
+ * cancelled before the replacements, the buffer is not modified.
+ *
+ * The search in a worker thread is not possible for a case insensitive or a
+ * multi-line search without regex, or when the buffer contains invisible text,
+ * pixbufs or child anchors. In that case the matches are searched in the main
+ * thread, by small steps when the main loop is idle.
+ *
+ * Since: 4.2
+ */
+void
+gtk_source_search_context_replace_all_async (GtkSourceSearchContext *search,
+					     const gchar            *replace,
+					     gint                    replace_length,
+					     GCancellable           *cancellable,
+					     GAsyncReadyCallback     callback,
+					     gpointer                user_data)
+{
+	GTask *task;
 
-	g_signal_handlers_unblock_by_func (search->priv->buffer, insert_text_before_cb, search);
-	g_signal_handlers_unblock_by_func (search->priv->buffer, insert_text_after_cb, search);
-	g_signal_handlers_unblock_by_func (search->priv->buffer, delete_range_before_cb, search);
-	g_signal_handlers_unblock_by_func (search->priv->buffer, delete_range_after_cb, search);
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+	g_return_if_fail (replace != NULL);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
-	update (search);
+	task = g_task_new (search, cancellable, callback, user_data);
 
-	return nb_matches_replaced;
+	g_task_set_task_data (task,
+			      replace_length < 0 ? g_strdup (replace) : g_strndup (replace, replace_length),
+			      g_free);
+
+	replace_all_async_start (search, task);
+}
+
+/**
+ * gtk_source_search_context_replace_all_finish:
+ * @search: a #GtkSourceSearchContext.
+ * @result: a #GAsyncResult.
+ * @error: location to a #GError, or %NULL to ignore errors.
+ *
+ * Finishes an operation started with
+ * gtk_source_search_context_replace_all_async().
+ *
+ * Returns: the number of replaced matches.
+ * Since: 4.2
+ */
+guint
+gtk_source_search_context_replace_all_finish (GtkSourceSearchContext  *search,
+					      GAsyncResult            *result,
+					      GError                 **error)
+{
+	gssize nb_matches_replaced;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), 0);
+	g_return_val_if_fail (g_task_is_valid (result, search), 0);
+
+	nb_matches_replaced = g_task_propagate_int (G_TASK (result), error);
+
+	return nb_matches_replaced > 0 ? nb_matches_replaced : 0;
 }
 
 /* Highlight the [start,end] region in priority. */
@@ -3823,12 +6752,18 @@ _gtk_source_search_context_update_highlight (GtkSourceSearchContext *search,
 	g_return_if_fail (end != NULL);
 
 	if (search->priv->buffer == NULL ||
-	    gtk_source_region_is_empty (search->priv->scan_region) ||
 	    !search->priv->highlight)
 	{
 		return;
 	}
 
+	tag_range (search, start, end);
+
+	if (gtk_source_region_is_empty (search->priv->scan_region))
+	{
+		return;
+	}
+
 	region_to_highlight = gtk_source_region_intersect_subregion (search->priv->scan_region,
 								     start,
 								     end);
@@ -150,6 +150,19 @@ guint			 gtk_source_search_context_replace_all			(GtkSourceSearchContext	 *searc
 										 gint			  replace_length,
 										 GError			**error);
 
+GTK_SOURCE_AVAILABLE_IN_4_2
+void			 gtk_source_search_context_replace_all_async		(GtkSourceSearchContext	 *search,
+										 const gchar		 *replace,
+										 gint			  replace_length,
+										 GCancellable		 *cancellable,
+										 GAsyncReadyCallback	  callback,
+										 gpointer		  user_data);
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+guint			 gtk_source_search_context_replace_all_finish		(GtkSourceSearchContext	 *search,
+										 GAsyncResult		 *result,
+										 GError			**error);
+
 G_GNUC_INTERNAL
 void			 _gtk_source_search_context_update_highlight		(GtkSourceSearchContext	 *search,
 										 const GtkTextIter	 *start,
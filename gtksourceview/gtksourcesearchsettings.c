@@ -42,12 +42,14 @@ enum
 	PROP_CASE_SENSITIVE,
 	PROP_AT_WORD_BOUNDARIES,
 	PROP_WRAP_AROUND,
-	PROP_REGEX_ENABLED
+	PROP_REGEX_ENABLED,
+	PROP_MAX_MATCH_SPAN
 };
 
 struct _GtkSourceSearchSettingsPrivate
 {
 	gchar *search_text;
+	gint max_match_span;
 	guint case_sensitive : 1;
 	guint at_word_boundaries : 1;
 	guint wrap_around : 1;
@@ -100,6 +102,10 @@ gtk_source_search_settings_get_property (GObject    *object,
 			g_value_set_boolean (value, settings->priv->regex_enabled);
 			break;
 
+		case PROP_MAX_MATCH_SPAN:
+			g_value_set_int (value, settings->priv->max_match_span);
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -140,6 +146,10 @@ gtk_source_search_settings_set_property (GObject      *object,
 			settings->priv->regex_enabled = g_value_get_boolean (value);
 			break;
 
+		case PROP_MAX_MATCH_SPAN:
+			settings->priv->max_match_span = g_value_get_int (value);
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -245,6 +255,26 @@ gtk_source_search_settings_class_init (GtkSourceSearchSettingsClass *klass)
 							       G_PARAM_READWRITE |
 							       G_PARAM_CONSTRUCT |
 							       G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceSearchSettings:max-match-span:
+	 *
+	 * The maximum number of lines that an occurrence can span, for the
+	 * regex search. 0 means no limit.
+	 *
+	 * Since: 4.2
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_MAX_MATCH_SPAN,
+					 g_param_spec_int ("max-match-span",
+							   "Max match span",
+							   "Maximum number of lines of an occurrence",
+							   0,
+							   G_MAXINT,
+							   0,
+							   G_PARAM_READWRITE |
+							   G_PARAM_CONSTRUCT |
+							   G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -496,3 +526,52 @@ gtk_source_search_settings_get_regex_enabled (GtkSourceSearchSettings *settings)
 
 	return settings->priv->regex_enabled;
 }
+
+/**
+ * gtk_source_search_settings_set_max_match_span:
+ * @settings: a #GtkSourceSearchSettings.
+ * @max_match_span: the maximum number of lines of an occurrence, or 0.
+ *
+ * Sets the maximum number of lines that an occurrence can span, when the
+ * regex search is enabled. A pattern containing "\n", or the "(?s)" option,
+ * can match a lot of lines, and a partial match can make
+ * #GtkSourceSearchContext scan until the end of the buffer before finding
+ * that there is no occurrence. With a limit, the buffer is scanned in
+ * overlapping windows of @max_match_span lines, and an occurrence spanning
+ * more lines may not be found. When the buffer is modified, the occurrences are
+ * also updated in the @max_match_span lines around the modification, or in a
+ * few lines if there is no limit.
+ *
+ * The default value is 0: there is no limit.
+ *
+ * Since: 4.2
+ */
+void
+gtk_source_search_settings_set_max_match_span (GtkSourceSearchSettings *settings,
+					       gint                     max_match_span)
+{
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_SETTINGS (settings));
+	g_return_if_fail (max_match_span >= 0);
+
+	if (settings->priv->max_match_span != max_match_span)
+	{
+		settings->priv->max_match_span = max_match_span;
+		g_object_notify (G_OBJECT (settings), "max-match-span");
+	}
+}
+
+/**
+ * gtk_source_search_settings_get_max_match_span:
+ * @settings: a #GtkSourceSearchSettings.
+ *
+ * Returns: the maximum number of lines of an occurrence, or 0 if there is no
+ * limit.
+ * Since: 4.2
+ */
+gint
+gtk_source_search_settings_get_max_match_span (GtkSourceSearchSettings *settings)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_SETTINGS (settings), 0);
+
+	return settings->priv->max_match_span;
+}
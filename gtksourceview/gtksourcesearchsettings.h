@@ -95,6 +95,13 @@ void			 gtk_source_search_settings_set_regex_enabled		(GtkSourceSearchSettings *
 GTK_SOURCE_AVAILABLE_IN_ALL
 gboolean		 gtk_source_search_settings_get_regex_enabled		(GtkSourceSearchSettings *settings);
 
+GTK_SOURCE_AVAILABLE_IN_4_2
+void			 gtk_source_search_settings_set_max_match_span		(GtkSourceSearchSettings *settings,
+										 gint			  max_match_span);
+
+GTK_SOURCE_AVAILABLE_IN_4_2
+gint			 gtk_source_search_settings_get_max_match_span		(GtkSourceSearchSettings *settings);
+
 G_END_DECLS
 
 #endif /* GTK_SOURCE_SEARCH_SETTINGS_H */
@@ -46,6 +46,7 @@ typedef struct _GtkSourceEncoding		GtkSourceEncoding;
 typedef struct _GtkSourceFile			GtkSourceFile;
 typedef struct _GtkSourceFileLoader		GtkSourceFileLoader;
 typedef struct _GtkSourceFileSaver		GtkSourceFileSaver;
+typedef struct _GtkSourceFileSearch		GtkSourceFileSearch;
 typedef struct _GtkSourceGutter			GtkSourceGutter;
 typedef struct _GtkSourceGutterRenderer		GtkSourceGutterRenderer;
 typedef struct _GtkSourceGutterRendererPixbuf	GtkSourceGutterRendererPixbuf;
@@ -42,6 +42,9 @@ gint		_gtk_source_utils_string_to_int			(const gchar *str);
 G_GNUC_INTERNAL
 gchar *		_gtk_source_utils_pango_font_description_to_css	(const PangoFontDescription *font_desc);
 
+G_GNUC_INTERNAL
+guint		_gtk_source_utils_get_nb_search_threads		(void);
+
 /* Note: it returns duplicated string. */
 G_GNUC_INTERNAL
 gchar *		_gtk_source_utils_dgettext			(const gchar *domain,
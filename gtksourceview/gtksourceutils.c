@@ -321,6 +321,31 @@ _gtk_source_utils_string_to_int (const gchar *str)
 	return number;
 }
 
+/* Maximum number of worker threads for the searches. */
+#define SEARCH_MAX_THREADS 64
+
+/* Returns the number of worker threads to use for the searches: the number of
+ * processors, or the value of the GTK_SOURCE_SEARCH_THREADS environment
+ * variable, at most SEARCH_MAX_THREADS. 0 means that the search must be done
+ * without worker threads, when possible.
+ */
+guint
+_gtk_source_utils_get_nb_search_threads (void)
+{
+	const gchar *env;
+
+	env = g_getenv ("GTK_SOURCE_SEARCH_THREADS");
+
+	if (env != NULL && env[0] != '\0')
+	{
+		guint64 nb_threads = g_ascii_strtoull (env, NULL, 10);
+
+		return MIN (nb_threads, SEARCH_MAX_THREADS);
+	}
+
+	return CLAMP (g_get_num_processors (), 1, SEARCH_MAX_THREADS);
+}
+
 #define FONT_FAMILY  "font-family"
 #define FONT_VARIANT "font-variant"
 #define FONT_STRETCH "font-stretch"
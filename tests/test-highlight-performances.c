@@ -0,0 +1,122 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include <gtksourceview/gtksource.h>
+
+/* This measures, for C buffers of different sizes:
+ * - the time to analyze and highlight the whole buffer;
+ * - the time to type a character near the top of the fully analyzed buffer
+ *   and to highlight the changed line again, i.e. what the first update
+ *   does after each keypress.
+ *
+ * The second figure should not depend on the size of the buffer: the offsets
+ * of the segments after the change are not updated one by one.
+ */
+
+#define NB_KEYSTROKES 100
+
+static const gchar *code =
+	"static gint\n"
+	"foo (const gchar *str) /* a comment */\n"
+	"{\n"
+	"\treturn bar (str, \"string\", 42);\n"
+	"}\n";
+
+static void
+test_typing (GtkSourceLanguage *language,
+	     gint               nb_lines)
+{
+	GtkSourceBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	GString *text;
+	GTimer *timer;
+	gint i;
+
+	buffer = gtk_source_buffer_new_with_language (language);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	text = g_string_new (NULL);
+
+	for (i = 0; i < nb_lines / 5; i++)
+	{
+		g_string_append (text, code);
+	}
+
+	gtk_text_buffer_set_text (text_buffer, text->str, text->len);
+	g_string_free (text, TRUE);
+
+	timer = g_timer_new ();
+
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	g_timer_stop (timer);
+	g_print ("%d lines: whole buffer highlighted in %lf seconds.\n",
+		 nb_lines,
+		 g_timer_elapsed (timer, NULL));
+
+	g_timer_start (timer);
+
+	for (i = 0; i < NB_KEYSTROKES; i++)
+	{
+		gtk_text_buffer_get_iter_at_line_offset (text_buffer, &start, 3, 1);
+		gtk_text_buffer_insert (text_buffer, &start, "x", -1);
+
+		gtk_text_buffer_get_iter_at_line (text_buffer, &start, 3);
+		end = start;
+		gtk_text_iter_forward_line (&end);
+		gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+	}
+
+	g_timer_stop (timer);
+	g_print ("%d lines: %lf ms per keystroke.\n",
+		 nb_lines,
+		 g_timer_elapsed (timer, NULL) * 1000 / NB_KEYSTROKES);
+
+	g_timer_destroy (timer);
+	g_object_unref (buffer);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GtkSourceLanguageManager *language_manager;
+	GtkSourceLanguage *language;
+	gint nb_lines;
+
+	gtk_init (&argc, &argv);
+
+	language_manager = gtk_source_language_manager_get_default ();
+	language = gtk_source_language_manager_get_language (language_manager, "c");
+
+	if (language == NULL)
+	{
+		g_printerr ("The C language definition is not installed.\n");
+		return 1;
+	}
+
+	for (nb_lines = 10000; nb_lines <= 1000000; nb_lines *= 10)
+	{
+		test_typing (language, nb_lines);
+	}
+
+	return 0;
+}
@@ -0,0 +1,185 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include <gtksourceview/gtksource.h>
+
+/* This measures, for each sample file of tests/syntax-highlighting/, the time
+ * to analyze and highlight a buffer containing the file repeated up to
+ * NB_LINES lines, with the language definitions of data/language-specs/.
+ *
+ * It is mostly useful to compare the results before and after a change in the
+ * context engine or in the regexes of a language definition. The sample files
+ * can be restricted by giving their names on the command line, for example:
+ * ./test-language-performances file.c file.py
+ */
+
+#define NB_LINES 20000
+
+static void
+init_default_manager (void)
+{
+	gchar *dir;
+
+	dir = g_build_filename (TOP_SRCDIR, "data", "language-specs", NULL);
+
+	if (g_file_test (dir, G_FILE_TEST_IS_DIR))
+	{
+		GtkSourceLanguageManager *lm = gtk_source_language_manager_get_default ();
+		gchar *lang_dirs[2] = {dir, NULL};
+
+		gtk_source_language_manager_set_search_path (lm, lang_dirs);
+	}
+
+	g_free (dir);
+}
+
+static void
+test_file (const gchar *dir,
+	   const gchar *filename)
+{
+	GtkSourceLanguageManager *language_manager;
+	GtkSourceLanguage *language;
+	GtkSourceBuffer *buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	GString *text;
+	gchar *path;
+	gchar *contents;
+	gsize length;
+	gint nb_lines;
+	GTimer *timer;
+
+	language_manager = gtk_source_language_manager_get_default ();
+	language = gtk_source_language_manager_guess_language (language_manager, filename, NULL);
+
+	if (language == NULL)
+	{
+		return;
+	}
+
+	path = g_build_filename (dir, filename, NULL);
+
+	if (!g_file_get_contents (path, &contents, &length, NULL) ||
+	    length == 0 ||
+	    !g_utf8_validate (contents, length, NULL))
+	{
+		g_free (path);
+		g_free (contents);
+		return;
+	}
+
+	text = g_string_new (NULL);
+	nb_lines = 0;
+
+	while (nb_lines < NB_LINES)
+	{
+		const gchar *p;
+
+		g_string_append_len (text, contents, length);
+
+		if (contents[length - 1] != '\n')
+		{
+			g_string_append_c (text, '\n');
+		}
+
+		for (p = contents; p != NULL && p < contents + length; nb_lines++)
+		{
+			p = memchr (p, '\n', contents + length - p);
+
+			if (p != NULL)
+			{
+				p++;
+			}
+		}
+	}
+
+	buffer = gtk_source_buffer_new_with_language (language);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, text->len);
+
+	timer = g_timer_new ();
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	g_timer_stop (timer);
+	g_print ("%-20s %-16s %lf seconds.\n",
+		 filename,
+		 gtk_source_language_get_id (language),
+		 g_timer_elapsed (timer, NULL));
+
+	g_timer_destroy (timer);
+	g_object_unref (buffer);
+	g_string_free (text, TRUE);
+	g_free (contents);
+	g_free (path);
+}
+
+int
+main (int argc, char *argv[])
+{
+	gchar *dir;
+	GDir *gdir;
+	GList *filenames = NULL;
+	GList *l;
+	const gchar *filename;
+	gint i;
+
+	gtk_init (&argc, &argv);
+
+	init_default_manager ();
+
+	dir = g_build_filename (TOP_SRCDIR, "tests", "syntax-highlighting", NULL);
+
+	if (argc > 1)
+	{
+		for (i = 1; i < argc; i++)
+		{
+			filenames = g_list_prepend (filenames, g_strdup (argv[i]));
+		}
+	}
+	else
+	{
+		gdir = g_dir_open (dir, 0, NULL);
+
+		if (gdir == NULL)
+		{
+			g_printerr ("Cannot open %s.\n", dir);
+			g_free (dir);
+			return 1;
+		}
+
+		while ((filename = g_dir_read_name (gdir)) != NULL)
+		{
+			filenames = g_list_prepend (filenames, g_strdup (filename));
+		}
+
+		g_dir_close (gdir);
+	}
+
+	filenames = g_list_sort (filenames, (GCompareFunc) g_strcmp0);
+
+	for (l = filenames; l != NULL; l = l->next)
+	{
+		test_file (dir, l->data);
+	}
+
+	g_list_free_full (filenames, g_free);
+	g_free (dir);
+	return 0;
+}
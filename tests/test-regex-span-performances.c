@@ -0,0 +1,150 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include <gtksourceview/gtksource.h>
+
+/* This measures the throughput of the scan of a buffer with a multi-line
+ * regex, for buffers of 25, 50 and 100 MB, with and without the
+ * GtkSourceSearchSettings:max-match-span setting.
+ *
+ * The buffer contains blocks of BLOCK_NB_LINES lines between "BEGIN" and
+ * "END", and in its last part a "BEGIN" without "END". Without a limit, the
+ * partial match of the last "BEGIN" grows until the end of the buffer. With
+ * MAX_MATCH_SPAN, the throughput should not depend on the buffer size.
+ *
+ * The scan is measured in the main loop and with the worker threads (see the
+ * GTK_SOURCE_SEARCH_THREADS environment variable).
+ */
+
+#define MAX_SIZE_MB 100
+#define BLOCK_NB_LINES 10
+#define MAX_MATCH_SPAN 100
+
+static const gchar *line = "A line of text to fill the text buffer. Is it long enough?\n";
+
+static void
+fill_buffer (GtkTextBuffer *buffer,
+	     gint           size_mb)
+{
+	GString *text;
+	gsize size = (gsize) size_mb * 1024 * 1024;
+	gint line_num = 0;
+
+	text = g_string_sized_new (size + 1024);
+
+	while (text->len < size)
+	{
+		if (line_num % 100 == 0)
+		{
+			g_string_append (text, "BEGIN\n");
+		}
+		else if (line_num % 100 == BLOCK_NB_LINES)
+		{
+			g_string_append (text, "END\n");
+		}
+		else
+		{
+			g_string_append (text, line);
+		}
+
+		line_num++;
+	}
+
+	g_string_append (text, "BEGIN\n");
+
+	while (text->len < size + size / 10)
+	{
+		g_string_append (text, line);
+	}
+
+	gtk_text_buffer_set_text (buffer, text->str, text->len);
+	g_string_free (text, TRUE);
+}
+
+static void
+test_scan (GtkSourceSearchContext  *search_context,
+	   GtkSourceSearchSettings *search_settings,
+	   gint                     size_mb,
+	   gint                     max_match_span,
+	   const gchar             *nb_threads)
+{
+	GTimer *timer;
+	gdouble elapsed;
+
+	g_setenv ("GTK_SOURCE_SEARCH_THREADS", nb_threads, TRUE);
+
+	gtk_source_search_settings_set_search_text (search_settings, NULL);
+	gtk_source_search_settings_set_max_match_span (search_settings, max_match_span);
+
+	timer = g_timer_new ();
+
+	gtk_source_search_settings_set_search_text (search_settings, "(?s)BEGIN.*?END");
+
+	while (gtk_source_search_context_get_occurrences_count (search_context) == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_timer_stop (timer);
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_print ("%3d MB, max-match-span %3d, %s: %lf seconds (%.1lf MB/s), %d occurrences.\n",
+		 size_mb,
+		 max_match_span,
+		 g_str_equal (nb_threads, "0") ? "main loop" : "threads  ",
+		 elapsed,
+		 (size_mb + size_mb / 10.0) / elapsed,
+		 gtk_source_search_context_get_occurrences_count (search_context));
+
+	g_timer_destroy (timer);
+}
+
+int
+main (int argc, char *argv[])
+{
+	gint size_mb;
+
+	gtk_init (&argc, &argv);
+
+	for (size_mb = 25; size_mb <= MAX_SIZE_MB; size_mb *= 2)
+	{
+		GtkSourceBuffer *buffer;
+		GtkSourceSearchSettings *search_settings;
+		GtkSourceSearchContext *search_context;
+
+		buffer = gtk_source_buffer_new (NULL);
+		fill_buffer (GTK_TEXT_BUFFER (buffer), size_mb);
+
+		search_settings = gtk_source_search_settings_new ();
+		gtk_source_search_settings_set_regex_enabled (search_settings, TRUE);
+		search_context = gtk_source_search_context_new (buffer, search_settings);
+		gtk_source_search_context_set_highlight (search_context, FALSE);
+
+		test_scan (search_context, search_settings, size_mb, 0, "0");
+		test_scan (search_context, search_settings, size_mb, MAX_MATCH_SPAN, "0");
+		test_scan (search_context, search_settings, size_mb, 0, "");
+		test_scan (search_context, search_settings, size_mb, MAX_MATCH_SPAN, "");
+
+		g_object_unref (search_context);
+		g_object_unref (search_settings);
+		g_object_unref (buffer);
+	}
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include <gtksourceview/gtksource.h>
+
+/* This measures, for buffers with different numbers of matches, the time of
+ * gtk_source_search_context_replace_all(), for a normal search and for a regex
+ * search with backreferences, and the time to undo the replacements.
+ */
+
+#define NB_MATCHES_PER_LINE 2
+
+static void
+test_replace_all (gint         nb_lines,
+		  const gchar *search_text,
+		  gboolean     regex_enabled,
+		  const gchar *replace)
+{
+	GtkSourceBuffer *buffer;
+	GtkSourceSearchSettings *settings;
+	GtkSourceSearchContext *context;
+	GtkTextIter iter;
+	GTimer *timer;
+	guint nb_replaced;
+	gint i;
+
+	buffer = gtk_source_buffer_new (NULL);
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &iter);
+
+	gtk_source_buffer_begin_not_undoable_action (buffer);
+
+	for (i = 0; i < nb_lines; i++)
+	{
+		gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer),
+					&iter,
+					"foo bar baz foo\n",
+					-1);
+	}
+
+	gtk_source_buffer_end_not_undoable_action (buffer);
+
+	settings = gtk_source_search_settings_new ();
+	gtk_source_search_settings_set_regex_enabled (settings, regex_enabled);
+	gtk_source_search_settings_set_search_text (settings, search_text);
+
+	context = gtk_source_search_context_new (buffer, settings);
+	gtk_source_search_context_set_highlight (context, FALSE);
+
+	timer = g_timer_new ();
+
+	nb_replaced = gtk_source_search_context_replace_all (context, replace, -1, NULL);
+	g_assert_cmpuint (nb_replaced, ==, nb_lines * NB_MATCHES_PER_LINE);
+
+	g_timer_stop (timer);
+	g_print ("%u matches, %s: replace all in %lf seconds.\n",
+		 nb_replaced,
+		 regex_enabled ? "regex with backreferences" : "normal search",
+		 g_timer_elapsed (timer, NULL));
+
+	g_timer_start (timer);
+
+	gtk_source_buffer_undo (buffer);
+
+	g_timer_stop (timer);
+	g_print ("%u matches, %s: undo in %lf seconds.\n",
+		 nb_replaced,
+		 regex_enabled ? "regex with backreferences" : "normal search",
+		 g_timer_elapsed (timer, NULL));
+
+	g_assert_false (gtk_source_buffer_can_undo (buffer));
+
+	g_timer_destroy (timer);
+	g_object_unref (context);
+	g_object_unref (settings);
+	g_object_unref (buffer);
+}
+
+int
+main (int argc, char *argv[])
+{
+	gint nb_lines;
+
+	gtk_init (&argc, &argv);
+
+	for (nb_lines = 1000; nb_lines <= 100000; nb_lines *= 10)
+	{
+		test_replace_all (nb_lines, "foo", FALSE, "quux");
+		test_replace_all (nb_lines, "(f)(oo)", TRUE, "\\2\\1");
+	}
+
+	return 0;
+}
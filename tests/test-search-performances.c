@@ -18,6 +18,7 @@
  */
 
 #include <gtk/gtk.h>
+#include <string.h>
 #include <gtksourceview/gtksource.h>
 
 /* This measures the execution times for:
@@ -30,9 +31,27 @@
  * are really fast (going to the previous/next occurrence is done in O(log n)).
  * Different search flags are also tested. We can see a big difference between
  * the case sensitive search and case insensitive.
+ *
+ * The regex searches use the PCRE2 JIT compiler when GtkSourceView is
+ * configured with --enable-pcre2-jit. Compare the results with a build
+ * without it to see the gain.
+ *
+ * The scan of the whole buffer for a regex search is also measured with 1, 2, 4
+ * and 8 worker threads (see the GTK_SOURCE_SEARCH_THREADS environment
+ * variable), and with the scan in the main loop. The parallel scan is disabled
+ * for the other measures.
+ *
+ * The search-as-you-type is measured on a buffer with long lines: when the
+ * search text is extended, the new occurrences are found from the previous
+ * ones, and the time per keystroke should not depend on the length of the
+ * lines.
  */
 
 #define NB_LINES 100000
+#define MAX_NB_THREADS 8
+
+#define NB_LONG_LINES 100
+#define NB_WORDS_PER_LONG_LINE 2000
 
 static void
 on_notify_search_occurrences_count_cb (GtkSourceSearchContext *search_context,
@@ -45,6 +64,72 @@ on_notify_search_occurrences_count_cb (GtkSourceSearchContext *search_context,
 	gtk_main_quit ();
 }
 
+static void
+test_search_as_you_type_long_lines (void)
+{
+	GtkSourceBuffer *buffer;
+	GtkSourceSearchContext *search_context;
+	GtkSourceSearchSettings *search_settings;
+	GString *text;
+	GTimer *timer;
+	const gchar *search_text = "foobar";
+	gint i;
+
+	buffer = gtk_source_buffer_new (NULL);
+
+	text = g_string_new (NULL);
+
+	for (i = 0; i < NB_LONG_LINES * NB_WORDS_PER_LONG_LINE; i++)
+	{
+		g_string_append (text, i % 2 == 0 ? "foobar " : "foobaz ");
+
+		if ((i + 1) % NB_WORDS_PER_LONG_LINE == 0)
+		{
+			g_string_append_c (text, '\n');
+		}
+	}
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, text->len);
+	g_string_free (text, TRUE);
+
+	search_settings = gtk_source_search_settings_new ();
+	gtk_source_search_settings_set_case_sensitive (search_settings, TRUE);
+	search_context = gtk_source_search_context_new (buffer, search_settings);
+
+	gtk_source_search_settings_set_search_text (search_settings, "f");
+
+	while (gtk_source_search_context_get_occurrences_count (search_context) == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	timer = g_timer_new ();
+
+	for (i = 2; i <= (gint) strlen (search_text); i++)
+	{
+		gchar *prefix = g_strndup (search_text, i);
+
+		gtk_source_search_settings_set_search_text (search_settings, prefix);
+		g_free (prefix);
+
+		while (gtk_source_search_context_get_occurrences_count (search_context) == -1)
+		{
+			gtk_main_iteration ();
+		}
+	}
+
+	g_timer_stop (timer);
+	g_print ("search-as-you-type, %d lines of %d words: %lf seconds per keystroke.\n",
+		 NB_LONG_LINES,
+		 NB_WORDS_PER_LONG_LINE,
+		 g_timer_elapsed (timer, NULL) / (strlen (search_text) - 1));
+
+	g_timer_destroy (timer);
+	g_object_unref (search_context);
+	g_object_unref (search_settings);
+	g_object_unref (buffer);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -57,9 +142,13 @@ main (int argc, char *argv[])
 	gint i;
 	GtkTextSearchFlags flags;
 	gchar *regex_pattern;
+	gint nb_threads;
+	gdouble one_thread_time = 0.0;
 
 	gtk_init (&argc, &argv);
 
+	g_setenv ("GTK_SOURCE_SEARCH_THREADS", "0", TRUE);
+
 	buffer = gtk_source_buffer_new (NULL);
 
 	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &iter);
@@ -202,6 +291,23 @@ main (int argc, char *argv[])
 	g_print ("regex search: 'fill' (no partial matches): %lf seconds.\n",
 		 g_timer_elapsed (timer, NULL));
 
+	/* Regex search: search words with an alternation */
+
+	g_timer_start (timer);
+
+	gtk_source_search_settings_set_search_text (search_settings, "\\b(?:line|text|buffer)\\w*");
+
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &iter);
+
+	while (gtk_source_search_context_forward (search_context, &iter, NULL, &match_end, NULL))
+	{
+		iter = match_end;
+	}
+
+	g_timer_stop (timer);
+	g_print ("regex search: words with an alternation (no partial matches): %lf seconds.\n",
+		 g_timer_elapsed (timer, NULL));
+
 	/* Regex search: search single lines */
 
 	g_timer_start (timer);
@@ -259,6 +365,53 @@ main (int argc, char *argv[])
 		 NB_LINES / 10,
 		 g_timer_elapsed (timer, NULL));
 
+	/* Regex search: scan of the whole buffer, asynchronous */
+
+	for (nb_threads = 0; nb_threads <= MAX_NB_THREADS; nb_threads = MAX (1, nb_threads * 2))
+	{
+		gchar *nb_threads_str;
+		gdouble elapsed;
+
+		nb_threads_str = g_strdup_printf ("%d", nb_threads);
+		g_setenv ("GTK_SOURCE_SEARCH_THREADS", nb_threads_str, TRUE);
+		g_free (nb_threads_str);
+
+		gtk_source_search_settings_set_search_text (search_settings, NULL);
+
+		g_timer_start (timer);
+
+		gtk_source_search_settings_set_search_text (search_settings, "\\b(?:line|text|buffer)\\w*");
+
+		while (gtk_source_search_context_get_occurrences_count (search_context) == -1)
+		{
+			gtk_main_iteration ();
+		}
+
+		g_timer_stop (timer);
+		elapsed = g_timer_elapsed (timer, NULL);
+
+		if (nb_threads == 0)
+		{
+			g_print ("regex scan of the whole buffer, in the main loop: %lf seconds.\n",
+				 elapsed);
+			continue;
+		}
+
+		if (nb_threads == 1)
+		{
+			one_thread_time = elapsed;
+		}
+
+		g_print ("regex scan of the whole buffer, %d thread(s): %lf seconds (speedup: %.2lf).\n",
+			 nb_threads,
+			 elapsed,
+			 one_thread_time / elapsed);
+	}
+
+	g_setenv ("GTK_SOURCE_SEARCH_THREADS", "0", TRUE);
+
+	test_search_as_you_type_long_lines ();
+
 	/* Smart search, case sensitive, asynchronous */
 
 	/* The asynchronous overhead doesn't depend on the search flags, it
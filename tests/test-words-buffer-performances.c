@@ -0,0 +1,128 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include "gtksourceview/completion-providers/words/gtksourcecompletionwordsbuffer.h"
+
+/* This measures the cost of a keystroke in a long line, like a minified
+ * JavaScript file, for a text buffer scanned by the words completion provider.
+ * NB_KEYSTROKES characters are typed in the middle of a line of 1000, 10000 and
+ * 100000 characters, and then deleted one by one. The time per keystroke should
+ * not depend on the line length.
+ */
+
+#define MAX_LINE_LENGTH 100000
+#define NB_KEYSTROKES 10000
+
+/* Smaller than the size of the insertions for which the words are updated
+ * directly, so the line is never added to the scan region.
+ */
+#define PIECE_SIZE 512
+
+static void
+fill_line (GtkTextBuffer *buffer,
+	   gint           length)
+{
+	GString *line = g_string_new (NULL);
+	gint offset;
+	gint i;
+
+	for (i = 0; line->len < (gsize) length; i++)
+	{
+		g_string_append_printf (line, "var v%d=obj%d.method%d(arg%d);", i, i % 100, i % 10, i);
+	}
+
+	g_string_truncate (line, length);
+
+	for (offset = 0; offset < length; offset += PIECE_SIZE)
+	{
+		GtkTextIter end;
+
+		gtk_text_buffer_get_end_iter (buffer, &end);
+		gtk_text_buffer_insert (buffer, &end, line->str + offset, MIN (PIECE_SIZE, length - offset));
+	}
+
+	g_string_free (line, TRUE);
+}
+
+static void
+test_typing (gint length)
+{
+	GtkSourceCompletionWordsLibrary *library;
+	GtkSourceCompletionWordsBuffer *words_buffer;
+	GtkTextBuffer *buffer;
+	const gchar *text = "typed_word ";
+	GTimer *timer;
+	GtkTextIter iter;
+	gdouble insert_time;
+	gdouble delete_time;
+	gint i;
+
+	library = gtk_source_completion_words_library_new ();
+	buffer = gtk_text_buffer_new (NULL);
+	words_buffer = gtk_source_completion_words_buffer_new (library, buffer);
+
+	fill_line (buffer, length);
+
+	timer = g_timer_new ();
+
+	gtk_text_buffer_get_iter_at_offset (buffer, &iter, length / 2);
+
+	for (i = 0; i < NB_KEYSTROKES; i++)
+	{
+		gtk_text_buffer_insert (buffer, &iter, text + i % 11, 1);
+	}
+
+	insert_time = g_timer_elapsed (timer, NULL);
+	g_timer_start (timer);
+
+	for (i = 0; i < NB_KEYSTROKES; i++)
+	{
+		GtkTextIter start = iter;
+
+		gtk_text_iter_backward_char (&start);
+		gtk_text_buffer_delete (buffer, &start, &iter);
+	}
+
+	delete_time = g_timer_elapsed (timer, NULL);
+
+	g_print ("line of %6d characters: %lf ms per typed character, %lf ms per deleted character.\n",
+		 length,
+		 insert_time * 1000 / NB_KEYSTROKES,
+		 delete_time * 1000 / NB_KEYSTROKES);
+
+	g_timer_destroy (timer);
+	g_object_unref (words_buffer);
+	g_object_unref (buffer);
+	g_object_unref (library);
+}
+
+int
+main (int argc, char *argv[])
+{
+	gint length;
+
+	gtk_init (&argc, &argv);
+
+	for (length = 1000; length <= MAX_LINE_LENGTH; length *= 10)
+	{
+		test_typing (length);
+	}
+
+	return 0;
+}
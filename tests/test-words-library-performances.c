@@ -0,0 +1,202 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "gtksourceview/completion-providers/words/gtksourcecompletionwordslibrary.h"
+
+/* This measures the execution times of the library of the words completion
+ * provider, with NB_WORDS distinct words: adding the words (each word twice,
+ * like a word appearing in two buffers), enumerating the proposals for
+ * NB_PREFIXES prefixes by batches of PROPOSALS_BATCH_SIZE (the default of
+ * GtkSourceCompletionWords:proposals-batch-size), and removing the words.
+ *
+ * The fuzzy matching is measured for NB_FUZZY_QUERIES queries, with and without
+ * the time budget of GtkSourceCompletionWords:fuzzy-matching.
+ */
+
+#define NB_WORDS 1000000
+#define NB_PREFIXES 1000
+#define PROPOSALS_BATCH_SIZE 300
+#define NB_FUZZY_QUERIES 100
+#define FUZZY_TIME_BUDGET 3000
+
+static const gchar *prefixes[] =
+{
+	"get_", "set_", "is_", "on_", "update", "buffer", "iter", "tmp"
+};
+
+static gchar **
+generate_words (void)
+{
+	gchar **words = g_new0 (gchar *, NB_WORDS + 1);
+	GRand *rand = g_rand_new_with_seed (42);
+	gint i;
+
+	for (i = 0; i < NB_WORDS; i++)
+	{
+		words[i] = g_strdup_printf ("%s%x_%d",
+					    prefixes[g_rand_int_range (rand, 0, G_N_ELEMENTS (prefixes))],
+					    g_rand_int (rand),
+					    i);
+	}
+
+	g_rand_free (rand);
+	return words;
+}
+
+/* The queries are the first characters of the first two parts of a word, e.g.
+ * "gf" for "get_f5_1".
+ */
+static void
+test_fuzzy_matching (GtkSourceCompletionWordsLibrary *library,
+		     gchar                          **words,
+		     gint64                           time_budget)
+{
+	GTimer *timer = g_timer_new ();
+	gdouble total_time = 0.0;
+	gdouble max_time = 0.0;
+	guint nb_proposals = 0;
+	gint i;
+
+	for (i = 0; i < NB_FUZZY_QUERIES; i++)
+	{
+		const gchar *word = words[i * (NB_WORDS / NB_FUZZY_QUERIES)];
+		const gchar *separator = strchr (word, '_');
+		gchar query[3] = { word[0], separator[1], '\0' };
+		GList *proposals;
+		gdouble time;
+
+		g_timer_start (timer);
+
+		proposals = gtk_source_completion_words_library_get_fuzzy_proposals (library,
+										     query,
+										     PROPOSALS_BATCH_SIZE,
+										     time_budget);
+
+		time = g_timer_elapsed (timer, NULL);
+		total_time += time;
+		max_time = MAX (max_time, time);
+
+		nb_proposals += g_list_length (proposals);
+		g_list_free (proposals);
+	}
+
+	g_print ("fuzzy matching of %d queries (%u proposals), time budget %" G_GINT64_FORMAT " us: "
+		 "%lf seconds per query on average, %lf seconds at most.\n",
+		 NB_FUZZY_QUERIES,
+		 nb_proposals,
+		 time_budget,
+		 total_time / NB_FUZZY_QUERIES,
+		 max_time);
+
+	g_timer_destroy (timer);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GtkSourceCompletionWordsLibrary *library;
+	gchar **words;
+	GTimer *timer;
+	guint nb_proposals = 0;
+	gint i;
+
+	gtk_init (&argc, &argv);
+
+	words = generate_words ();
+	library = gtk_source_completion_words_library_new ();
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < NB_WORDS; i++)
+	{
+		gtk_source_completion_words_library_add_word (library, words[i]);
+		gtk_source_completion_words_library_add_word (library, words[i]);
+	}
+
+	g_print ("add %d words twice: %lf seconds.\n",
+		 NB_WORDS,
+		 g_timer_elapsed (timer, NULL));
+
+	g_timer_start (timer);
+
+	for (i = 0; i < NB_PREFIXES; i++)
+	{
+		gchar *prefix = g_strndup (words[i * (NB_WORDS / NB_PREFIXES)],
+					   strlen (prefixes[0]) + 1);
+		gchar *after = NULL;
+
+		while (TRUE)
+		{
+			GList *proposals;
+			guint nb;
+
+			proposals = gtk_source_completion_words_library_get_proposals (library,
+										       prefix,
+										       -1,
+										       after,
+										       PROPOSALS_BATCH_SIZE);
+
+			nb = g_list_length (proposals);
+			nb_proposals += nb;
+
+			if (nb > 0)
+			{
+				g_free (after);
+				after = g_strdup (gtk_source_completion_words_proposal_get_word (g_list_last (proposals)->data));
+			}
+
+			g_list_free (proposals);
+
+			if (nb < PROPOSALS_BATCH_SIZE)
+			{
+				break;
+			}
+		}
+
+		g_free (prefix);
+		g_free (after);
+	}
+
+	g_print ("enumerate the proposals of %d prefixes (%u proposals): %lf seconds.\n",
+		 NB_PREFIXES,
+		 nb_proposals,
+		 g_timer_elapsed (timer, NULL));
+
+	test_fuzzy_matching (library, words, 0);
+	test_fuzzy_matching (library, words, FUZZY_TIME_BUDGET);
+
+	g_timer_start (timer);
+
+	for (i = 0; i < NB_WORDS; i++)
+	{
+		gtk_source_completion_words_library_remove_word (library, words[i]);
+		gtk_source_completion_words_library_remove_word (library, words[i]);
+	}
+
+	g_print ("remove %d words twice: %lf seconds.\n",
+		 NB_WORDS,
+		 g_timer_elapsed (timer, NULL));
+
+	g_timer_destroy (timer);
+	g_object_unref (library);
+	g_strfreev (words);
+
+	return 0;
+}
@@ -162,6 +162,64 @@ do_test_change_case (GtkSourceBuffer         *buffer,
 	g_free (expected_normalized);
 }
 
+/* A big file is opened and the view goes to its end: the visible lines are
+ * highlighted before the text above them is analyzed.
+ */
+static void
+test_highlight_viewport_first (void)
+{
+	GtkSourceLanguageManager *lm;
+	GtkSourceLanguage *lang;
+	GtkSourceBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	GtkTextIter iter;
+	GString *text;
+	const gint nb_lines = 100000;
+	gint i;
+
+	lm = gtk_source_language_manager_get_default ();
+	lang = gtk_source_language_manager_get_language (lm, "c");
+	buffer = gtk_source_buffer_new_with_language (lang);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	text = g_string_new (NULL);
+
+	for (i = 0; i < nb_lines; i++)
+	{
+		g_string_append (text, "x; /* comment */\n");
+	}
+
+	gtk_text_buffer_set_text (text_buffer, text->str, -1);
+	g_string_free (text, TRUE);
+
+	/* What the view asks for when it shows the last lines. */
+	gtk_text_buffer_get_end_iter (text_buffer, &end);
+	start = end;
+	gtk_text_iter_backward_lines (&start, 50);
+	_gtk_source_buffer_update_syntax_highlight (buffer, &start, &end, FALSE);
+
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &iter, nb_lines - 10, 5);
+
+	while (!gtk_source_buffer_iter_has_context_class (buffer, &iter, "comment"))
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &iter, nb_lines / 2, 5);
+	g_assert (!gtk_source_buffer_iter_has_context_class (buffer, &iter, "comment"));
+
+	/* The rest is analyzed afterwards. */
+	start = iter;
+	end = start;
+	gtk_text_iter_forward_line (&end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+	g_assert (gtk_source_buffer_iter_has_context_class (buffer, &iter, "comment"));
+
+	g_object_unref (buffer);
+}
+
 static void
 test_change_case (void)
 {
@@ -445,6 +503,7 @@ main (int argc, char** argv)
 
 	g_test_add_func ("/Buffer/bug-634510", test_get_buffer);
 	g_test_add_func ("/Buffer/get-context-classes", test_get_context_classes);
+	g_test_add_func ("/Buffer/highlight-viewport-first", test_highlight_viewport_first);
 	g_test_add_func ("/Buffer/change-case", test_change_case);
 	g_test_add_func ("/Buffer/join-lines", test_join_lines);
 	g_test_add_func ("/Buffer/sort-lines", test_sort_lines);
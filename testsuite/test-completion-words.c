@@ -18,6 +18,7 @@
  */
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 #include <gtksourceview/gtksource.h>
 #include "gtksourceview/completion-providers/words/gtksourcecompletionwordslibrary.h"
 
@@ -32,39 +33,330 @@ library_add_words (GtkSourceCompletionWordsLibrary *library)
 	gtk_source_completion_words_library_add_word (library, "ddf");
 }
 
+/* Returns the words of the proposals, separated by spaces, and frees the
+ * list.
+ */
+static gchar *
+proposals_to_string (GList *proposals)
+{
+	GList *l;
+	GString *words = g_string_new (NULL);
+
+	for (l = proposals; l != NULL; l = l->next)
+	{
+		GtkSourceCompletionWordsProposal *proposal = l->data;
+
+		if (l != proposals)
+		{
+			g_string_append_c (words, ' ');
+		}
+
+		g_string_append (words, gtk_source_completion_words_proposal_get_word (proposal));
+	}
+
+	g_list_free (proposals);
+	return g_string_free (words, FALSE);
+}
+
+static gchar *
+get_proposals (GtkSourceCompletionWordsLibrary *library,
+	       const gchar                     *prefix,
+	       const gchar                     *after,
+	       guint                            max_proposals)
+{
+	return proposals_to_string (gtk_source_completion_words_library_get_proposals (library,
+										       prefix,
+										       -1,
+										       after,
+										       max_proposals));
+}
+
+static gchar *
+get_fuzzy_proposals (GtkSourceCompletionWordsLibrary *library,
+		     const gchar                     *query,
+		     guint                            max_proposals)
+{
+	return proposals_to_string (gtk_source_completion_words_library_get_fuzzy_proposals (library,
+											     query,
+											     max_proposals,
+											     0));
+}
+
 static void
 test_library_find (void)
 {
 	GtkSourceCompletionWordsLibrary *library = gtk_source_completion_words_library_new ();
-	GtkSourceCompletionWordsProposal *proposal;
-	GSequenceIter *iter;
-	const gchar *word;
+	gchar *words;
+
+	library_add_words (library);
+
+	words = get_proposals (library, "a", NULL, 10);
+	g_assert_cmpstr (words, ==, "");
+	g_free (words);
+
+	words = get_proposals (library, "bba", NULL, 10);
+	g_assert_cmpstr (words, ==, "");
+	g_free (words);
+
+	words = get_proposals (library, "b", NULL, 10);
+	g_assert_cmpstr (words, ==, "bb bbc bbd");
+	g_free (words);
+
+	words = get_proposals (library, "dd", NULL, 10);
+	g_assert_cmpstr (words, ==, "dd dde ddf");
+	g_free (words);
+
+	words = get_proposals (library, "", NULL, 10);
+	g_assert_cmpstr (words, ==, "bb bbc bbd dd dde ddf");
+	g_free (words);
+
+	/* By batches. */
+	words = get_proposals (library, "", NULL, 4);
+	g_assert_cmpstr (words, ==, "bb bbc bbd dd");
+	g_free (words);
+
+	words = get_proposals (library, "", "dd", 4);
+	g_assert_cmpstr (words, ==, "dde ddf");
+	g_free (words);
+
+	words = get_proposals (library, "b", "bbc", 4);
+	g_assert_cmpstr (words, ==, "bbd");
+	g_free (words);
+
+	g_object_unref (library);
+}
+
+static void
+test_library_remove (void)
+{
+	GtkSourceCompletionWordsLibrary *library = gtk_source_completion_words_library_new ();
+	gchar *words;
 
 	library_add_words (library);
+	gtk_source_completion_words_library_add_word (library, "bbc");
+
+	gtk_source_completion_words_library_remove_word (library, "bb");
+	gtk_source_completion_words_library_remove_word (library, "bbc");
+
+	words = get_proposals (library, "b", NULL, 10);
+	g_assert_cmpstr (words, ==, "bbc bbd");
+	g_free (words);
+
+	gtk_source_completion_words_library_remove_word (library, "bbc");
+	gtk_source_completion_words_library_remove_word (library, "bbd");
+
+	words = get_proposals (library, "b", NULL, 10);
+	g_assert_cmpstr (words, ==, "");
+	g_free (words);
 
-	iter = gtk_source_completion_words_library_find_first (library, "a", -1);
-	g_assert (iter == NULL);
+	/* New words are not added when the library is locked. */
+	gtk_source_completion_words_library_lock (library);
+	g_assert (!gtk_source_completion_words_library_add_word (library, "ddg"));
+	g_assert (gtk_source_completion_words_library_add_word (library, "dde"));
+	gtk_source_completion_words_library_unlock (library);
 
-	iter = gtk_source_completion_words_library_find_first (library, "bba", -1);
-	g_assert (iter == NULL);
+	words = get_proposals (library, "", NULL, 10);
+	g_assert_cmpstr (words, ==, "dd dde ddf");
+	g_free (words);
 
-	iter = gtk_source_completion_words_library_find_first (library, "b", -1);
-	g_assert (iter != NULL);
+	g_object_unref (library);
+}
+
+static void
+test_library_add_words (void)
+{
+	GtkSourceCompletionWordsLibrary *library = gtk_source_completion_words_library_new ();
+	GHashTable *counts;
+	gchar *words;
 
-	proposal = gtk_source_completion_words_library_get_proposal (iter);
-	word = gtk_source_completion_words_proposal_get_word (proposal);
-	g_assert_cmpstr (word, ==, "bb");
+	counts = g_hash_table_new (g_str_hash, g_str_equal);
+	g_hash_table_insert (counts, "foo", GUINT_TO_POINTER (2));
+	g_hash_table_insert (counts, "foobar", GUINT_TO_POINTER (1));
+	g_hash_table_insert (counts, "bar", GUINT_TO_POINTER (1));
 
-	iter = gtk_source_completion_words_library_find_first (library, "dd", -1);
-	g_assert (iter != NULL);
+	gtk_source_completion_words_library_add_words (library, counts);
+	g_hash_table_unref (counts);
 
-	proposal = gtk_source_completion_words_library_get_proposal (iter);
-	word = gtk_source_completion_words_proposal_get_word (proposal);
-	g_assert_cmpstr (word, ==, "dd");
+	words = get_proposals (library, "foo", NULL, 10);
+	g_assert_cmpstr (words, ==, "foo foobar");
+	g_free (words);
+
+	/* "foo" has two occurrences. */
+	gtk_source_completion_words_library_remove_word (library, "foo");
+	gtk_source_completion_words_library_remove_word (library, "foobar");
+
+	words = get_proposals (library, "", NULL, 10);
+	g_assert_cmpstr (words, ==, "bar foo");
+	g_free (words);
 
 	g_object_unref (library);
 }
 
+static void
+test_library_fuzzy (void)
+{
+	GtkSourceCompletionWordsLibrary *library = gtk_source_completion_words_library_new ();
+	gchar *words;
+
+	gtk_source_completion_words_library_add_word (library, "get_buffer");
+	gtk_source_completion_words_library_add_word (library, "getBuffer");
+	gtk_source_completion_words_library_add_word (library, "gbuffer");
+	gtk_source_completion_words_library_add_word (library, "global_buf");
+	gtk_source_completion_words_library_add_word (library, "begin");
+	gtk_source_completion_words_library_add_word (library, "get_bounds");
+	gtk_source_completion_words_library_add_word (library, "get_bounds");
+
+	words = get_fuzzy_proposals (library, "gbuf", 10);
+	g_assert_cmpstr (words, ==, "gbuffer getBuffer get_buffer global_buf");
+	g_free (words);
+
+	/* Same score, "get_bounds" is more used. */
+	words = get_fuzzy_proposals (library, "gb", 3);
+	g_assert_cmpstr (words, ==, "gbuffer get_bounds getBuffer");
+	g_free (words);
+
+	/* Bonus for the same case. */
+	words = get_fuzzy_proposals (library, "GB", 1);
+	g_assert_cmpstr (words, ==, "getBuffer");
+	g_free (words);
+
+	words = get_fuzzy_proposals (library, "bgn", 10);
+	g_assert_cmpstr (words, ==, "begin");
+	g_free (words);
+
+	words = get_fuzzy_proposals (library, "zz", 10);
+	g_assert_cmpstr (words, ==, "");
+	g_free (words);
+
+	gtk_source_completion_words_library_remove_word (library, "gbuffer");
+
+	words = get_fuzzy_proposals (library, "gbuf", 10);
+	g_assert_cmpstr (words, ==, "getBuffer get_buffer global_buf");
+	g_free (words);
+
+	g_object_unref (library);
+}
+
+/* Index files with two words, at the offsets 32 and 36, each with a frequency
+ * of 1. The last nul byte is the one of the string literal.
+ */
+static const gchar unsorted_index[] =
+	"GSVWORDS" "\1\0\0\0" "\2\0\0\0"
+	"\40\0\0\0" "\1\0\0\0"
+	"\44\0\0\0" "\1\0\0\0"
+	"foo\0" "bar";
+
+static const gchar invalid_utf8_index[] =
+	"GSVWORDS" "\1\0\0\0" "\2\0\0\0"
+	"\40\0\0\0" "\1\0\0\0"
+	"\44\0\0\0" "\1\0\0\0"
+	"bar\0" "\377oo";
+
+static void
+test_library_index (void)
+{
+	GtkSourceCompletionWordsLibrary *library = gtk_source_completion_words_library_new ();
+	GtkSourceCompletionWordsIndex *index;
+	const gchar *filename = "completion-words.index";
+	GHashTable *frequencies;
+	gchar *words;
+	GError *error = NULL;
+
+	frequencies = g_hash_table_new (g_str_hash, g_str_equal);
+	g_hash_table_insert (frequencies, "foo", GUINT_TO_POINTER (5));
+	g_hash_table_insert (frequencies, "foobar", GUINT_TO_POINTER (1));
+	g_hash_table_insert (frequencies, "baz", GUINT_TO_POINTER (2));
+
+	gtk_source_completion_words_index_write (frequencies, filename, &error);
+	g_assert_no_error (error);
+	g_hash_table_unref (frequencies);
+
+	index = gtk_source_completion_words_index_new (filename, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (gtk_source_completion_words_index_get_n_words (index), ==, 3);
+	g_assert_cmpstr (gtk_source_completion_words_index_get_word (index, 0), ==, "baz");
+	g_assert_cmpuint (gtk_source_completion_words_index_get_frequency (index, 0), ==, 2);
+
+	gtk_source_completion_words_library_add_word (library, "foo");
+	gtk_source_completion_words_library_add_word (library, "fooqux");
+	gtk_source_completion_words_library_set_index (library, index);
+
+	/* The words in the trie and in the index are merged. */
+	words = get_proposals (library, "foo", NULL, 10);
+	g_assert_cmpstr (words, ==, "foo foobar fooqux");
+	g_free (words);
+
+	words = get_proposals (library, "foo", "foo", 1);
+	g_assert_cmpstr (words, ==, "foobar");
+	g_free (words);
+
+	words = get_fuzzy_proposals (library, "fb", 10);
+	g_assert_cmpstr (words, ==, "foobar");
+	g_free (words);
+
+	/* The words of the index stay. */
+	gtk_source_completion_words_library_remove_word (library, "foo");
+
+	words = get_proposals (library, "", NULL, 10);
+	g_assert_cmpstr (words, ==, "baz foo foobar fooqux");
+	g_free (words);
+
+	gtk_source_completion_words_library_set_index (library, NULL);
+
+	words = get_proposals (library, "", NULL, 10);
+	g_assert_cmpstr (words, ==, "fooqux");
+	g_free (words);
+
+	/* Invalid file. */
+	g_file_set_contents (filename, "foo", -1, &error);
+	g_assert_no_error (error);
+
+	index = gtk_source_completion_words_index_new (filename, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	g_assert (index == NULL);
+	g_clear_error (&error);
+
+	/* Words not sorted. The words are checked only when they are read, a
+	 * wrong order gives missing words.
+	 */
+	g_file_set_contents (filename, unsorted_index, sizeof (unsorted_index), &error);
+	g_assert_no_error (error);
+
+	index = gtk_source_completion_words_index_new (filename, &error);
+	g_assert_no_error (error);
+	gtk_source_completion_words_library_set_index (library, index);
+
+	words = get_proposals (library, "f", NULL, 10);
+	g_assert_cmpstr (words, ==, "fooqux");
+	g_free (words);
+
+	words = get_proposals (library, "", NULL, 10);
+	g_assert_cmpstr (words, ==, "foo fooqux");
+	g_free (words);
+
+	/* Word not valid UTF-8. */
+	g_file_set_contents (filename, invalid_utf8_index, sizeof (invalid_utf8_index), &error);
+	g_assert_no_error (error);
+
+	index = gtk_source_completion_words_index_new (filename, &error);
+	g_assert_no_error (error);
+	g_assert (gtk_source_completion_words_index_get_word (index, 1) == NULL);
+	gtk_source_completion_words_library_set_index (library, index);
+
+	words = get_proposals (library, "", NULL, 10);
+	g_assert_cmpstr (words, ==, "bar fooqux");
+	g_free (words);
+
+	words = get_fuzzy_proposals (library, "oo", 10);
+	g_assert_cmpstr (words, ==, "fooqux");
+	g_free (words);
+
+	gtk_source_completion_words_library_set_index (library, NULL);
+
+	g_remove (filename);
+	g_object_unref (library);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -73,5 +365,17 @@ main (int argc, char **argv)
 	g_test_add_func ("/CompletionWords/library/find",
 			 test_library_find);
 
+	g_test_add_func ("/CompletionWords/library/remove",
+			 test_library_remove);
+
+	g_test_add_func ("/CompletionWords/library/add_words",
+			 test_library_add_words);
+
+	g_test_add_func ("/CompletionWords/library/fuzzy",
+			 test_library_fuzzy);
+
+	g_test_add_func ("/CompletionWords/library/index",
+			 test_library_index);
+
 	return g_test_run ();
 }
@@ -0,0 +1,189 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtksourceview/gtksource.h>
+#include <string.h>
+
+typedef struct
+{
+	GMainLoop *main_loop;
+
+	/* The occurrences found, as "basename:line:start-end" strings. */
+	GPtrArray *matches;
+
+	GError *error;
+} SearchTestData;
+
+static void
+match_found_cb (GtkSourceFileSearch *search,
+		GFile               *file,
+		gint                 line,
+		gint                 start_byte,
+		gint                 end_byte,
+		SearchTestData      *data)
+{
+	gchar *basename = g_file_get_basename (file);
+
+	g_ptr_array_add (data->matches,
+			 g_strdup_printf ("%s:%d:%d-%d", basename, line, start_byte, end_byte));
+
+	g_free (basename);
+}
+
+static void
+search_finished_cb (GtkSourceFileSearch *search,
+		    GAsyncResult        *result,
+		    SearchTestData      *data)
+{
+	gtk_source_file_search_search_finish (search, result, &data->error);
+	g_main_loop_quit (data->main_loop);
+}
+
+static gint
+compare_strings (gconstpointer a,
+		 gconstpointer b)
+{
+	return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Returns the sorted occurrences, separated by spaces. */
+static gchar *
+search_files (GtkSourceFileSearch  *search,
+	      GList                *files,
+	      GError              **error)
+{
+	SearchTestData data;
+	gulong handler_id;
+	gchar *result;
+
+	data.main_loop = g_main_loop_new (NULL, FALSE);
+	data.matches = g_ptr_array_new_with_free_func (g_free);
+	data.error = NULL;
+
+	handler_id = g_signal_connect (search,
+				       "match-found",
+				       G_CALLBACK (match_found_cb),
+				       &data);
+
+	gtk_source_file_search_search_async (search,
+					     files,
+					     G_PRIORITY_DEFAULT,
+					     NULL,
+					     (GAsyncReadyCallback) search_finished_cb,
+					     &data);
+
+	g_main_loop_run (data.main_loop);
+	g_signal_handler_disconnect (search, handler_id);
+
+	g_ptr_array_sort (data.matches, compare_strings);
+	g_ptr_array_add (data.matches, NULL);
+	result = g_strjoinv (" ", (gchar **) data.matches->pdata);
+
+	g_ptr_array_unref (data.matches);
+	g_main_loop_unref (data.main_loop);
+
+	g_propagate_error (error, data.error);
+	return result;
+}
+
+static GFile *
+create_file (const gchar *filename,
+	     const gchar *contents)
+{
+	GError *error = NULL;
+
+	g_file_set_contents (filename, contents, -1, &error);
+	g_assert_no_error (error);
+
+	return g_file_new_for_path (filename);
+}
+
+static void
+delete_file (GFile *location)
+{
+	GError *error = NULL;
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+}
+
+static void
+test_search (void)
+{
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceFileSearch *search = gtk_source_file_search_new (settings);
+	GSList *candidate_encodings = NULL;
+	GList *files = NULL;
+	gchar *result;
+	GError *error = NULL;
+
+	files = g_list_append (files, create_file ("file-search-1.txt", "foo bar\nbaz Foo\n"));
+
+	/* "café foo\r\nfoo" in ISO-8859-15. */
+	files = g_list_append (files, create_file ("file-search-2.txt", "caf\xe9 foo\r\nfoo"));
+
+	candidate_encodings = g_slist_append (candidate_encodings, (gpointer) gtk_source_encoding_get_utf8 ());
+	candidate_encodings = g_slist_append (candidate_encodings, (gpointer) gtk_source_encoding_get_from_charset ("ISO-8859-15"));
+	gtk_source_file_search_set_candidate_encodings (search, candidate_encodings);
+
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	result = search_files (search, files, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (result, ==, "file-search-1.txt:0:0-3 file-search-1.txt:1:4-7 "
+			 "file-search-2.txt:0:6-9 file-search-2.txt:1:0-3");
+	g_free (result);
+
+	gtk_source_search_settings_set_case_sensitive (settings, TRUE);
+	result = search_files (search, files, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (result, ==, "file-search-1.txt:0:0-3 "
+			 "file-search-2.txt:0:6-9 file-search-2.txt:1:0-3");
+	g_free (result);
+
+	/* A multi-line match. */
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "bar\\nbaz");
+	result = search_files (search, files, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (result, ==, "file-search-1.txt:0:4-11");
+	g_free (result);
+
+	/* Invalid regex. */
+	gtk_source_search_settings_set_search_text (settings, "foo(");
+	result = search_files (search, files, &error);
+	g_assert_error (error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE);
+	g_assert_cmpstr (result, ==, "");
+	g_clear_error (&error);
+	g_free (result);
+
+	g_list_foreach (files, (GFunc) delete_file, NULL);
+	g_list_free_full (files, g_object_unref);
+	g_slist_free (candidate_encodings);
+	g_object_unref (search);
+	g_object_unref (settings);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/file-search/search", test_search);
+
+	return g_test_run ();
+}
@@ -22,8 +22,17 @@
  */
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <utime.h>
 #include <gtksourceview/gtksource.h>
 
+/* Temporary $XDG_CACHE_HOME, so that the tests don't use the cache of the
+ * user. It is created by the main test process, and shared with the
+ * subprocesses through CACHE_HOME_ENV.
+ */
+#define CACHE_HOME_ENV "GTK_SOURCE_TEST_CACHE_HOME"
+static gchar *cache_home;
+
 /* If we are running from the source dir (e.g. during make check)
  * we override the path to read from the data dir
  */
@@ -184,9 +193,220 @@ test_guess_language (void)
 	g_assert_cmpstr (gtk_source_language_get_id (l), ==, "xslt");
 }
 
+static void
+check_same_strv (gchar **strv1,
+		 gchar **strv2)
+{
+	gint i;
+
+	g_assert ((strv1 == NULL) == (strv2 == NULL));
+
+	if (strv1 == NULL)
+	{
+		return;
+	}
+
+	g_assert_cmpuint (g_strv_length (strv1), ==, g_strv_length (strv2));
+
+	for (i = 0; strv1[i] != NULL; i++)
+	{
+		g_assert_cmpstr (strv1[i], ==, strv2[i]);
+	}
+}
+
+static gchar *
+get_cache_dir (void)
+{
+	return g_build_filename (cache_home, "gtksourceview-4", NULL);
+}
+
+/* Returns the cache files, and sets their modification time to @mtime if it
+ * is not 0.
+ */
+static GPtrArray *
+get_cache_files (time_t mtime)
+{
+	GPtrArray *files;
+	gchar *dirname;
+	GDir *dir;
+	const gchar *name;
+
+	files = g_ptr_array_new_with_free_func (g_free);
+	dirname = get_cache_dir ();
+	dir = g_dir_open (dirname, 0, NULL);
+
+	while (dir != NULL && (name = g_dir_read_name (dir)) != NULL)
+	{
+		gchar *filename = g_build_filename (dirname, name, NULL);
+
+		if (mtime != 0)
+		{
+			struct utimbuf times;
+
+			times.actime = mtime;
+			times.modtime = mtime;
+			g_assert_cmpint (g_utime (filename, &times), ==, 0);
+		}
+
+		g_ptr_array_add (files, filename);
+	}
+
+	if (dir != NULL)
+	{
+		g_dir_close (dir);
+	}
+
+	g_free (dirname);
+	return files;
+}
+
+/* The first manager writes the cache of the language metadata, the second one
+ * reads it. Both must give the same languages. A manager with another search
+ * path uses another cache file.
+ */
+static void
+test_language_cache (void)
+{
+	GtkSourceLanguageManager *lm1, *lm2, *lm3;
+	const gchar * const *ids1;
+	const gchar * const *ids2;
+	gchar **search_path;
+	guint n_dirs;
+	GPtrArray *files;
+	guint n_files;
+	gint i;
+
+	lm1 = gtk_source_language_manager_new ();
+	gtk_source_language_manager_set_search_path (lm1,
+		(gchar **) gtk_source_language_manager_get_search_path (gtk_source_language_manager_get_default ()));
+	ids1 = gtk_source_language_manager_get_language_ids (lm1);
+
+	/* The cache is rewritten if any lang file is parsed, which would
+	 * change the modification time.
+	 */
+	files = get_cache_files (1);
+	n_files = files->len;
+	g_assert_cmpuint (n_files, >, 0);
+	g_ptr_array_unref (files);
+
+	lm2 = gtk_source_language_manager_new ();
+	gtk_source_language_manager_set_search_path (lm2,
+		(gchar **) gtk_source_language_manager_get_search_path (lm1));
+	ids2 = gtk_source_language_manager_get_language_ids (lm2);
+
+	files = get_cache_files (0);
+	g_assert_cmpuint (files->len, ==, n_files);
+
+	for (i = 0; i < (gint) files->len; i++)
+	{
+		GStatBuf buf;
+
+		g_assert_cmpint (g_stat (g_ptr_array_index (files, i), &buf), ==, 0);
+		g_assert_cmpint (buf.st_mtime, ==, 1);
+	}
+
+	g_ptr_array_unref (files);
+
+	g_assert (ids1 != NULL);
+	g_assert (ids2 != NULL);
+
+	for (i = 0; ids1[i] != NULL; i++)
+	{
+		GtkSourceLanguage *lang1, *lang2;
+		gchar **strv1, **strv2;
+
+		g_assert_cmpstr (ids1[i], ==, ids2[i]);
+
+		lang1 = gtk_source_language_manager_get_language (lm1, ids1[i]);
+		lang2 = gtk_source_language_manager_get_language (lm2, ids2[i]);
+
+		g_assert_cmpstr (gtk_source_language_get_name (lang1), ==, gtk_source_language_get_name (lang2));
+		g_assert_cmpstr (gtk_source_language_get_section (lang1), ==, gtk_source_language_get_section (lang2));
+		g_assert (gtk_source_language_get_hidden (lang1) == gtk_source_language_get_hidden (lang2));
+		g_assert_cmpstr (gtk_source_language_get_metadata (lang1, "line-comment-start"), ==,
+				 gtk_source_language_get_metadata (lang2, "line-comment-start"));
+
+		strv1 = gtk_source_language_get_globs (lang1);
+		strv2 = gtk_source_language_get_globs (lang2);
+		check_same_strv (strv1, strv2);
+		g_strfreev (strv1);
+		g_strfreev (strv2);
+
+		strv1 = gtk_source_language_get_mime_types (lang1);
+		strv2 = gtk_source_language_get_mime_types (lang2);
+		check_same_strv (strv1, strv2);
+		g_strfreev (strv1);
+		g_strfreev (strv2);
+	}
+
+	g_assert (ids2[i] == NULL);
+
+	n_dirs = g_strv_length ((gchar **) gtk_source_language_manager_get_search_path (lm1));
+	search_path = g_new0 (gchar *, n_dirs + 2);
+
+	for (i = 0; i < (gint) n_dirs; i++)
+	{
+		search_path[i] = g_strdup (gtk_source_language_manager_get_search_path (lm1)[i]);
+	}
+
+	search_path[n_dirs] = g_build_filename (cache_home, "nonexistent", NULL);
+
+	lm3 = gtk_source_language_manager_new ();
+	gtk_source_language_manager_set_search_path (lm3, search_path);
+	g_assert (gtk_source_language_manager_get_language_ids (lm3) != NULL);
+
+	files = get_cache_files (0);
+	g_assert_cmpuint (files->len, ==, n_files + 1);
+	g_ptr_array_unref (files);
+
+	g_strfreev (search_path);
+	g_object_unref (lm1);
+	g_object_unref (lm2);
+	g_object_unref (lm3);
+}
+
+static void
+remove_cache_home (void)
+{
+	GPtrArray *files;
+	gchar *dirname;
+	guint i;
+
+	files = get_cache_files (0);
+
+	for (i = 0; i < files->len; i++)
+	{
+		g_unlink (g_ptr_array_index (files, i));
+	}
+
+	g_ptr_array_unref (files);
+
+	dirname = get_cache_dir ();
+	g_rmdir (dirname);
+	g_free (dirname);
+
+	g_rmdir (cache_home);
+}
+
 int
 main (int argc, char** argv)
 {
+	gboolean subprocess;
+	gint ret;
+
+	/* Before the first call to g_get_user_cache_dir(). */
+	cache_home = g_strdup (g_getenv (CACHE_HOME_ENV));
+	subprocess = cache_home != NULL;
+
+	if (!subprocess)
+	{
+		cache_home = g_dir_make_tmp ("test-languagemanager-XXXXXX", NULL);
+		g_assert (cache_home != NULL);
+		g_setenv (CACHE_HOME_ENV, cache_home, TRUE);
+	}
+
+	g_setenv ("XDG_CACHE_HOME", cache_home, TRUE);
+
 	gtk_test_init (&argc, &argv);
 
 	init_default_manager ();
@@ -198,6 +418,15 @@ main (int argc, char** argv)
 	g_test_add_func ("/LanguageManager/guess-language/subprocess/empty_null", test_guess_language_empty_null);
 	g_test_add_func ("/LanguageManager/guess-language/subprocess/null_empty", test_guess_language_null_empty);
 	g_test_add_func ("/LanguageManager/guess-language/subprocess/empty_empty", test_guess_language_empty_empty);
+	g_test_add_func ("/LanguageManager/language-cache", test_language_cache);
+
+	ret = g_test_run ();
+
+	if (!subprocess)
+	{
+		remove_cache_home ();
+	}
 
-	return g_test_run();
+	g_free (cache_home);
+	return ret;
 }
@@ -0,0 +1,256 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; coding: utf-8 -*- */
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include "gtksourceview/gtksourceoccurrencesindex.h"
+
+/* Enough occurrences to have several blocks. */
+#define NB_OCCURRENCES 1000
+
+typedef struct
+{
+	gint start;
+	gint end;
+} Occurrence;
+
+/* Compares the index with @expected, an array of Occurrence's. */
+static void
+check_index (GtkSourceOccurrencesIndex *index,
+	     GArray                    *expected)
+{
+	GtkSourceOccurrencesIter iter;
+	guint i = 0;
+
+	g_assert_cmpuint (_gtk_source_occurrences_index_get_length (index), ==, expected->len);
+
+	for (_gtk_source_occurrences_index_iter_at_offset (index, &iter, 0);
+	     !_gtk_source_occurrences_index_iter_is_end (&iter);
+	     _gtk_source_occurrences_index_iter_next (&iter))
+	{
+		Occurrence *occurrence = &g_array_index (expected, Occurrence, i);
+		GtkSourceOccurrencesIter iter_at_offset;
+		gint start;
+		gint end;
+
+		_gtk_source_occurrences_index_iter_get (&iter, &start, &end);
+		g_assert_cmpint (start, ==, occurrence->start);
+		g_assert_cmpint (end, ==, occurrence->end);
+		g_assert_cmpuint (_gtk_source_occurrences_index_iter_get_position (&iter), ==, i);
+
+		_gtk_source_occurrences_index_iter_at_offset (index, &iter_at_offset, start);
+		_gtk_source_occurrences_index_iter_get (&iter_at_offset, &start, NULL);
+		g_assert_cmpint (start, ==, occurrence->start);
+
+		/* In the gap before the occurrence. */
+		if (i == 0 || g_array_index (expected, Occurrence, i - 1).start < occurrence->start - 1)
+		{
+			_gtk_source_occurrences_index_iter_at_offset (index, &iter_at_offset, occurrence->start - 1);
+			_gtk_source_occurrences_index_iter_get (&iter_at_offset, &start, NULL);
+			g_assert_cmpint (start, ==, occurrence->start);
+		}
+
+		i++;
+	}
+
+	g_assert_cmpuint (i, ==, expected->len);
+
+	/* Backward. */
+	while (_gtk_source_occurrences_index_iter_prev (&iter))
+	{
+		gint start;
+
+		i--;
+		_gtk_source_occurrences_index_iter_get (&iter, &start, NULL);
+		g_assert_cmpint (start, ==, g_array_index (expected, Occurrence, i).start);
+	}
+
+	g_assert_cmpuint (i, ==, 0);
+}
+
+static void
+expected_remove (GArray *expected,
+		 gint    start_offset,
+		 gint    end_offset)
+{
+	guint i = 0;
+
+	while (i < expected->len)
+	{
+		Occurrence *occurrence = &g_array_index (expected, Occurrence, i);
+
+		if (start_offset <= occurrence->start && occurrence->start < end_offset)
+		{
+			g_array_remove_index (expected, i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+static void
+expected_shift (GArray *expected,
+		gint    offset,
+		gint    delta)
+{
+	guint i;
+
+	for (i = 0; i < expected->len; i++)
+	{
+		Occurrence *occurrence = &g_array_index (expected, Occurrence, i);
+
+		if (occurrence->start >= offset)
+		{
+			occurrence->start += delta;
+			occurrence->end += delta;
+		}
+	}
+}
+
+static void
+expected_add (GArray *expected,
+	      gint    start,
+	      gint    end)
+{
+	Occurrence occurrence = { start, end };
+	guint i = 0;
+
+	while (i < expected->len && g_array_index (expected, Occurrence, i).start < start)
+	{
+		i++;
+	}
+
+	g_array_insert_val (expected, i, occurrence);
+}
+
+static void
+test_add (void)
+{
+	GtkSourceOccurrencesIndex *index;
+	GArray *expected;
+	gint i;
+
+	index = _gtk_source_occurrences_index_new ();
+	expected = g_array_new (FALSE, FALSE, sizeof (Occurrence));
+
+	/* In the order of a scan, then in the reverse order, then in the
+	 * middle of the previous ones.
+	 */
+	for (i = 0; i < NB_OCCURRENCES; i++)
+	{
+		Occurrence occurrence = { 10 * i + 3000 * 10, 10 * i + 3000 * 10 + 2 };
+
+		_gtk_source_occurrences_index_add (index, occurrence.start, occurrence.end);
+		g_array_append_val (expected, occurrence);
+	}
+
+	for (i = NB_OCCURRENCES - 1; i >= 0; i--)
+	{
+		Occurrence occurrence = { 10 * i, 10 * i + 2 };
+
+		_gtk_source_occurrences_index_add (index, occurrence.start, occurrence.end);
+		g_array_insert_val (expected, 0, occurrence);
+	}
+
+	check_index (index, expected);
+
+	for (i = 0; i < NB_OCCURRENCES; i++)
+	{
+		Occurrence occurrence = { 10 * i + 5, 10 * i + 7 };
+
+		_gtk_source_occurrences_index_add (index, occurrence.start, occurrence.end);
+		g_array_insert_val (expected, 2 * i + 1, occurrence);
+	}
+
+	check_index (index, expected);
+
+	_gtk_source_occurrences_index_clear (index);
+	g_array_set_size (expected, 0);
+	check_index (index, expected);
+
+	_gtk_source_occurrences_index_free (index);
+	g_array_free (expected, TRUE);
+}
+
+/* Random text insertions and deletions, like in a buffer. */
+static void
+test_edits (void)
+{
+	GtkSourceOccurrencesIndex *index;
+	GArray *expected;
+	gint i;
+
+	index = _gtk_source_occurrences_index_new ();
+	expected = g_array_new (FALSE, FALSE, sizeof (Occurrence));
+
+	for (i = 0; i < NB_OCCURRENCES; i++)
+	{
+		Occurrence occurrence = { 10 * i, 10 * i + 4 };
+
+		_gtk_source_occurrences_index_add (index, occurrence.start, occurrence.end);
+		g_array_append_val (expected, occurrence);
+	}
+
+	for (i = 0; i < 2000; i++)
+	{
+		gint offset = g_test_rand_int_range (0, 10 * NB_OCCURRENCES);
+		gint length = g_test_rand_int_range (1, i % 10 == 0 ? 2000 : 20);
+
+		if (g_test_rand_bit ())
+		{
+			/* Insertion of @length characters at @offset. The
+			 * occurrence containing @offset is removed.
+			 */
+			_gtk_source_occurrences_index_remove (index, offset - 3, offset + 1);
+			expected_remove (expected, offset - 3, offset + 1);
+
+			_gtk_source_occurrences_index_shift (index, offset, length);
+			expected_shift (expected, offset, length);
+
+			/* An occurrence found in the inserted text. */
+			_gtk_source_occurrences_index_add (index, offset, offset + MIN (length, 4));
+			expected_add (expected, offset, offset + MIN (length, 4));
+		}
+		else
+		{
+			/* Deletion of [offset; offset + length[. */
+			_gtk_source_occurrences_index_remove (index, offset - 3, offset + length);
+			expected_remove (expected, offset - 3, offset + length);
+
+			_gtk_source_occurrences_index_shift (index, offset + length, -length);
+			expected_shift (expected, offset + length, -length);
+		}
+
+		check_index (index, expected);
+	}
+
+	_gtk_source_occurrences_index_free (index);
+	g_array_free (expected, TRUE);
+}
+
+int
+main (int argc, char** argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/OccurrencesIndex/add", test_add);
+	g_test_add_func ("/OccurrencesIndex/edits", test_edits);
+
+	return g_test_run();
+}
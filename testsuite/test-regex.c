@@ -33,12 +33,97 @@ test_slash_c_pattern (void)
 	g_assert (regex == NULL);
 }
 
+static void
+test_first_bytes (void)
+{
+	GtkSourceRegex *regex;
+	GError *error = NULL;
+
+	regex = _gtk_source_regex_new ("(?i-x)\\b(?:if|else)\\b", G_REGEX_ANCHORED, &error);
+	g_assert_no_error (error);
+	g_assert (_gtk_source_regex_match (regex, "else", -1, 0));
+	g_assert (_gtk_source_regex_match (regex, "ELSE", -1, 0));
+	g_assert (_gtk_source_regex_match (regex, "x if", -1, 2));
+	g_assert (!_gtk_source_regex_match (regex, "x if", -1, 0));
+	g_assert (!_gtk_source_regex_match (regex, "x if", 2, 2));
+	_gtk_source_regex_unref (regex);
+
+	regex = _gtk_source_regex_new ("(?x-i) \\# [ \\t]* (?: define | include ) # comment", G_REGEX_ANCHORED, &error);
+	g_assert_no_error (error);
+	g_assert (_gtk_source_regex_match (regex, "#  define", -1, 0));
+	g_assert (!_gtk_source_regex_match (regex, " #define", -1, 0));
+	_gtk_source_regex_unref (regex);
+
+	regex = _gtk_source_regex_new ("(?-ix)[a-zé]+|\\d", G_REGEX_ANCHORED, &error);
+	g_assert_no_error (error);
+	g_assert (_gtk_source_regex_match (regex, "9", -1, 0));
+	g_assert (_gtk_source_regex_match (regex, "éa", -1, 0));
+	g_assert (!_gtk_source_regex_match (regex, "A", -1, 0));
+	_gtk_source_regex_unref (regex);
+
+	/* Regexes matching the empty string are not prefiltered. */
+	regex = _gtk_source_regex_new ("(?-ix)a?", G_REGEX_ANCHORED, &error);
+	g_assert_no_error (error);
+	g_assert (_gtk_source_regex_match (regex, "b", -1, 0));
+	_gtk_source_regex_unref (regex);
+
+	regex = _gtk_source_regex_new ("(?-ix)(?=b)|a{0,2}$", G_REGEX_ANCHORED, &error);
+	g_assert_no_error (error);
+	g_assert (_gtk_source_regex_match (regex, "b", -1, 0));
+	g_assert (_gtk_source_regex_match (regex, "xyz", -1, 3));
+	_gtk_source_regex_unref (regex);
+}
+
+static void
+test_resolve_cache (void)
+{
+	GtkSourceRegex *start;
+	GtkSourceRegex *end;
+	GtkSourceRegex *resolved1;
+	GtkSourceRegex *resolved2;
+	GtkSourceRegex *resolved3;
+	GError *error = NULL;
+	guint hits;
+	guint misses;
+
+	start = _gtk_source_regex_new ("<<(?<delim>\\w+)", 0, &error);
+	g_assert_no_error (error);
+	end = _gtk_source_regex_new ("^\\%{delim@start}$", 0, &error);
+	g_assert_no_error (error);
+	g_assert (!_gtk_source_regex_is_resolved (end));
+
+	g_assert (_gtk_source_regex_match (start, "cat <<EOF", -1, 0));
+	resolved1 = _gtk_source_regex_resolve (end, start, "cat <<EOF");
+	g_assert (_gtk_source_regex_match (start, "cat <<EOF", -1, 0));
+	resolved2 = _gtk_source_regex_resolve (end, start, "cat <<EOF");
+	g_assert (_gtk_source_regex_match (start, "cat <<END", -1, 0));
+	resolved3 = _gtk_source_regex_resolve (end, start, "cat <<END");
+
+	g_assert (resolved1 == resolved2);
+	g_assert (resolved1 != resolved3);
+	g_assert (_gtk_source_regex_match (resolved1, "EOF", -1, 0));
+	g_assert (_gtk_source_regex_match (resolved3, "END", -1, 0));
+	g_assert (!_gtk_source_regex_match (resolved3, "EOF", -1, 0));
+
+	_gtk_source_regex_get_resolve_stats (end, &hits, &misses);
+	g_assert_cmpuint (hits, ==, 1);
+	g_assert_cmpuint (misses, ==, 2);
+
+	_gtk_source_regex_unref (resolved1);
+	_gtk_source_regex_unref (resolved2);
+	_gtk_source_regex_unref (resolved3);
+	_gtk_source_regex_unref (end);
+	_gtk_source_regex_unref (start);
+}
+
 int
 main (int argc, char** argv)
 {
 	gtk_test_init (&argc, &argv);
 
 	g_test_add_func ("/Regex/slash-c", test_slash_c_pattern);
+	g_test_add_func ("/Regex/first-bytes", test_first_bytes);
+	g_test_add_func ("/Regex/resolve-cache", test_resolve_cache);
 
 	return g_test_run();
 }
@@ -417,6 +417,22 @@ test_search_at_word_boundaries (void)
 	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
 	g_assert_cmpint (occurrences_count, ==, 2);
 
+	/* The occurrence overlaps a match that is not at word boundaries. */
+
+	gtk_text_buffer_set_text (text_buffer, "ba.a.a", -1);
+	gtk_source_search_settings_set_search_text (settings, "a.a");
+
+	gtk_source_search_settings_set_at_word_boundaries (settings, TRUE);
+	flush_queue ();
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 1);
+
+	/* With the literal search. */
+	gtk_source_search_settings_set_case_sensitive (settings, TRUE);
+	flush_queue ();
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 1);
+
 	g_object_unref (source_buffer);
 	g_object_unref (settings);
 	g_object_unref (context);
@@ -896,6 +912,254 @@ test_occurrence_position (void)
 	g_object_unref (context);
 }
 
+static void
+check_occurrence_position (GtkSourceSearchContext *context,
+			   gint                    offset,
+			   gint                    length,
+			   gint                    expected_pos)
+{
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (gtk_source_search_context_get_buffer (context));
+	GtkTextIter start;
+	GtkTextIter end;
+	gint pos;
+
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, offset);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, offset + length);
+
+	pos = gtk_source_search_context_get_occurrence_position (context, &start, &end);
+	g_assert_cmpint (pos, ==, expected_pos);
+}
+
+static void
+test_occurrence_position_with_edit (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_set_text (text_buffer, "foo bar foo\nbar foo", -1);
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	flush_queue ();
+
+	check_occurrence_position (context, 0, 3, 1);
+	check_occurrence_position (context, 8, 3, 2);
+	check_occurrence_position (context, 16, 3, 3);
+
+	/* The occurrences after the insertion are shifted. */
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	gtk_text_buffer_insert (text_buffer, &start, "foo ", -1);
+	flush_queue ();
+
+	check_occurrence_position (context, 0, 3, 1);
+	check_occurrence_position (context, 4, 3, 2);
+	check_occurrence_position (context, 12, 3, 3);
+	check_occurrence_position (context, 20, 3, 4);
+
+	/* Insertion in an occurrence. */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 5);
+	gtk_text_buffer_insert (text_buffer, &start, "x", -1);
+	flush_queue ();
+
+	check_occurrence_position (context, 4, 4, 0);
+	check_occurrence_position (context, 13, 3, 2);
+	check_occurrence_position (context, 21, 3, 3);
+
+	/* Deletion of occurrences. */
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 9);
+	gtk_text_buffer_delete (text_buffer, &start, &end);
+	flush_queue ();
+
+	check_occurrence_position (context, 4, 3, 1);
+	check_occurrence_position (context, 12, 3, 2);
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+static void
+test_contiguous_occurrences (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextIter iter;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gboolean found;
+
+	gtk_text_buffer_set_text (text_buffer, "aaaaaaaa", -1);
+	gtk_source_search_settings_set_search_text (settings, "aa");
+	flush_queue ();
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 4);
+	check_occurrence_position (context, 4, 2, 3);
+	check_occurrence_position (context, 3, 2, 0);
+
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, 3);
+	found = gtk_source_search_context_forward (context, &iter, &match_start, &match_end, NULL);
+	g_assert_true (found);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_start), ==, 4);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_end), ==, 6);
+
+	found = gtk_source_search_context_backward (context, &iter, &match_start, &match_end, NULL);
+	g_assert_true (found);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_start), ==, 0);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_end), ==, 2);
+
+	/* Delete one character in the third occurrence. */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &match_start, 4);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &match_end, 5);
+	gtk_text_buffer_delete (text_buffer, &match_start, &match_end);
+	flush_queue ();
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 3);
+	check_occurrence_position (context, 2, 2, 2);
+	check_occurrence_position (context, 4, 2, 3);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+static void
+test_literal_search (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextIter start;
+	GtkTextIter end;
+	GtkTextTag *tag;
+	gint occurrences_count;
+
+	gtk_source_search_settings_set_case_sensitive (settings, TRUE);
+
+	gtk_text_buffer_set_text (text_buffer, "\xc3\xa9t\xc3\xa9 \xc3\xa9t\xc3\xa9s\n\xc3\x89t\xc3\xa9 \xc3\xa9t\xc3\xa9", -1);
+	gtk_source_search_settings_set_search_text (settings, "\xc3\xa9t\xc3\xa9");
+	flush_queue ();
+
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 3);
+	check_occurrence_position (context, 4, 3, 2);
+	check_occurrence_position (context, 13, 3, 3);
+
+	gtk_source_search_settings_set_at_word_boundaries (settings, TRUE);
+	flush_queue ();
+
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 2);
+	check_occurrence_position (context, 13, 3, 2);
+
+	/* The child anchors are ignored. */
+	gtk_source_search_settings_set_at_word_boundaries (settings, FALSE);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 14);
+	gtk_text_buffer_create_child_anchor (text_buffer, &start);
+	flush_queue ();
+
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 3);
+
+	/* The invisible text is ignored. */
+	gtk_text_buffer_set_text (text_buffer, "foo fXoo", -1);
+	tag = gtk_text_buffer_create_tag (text_buffer, NULL, "invisible", TRUE, NULL);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 5);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 6);
+	gtk_text_buffer_apply_tag (text_buffer, tag, &start, &end);
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	flush_queue ();
+
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 2);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+static void
+test_incremental_search (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextIter iter;
+	GtkTextIter end;
+	GtkTextTag *tag;
+	gint occurrences_count;
+
+	gtk_source_search_settings_set_case_sensitive (settings, TRUE);
+	gtk_text_buffer_set_text (text_buffer, "foo foobar\nfoobaz foobar", -1);
+
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	flush_queue ();
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 4);
+
+	/* The occurrences are refined without scanning the buffer. */
+	gtk_source_search_settings_set_search_text (settings, "foob");
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 3);
+
+	gtk_source_search_settings_set_search_text (settings, "foobar");
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 2);
+	check_occurrence_position (context, 4, 6, 1);
+	check_occurrence_position (context, 18, 6, 2);
+
+	/* The previous results are restored. */
+	gtk_source_search_settings_set_search_text (settings, "foob");
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 3);
+	check_occurrence_position (context, 11, 4, 2);
+
+	/* A modification of the buffer discards them. */
+	gtk_text_buffer_get_start_iter (text_buffer, &iter);
+	gtk_text_buffer_insert (text_buffer, &iter, "foob ", -1);
+	flush_queue ();
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	flush_queue ();
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 5);
+
+	/* With invisible text, an occurrence is longer than the search text. */
+	gtk_text_buffer_set_text (text_buffer, "fooxbar foobar", -1);
+	tag = gtk_text_buffer_create_tag (text_buffer, NULL, "invisible", TRUE, NULL);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, 3);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 4);
+	gtk_text_buffer_apply_tag (text_buffer, tag, &iter, &end);
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	flush_queue ();
+	gtk_source_search_settings_set_search_text (settings, "foobar");
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 2);
+	check_occurrence_position (context, 0, 7, 1);
+	check_occurrence_position (context, 8, 6, 2);
+	gtk_text_tag_table_remove (gtk_text_buffer_get_tag_table (text_buffer), tag);
+
+	/* A search text that can overlap itself. */
+	gtk_text_buffer_set_text (text_buffer, "aaab", -1);
+	gtk_source_search_settings_set_search_text (settings, "aa");
+	flush_queue ();
+	gtk_source_search_settings_set_search_text (settings, "aab");
+	flush_queue ();
+	occurrences_count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (occurrences_count, ==, 1);
+	check_occurrence_position (context, 1, 3, 1);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
 static void
 test_replace (void)
 {
@@ -945,6 +1209,11 @@ test_replace_all (void)
 	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
 	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
 	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkSourceMark *mark;
+	GtkTextMark *text_mark;
+	GtkTextTag *tag;
+	GtkTextIter iter;
+	GtkTextIter end;
 	gint nb_replacements;
 	gchar *contents;
 
@@ -959,11 +1228,229 @@ test_replace_all (void)
 	g_assert_cmpstr (contents, ==, "bbbb");
 	g_free (contents);
 
+	/* The marks and the tags of the text between the matches must be
+	 * kept.
+	 */
+	gtk_text_buffer_set_text (text_buffer, "\xc3\xa9t\xc3\xa9 foo\nbar foo\nfoo", -1);
+	gtk_text_buffer_get_iter_at_line (text_buffer, &iter, 1);
+	mark = gtk_source_buffer_create_source_mark (source_buffer, NULL, "category", &iter);
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &end, 1, 3);
+	tag = gtk_text_buffer_create_tag (text_buffer, NULL, NULL);
+	gtk_text_buffer_apply_tag (text_buffer, tag, &iter, &end);
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &iter, 1, 2);
+	text_mark = gtk_text_buffer_create_mark (text_buffer, NULL, &iter, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	flush_queue ();
+
+	nb_replacements = gtk_source_search_context_replace_all (context, "x", -1, NULL);
+	g_assert_cmpint (nb_replacements, ==, 3);
+
+	contents = get_buffer_contents (text_buffer);
+	g_assert_cmpstr (contents, ==, "\xc3\xa9t\xc3\xa9 x\nbar x\nx");
+	g_free (contents);
+
+	gtk_text_buffer_get_iter_at_mark (text_buffer, &iter, GTK_TEXT_MARK (mark));
+	g_assert_cmpint (gtk_text_iter_get_line (&iter), ==, 1);
+	g_assert_true (gtk_text_iter_starts_line (&iter));
+	g_assert_true (gtk_text_iter_starts_tag (&iter, tag));
+
+	gtk_text_buffer_get_iter_at_mark (text_buffer, &iter, text_mark);
+	g_assert_cmpint (gtk_text_iter_get_line (&iter), ==, 1);
+	g_assert_cmpint (gtk_text_iter_get_line_offset (&iter), ==, 2);
+
+	gtk_text_iter_forward_char (&iter);
+	g_assert_true (gtk_text_iter_ends_tag (&iter, tag));
+
+	/* With backreferences. */
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "(a)(r)");
+	flush_queue ();
+
+	nb_replacements = gtk_source_search_context_replace_all (context, "\\2\\1", -1, NULL);
+	g_assert_cmpint (nb_replacements, ==, 1);
+
+	contents = get_buffer_contents (text_buffer);
+	g_assert_cmpstr (contents, ==, "\xc3\xa9t\xc3\xa9 x\nbra x\nx");
+	g_free (contents);
+
 	g_object_unref (source_buffer);
 	g_object_unref (settings);
 	g_object_unref (context);
 }
 
+static void
+replace_all_async_cb (GtkSourceSearchContext *context,
+		      GAsyncResult           *result,
+		      gint                   *nb_replacements)
+{
+	GError *error = NULL;
+
+	*nb_replacements = gtk_source_search_context_replace_all_finish (context, result, &error);
+	g_assert_no_error (error);
+}
+
+/* Several buffers, replaced at the same time. */
+static void
+test_replace_all_async (void)
+{
+	GtkSourceBuffer *source_buffer1 = gtk_source_buffer_new (NULL);
+	GtkSourceBuffer *source_buffer2 = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer1 = GTK_TEXT_BUFFER (source_buffer1);
+	GtkTextBuffer *text_buffer2 = GTK_TEXT_BUFFER (source_buffer2);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context1 = gtk_source_search_context_new (source_buffer1, settings);
+	GtkSourceSearchContext *context2 = gtk_source_search_context_new (source_buffer2, settings);
+	gint nb_replacements1 = -1;
+	gint nb_replacements2 = -1;
+	GtkTextIter iter;
+	GString *text;
+	gchar *contents;
+	gint i;
+
+	gtk_text_buffer_set_text (text_buffer1, "\xc3\xa9t\xc3\xa9 foo\nbar foo\nfoobar", -1);
+	gtk_text_buffer_set_text (text_buffer2, "foo foo", -1);
+
+	/* Literal search, at word boundaries. */
+	gtk_source_search_settings_set_case_sensitive (settings, TRUE);
+	gtk_source_search_settings_set_at_word_boundaries (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "foo");
+
+	gtk_source_search_context_replace_all_async (context1, "x", -1, NULL,
+						     (GAsyncReadyCallback) replace_all_async_cb,
+						     &nb_replacements1);
+	gtk_source_search_context_replace_all_async (context2, "x", -1, NULL,
+						     (GAsyncReadyCallback) replace_all_async_cb,
+						     &nb_replacements2);
+
+	while (nb_replacements1 == -1 || nb_replacements2 == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (nb_replacements1, ==, 2);
+	g_assert_cmpint (nb_replacements2, ==, 2);
+
+	contents = get_buffer_contents (text_buffer1);
+	g_assert_cmpstr (contents, ==, "\xc3\xa9t\xc3\xa9 x\nbar x\nfoobar");
+	g_free (contents);
+
+	contents = get_buffer_contents (text_buffer2);
+	g_assert_cmpstr (contents, ==, "x x");
+	g_free (contents);
+
+	/* The replacements are undone at once. */
+	gtk_source_buffer_undo (source_buffer1);
+	contents = get_buffer_contents (text_buffer1);
+	g_assert_cmpstr (contents, ==, "\xc3\xa9t\xc3\xa9 foo\nbar foo\nfoobar");
+	g_free (contents);
+
+	/* Regex with backreferences. */
+	gtk_source_search_settings_set_at_word_boundaries (settings, FALSE);
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "(o)(b)");
+
+	nb_replacements1 = -1;
+	gtk_source_search_context_replace_all_async (context1, "\\2\\1", -1, NULL,
+						     (GAsyncReadyCallback) replace_all_async_cb,
+						     &nb_replacements1);
+
+	while (nb_replacements1 == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (nb_replacements1, ==, 1);
+
+	contents = get_buffer_contents (text_buffer1);
+	g_assert_cmpstr (contents, ==, "\xc3\xa9t\xc3\xa9 foo\nbar foo\nfoboar");
+	g_free (contents);
+
+	/* The segments of the regex search are limited by max-match-span. */
+	text = g_string_new ("BEGIN\n");
+
+	for (i = 0; i < 50; i++)
+	{
+		g_string_append (text, "foo bar\n");
+	}
+
+	g_string_append (text, "END\nBEGIN foo END\n");
+	gtk_text_buffer_set_text (text_buffer1, text->str, -1);
+	g_string_free (text, TRUE);
+
+	gtk_source_search_settings_set_search_text (settings, "(?s)BEGIN.*?END");
+	gtk_source_search_settings_set_max_match_span (settings, 10);
+
+	nb_replacements1 = -1;
+	gtk_source_search_context_replace_all_async (context1, "x", -1, NULL,
+						     (GAsyncReadyCallback) replace_all_async_cb,
+						     &nb_replacements1);
+
+	while (nb_replacements1 == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (nb_replacements1, ==, 1);
+
+	contents = get_buffer_contents (text_buffer1);
+	g_assert_true (g_str_has_suffix (contents, "END\nx\n"));
+	g_free (contents);
+
+	gtk_source_search_settings_set_max_match_span (settings, 0);
+
+	/* A buffer modification before the replacements: the matches are
+	 * searched again.
+	 */
+	gtk_source_search_settings_set_regex_enabled (settings, FALSE);
+	gtk_source_search_settings_set_search_text (settings, "foo");
+	gtk_text_buffer_set_text (text_buffer2, "foo foo", -1);
+
+	nb_replacements2 = -1;
+	gtk_source_search_context_replace_all_async (context2, "x", -1, NULL,
+						     (GAsyncReadyCallback) replace_all_async_cb,
+						     &nb_replacements2);
+
+	gtk_text_buffer_get_start_iter (text_buffer2, &iter);
+	gtk_text_buffer_insert (text_buffer2, &iter, "foo ", -1);
+
+	while (nb_replacements2 == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (nb_replacements2, ==, 3);
+
+	contents = get_buffer_contents (text_buffer2);
+	g_assert_cmpstr (contents, ==, "x x x");
+	g_free (contents);
+
+	/* A case insensitive search is done in the main thread. */
+	gtk_source_search_settings_set_case_sensitive (settings, FALSE);
+	gtk_text_buffer_set_text (text_buffer2, "Foo fOO", -1);
+
+	nb_replacements2 = -1;
+	gtk_source_search_context_replace_all_async (context2, "x", -1, NULL,
+						     (GAsyncReadyCallback) replace_all_async_cb,
+						     &nb_replacements2);
+
+	while (nb_replacements2 == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (nb_replacements2, ==, 2);
+
+	contents = get_buffer_contents (text_buffer2);
+	g_assert_cmpstr (contents, ==, "x x");
+	g_free (contents);
+
+	g_object_unref (source_buffer1);
+	g_object_unref (source_buffer2);
+	g_object_unref (settings);
+	g_object_unref (context1);
+	g_object_unref (context2);
+}
+
 static void
 test_regex_basics (void)
 {
@@ -1287,6 +1774,329 @@ test_regex_look_ahead (void)
 	g_object_unref (context);
 }
 
+/* The buffer is big enough to be scanned in worker threads. The matches span
+ * two lines, so they cross the boundaries between the chunks.
+ */
+static void
+test_regex_parallel_scan (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GString *text;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gint pos;
+	gint i;
+
+	text = g_string_new (NULL);
+
+	for (i = 0; i < 20000; i++)
+	{
+		g_string_append (text, "foo bar\n");
+	}
+
+	gtk_text_buffer_set_text (text_buffer, text->str, -1);
+	g_string_free (text, TRUE);
+
+	g_setenv ("GTK_SOURCE_SEARCH_THREADS", "4", TRUE);
+
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "bar\nfoo");
+
+	while (gtk_source_search_context_get_occurrences_count (context) == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 19999);
+
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &match_start, 12345, 4);
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &match_end, 12346, 3);
+	pos = gtk_source_search_context_get_occurrence_position (context, &match_start, &match_end);
+	g_assert_cmpint (pos, ==, 12346);
+
+	/* Contiguous matches of several lines. */
+	gtk_source_search_settings_set_search_text (settings, "(foo bar\n){3}");
+
+	while (gtk_source_search_context_get_occurrences_count (context) == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 6666);
+
+	/* The subject of a chunk starts at the chunk, the text before it is
+	 * still seen by the lookbehinds and by ^.
+	 */
+	gtk_source_search_settings_set_search_text (settings, "(?<=bar\n)foo");
+
+	while (gtk_source_search_context_get_occurrences_count (context) == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 19999);
+
+	gtk_source_search_settings_set_search_text (settings, "^foo|ar$");
+
+	while (gtk_source_search_context_get_occurrences_count (context) == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 40000);
+
+	g_unsetenv ("GTK_SOURCE_SEARCH_THREADS");
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+/* The first match spans a lot more lines than a segment, so the subject is
+ * grown several times on partial matches.
+ */
+static void
+test_regex_multiline_partial_match (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GString *text;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gint pos;
+	gint i;
+
+	text = g_string_new ("BEGIN\n");
+
+	for (i = 0; i < 1000; i++)
+	{
+		g_string_append (text, "foo bar\n");
+	}
+
+	g_string_append (text, "END\nBEGIN foo END\n");
+
+	gtk_text_buffer_set_text (text_buffer, text->str, -1);
+	g_string_free (text, TRUE);
+
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "(?s)BEGIN.*?END");
+
+	while (gtk_source_search_context_get_occurrences_count (context) == -1)
+	{
+		gtk_main_iteration ();
+	}
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	gtk_text_buffer_get_start_iter (text_buffer, &match_start);
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &match_end, 1001, 3);
+	pos = gtk_source_search_context_get_occurrence_position (context, &match_start, &match_end);
+	g_assert_cmpint (pos, ==, 1);
+
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &match_start, 1002, 0);
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &match_end, 1002, 13);
+	pos = gtk_source_search_context_get_occurrence_position (context, &match_start, &match_end);
+	g_assert_cmpint (pos, ==, 2);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+static void
+test_regex_max_match_span (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GString *text;
+	gint i;
+
+	text = g_string_new ("BEGIN\n");
+
+	for (i = 0; i < 50; i++)
+	{
+		g_string_append (text, "foo bar\n");
+	}
+
+	g_string_append (text, "END\nBEGIN foo END\nfoo bar\n");
+
+	gtk_text_buffer_set_text (text_buffer, text->str, -1);
+	g_string_free (text, TRUE);
+
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "(?s)BEGIN.*?END");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	/* The first occurrence spans 52 lines. */
+	gtk_source_search_settings_set_max_match_span (settings, 10);
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 1);
+
+	gtk_source_search_settings_set_max_match_span (settings, 52);
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+/* Like the non-regex search, the regex search matches only the visible text:
+ * the invisible text, the pixbufs and the child anchors are skipped.
+ */
+static void
+test_regex_visible_text (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextTag *tag;
+	GString *text;
+	GtkTextIter start;
+	GtkTextIter end;
+	gint i;
+
+	tag = gtk_text_buffer_create_tag (text_buffer, NULL, "invisible", TRUE, NULL);
+
+	gtk_text_buffer_set_text (text_buffer, "fooX\nfoo", -1);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 3);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 4);
+	gtk_text_buffer_apply_tag (text_buffer, tag, &start, &end);
+
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "^foo$");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+	check_occurrence_position (context, 0, 3, 1);
+	check_occurrence_position (context, 5, 3, 2);
+
+	/* Matches spanning invisible text, on more lines than a segment. */
+	text = g_string_new (NULL);
+
+	for (i = 0; i < 100; i++)
+	{
+		g_string_append (text, "fXoo bar\n");
+	}
+
+	gtk_text_buffer_set_text (text_buffer, text->str, -1);
+	g_string_free (text, TRUE);
+
+	for (i = 0; i < 100; i++)
+	{
+		gtk_text_buffer_get_iter_at_line_offset (text_buffer, &start, i, 1);
+		gtk_text_buffer_get_iter_at_line_offset (text_buffer, &end, i, 2);
+		gtk_text_buffer_apply_tag (text_buffer, tag, &start, &end);
+	}
+
+	gtk_source_search_settings_set_search_text (settings, "o bar\nfo");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 99);
+	check_occurrence_position (context, 3, 9, 1);
+	check_occurrence_position (context, 9 * 50 + 3, 9, 51);
+	check_occurrence_position (context, 9 * 98 + 3, 9, 99);
+
+	/* Child anchors. */
+	gtk_text_buffer_set_text (text_buffer, "ab\nfoo", -1);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 3);
+	gtk_text_buffer_create_child_anchor (text_buffer, &start);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 1);
+	gtk_text_buffer_create_child_anchor (text_buffer, &start);
+
+	gtk_source_search_settings_set_search_text (settings, "a.b");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 0);
+
+	gtk_source_search_settings_set_search_text (settings, "ab");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 1);
+	check_occurrence_position (context, 0, 3, 1);
+
+	gtk_source_search_settings_set_search_text (settings, "^foo");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 1);
+	check_occurrence_position (context, 5, 3, 1);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+/* On text insertion and deletion, only the neighbouring lines are scanned
+ * again.
+ */
+static void
+test_regex_with_edit (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GString *text;
+	GtkTextIter start;
+	GtkTextIter end;
+	gint i;
+
+	gtk_text_buffer_set_text (text_buffer, "aaa", -1);
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "(aa)+");
+	flush_queue ();
+
+	check_occurrence_position (context, 0, 2, 1);
+
+	/* The insertion outside the occurrence modifies it. */
+	gtk_text_buffer_get_end_iter (text_buffer, &end);
+	gtk_text_buffer_insert (text_buffer, &end, "a", -1);
+	flush_queue ();
+
+	check_occurrence_position (context, 0, 4, 1);
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 1);
+
+	/* Matches spanning two lines. */
+	text = g_string_new (NULL);
+
+	for (i = 0; i < 100; i++)
+	{
+		g_string_append (text, "foo bar\n");
+	}
+
+	gtk_text_buffer_set_text (text_buffer, text->str, -1);
+	g_string_free (text, TRUE);
+
+	gtk_source_search_settings_set_search_text (settings, "bar\nfoo");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 99);
+
+	gtk_text_buffer_get_iter_at_line (text_buffer, &start, 50);
+	gtk_text_buffer_insert (text_buffer, &start, "x", -1);
+	flush_queue ();
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 98);
+	check_occurrence_position (context, 8 * 48 + 4, 7, 49);
+	check_occurrence_position (context, 8 * 50 + 5, 7, 50);
+
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &start, 50, 0);
+	gtk_text_buffer_get_iter_at_line_offset (text_buffer, &end, 50, 1);
+	gtk_text_buffer_delete (text_buffer, &start, &end);
+	flush_queue ();
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 99);
+	check_occurrence_position (context, 8 * 49 + 4, 7, 50);
+	check_occurrence_position (context, 8 * 98 + 4, 7, 99);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
 static void
 test_destroy_buffer_during_search (void)
 {
@@ -1332,12 +2142,22 @@ main (int argc, char **argv)
 	g_test_add_func ("/Search/highlight", test_highlight);
 	g_test_add_func ("/Search/get-search-text", test_get_search_text);
 	g_test_add_func ("/Search/occurrence-position", test_occurrence_position);
+	g_test_add_func ("/Search/occurrence-position/with-edit", test_occurrence_position_with_edit);
+	g_test_add_func ("/Search/contiguous-occurrences", test_contiguous_occurrences);
+	g_test_add_func ("/Search/literal", test_literal_search);
+	g_test_add_func ("/Search/incremental", test_incremental_search);
 	g_test_add_func ("/Search/replace", test_replace);
 	g_test_add_func ("/Search/replace_all", test_replace_all);
+	g_test_add_func ("/Search/replace_all_async", test_replace_all_async);
 	g_test_add_func ("/Search/regex/basics", test_regex_basics);
 	g_test_add_func ("/Search/regex/at-word-boundaries", test_regex_at_word_boundaries);
 	g_test_add_func ("/Search/regex/look-behind", test_regex_look_behind);
 	g_test_add_func ("/Search/regex/look-ahead", test_regex_look_ahead);
+	g_test_add_func ("/Search/regex/parallel-scan", test_regex_parallel_scan);
+	g_test_add_func ("/Search/regex/multiline-partial-match", test_regex_multiline_partial_match);
+	g_test_add_func ("/Search/regex/max-match-span", test_regex_max_match_span);
+	g_test_add_func ("/Search/regex/visible-text", test_regex_visible_text);
+	g_test_add_func ("/Search/regex/with-edit", test_regex_with_edit);
 	g_test_add_func ("/Search/destroy-buffer-during-search", test_destroy_buffer_during_search);
 
 	return g_test_run ();